@@ -126,6 +126,82 @@ Status AeadCryptor::Open(ByteContainerView ciphertext,
                     plaintext_size);
 }
 
+Status AeadCryptor::SealBatch(
+    absl::Span<const ByteContainerView> plaintexts,
+    absl::Span<const ByteContainerView> associated_data,
+    absl::Span<uint8_t> nonces, absl::Span<uint8_t> ciphertexts,
+    absl::Span<size_t> ciphertext_sizes) {
+  // All arguments are checked before any nonce is drawn, so that an invalid
+  // batch does not use up messages of the cryptor.
+  size_t ciphertexts_size = 0;
+  for (const ByteContainerView &plaintext : plaintexts) {
+    if (plaintext.size() > max_message_size_) {
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    absl::StrCat("Plaintext size ", plaintext.size(),
+                                 " exceeds maximum message size (",
+                                 max_message_size_, " bytes)"));
+    }
+    ciphertexts_size += plaintext.size() + key_->MaxSealOverhead();
+  }
+  if (plaintexts.size() > max_sealed_messages_ - number_of_sealed_messages_) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  absl::StrCat("Sealing ", plaintexts.size(),
+                               " messages would exceed the maximum number of "
+                               "sealed messages (",
+                               max_sealed_messages_, ")"));
+  }
+  if (associated_data.size() != 1 &&
+      associated_data.size() != plaintexts.size()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid number of associated data: ",
+                               associated_data.size(), " (must be 1 or ",
+                               plaintexts.size(), ")"));
+  }
+  const size_t nonces_size = plaintexts.size() * key_->NonceSize();
+  if (nonces.size() < nonces_size) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid nonces size: ", nonces.size(),
+                               " (must be >= ", nonces_size, ")"));
+  }
+  if (ciphertexts.size() < ciphertexts_size) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid ciphertexts size: ", ciphertexts.size(),
+                               " (must be >= ", ciphertexts_size, ")"));
+  }
+  if (ciphertext_sizes.size() != plaintexts.size()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid number of ciphertext sizes: ",
+                               ciphertext_sizes.size(), " (must be ",
+                               plaintexts.size(), ")"));
+  }
+
+  ASYLO_RETURN_IF_ERROR(
+      nonce_generator_->NextNonces(nonces, plaintexts.size()));
+
+  // Every drawn nonce counts as a sealed message, even if sealing fails
+  // partway, since the messages before the failure were sealed with theirs.
+  number_of_sealed_messages_ += plaintexts.size();
+  return key_->SealBatch(plaintexts, associated_data,
+                         nonces.subspan(0, nonces_size), ciphertexts,
+                         ciphertext_sizes);
+}
+
+Status AeadCryptor::OpenBatch(
+    absl::Span<const ByteContainerView> ciphertexts,
+    absl::Span<const ByteContainerView> associated_data,
+    ByteContainerView nonces, absl::Span<uint8_t> plaintexts,
+    absl::Span<size_t> plaintext_sizes) {
+  const size_t nonces_size = ciphertexts.size() * key_->NonceSize();
+  if (nonces.size() < nonces_size) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid nonces size: ", nonces.size(),
+                               " (must be >= ", nonces_size, ")"));
+  }
+  return key_->OpenBatch(ciphertexts, associated_data,
+                         ByteContainerView(nonces.data(), nonces_size),
+                         plaintexts, plaintext_sizes);
+}
+
 AeadCryptor::AeadCryptor(
     std::unique_ptr<AeadKey> key, size_t max_message_size,
     uint64_t max_sealed_messages,
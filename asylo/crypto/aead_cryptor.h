@@ -131,6 +131,52 @@ class AeadCryptor {
               ByteContainerView nonce, absl::Span<uint8_t> plaintext,
               size_t *plaintext_size);
 
+  /// Implements the AEAD Seal operation on a batch of messages.
+  ///
+  /// Seals each message as Seal() does, but draws the nonces of all messages
+  /// at once and initializes the AEAD context once for the whole batch, which
+  /// amortizes the per-call overhead over many small messages. The nonce of
+  /// message `i` is written at offset `i * NonceSize()` of `nonces`, whose size
+  /// must be at least `plaintexts.size() * NonceSize()`. The ciphertexts are
+  /// written back to back to `ciphertexts`, whose size must be at least the
+  /// total size of `plaintexts` plus `plaintexts.size() * MaxSealOverhead()`,
+  /// and their sizes to `ciphertext_sizes`. Arguments are checked before any
+  /// nonce is generated. Every message counts towards MaxSealedMessages() once
+  /// its nonce is generated, even if sealing a later message fails.
+  ///
+  /// \param plaintexts The secrets that will be sealed.
+  /// \param associated_data The authenticated data of each message, or a
+  ///                        single entry used for all messages.
+  /// \param[out] nonces The generated nonces.
+  /// \param[out] ciphertexts The sealed ciphertexts of `plaintexts`.
+  /// \param[out] ciphertext_sizes The size of each ciphertext.
+  /// \return The resulting status of the SealBatch() operation.
+  Status SealBatch(absl::Span<const ByteContainerView> plaintexts,
+                   absl::Span<const ByteContainerView> associated_data,
+                   absl::Span<uint8_t> nonces, absl::Span<uint8_t> ciphertexts,
+                   absl::Span<size_t> ciphertext_sizes);
+
+  /// Implements the AEAD Open operation on a batch of messages.
+  ///
+  /// Opens each message as Open() does, initializing the AEAD context once for
+  /// the whole batch. The nonce of message `i` is read at offset
+  /// `i * NonceSize()` of `nonces`. The plaintexts are written back to back to
+  /// `plaintexts`, whose size should be at least the total size of
+  /// `ciphertexts`, and their sizes to `plaintext_sizes`. Fails if any of the
+  /// messages fails to open.
+  ///
+  /// \param ciphertexts The sealed ciphertexts.
+  /// \param associated_data The authenticated data of each message, or a
+  ///                        single entry used for all messages.
+  /// \param nonces The nonces used to seal the ciphertexts.
+  /// \param[out] plaintexts The unsealed ciphertexts.
+  /// \param[out] plaintext_sizes The size of each plaintext.
+  /// \return The resulting status of the OpenBatch() operation.
+  Status OpenBatch(absl::Span<const ByteContainerView> ciphertexts,
+                   absl::Span<const ByteContainerView> associated_data,
+                   ByteContainerView nonces, absl::Span<uint8_t> plaintexts,
+                   absl::Span<size_t> plaintext_sizes);
+
  private:
   AeadCryptor(std::unique_ptr<AeadKey> key, size_t max_message_size,
               uint64_t max_sealed_messages,
@@ -0,0 +1,172 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of sealing and opening batches of messages with AeadCryptor, one
+// message per call and all messages in a single call. Run with
+// --benchmarks=all.
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "asylo/crypto/aead_cryptor.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace {
+
+// Number of messages sealed or opened per iteration.
+constexpr size_t kBatchSize = 64;
+
+constexpr uint8_t kKey[32] = {};
+constexpr char kAssociatedData[] = "associated data";
+
+// Messages of the length given by the argument of a benchmark, along with
+// buffers for their sealed form.
+struct Batch {
+  Batch(size_t message_length, const AeadCryptor &cryptor)
+      : messages(kBatchSize, std::vector<uint8_t>(message_length, 'm')),
+        associated_data(1, ByteContainerView(kAssociatedData,
+                                             sizeof(kAssociatedData))),
+        nonces(kBatchSize * cryptor.NonceSize()),
+        ciphertexts(kBatchSize * (message_length + cryptor.MaxSealOverhead())),
+        ciphertext_sizes(kBatchSize),
+        plaintexts(ciphertexts.size()),
+        plaintext_sizes(kBatchSize) {
+    for (const std::vector<uint8_t> &message : messages) {
+      plaintext_views.emplace_back(message);
+    }
+  }
+
+  // Returns views of the ciphertexts after SealBatch().
+  std::vector<ByteContainerView> CiphertextViews() const {
+    std::vector<ByteContainerView> views;
+    size_t offset = 0;
+    for (size_t size : ciphertext_sizes) {
+      views.emplace_back(ciphertexts.data() + offset, size);
+      offset += size;
+    }
+    return views;
+  }
+
+  std::vector<std::vector<uint8_t>> messages;
+  std::vector<ByteContainerView> plaintext_views;
+  std::vector<ByteContainerView> associated_data;
+  std::vector<uint8_t> nonces;
+  std::vector<uint8_t> ciphertexts;
+  std::vector<size_t> ciphertext_sizes;
+  std::vector<uint8_t> plaintexts;
+  std::vector<size_t> plaintext_sizes;
+};
+
+std::unique_ptr<AeadCryptor> CreateCryptor() {
+  auto cryptor_result =
+      AeadCryptor::CreateAesGcmSivCryptor(ByteContainerView(kKey, 32));
+  CHECK(cryptor_result.ok()) << cryptor_result.status();
+  return std::move(cryptor_result).ValueOrDie();
+}
+
+void SealBatch(AeadCryptor *cryptor, Batch *batch) {
+  CHECK(cryptor
+            ->SealBatch(batch->plaintext_views, batch->associated_data,
+                        absl::MakeSpan(batch->nonces),
+                        absl::MakeSpan(batch->ciphertexts),
+                        absl::MakeSpan(batch->ciphertext_sizes))
+            .ok());
+}
+
+void SetProcessed(benchmark::State &state) {
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+  state.SetBytesProcessed(state.iterations() * kBatchSize * state.range(0));
+}
+
+void BM_Seal(benchmark::State &state) {
+  std::unique_ptr<AeadCryptor> cryptor = CreateCryptor();
+  Batch batch(state.range(0), *cryptor);
+  const size_t nonce_size = cryptor->NonceSize();
+  for (auto _ : state) {
+    size_t offset = 0;
+    for (size_t i = 0; i < kBatchSize; i++) {
+      CHECK(cryptor
+                ->Seal(batch.plaintext_views[i], batch.associated_data[0],
+                       absl::MakeSpan(batch.nonces)
+                           .subspan(i * nonce_size, nonce_size),
+                       absl::MakeSpan(batch.ciphertexts).subspan(offset),
+                       &batch.ciphertext_sizes[i])
+                .ok());
+      offset += batch.ciphertext_sizes[i];
+    }
+  }
+  SetProcessed(state);
+}
+BENCHMARK(BM_Seal)->Arg(64)->Arg(1024)->Arg(64 * 1024);
+
+void BM_SealBatch(benchmark::State &state) {
+  std::unique_ptr<AeadCryptor> cryptor = CreateCryptor();
+  Batch batch(state.range(0), *cryptor);
+  for (auto _ : state) {
+    SealBatch(cryptor.get(), &batch);
+  }
+  SetProcessed(state);
+}
+BENCHMARK(BM_SealBatch)->Arg(64)->Arg(1024)->Arg(64 * 1024);
+
+void BM_Open(benchmark::State &state) {
+  std::unique_ptr<AeadCryptor> cryptor = CreateCryptor();
+  Batch batch(state.range(0), *cryptor);
+  SealBatch(cryptor.get(), &batch);
+  const std::vector<ByteContainerView> ciphertexts = batch.CiphertextViews();
+  const size_t nonce_size = cryptor->NonceSize();
+  for (auto _ : state) {
+    size_t offset = 0;
+    for (size_t i = 0; i < kBatchSize; i++) {
+      CHECK(cryptor
+                ->Open(ciphertexts[i], batch.associated_data[0],
+                       ByteContainerView(batch.nonces.data() + i * nonce_size,
+                                         nonce_size),
+                       absl::MakeSpan(batch.plaintexts).subspan(offset),
+                       &batch.plaintext_sizes[i])
+                .ok());
+      offset += batch.plaintext_sizes[i];
+    }
+  }
+  SetProcessed(state);
+}
+BENCHMARK(BM_Open)->Arg(64)->Arg(1024)->Arg(64 * 1024);
+
+void BM_OpenBatch(benchmark::State &state) {
+  std::unique_ptr<AeadCryptor> cryptor = CreateCryptor();
+  Batch batch(state.range(0), *cryptor);
+  SealBatch(cryptor.get(), &batch);
+  const std::vector<ByteContainerView> ciphertexts = batch.CiphertextViews();
+  for (auto _ : state) {
+    CHECK(cryptor
+              ->OpenBatch(ciphertexts, batch.associated_data, batch.nonces,
+                          absl::MakeSpan(batch.plaintexts),
+                          absl::MakeSpan(batch.plaintext_sizes))
+              .ok());
+  }
+  SetProcessed(state);
+}
+BENCHMARK(BM_OpenBatch)->Arg(64)->Arg(1024)->Arg(64 * 1024);
+
+}  // namespace
+}  // namespace asylo
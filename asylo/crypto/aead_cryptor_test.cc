@@ -17,8 +17,11 @@
  */
 #include "asylo/crypto/aead_cryptor.h"
 
+#include <string>
+#include <utility>
 #include <vector>
 
+#include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/types/span.h"
 #include "asylo/crypto/aead_test_vector.h"
@@ -77,6 +80,7 @@ const char kAesGcmSivNonceHex256[] = "030000000000000000000000";
 const char kAesGcmSivCiphertextHex256[] = "c91545823cc24f17dbb0e9e807d5ec17";
 const char kAesGcmSivTagHex256[] = "b292d28ff61189e8e49f3875ef91aff7";
 
+using ::testing::Not;
 using ::testing::TestWithParam;
 
 struct AeadCryptorParam {
@@ -128,6 +132,152 @@ TEST_P(AeadCryptorTest, OpenTest) {
             ByteContainerView(actual_plaintext));
 }
 
+TEST_P(AeadCryptorTest, BatchEndToEndTest) {
+  AeadTestVector test_vector = GetParam().test_vector;
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSERT_OK_AND_ASSIGN(cryptor, GetParam().factory(test_vector.key));
+
+  const std::vector<std::string> messages = {"", "a", std::string(100, 'b'),
+                                             std::string(4096, 'c')};
+  const std::vector<std::string> aads = {"0", "1", "2", "3"};
+  std::vector<ByteContainerView> plaintexts;
+  std::vector<ByteContainerView> associated_data;
+  size_t total_size = 0;
+  for (int i = 0; i < messages.size(); i++) {
+    plaintexts.emplace_back(messages[i]);
+    associated_data.emplace_back(aads[i]);
+    total_size += messages[i].size() + cryptor->MaxSealOverhead();
+  }
+
+  std::vector<uint8_t> nonces(messages.size() * cryptor->NonceSize());
+  std::vector<uint8_t> ciphertexts(total_size);
+  std::vector<size_t> ciphertext_sizes(messages.size());
+  ASYLO_ASSERT_OK(cryptor->SealBatch(
+      plaintexts, associated_data, absl::MakeSpan(nonces),
+      absl::MakeSpan(ciphertexts), absl::MakeSpan(ciphertext_sizes)));
+
+  // Each message of the batch opens on its own.
+  std::vector<ByteContainerView> sealed;
+  size_t offset = 0;
+  for (int i = 0; i < messages.size(); i++) {
+    sealed.emplace_back(ciphertexts.data() + offset, ciphertext_sizes[i]);
+    offset += ciphertext_sizes[i];
+
+    CleansingVector<uint8_t> plaintext(sealed[i].size());
+    size_t plaintext_size;
+    ASYLO_ASSERT_OK(cryptor->Open(
+        sealed[i], aads[i],
+        ByteContainerView(nonces.data() + i * cryptor->NonceSize(),
+                          cryptor->NonceSize()),
+        absl::MakeSpan(plaintext), &plaintext_size));
+    plaintext.resize(plaintext_size);
+    EXPECT_EQ(ByteContainerView(messages[i]), ByteContainerView(plaintext));
+  }
+
+  CleansingVector<uint8_t> plaintexts_out(ciphertexts.size());
+  std::vector<size_t> plaintext_sizes(messages.size());
+  ASYLO_ASSERT_OK(cryptor->OpenBatch(sealed, associated_data, nonces,
+                                     absl::MakeSpan(plaintexts_out),
+                                     absl::MakeSpan(plaintext_sizes)));
+  offset = 0;
+  for (int i = 0; i < messages.size(); i++) {
+    EXPECT_EQ(ByteContainerView(messages[i]),
+              ByteContainerView(plaintexts_out.data() + offset,
+                                plaintext_sizes[i]));
+    offset += plaintext_sizes[i];
+  }
+
+  // A message opened with the associated data of another one fails the batch.
+  std::swap(associated_data[1], associated_data[2]);
+  EXPECT_THAT(cryptor->OpenBatch(sealed, associated_data, nonces,
+                                 absl::MakeSpan(plaintexts_out),
+                                 absl::MakeSpan(plaintext_sizes)),
+              Not(IsOk()));
+}
+
+TEST_P(AeadCryptorTest, BatchSharedAssociatedDataTest) {
+  AeadTestVector test_vector = GetParam().test_vector;
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSERT_OK_AND_ASSIGN(cryptor, GetParam().factory(test_vector.key));
+
+  const std::vector<ByteContainerView> plaintexts(8, test_vector.plaintext);
+  const std::vector<ByteContainerView> associated_data = {test_vector.aad};
+  std::vector<uint8_t> nonces(plaintexts.size() * cryptor->NonceSize());
+  std::vector<uint8_t> ciphertexts(
+      plaintexts.size() *
+      (test_vector.plaintext.size() + cryptor->MaxSealOverhead()));
+  std::vector<size_t> ciphertext_sizes(plaintexts.size());
+  ASYLO_ASSERT_OK(cryptor->SealBatch(
+      plaintexts, associated_data, absl::MakeSpan(nonces),
+      absl::MakeSpan(ciphertexts), absl::MakeSpan(ciphertext_sizes)));
+
+  // Every message is sealed with its own nonce.
+  for (int i = 1; i < plaintexts.size(); i++) {
+    EXPECT_NE(ByteContainerView(nonces.data(), cryptor->NonceSize()),
+              ByteContainerView(nonces.data() + i * cryptor->NonceSize(),
+                                cryptor->NonceSize()));
+  }
+
+  std::vector<ByteContainerView> sealed;
+  size_t offset = 0;
+  for (size_t size : ciphertext_sizes) {
+    sealed.emplace_back(ciphertexts.data() + offset, size);
+    offset += size;
+  }
+  CleansingVector<uint8_t> plaintexts_out(ciphertexts.size());
+  std::vector<size_t> plaintext_sizes(plaintexts.size());
+  ASYLO_ASSERT_OK(cryptor->OpenBatch(sealed, associated_data, nonces,
+                                     absl::MakeSpan(plaintexts_out),
+                                     absl::MakeSpan(plaintext_sizes)));
+  for (size_t size : plaintext_sizes) {
+    EXPECT_EQ(size, test_vector.plaintext.size());
+  }
+}
+
+TEST_P(AeadCryptorTest, BatchInvalidArgumentsTest) {
+  AeadTestVector test_vector = GetParam().test_vector;
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSERT_OK_AND_ASSIGN(cryptor, GetParam().factory(test_vector.key));
+
+  const std::vector<ByteContainerView> plaintexts(3, test_vector.plaintext);
+  std::vector<uint8_t> nonces(plaintexts.size() * cryptor->NonceSize());
+  std::vector<uint8_t> ciphertexts(
+      plaintexts.size() *
+      (test_vector.plaintext.size() + cryptor->MaxSealOverhead()));
+  std::vector<size_t> ciphertext_sizes(plaintexts.size());
+
+  // Two entries of associated data for three messages.
+  const std::vector<ByteContainerView> associated_data(2, test_vector.aad);
+  EXPECT_THAT(cryptor->SealBatch(plaintexts, associated_data,
+                                 absl::MakeSpan(nonces),
+                                 absl::MakeSpan(ciphertexts),
+                                 absl::MakeSpan(ciphertext_sizes)),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  // Room for two nonces only.
+  const std::vector<ByteContainerView> shared_aad = {test_vector.aad};
+  EXPECT_THAT(
+      cryptor->SealBatch(
+          plaintexts, shared_aad,
+          absl::MakeSpan(nonces.data(), 2 * cryptor->NonceSize()),
+          absl::MakeSpan(ciphertexts), absl::MakeSpan(ciphertext_sizes)),
+      StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  // Room for two ciphertext sizes only.
+  EXPECT_THAT(cryptor->SealBatch(plaintexts, shared_aad,
+                                 absl::MakeSpan(nonces),
+                                 absl::MakeSpan(ciphertexts),
+                                 absl::MakeSpan(ciphertext_sizes.data(), 2)),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  // One byte short of room for the ciphertexts.
+  EXPECT_THAT(cryptor->SealBatch(
+                  plaintexts, shared_aad, absl::MakeSpan(nonces),
+                  absl::MakeSpan(ciphertexts.data(), ciphertexts.size() - 1),
+                  absl::MakeSpan(ciphertext_sizes)),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
 INSTANTIATE_TEST_SUITE_P(
     AllTests, AeadCryptorTest,
     ::testing::Values(
@@ -112,14 +112,7 @@ Status AeadKey::Seal(ByteContainerView plaintext,
 
   EVP_AEAD_CTX context;
   Cleanup cleanup_context([&context]() { EVP_AEAD_CTX_cleanup(&context); });
-
-  if (EVP_AEAD_CTX_init(&context, aead_, key_.data(), key_.size(),
-                        EVP_AEAD_max_tag_len(aead_),
-                        /*impl=*/nullptr) != 1) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        absl::StrCat("EVP_AEAD_CTX_init failed: ", BsslLastErrorString()));
-  }
+  ASYLO_RETURN_IF_ERROR(InitContext(&context));
 
   if (EVP_AEAD_CTX_seal(&context, ciphertext.data(), ciphertext_size,
                         ciphertext.size(), nonce.data(), nonce.size(),
@@ -144,13 +137,7 @@ Status AeadKey::Open(ByteContainerView ciphertext,
 
   EVP_AEAD_CTX context;
   Cleanup cleanup_context([&context]() { EVP_AEAD_CTX_cleanup(&context); });
-  if (EVP_AEAD_CTX_init(&context, aead_, key_.data(), key_.size(),
-                        EVP_AEAD_max_tag_len(aead_),
-                        /*impl=*/nullptr) != 1) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        absl::StrCat("EVP_AEAD_CTX_init failed: ", BsslLastErrorString()));
-  }
+  ASYLO_RETURN_IF_ERROR(InitContext(&context));
 
   if (EVP_AEAD_CTX_open(&context, plaintext.data(), plaintext_size,
                         plaintext.size(), nonce.data(), nonce.size(),
@@ -164,6 +151,107 @@ Status AeadKey::Open(ByteContainerView ciphertext,
   return Status::OkStatus();
 }
 
+Status AeadKey::SealBatch(absl::Span<const ByteContainerView> plaintexts,
+                          absl::Span<const ByteContainerView> associated_data,
+                          ByteContainerView nonces,
+                          absl::Span<uint8_t> ciphertexts,
+                          absl::Span<size_t> ciphertext_sizes) {
+  ASYLO_RETURN_IF_ERROR(CheckBatch(plaintexts.size(), associated_data.size(),
+                                   nonces.size(), ciphertext_sizes.size()));
+  if (plaintexts.empty()) {
+    return Status::OkStatus();
+  }
+
+  EVP_AEAD_CTX context;
+  Cleanup cleanup_context([&context]() { EVP_AEAD_CTX_cleanup(&context); });
+  ASYLO_RETURN_IF_ERROR(InitContext(&context));
+
+  size_t offset = 0;
+  for (size_t i = 0; i < plaintexts.size(); i++) {
+    const ByteContainerView &aad =
+        associated_data[associated_data.size() == 1 ? 0 : i];
+    if (EVP_AEAD_CTX_seal(&context, ciphertexts.data() + offset,
+                          &ciphertext_sizes[i], ciphertexts.size() - offset,
+                          nonces.data() + i * nonce_size_, nonce_size_,
+                          plaintexts[i].data(), plaintexts[i].size(),
+                          aad.data(), aad.size()) != 1) {
+      return Status(
+          error::GoogleError::INTERNAL,
+          absl::StrCat("EVP_AEAD_CTX_seal failed: ", BsslLastErrorString()));
+    }
+    offset += ciphertext_sizes[i];
+  }
+
+  return Status::OkStatus();
+}
+
+Status AeadKey::OpenBatch(absl::Span<const ByteContainerView> ciphertexts,
+                          absl::Span<const ByteContainerView> associated_data,
+                          ByteContainerView nonces,
+                          absl::Span<uint8_t> plaintexts,
+                          absl::Span<size_t> plaintext_sizes) {
+  ASYLO_RETURN_IF_ERROR(CheckBatch(ciphertexts.size(), associated_data.size(),
+                                   nonces.size(), plaintext_sizes.size()));
+  if (ciphertexts.empty()) {
+    return Status::OkStatus();
+  }
+
+  EVP_AEAD_CTX context;
+  Cleanup cleanup_context([&context]() { EVP_AEAD_CTX_cleanup(&context); });
+  ASYLO_RETURN_IF_ERROR(InitContext(&context));
+
+  size_t offset = 0;
+  for (size_t i = 0; i < ciphertexts.size(); i++) {
+    const ByteContainerView &aad =
+        associated_data[associated_data.size() == 1 ? 0 : i];
+    if (EVP_AEAD_CTX_open(&context, plaintexts.data() + offset,
+                          &plaintext_sizes[i], plaintexts.size() - offset,
+                          nonces.data() + i * nonce_size_, nonce_size_,
+                          ciphertexts[i].data(), ciphertexts[i].size(),
+                          aad.data(), aad.size()) != 1) {
+      return Status(
+          error::GoogleError::INTERNAL,
+          absl::StrCat("EVP_AEAD_CTX_open failed for message ", i, ": ",
+                       BsslLastErrorString()));
+    }
+    offset += plaintext_sizes[i];
+  }
+
+  return Status::OkStatus();
+}
+
+Status AeadKey::InitContext(EVP_AEAD_CTX *context) const {
+  if (EVP_AEAD_CTX_init(context, aead_, key_.data(), key_.size(),
+                        EVP_AEAD_max_tag_len(aead_),
+                        /*impl=*/nullptr) != 1) {
+    return Status(
+        error::GoogleError::INTERNAL,
+        absl::StrCat("EVP_AEAD_CTX_init failed: ", BsslLastErrorString()));
+  }
+  return Status::OkStatus();
+}
+
+Status AeadKey::CheckBatch(size_t count, size_t associated_data_count,
+                           size_t nonces_size, size_t sizes_count) const {
+  if (associated_data_count != 1 && associated_data_count != count) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid number of associated data: ",
+                               associated_data_count, " (must be 1 or ",
+                               count, ")"));
+  }
+  if (nonces_size != count * nonce_size_) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid nonces length: ", nonces_size,
+                               " (must be ", count * nonce_size_, " bytes)"));
+  }
+  if (sizes_count != count) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid number of output sizes: ", sizes_count,
+                               " (must be ", count, ")"));
+  }
+  return Status::OkStatus();
+}
+
 AeadKey::AeadKey(AeadScheme aead_scheme, ByteContainerView key)
     : aead_(GetEvpAead(aead_scheme)),
       aead_scheme_(aead_scheme),
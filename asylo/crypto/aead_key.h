@@ -24,6 +24,7 @@
 #include <memory>
 #include <vector>
 
+#include "absl/types/span.h"
 #include "asylo/crypto/algorithms.pb.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/util/cleansing_types.h"
@@ -72,9 +73,35 @@ class AeadKey {
               ByteContainerView nonce, absl::Span<uint8_t> plaintext,
               size_t *plaintext_size);
 
+  // Implements the AEAD Seal operation on a batch of messages, initializing the
+  // AEAD context once for the whole batch. |plaintexts|[i] is sealed with
+  // |associated_data|[i], or with |associated_data|[0] if it holds a single
+  // entry, and with the nonce at offset i * NonceSize() of |nonces|. The
+  // ciphertexts are written back to back to |ciphertexts|, which is not
+  // resized, and their sizes to |ciphertext_sizes|.
+  Status SealBatch(absl::Span<const ByteContainerView> plaintexts,
+                   absl::Span<const ByteContainerView> associated_data,
+                   ByteContainerView nonces, absl::Span<uint8_t> ciphertexts,
+                   absl::Span<size_t> ciphertext_sizes);
+
+  // Implements the AEAD Open operation on a batch of messages, as the reverse
+  // of SealBatch(). The plaintexts are written back to back to |plaintexts|,
+  // which is not resized, and their sizes to |plaintext_sizes|.
+  Status OpenBatch(absl::Span<const ByteContainerView> ciphertexts,
+                   absl::Span<const ByteContainerView> associated_data,
+                   ByteContainerView nonces, absl::Span<uint8_t> plaintexts,
+                   absl::Span<size_t> plaintext_sizes);
+
  private:
   AeadKey(AeadScheme scheme, ByteContainerView key);
 
+  // Initializes |context| with the key.
+  Status InitContext(EVP_AEAD_CTX *context) const;
+
+  // Checks the sizes of the arguments of SealBatch() and OpenBatch().
+  Status CheckBatch(size_t count, size_t associated_data_count,
+                    size_t nonces_size, size_t sizes_count) const;
+
   // The object that encapsulates the AEAD algorithm.
   const EVP_AEAD *const aead_;
 
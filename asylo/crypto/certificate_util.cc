@@ -20,6 +20,7 @@
 
 #include <cstdint>
 #include <utility>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
@@ -150,6 +151,25 @@ StatusOr<CertificateInterfaceVector> CreateCertificateChain(
 
 Status VerifyCertificateChain(CertificateInterfaceSpan certificate_chain,
                               const VerificationConfig &verification_config) {
+  std::vector<const CertificateInterface *> certificates;
+  certificates.reserve(certificate_chain.size());
+  for (const std::unique_ptr<CertificateInterface> &certificate :
+       certificate_chain) {
+    certificates.push_back(certificate.get());
+  }
+  return VerifyCertificateChain(
+      certificates, verification_config,
+      [&certificates, &verification_config](size_t subject_index,
+                                            size_t issuer_index) {
+        return certificates[subject_index]->Verify(
+            *certificates[issuer_index], verification_config);
+      });
+}
+
+Status VerifyCertificateChain(
+    absl::Span<const CertificateInterface *const> certificate_chain,
+    const VerificationConfig &verification_config,
+    const CertificateLinkVerifier &verify_link) {
   if (certificate_chain.empty()) {
     return Status(error::GoogleError::INVALID_ARGUMENT,
                   "Certificate chain must include at least one certificate");
@@ -161,8 +181,7 @@ Status VerifyCertificateChain(CertificateInterfaceSpan certificate_chain,
   // verified.
   int64_t ca_count = 0;
   for (int i = 0; i < certificate_chain.size() - 1; i++) {
-    const CertificateInterface *subject = certificate_chain[i].get();
-    const CertificateInterface *issuer = certificate_chain[i + 1].get();
+    const CertificateInterface *issuer = certificate_chain[i + 1];
     if (verification_config.max_pathlen) {
       absl::optional<int64_t> max_pathlength = issuer->CertPathLength();
       if (max_pathlength.has_value() && max_pathlength.value() < ca_count) {
@@ -179,17 +198,16 @@ Status VerifyCertificateChain(CertificateInterfaceSpan certificate_chain,
       ca_count++;
     }
 
-    Status status = subject->Verify(*issuer, verification_config);
+    Status status = verify_link(i, i + 1);
     if (!status.ok()) {
       return status.WithPrependedContext(
           absl::StrCat("Failed to verify certificate at index ", i));
     }
   }
 
-  const CertificateInterface *root = certificate_chain.rbegin()->get();
-
   // Root certificate should be self-signed.
-  Status status = root->Verify(*root, verification_config);
+  size_t root_index = certificate_chain.size() - 1;
+  Status status = verify_link(root_index, root_index);
   if (!status.ok()) {
     return status.WithPrependedContext("Failed to verify root certificate");
   }
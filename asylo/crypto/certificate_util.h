@@ -19,6 +19,7 @@
 #ifndef ASYLO_CRYPTO_CERTIFICATE_UTIL_H_
 #define ASYLO_CRYPTO_CERTIFICATE_UTIL_H_
 
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <string>
@@ -46,6 +47,12 @@ using CertificateInterfaceVector =
 using CertificateInterfaceSpan =
     absl::Span<const std::unique_ptr<CertificateInterface>>;
 
+// Verifies that the certificate at |subject_index| in a certificate chain was
+// issued by the certificate at |issuer_index|. Returns a non-OK Status if it
+// was not.
+using CertificateLinkVerifier =
+    std::function<Status(size_t subject_index, size_t issuer_index)>;
+
 // Validates a CertificateSigningRequest message. Returns an OK status if and
 // only if the message is valid.
 //
@@ -103,6 +110,15 @@ StatusOr<CertificateInterfaceVector> CreateCertificateChain(
 Status VerifyCertificateChain(CertificateInterfaceSpan certificate_chain,
                               const VerificationConfig &verification_config);
 
+// Checks |certificate_chain| as above, but calls |verify_link| to verify the
+// signature of each certificate instead of CertificateInterface::Verify(), so
+// that callers can skip the links they have verified before. |verify_link|
+// must apply |verification_config|.
+Status VerifyCertificateChain(
+    absl::Span<const CertificateInterface *const> certificate_chain,
+    const VerificationConfig &verification_config,
+    const CertificateLinkVerifier &verify_link);
+
 // Parses PEM-encoded certificate |pem_cert| into Certificate protobuf.
 // Returns a non-OK Status if |pem_cert| is not X.509 PEM encoded.
 StatusOr<Certificate> GetCertificateFromPem(absl::string_view pem_cert);
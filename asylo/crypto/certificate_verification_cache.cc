@@ -0,0 +1,247 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/certificate_verification_cache.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "asylo/crypto/sha256_hash.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/crypto/x509_certificate.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+// Returns a digest of the format and the data of |certificate|.
+StatusOr<std::string> CertificateDigest(const Certificate &certificate) {
+  Sha256Hash hash;
+  int32_t format = certificate.format();
+  hash.Update(ByteContainerView(&format, sizeof(format)));
+  hash.Update(certificate.data());
+  std::vector<uint8_t> digest;
+  ASYLO_RETURN_IF_ERROR(hash.CumulativeHash(&digest));
+  return std::string(digest.begin(), digest.end());
+}
+
+// Returns the end of the validity period of |certificate|. Returns
+// absl::InfiniteFuture() if the format has no validity period, and
+// absl::InfinitePast() if the validity period could not be read.
+absl::Time GetNotAfter(const CertificateInterface &certificate) {
+  const X509Certificate *x509_certificate =
+      dynamic_cast<const X509Certificate *>(&certificate);
+  if (x509_certificate == nullptr) {
+    return absl::InfiniteFuture();
+  }
+  StatusOr<X509Validity> validity_result = x509_certificate->GetValidity();
+  if (!validity_result.ok()) {
+    return absl::InfinitePast();
+  }
+  return validity_result.ValueOrDie().not_after;
+}
+
+// Returns the key of the link from |issuer_digest| to |subject_digest| when
+// verified under |config|.
+std::string LinkKey(const std::string &subject_digest,
+                    const std::string &issuer_digest,
+                    const VerificationConfig &config) {
+  return absl::StrCat(subject_digest, issuer_digest, config.issuer_ca ? 1 : 0,
+                      config.max_pathlen ? 1 : 0,
+                      config.issuer_key_usage ? 1 : 0);
+}
+
+}  // namespace
+
+CertificateVerificationCache::CertificateVerificationCache()
+    : CertificateVerificationCache(Options()) {}
+
+CertificateVerificationCache::CertificateVerificationCache(
+    const Options &options)
+    : options_(options), stats_{0, 0, 0, 0} {}
+
+StatusOr<SharedCertificateInterfaceVector>
+CertificateVerificationCache::CreateCertificateChain(
+    const CertificateFactoryMap &factory_map, const CertificateChain &chain) {
+  SharedCertificateInterfaceVector certificate_chain;
+  certificate_chain.reserve(chain.certificates_size());
+  for (int i = 0; i < chain.certificates_size(); i++) {
+    auto certificate_result = Intern(factory_map, chain.certificates(i));
+    if (!certificate_result.ok()) {
+      return certificate_result.status().WithPrependedContext(
+          absl::StrCat("Failed to create certificate at index ", i));
+    }
+    certificate_chain.push_back(std::move(certificate_result).ValueOrDie());
+  }
+  return std::move(certificate_chain);
+}
+
+Status CertificateVerificationCache::VerifyCertificateChain(
+    absl::Span<const std::shared_ptr<const CertificateInterface>>
+        certificate_chain,
+    const VerificationConfig &verification_config) {
+  std::vector<const CertificateInterface *> certificates;
+  certificates.reserve(certificate_chain.size());
+  for (const auto &certificate : certificate_chain) {
+    certificates.push_back(certificate.get());
+  }
+
+  absl::Time now = absl::Now();
+  return asylo::VerifyCertificateChain(
+      certificates, verification_config,
+      [this, &certificates, &verification_config, now](size_t subject_index,
+                                                       size_t issuer_index) {
+        return VerifyLink(*certificates[subject_index],
+                          *certificates[issuer_index], verification_config,
+                          now);
+      });
+}
+
+void CertificateVerificationCache::ClearLinks() {
+  absl::MutexLock lock(&mu_);
+  links_.clear();
+  links_by_key_.clear();
+}
+
+void CertificateVerificationCache::Clear() {
+  absl::MutexLock lock(&mu_);
+  links_.clear();
+  links_by_key_.clear();
+  certificates_.clear();
+  certificates_by_digest_.clear();
+  certificates_by_address_.clear();
+}
+
+CertificateVerificationCache::Stats CertificateVerificationCache::GetStats()
+    const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+StatusOr<std::shared_ptr<const CertificateInterface>>
+CertificateVerificationCache::Intern(const CertificateFactoryMap &factory_map,
+                                     const Certificate &certificate) {
+  std::string digest;
+  ASYLO_ASSIGN_OR_RETURN(digest, CertificateDigest(certificate));
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = certificates_by_digest_.find(digest);
+    if (it != certificates_by_digest_.end()) {
+      stats_.certificate_hits++;
+      certificates_.splice(certificates_.begin(), certificates_, it->second);
+      return it->second->certificate;
+    }
+    stats_.certificate_misses++;
+  }
+
+  // Parse the certificate without holding the lock.
+  std::unique_ptr<CertificateInterface> parsed_certificate;
+  ASYLO_ASSIGN_OR_RETURN(parsed_certificate,
+                         CreateCertificateInterface(factory_map, certificate));
+  std::shared_ptr<const CertificateInterface> shared_certificate =
+      std::move(parsed_certificate);
+  if (options_.max_certificates == 0) {
+    return shared_certificate;
+  }
+  absl::Time not_after = GetNotAfter(*shared_certificate);
+
+  absl::MutexLock lock(&mu_);
+  auto it = certificates_by_digest_.find(digest);
+  if (it != certificates_by_digest_.end()) {
+    // Another thread interned the certificate in the meantime.
+    return it->second->certificate;
+  }
+  certificates_.push_front(
+      CertificateEntry{digest, shared_certificate, not_after});
+  certificates_by_digest_[digest] = certificates_.begin();
+  certificates_by_address_[shared_certificate.get()] = certificates_.begin();
+  while (certificates_.size() > options_.max_certificates) {
+    const CertificateEntry &least_recently_used = certificates_.back();
+    certificates_by_digest_.erase(least_recently_used.digest);
+    certificates_by_address_.erase(least_recently_used.certificate.get());
+    certificates_.pop_back();
+  }
+  return shared_certificate;
+}
+
+Status CertificateVerificationCache::VerifyLink(
+    const CertificateInterface &subject, const CertificateInterface &issuer,
+    const VerificationConfig &config, absl::Time now) {
+  // The link is only cached if both certificates are interned.
+  std::string key;
+  absl::Time expiry = now + options_.link_lifetime;
+  {
+    absl::MutexLock lock(&mu_);
+    const CertificateEntry *subject_entry = FindCertificate(subject);
+    const CertificateEntry *issuer_entry = FindCertificate(issuer);
+    if (subject_entry != nullptr && issuer_entry != nullptr &&
+        options_.max_links != 0) {
+      key = LinkKey(subject_entry->digest, issuer_entry->digest, config);
+      expiry =
+          std::min({expiry, subject_entry->not_after, issuer_entry->not_after});
+      auto it = links_by_key_.find(key);
+      if (it != links_by_key_.end()) {
+        if (it->second->expiry > now) {
+          stats_.link_hits++;
+          links_.splice(links_.begin(), links_, it->second);
+          return Status::OkStatus();
+        }
+        EraseLink(it->second);
+      }
+    }
+    stats_.link_misses++;
+  }
+
+  // Verify the link without holding the lock.
+  ASYLO_RETURN_IF_ERROR(subject.Verify(issuer, config));
+  if (key.empty() || expiry <= now) {
+    return Status::OkStatus();
+  }
+
+  absl::MutexLock lock(&mu_);
+  auto it = links_by_key_.find(key);
+  if (it != links_by_key_.end()) {
+    EraseLink(it->second);
+  }
+  links_.push_front(LinkEntry{key, expiry});
+  links_by_key_[key] = links_.begin();
+  while (links_.size() > options_.max_links) {
+    EraseLink(std::prev(links_.end()));
+  }
+  return Status::OkStatus();
+}
+
+const CertificateVerificationCache::CertificateEntry *
+CertificateVerificationCache::FindCertificate(
+    const CertificateInterface &certificate) {
+  auto it = certificates_by_address_.find(&certificate);
+  if (it == certificates_by_address_.end()) {
+    return nullptr;
+  }
+  return &*it->second;
+}
+
+void CertificateVerificationCache::EraseLink(LinkList::iterator it) {
+  links_by_key_.erase(it->key);
+  links_.erase(it);
+}
+
+}  // namespace asylo
@@ -0,0 +1,165 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_CRYPTO_CERTIFICATE_VERIFICATION_CACHE_H_
+#define ASYLO_CRYPTO_CERTIFICATE_VERIFICATION_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "asylo/crypto/certificate.pb.h"
+#include "asylo/crypto/certificate_interface.h"
+#include "asylo/crypto/certificate_util.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+using SharedCertificateInterfaceVector =
+    std::vector<std::shared_ptr<const CertificateInterface>>;
+
+// A cache for parsing and verifying certificate chains that are seen
+// repeatedly, such as the certificate chains of remote assertions.
+//
+// The cache interns parsed certificates, keyed by a SHA-256 digest of their
+// format and data, so that each certificate is parsed once. It also remembers
+// the links of chains that verified, keyed by the digests of the subject and
+// the issuer and by the verification config, so that each link is verified
+// once. A verified link expires at the end of the validity period of either
+// certificate, if known, and at most |link_lifetime| after it was verified.
+// Callers that check revocation lists should call ClearLinks() when they fetch
+// new ones. Failed verifications are not cached.
+//
+// A cache must only be used with one set of certificate factories. The least
+// recently used certificates and links are evicted first. All methods are
+// thread-safe.
+class CertificateVerificationCache {
+ public:
+  struct Options {
+    // Number of parsed certificates held by the cache.
+    size_t max_certificates = 256;
+
+    // Number of verified links held by the cache.
+    size_t max_links = 1024;
+
+    // The longest time a verified link is trusted without verifying it again.
+    absl::Duration link_lifetime = absl::Hours(1);
+  };
+
+  // Counters of the cache since its creation.
+  struct Stats {
+    uint64_t certificate_hits;
+    uint64_t certificate_misses;
+    uint64_t link_hits;
+    uint64_t link_misses;
+  };
+
+  CertificateVerificationCache();
+  explicit CertificateVerificationCache(const Options &options);
+
+  // Parses |chain| as CreateCertificateChain() does, returning interned
+  // certificates for the ones parsed before.
+  StatusOr<SharedCertificateInterfaceVector> CreateCertificateChain(
+      const CertificateFactoryMap &factory_map, const CertificateChain &chain)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Checks |certificate_chain| as VerifyCertificateChain() does, skipping the
+  // links verified before. Only the links between certificates returned by
+  // CreateCertificateChain() are cached.
+  Status VerifyCertificateChain(
+      absl::Span<const std::shared_ptr<const CertificateInterface>>
+          certificate_chain,
+      const VerificationConfig &verification_config) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Drops all verified links.
+  void ClearLinks() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Drops all verified links and parsed certificates.
+  void Clear() ABSL_LOCKS_EXCLUDED(mu_);
+
+  Stats GetStats() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct CertificateEntry {
+    std::string digest;
+    std::shared_ptr<const CertificateInterface> certificate;
+
+    // The end of the validity period of the certificate, or
+    // absl::InfiniteFuture() if it is unknown.
+    absl::Time not_after;
+  };
+
+  struct LinkEntry {
+    std::string key;
+    absl::Time expiry;
+  };
+
+  using CertificateList = std::list<CertificateEntry>;
+  using LinkList = std::list<LinkEntry>;
+
+  // Returns the interned certificate for |certificate|, parsing it with
+  // |factory_map| if needed.
+  StatusOr<std::shared_ptr<const CertificateInterface>> Intern(
+      const CertificateFactoryMap &factory_map, const Certificate &certificate)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Verifies that |subject| was issued by |issuer| under |config|, unless the
+  // link was verified before.
+  Status VerifyLink(const CertificateInterface &subject,
+                    const CertificateInterface &issuer,
+                    const VerificationConfig &config, absl::Time now)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the entry of the interned |certificate|, or nullptr if it is not
+  // interned.
+  const CertificateEntry *FindCertificate(
+      const CertificateInterface &certificate)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Removes the link at |it|.
+  void EraseLink(LinkList::iterator it) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const Options options_;
+  Stats stats_ ABSL_GUARDED_BY(mu_);
+
+  // Entries ordered from the most to the least recently used, and their
+  // indices.
+  CertificateList certificates_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::string, CertificateList::iterator>
+      certificates_by_digest_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<const CertificateInterface *, CertificateList::iterator>
+      certificates_by_address_ ABSL_GUARDED_BY(mu_);
+  LinkList links_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::string, LinkList::iterator> links_by_key_
+      ABSL_GUARDED_BY(mu_);
+
+  mutable absl::Mutex mu_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_CRYPTO_CERTIFICATE_VERIFICATION_CACHE_H_
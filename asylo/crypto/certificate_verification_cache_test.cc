@@ -0,0 +1,255 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/certificate_verification_cache.h"
+
+#include <memory>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "asylo/crypto/certificate.pb.h"
+#include "asylo/crypto/certificate_interface.h"
+#include "asylo/crypto/certificate_util.h"
+#include "asylo/crypto/fake_certificate.h"
+#include "asylo/crypto/fake_certificate.pb.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+constexpr char kRootKey[] = "f00d";
+constexpr char kIntermediateKey[] = "c0ff33";
+constexpr char kEndUserKey[] = "fun";
+
+// Number of certificates parsed and verified by CountingCertificate.
+int parse_count = 0;
+int verify_count = 0;
+
+// A FakeCertificate that counts how often it is parsed and verified.
+class CountingCertificate : public FakeCertificate {
+ public:
+  using FakeCertificate::FakeCertificate;
+
+  static StatusOr<std::unique_ptr<CertificateInterface>> Create(
+      const Certificate &certificate) {
+    ASYLO_RETURN_IF_ERROR(FakeCertificate::Create(certificate).status());
+    parse_count++;
+    FakeCertificateProto proto;
+    proto.ParseFromString(certificate.data());
+    absl::optional<int64_t> pathlength;
+    if (proto.has_pathlength()) {
+      pathlength = proto.pathlength();
+    }
+    return absl::make_unique<CountingCertificate>(
+        proto.subject_key(), proto.issuer_key(), /*is_ca=*/absl::nullopt,
+        pathlength);
+  }
+
+  Status Verify(const CertificateInterface &issuer_certificate,
+                const VerificationConfig &config) const override {
+    verify_count++;
+    return FakeCertificate::Verify(issuer_certificate, config);
+  }
+};
+
+Certificate CreateCertificate(const std::string &subject_key,
+                              const std::string &issuer_key,
+                              absl::optional<int64_t> pathlength) {
+  FakeCertificateProto proto;
+  proto.set_subject_key(subject_key);
+  proto.set_issuer_key(issuer_key);
+  if (pathlength.has_value()) {
+    proto.set_pathlength(pathlength.value());
+  }
+  Certificate certificate;
+  certificate.set_format(Certificate::X509_DER);
+  proto.SerializeToString(certificate.mutable_data());
+  return certificate;
+}
+
+// Returns a chain of three certificates that verifies if |end_user_issuer_key|
+// is the intermediate key.
+CertificateChain CreateChain(const std::string &end_user_issuer_key) {
+  CertificateChain chain;
+  *chain.add_certificates() =
+      CreateCertificate(kEndUserKey, end_user_issuer_key, absl::nullopt);
+  *chain.add_certificates() =
+      CreateCertificate(kIntermediateKey, kRootKey, /*pathlength=*/0);
+  *chain.add_certificates() =
+      CreateCertificate(kRootKey, kRootKey, /*pathlength=*/1);
+  return chain;
+}
+
+class CertificateVerificationCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    factory_map_.emplace(Certificate::X509_DER, CountingCertificate::Create);
+    parse_count = 0;
+    verify_count = 0;
+  }
+
+  // Parses and verifies |chain| with |cache|.
+  Status ParseAndVerify(CertificateVerificationCache *cache,
+                        const CertificateChain &chain,
+                        const VerificationConfig &config) {
+    SharedCertificateInterfaceVector certificates;
+    ASYLO_ASSIGN_OR_RETURN(certificates,
+                           cache->CreateCertificateChain(factory_map_, chain));
+    return cache->VerifyCertificateChain(certificates, config);
+  }
+
+  CertificateFactoryMap factory_map_;
+};
+
+TEST_F(CertificateVerificationCacheTest, InternsParsedCertificates) {
+  CertificateVerificationCache cache;
+  SharedCertificateInterfaceVector first;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      first, cache.CreateCertificateChain(factory_map_, CreateChain(kRootKey)));
+  SharedCertificateInterfaceVector second;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      second,
+      cache.CreateCertificateChain(factory_map_, CreateChain(kRootKey)));
+
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(parse_count, 3);
+  EXPECT_EQ(cache.GetStats().certificate_hits, 3);
+}
+
+TEST_F(CertificateVerificationCacheTest, CreateCertificateChainForwardsErrors) {
+  CertificateVerificationCache cache;
+  CertificateChain chain = CreateChain(kIntermediateKey);
+  chain.mutable_certificates(1)->set_data("food food food food");
+  EXPECT_THAT(cache.CreateCertificateChain(factory_map_, chain),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  chain.mutable_certificates(1)->set_format(Certificate::X509_PEM);
+  EXPECT_THAT(cache.CreateCertificateChain(factory_map_, chain),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST_F(CertificateVerificationCacheTest, VerifiesEachLinkOnce) {
+  CertificateVerificationCache cache;
+  VerificationConfig config(/*all_fields=*/true);
+  CertificateChain chain = CreateChain(kIntermediateKey);
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  EXPECT_EQ(verify_count, 3);
+
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  EXPECT_EQ(verify_count, 3);
+  EXPECT_EQ(cache.GetStats().link_hits, 3);
+}
+
+TEST_F(CertificateVerificationCacheTest, CachesLinksPerConfig) {
+  CertificateVerificationCache cache;
+  CertificateChain chain = CreateChain(kIntermediateKey);
+  ASYLO_EXPECT_OK(
+      ParseAndVerify(&cache, chain, VerificationConfig(/*all_fields=*/true)));
+  ASYLO_EXPECT_OK(
+      ParseAndVerify(&cache, chain, VerificationConfig(/*all_fields=*/false)));
+  EXPECT_EQ(verify_count, 6);
+}
+
+TEST_F(CertificateVerificationCacheTest, DoesNotCacheFailedLinks) {
+  CertificateVerificationCache cache;
+  VerificationConfig config(/*all_fields=*/true);
+  CertificateChain chain = CreateChain(kRootKey);
+  EXPECT_THAT(ParseAndVerify(&cache, chain, config),
+              StatusIs(error::GoogleError::UNAUTHENTICATED));
+  EXPECT_THAT(ParseAndVerify(&cache, chain, config),
+              StatusIs(error::GoogleError::UNAUTHENTICATED));
+  EXPECT_EQ(verify_count, 2);
+}
+
+// Verifies that the path length constraints are checked on cached links.
+TEST_F(CertificateVerificationCacheTest, ChecksPathLengthOfCachedLinks) {
+  CertificateVerificationCache cache;
+  CertificateChain chain = CreateChain(kIntermediateKey);
+  ASYLO_EXPECT_OK(
+      ParseAndVerify(&cache, chain, VerificationConfig(/*all_fields=*/false)));
+
+  *chain.mutable_certificates(1) =
+      CreateCertificate(kIntermediateKey, kRootKey, /*pathlength=*/0);
+  *chain.mutable_certificates(2) =
+      CreateCertificate(kRootKey, kRootKey, /*pathlength=*/0);
+  VerificationConfig config(/*all_fields=*/false);
+  config.max_pathlen = true;
+  EXPECT_THAT(ParseAndVerify(&cache, chain, config),
+              StatusIs(error::GoogleError::UNAUTHENTICATED));
+}
+
+TEST_F(CertificateVerificationCacheTest, ReverifiesExpiredLinks) {
+  CertificateVerificationCache::Options options;
+  options.link_lifetime = absl::ZeroDuration();
+  CertificateVerificationCache cache(options);
+  VerificationConfig config(/*all_fields=*/true);
+  CertificateChain chain = CreateChain(kIntermediateKey);
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  EXPECT_EQ(verify_count, 6);
+}
+
+TEST_F(CertificateVerificationCacheTest, ClearLinksDropsVerifiedLinks) {
+  CertificateVerificationCache cache;
+  VerificationConfig config(/*all_fields=*/true);
+  CertificateChain chain = CreateChain(kIntermediateKey);
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  cache.ClearLinks();
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  EXPECT_EQ(verify_count, 6);
+  EXPECT_EQ(parse_count, 3);
+}
+
+TEST_F(CertificateVerificationCacheTest, EvictsLeastRecentlyUsed) {
+  CertificateVerificationCache::Options options;
+  options.max_certificates = 2;
+  options.max_links = 1;
+  CertificateVerificationCache cache(options);
+  VerificationConfig config(/*all_fields=*/true);
+  CertificateChain chain = CreateChain(kIntermediateKey);
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  ASYLO_EXPECT_OK(ParseAndVerify(&cache, chain, config));
+  EXPECT_EQ(parse_count, 6);
+  EXPECT_EQ(verify_count, 6);
+}
+
+// Verifies that chains of certificates that were not interned are verified.
+TEST_F(CertificateVerificationCacheTest, VerifiesChainsOfOtherCertificates) {
+  CertificateVerificationCache cache;
+  SharedCertificateInterfaceVector chain;
+  chain.push_back(std::make_shared<FakeCertificate>(
+      kEndUserKey, kIntermediateKey, /*is_ca=*/absl::nullopt,
+      /*pathlength=*/absl::nullopt));
+  chain.push_back(std::make_shared<FakeCertificate>(
+      kIntermediateKey, kRootKey, /*is_ca=*/absl::nullopt, /*pathlength=*/0));
+  chain.push_back(std::make_shared<FakeCertificate>(
+      kRootKey, kRootKey, /*is_ca=*/absl::nullopt, /*pathlength=*/1));
+
+  VerificationConfig config(/*all_fields=*/true);
+  ASYLO_EXPECT_OK(cache.VerifyCertificateChain(chain, config));
+  ASYLO_EXPECT_OK(cache.VerifyCertificateChain(chain, config));
+  EXPECT_EQ(cache.GetStats().link_hits, 0);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,177 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/der_reader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+
+namespace asylo {
+namespace {
+
+// The identifier octet bits that mark the high-tag-number form.
+constexpr uint8_t kHighTagNumberForm = 0x1f;
+
+// The largest number of length octets in the long form that DerReader accepts.
+constexpr size_t kMaxLengthOctets = 4;
+
+Status InvalidDerError(absl::string_view message) {
+  return Status(error::GoogleError::INVALID_ARGUMENT,
+                absl::StrCat("Invalid DER: ", message));
+}
+
+std::string OidContentsToHex(ByteContainerView oid) {
+  return absl::BytesToHexString(absl::string_view(
+      reinterpret_cast<const char *>(oid.data()), oid.size()));
+}
+
+}  // namespace
+
+Status DerReader::ExpectEnd() const {
+  if (!empty()) {
+    return InvalidDerError(
+        absl::StrFormat("%d unexpected trailing bytes", remaining_.size()));
+  }
+  return Status::OkStatus();
+}
+
+Status DerReader::ReadElement(DerElement *element) {
+  const uint8_t *data = remaining_.data();
+  const size_t size = remaining_.size();
+  if (size < 2) {
+    return InvalidDerError("truncated element");
+  }
+
+  const uint8_t tag = data[0];
+  if ((tag & kHighTagNumberForm) == kHighTagNumberForm) {
+    return InvalidDerError("high tag numbers are not supported");
+  }
+
+  size_t header_size = 2;
+  size_t length = data[1];
+  if (length & 0x80) {
+    const size_t length_octets = length & 0x7f;
+    if (length_octets == 0) {
+      return InvalidDerError("indefinite lengths are not allowed");
+    }
+    if (length_octets > kMaxLengthOctets) {
+      return InvalidDerError("length is too large");
+    }
+    if (size - header_size < length_octets) {
+      return InvalidDerError("truncated length");
+    }
+    if (data[header_size] == 0) {
+      return InvalidDerError("length is not minimally encoded");
+    }
+    length = 0;
+    for (size_t i = 0; i < length_octets; ++i) {
+      length = (length << 8) | data[header_size + i];
+    }
+    if (length < 0x80) {
+      return InvalidDerError("length is not minimally encoded");
+    }
+    header_size += length_octets;
+  }
+  if (size - header_size < length) {
+    return InvalidDerError("truncated contents");
+  }
+
+  element->tag = tag;
+  element->contents = ByteContainerView(data + header_size, length);
+  element->encoding = ByteContainerView(data, header_size + length);
+  remaining_ = ByteContainerView(data + header_size + length,
+                                 size - header_size - length);
+  return Status::OkStatus();
+}
+
+Status DerReader::ReadElement(DerTag tag, DerElement *element) {
+  DerReader reader = *this;
+  ASYLO_RETURN_IF_ERROR(reader.ReadElement(element));
+  if (element->tag != static_cast<uint8_t>(tag)) {
+    return InvalidDerError(
+        absl::StrFormat("expected identifier 0x%02x, found 0x%02x",
+                        static_cast<uint8_t>(tag), element->tag));
+  }
+  *this = reader;
+  return Status::OkStatus();
+}
+
+Status DerReader::ReadSequence(DerReader *sequence) {
+  DerElement element;
+  ASYLO_RETURN_IF_ERROR(ReadElement(DerTag::kSequence, &element));
+  *sequence = DerReader(element.contents);
+  return Status::OkStatus();
+}
+
+namespace internal {
+
+Status DecodeDerInteger(ByteContainerView contents, bool *negative,
+                        uint64_t *value) {
+  if (contents.empty()) {
+    return InvalidDerError("empty INTEGER");
+  }
+  if (contents.size() > 1 &&
+      ((contents[0] == 0x00 && !(contents[1] & 0x80)) ||
+       (contents[0] == 0xff && (contents[1] & 0x80)))) {
+    return InvalidDerError("INTEGER is not minimally encoded");
+  }
+
+  *negative = contents[0] & 0x80;
+  size_t begin = 0;
+  if (!*negative && contents[0] == 0x00) {
+    begin = 1;
+  }
+  if (contents.size() - begin > sizeof(uint64_t)) {
+    return Status(error::GoogleError::OUT_OF_RANGE,
+                  "INTEGER does not fit in 64 bits");
+  }
+
+  uint64_t bits = *negative ? ~uint64_t{0} : 0;
+  for (size_t i = begin; i < contents.size(); ++i) {
+    bits = (bits << 8) | contents[i];
+  }
+  *value = bits;
+  return Status::OkStatus();
+}
+
+Status UnexpectedOidError(ByteContainerView oid) {
+  return Status(error::GoogleError::INVALID_ARGUMENT,
+                absl::StrCat("Unexpected OID with contents ",
+                             OidContentsToHex(oid)));
+}
+
+Status RepeatedOidError(ByteContainerView oid) {
+  return Status(
+      error::GoogleError::INVALID_ARGUMENT,
+      absl::StrCat("Found repeated OID with contents ", OidContentsToHex(oid)));
+}
+
+Status MissingOidError(ByteContainerView oid) {
+  return Status(error::GoogleError::INVALID_ARGUMENT,
+                absl::StrCat("Missing extension with OID contents ",
+                             OidContentsToHex(oid)));
+}
+
+}  // namespace internal
+}  // namespace asylo
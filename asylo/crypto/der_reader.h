@@ -0,0 +1,235 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_CRYPTO_DER_READER_H_
+#define ASYLO_CRYPTO_DER_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "absl/types/span.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+
+// Identifier octets of the universal ASN.1 types that DerReader reads.
+enum class DerTag : uint8_t {
+  kBoolean = 0x01,
+  kInteger = 0x02,
+  kOctetString = 0x04,
+  kObjectId = 0x06,
+  kEnumerated = 0x0a,
+  kSequence = 0x30,
+};
+
+// A single DER-encoded element. Both views point into the buffer the element
+// was read from.
+struct DerElement {
+  // The identifier octet of the element.
+  uint8_t tag = 0;
+
+  // The contents octets of the element.
+  ByteContainerView contents{nullptr, 0};
+
+  // The whole encoding of the element, including its identifier and length
+  // octets.
+  ByteContainerView encoding{nullptr, 0};
+};
+
+// DerReader reads a sequence of DER-encoded elements from a buffer without
+// copying or allocating. Unlike Asn1Value, which builds a BoringSSL ASN1_TYPE
+// tree of the whole input, DerReader returns views into the buffer, which
+// must outlive the reader and all of the views it returns.
+//
+// Only the low-tag-number form of identifiers and definite lengths are
+// supported, and non-minimal lengths and INTEGERs are rejected. Malformed
+// input results in an INVALID_ARGUMENT error. An INTEGER or ENUMERATED that
+// does not fit in the requested type results in an OUT_OF_RANGE error, as
+// with Asn1Value::GetIntegerAsInt(). A failed read leaves the reader
+// unchanged.
+class DerReader {
+ public:
+  // Creates a reader with no elements.
+  DerReader() : remaining_(nullptr, 0) {}
+
+  // Creates a reader of the elements in |der|.
+  explicit DerReader(ByteContainerView der) : remaining_(der) {}
+
+  // Returns true if all elements have been read.
+  bool empty() const { return remaining_.empty(); }
+
+  // Returns an INVALID_ARGUMENT error if not all elements have been read.
+  Status ExpectEnd() const;
+
+  // Reads the next element into |element|.
+  Status ReadElement(DerElement *element);
+
+  // Reads the next element into |element| if it has the identifier |tag|.
+  Status ReadElement(DerTag tag, DerElement *element);
+
+  // Reads the next element as a SEQUENCE and sets |sequence| to a reader of
+  // its elements.
+  Status ReadSequence(DerReader *sequence);
+
+  // Reads the next element as an INTEGER or ENUMERATED value that fits in an
+  // IntT.
+  template <typename IntT>
+  Status ReadInteger(IntT *value);
+  template <typename IntT>
+  Status ReadEnumerated(IntT *value);
+
+ private:
+  ByteContainerView remaining_;
+};
+
+namespace internal {
+
+// Decodes |contents| as the contents octets of a DER INTEGER. On success, sets
+// |negative| to whether the value is negative and |value| to its 64-bit two's
+// complement representation. Returns an OUT_OF_RANGE error if the value does
+// not fit in either an int64_t or a uint64_t.
+Status DecodeDerInteger(ByteContainerView contents, bool *negative,
+                        uint64_t *value);
+
+// Errors returned by ReadDerOidSequence().
+Status UnexpectedOidError(ByteContainerView oid);
+Status RepeatedOidError(ByteContainerView oid);
+Status MissingOidError(ByteContainerView oid);
+
+}  // namespace internal
+
+// Decodes |contents| as the contents octets of a DER INTEGER or ENUMERATED
+// value that fits in an IntT.
+template <typename IntT>
+Status DecodeDerInteger(ByteContainerView contents, IntT *value) {
+  static_assert(std::is_integral<IntT>::value, "IntT must be an integral type");
+  static_assert(sizeof(IntT) <= sizeof(uint64_t),
+                "IntT must be at most 64 bits wide");
+
+  bool negative;
+  uint64_t bits;
+  ASYLO_RETURN_IF_ERROR(internal::DecodeDerInteger(contents, &negative, &bits));
+  if (negative) {
+    if (std::is_unsigned<IntT>::value ||
+        static_cast<int64_t>(bits) <
+            static_cast<int64_t>(std::numeric_limits<IntT>::min())) {
+      return Status(error::GoogleError::OUT_OF_RANGE,
+                    "INTEGER cannot fit in the desired type");
+    }
+  } else if (bits > static_cast<uint64_t>(std::numeric_limits<IntT>::max())) {
+    return Status(error::GoogleError::OUT_OF_RANGE,
+                  "INTEGER cannot fit in the desired type");
+  }
+  *value = static_cast<IntT>(bits);
+  return Status::OkStatus();
+}
+
+template <typename IntT>
+Status DerReader::ReadInteger(IntT *value) {
+  DerReader reader = *this;
+  DerElement element;
+  ASYLO_RETURN_IF_ERROR(reader.ReadElement(DerTag::kInteger, &element));
+  ASYLO_RETURN_IF_ERROR(DecodeDerInteger(element.contents, value));
+  *this = reader;
+  return Status::OkStatus();
+}
+
+template <typename IntT>
+Status DerReader::ReadEnumerated(IntT *value) {
+  DerReader reader = *this;
+  DerElement element;
+  ASYLO_RETURN_IF_ERROR(reader.ReadElement(DerTag::kEnumerated, &element));
+  ASYLO_RETURN_IF_ERROR(DecodeDerInteger(element.contents, value));
+  *this = reader;
+  return Status::OkStatus();
+}
+
+// Describes a required field of a SEQUENCE of (OBJECT IDENTIFIER, ANY) pairs,
+// and how to decode its value into a T.
+template <typename T>
+struct DerOidField {
+  // The contents octets of the OBJECT IDENTIFIER of the field.
+  ByteContainerView oid;
+
+  // Reads the value of the field from |value| into |out|. |index| is passed
+  // through from the field, so that one function can read several fields.
+  Status (*read)(DerReader *value, int index, T *out);
+
+  int index;
+};
+
+// Reads a SEQUENCE of (OBJECT IDENTIFIER, ANY) pairs from |reader| into |out|
+// by calling the read function of the field in |fields| with the same OBJECT
+// IDENTIFIER on the value of each pair. Each read function must consume its
+// entire value. The pairs may appear in any order, but every field in |fields|
+// must appear exactly once, and no other OBJECT IDENTIFIER may appear.
+//
+// At most 64 fields are supported. Apart from what the read functions do,
+// ReadDerOidSequence() does not allocate.
+template <typename T>
+Status ReadDerOidSequence(DerReader *reader,
+                          absl::Span<const DerOidField<T>> fields, T *out) {
+  if (fields.size() > 64) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Too many fields for ReadDerOidSequence()");
+  }
+
+  DerReader sequence;
+  ASYLO_RETURN_IF_ERROR(reader->ReadSequence(&sequence));
+  uint64_t found = 0;
+  while (!sequence.empty()) {
+    DerReader pair;
+    DerElement oid;
+    DerElement value_element;
+    ASYLO_RETURN_IF_ERROR(sequence.ReadSequence(&pair));
+    ASYLO_RETURN_IF_ERROR(pair.ReadElement(DerTag::kObjectId, &oid));
+    ASYLO_RETURN_IF_ERROR(pair.ReadElement(&value_element));
+    ASYLO_RETURN_IF_ERROR(pair.ExpectEnd());
+
+    size_t i = 0;
+    while (i < fields.size() && fields[i].oid != oid.contents) {
+      ++i;
+    }
+    if (i == fields.size()) {
+      return internal::UnexpectedOidError(oid.contents);
+    }
+    if (found & (uint64_t{1} << i)) {
+      return internal::RepeatedOidError(oid.contents);
+    }
+    found |= uint64_t{1} << i;
+
+    DerReader value(value_element.encoding);
+    ASYLO_RETURN_IF_ERROR(fields[i].read(&value, fields[i].index, out));
+    ASYLO_RETURN_IF_ERROR(value.ExpectEnd());
+  }
+
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (!(found & (uint64_t{1} << i))) {
+      return internal::MissingOidError(fields[i].oid);
+    }
+  }
+  return Status::OkStatus();
+}
+
+}  // namespace asylo
+
+#endif  // ASYLO_CRYPTO_DER_READER_H_
@@ -0,0 +1,298 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/der_reader.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+
+// A struct read by ReadDerOidSequence() in the tests.
+struct TestFields {
+  int8_t first = 0;
+  uint16_t second = 0;
+};
+
+Status ReadFirst(DerReader *value, int index, TestFields *out) {
+  return value->ReadInteger(&out->first);
+}
+
+Status ReadSecond(DerReader *value, int index, TestFields *out) {
+  return value->ReadEnumerated(&out->second);
+}
+
+constexpr uint8_t kFirstOid[] = {0x2a, 0x03, 0x01};
+constexpr uint8_t kSecondOid[] = {0x2a, 0x03, 0x02};
+
+const DerOidField<TestFields> kTestFields[] = {
+    {ByteContainerView(kFirstOid), ReadFirst, 0},
+    {ByteContainerView(kSecondOid), ReadSecond, 0},
+};
+
+// Returns the encoding of a (OBJECT IDENTIFIER, ANY) pair with the given OID
+// contents and value encoding.
+std::vector<uint8_t> Pair(std::vector<uint8_t> oid,
+                          std::vector<uint8_t> value) {
+  std::vector<uint8_t> pair = {0x30,
+                               static_cast<uint8_t>(2 + oid.size() +
+                                                    value.size()),
+                               0x06, static_cast<uint8_t>(oid.size())};
+  pair.insert(pair.end(), oid.begin(), oid.end());
+  pair.insert(pair.end(), value.begin(), value.end());
+  return pair;
+}
+
+// Returns the encoding of a SEQUENCE of |elements|.
+std::vector<uint8_t> Sequence(std::vector<std::vector<uint8_t>> elements) {
+  std::vector<uint8_t> contents;
+  for (const auto &element : elements) {
+    contents.insert(contents.end(), element.begin(), element.end());
+  }
+  std::vector<uint8_t> sequence = {0x30,
+                                   static_cast<uint8_t>(contents.size())};
+  sequence.insert(sequence.end(), contents.begin(), contents.end());
+  return sequence;
+}
+
+Status ReadTestFields(ByteContainerView der, TestFields *fields) {
+  DerReader reader(der);
+  ASYLO_RETURN_IF_ERROR(ReadDerOidSequence<TestFields>(
+      &reader, absl::MakeConstSpan(kTestFields), fields));
+  return reader.ExpectEnd();
+}
+
+TEST(DerReaderTest, ReadsElementsInOrder) {
+  const std::vector<uint8_t> der = {0x04, 0x02, 0xab, 0xcd, 0x06, 0x01,
+                                    0x2a, 0x05, 0x00};
+  DerReader reader(der);
+
+  DerElement element;
+  ASYLO_ASSERT_OK(reader.ReadElement(DerTag::kOctetString, &element));
+  EXPECT_THAT(element.contents, Eq(ByteContainerView("\xab\xcd")));
+  EXPECT_THAT(element.encoding.size(), Eq(4));
+  ASYLO_ASSERT_OK(reader.ReadElement(DerTag::kObjectId, &element));
+  EXPECT_THAT(element.contents, Eq(ByteContainerView("\x2a")));
+  ASYLO_ASSERT_OK(reader.ReadElement(&element));
+  EXPECT_THAT(element.tag, Eq(0x05));
+  EXPECT_TRUE(element.contents.empty());
+  EXPECT_TRUE(reader.empty());
+  ASYLO_EXPECT_OK(reader.ExpectEnd());
+}
+
+TEST(DerReaderTest, ReturnsViewsIntoTheBuffer) {
+  const std::vector<uint8_t> der = {0x04, 0x01, 0x7f};
+  DerReader reader(der);
+  DerElement element;
+  ASYLO_ASSERT_OK(reader.ReadElement(&element));
+  EXPECT_THAT(element.contents.data(), Eq(der.data() + 2));
+  EXPECT_THAT(element.encoding.data(), Eq(der.data()));
+}
+
+TEST(DerReaderTest, ReadsLongFormLengths) {
+  std::vector<uint8_t> der = {0x04, 0x81, 0x80};
+  der.resize(der.size() + 0x80, 0x11);
+  DerReader reader(der);
+  DerElement element;
+  ASYLO_ASSERT_OK(reader.ReadElement(DerTag::kOctetString, &element));
+  EXPECT_THAT(element.contents.size(), Eq(0x80));
+  EXPECT_TRUE(reader.empty());
+}
+
+TEST(DerReaderTest, RejectsMalformedElements) {
+  const std::vector<std::vector<uint8_t>> malformed = {
+      // Truncated identifier and length.
+      {0x04},
+      // Truncated contents.
+      {0x04, 0x02, 0x00},
+      // High-tag-number form.
+      {0x1f, 0x01, 0x00},
+      // Indefinite length.
+      {0x30, 0x80, 0x00, 0x00},
+      // Long-form length that fits in the short form.
+      {0x04, 0x81, 0x01, 0x00},
+      // Long-form length with a leading zero.
+      {0x04, 0x82, 0x00, 0x80},
+      // Truncated long-form length.
+      {0x04, 0x82, 0x01},
+  };
+  for (const auto &der : malformed) {
+    DerReader reader(der);
+    DerElement element;
+    EXPECT_THAT(reader.ReadElement(&element),
+                StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  }
+}
+
+TEST(DerReaderTest, FailedReadLeavesReaderUnchanged) {
+  const std::vector<uint8_t> der = {0x02, 0x01, 0x05};
+  DerReader reader(der);
+  DerElement element;
+  EXPECT_THAT(reader.ReadElement(DerTag::kOctetString, &element),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  uint8_t value;
+  EXPECT_THAT(reader.ReadEnumerated(&value),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  ASYLO_ASSERT_OK(reader.ReadInteger(&value));
+  EXPECT_THAT(value, Eq(5));
+}
+
+TEST(DerReaderTest, ReadsSequences) {
+  const std::vector<uint8_t> der = {0x30, 0x06, 0x02, 0x01, 0x01,
+                                    0x02, 0x01, 0x02, 0x02, 0x01, 0x03};
+  DerReader reader(der);
+  DerReader sequence;
+  ASYLO_ASSERT_OK(reader.ReadSequence(&sequence));
+
+  std::vector<int> values;
+  while (!sequence.empty()) {
+    int value;
+    ASYLO_ASSERT_OK(sequence.ReadInteger(&value));
+    values.push_back(value);
+  }
+  EXPECT_THAT(values, ElementsAre(1, 2));
+  EXPECT_THAT(reader.ExpectEnd(),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST(DerReaderTest, DecodesIntegers) {
+  int64_t value;
+  ASYLO_ASSERT_OK(DecodeDerInteger(ByteContainerView("\x00", 1), &value));
+  EXPECT_THAT(value, Eq(0));
+  ASYLO_ASSERT_OK(DecodeDerInteger(ByteContainerView("\x00\x80", 2), &value));
+  EXPECT_THAT(value, Eq(128));
+  ASYLO_ASSERT_OK(DecodeDerInteger("\xff", &value));
+  EXPECT_THAT(value, Eq(-1));
+  ASYLO_ASSERT_OK(DecodeDerInteger("\xff\x7f", &value));
+  EXPECT_THAT(value, Eq(-129));
+  ASYLO_ASSERT_OK(DecodeDerInteger(
+      ByteContainerView("\x80\x00\x00\x00\x00\x00\x00\x00", 8), &value));
+  EXPECT_THAT(value, Eq(INT64_MIN));
+
+  uint64_t unsigned_value;
+  ASYLO_ASSERT_OK(DecodeDerInteger(
+      ByteContainerView("\x00\xff\xff\xff\xff\xff\xff\xff\xff", 9),
+      &unsigned_value));
+  EXPECT_THAT(unsigned_value, Eq(UINT64_MAX));
+}
+
+TEST(DerReaderTest, RejectsNonMinimalIntegers) {
+  int value;
+  EXPECT_THAT(DecodeDerInteger(ByteContainerView(nullptr, 0), &value),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(DecodeDerInteger(ByteContainerView("\x00\x01", 2), &value),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(DecodeDerInteger("\xff\xff", &value),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST(DerReaderTest, RejectsIntegersOutOfRange) {
+  uint8_t uint8_value;
+  EXPECT_THAT(DecodeDerInteger(ByteContainerView("\x01\x00", 2), &uint8_value),
+              StatusIs(error::GoogleError::OUT_OF_RANGE));
+  EXPECT_THAT(DecodeDerInteger("\xff", &uint8_value),
+              StatusIs(error::GoogleError::OUT_OF_RANGE));
+
+  int8_t int8_value;
+  ASYLO_ASSERT_OK(DecodeDerInteger("\x80", &int8_value));
+  EXPECT_THAT(int8_value, Eq(-128));
+  EXPECT_THAT(DecodeDerInteger("\xff\x7f", &int8_value),
+              StatusIs(error::GoogleError::OUT_OF_RANGE));
+  EXPECT_THAT(DecodeDerInteger(ByteContainerView("\x00\x80", 2), &int8_value),
+              StatusIs(error::GoogleError::OUT_OF_RANGE));
+
+  int64_t int64_value;
+  EXPECT_THAT(
+      DecodeDerInteger(
+          ByteContainerView("\x00\x80\x00\x00\x00\x00\x00\x00\x00", 9),
+          &int64_value),
+      StatusIs(error::GoogleError::OUT_OF_RANGE));
+  EXPECT_THAT(
+      DecodeDerInteger(
+          ByteContainerView("\xff\x7f\xff\xff\xff\xff\xff\xff\xff", 9),
+          &int64_value),
+      StatusIs(error::GoogleError::OUT_OF_RANGE));
+}
+
+TEST(DerReaderTest, ReadsOidSequenceInAnyOrder) {
+  TestFields fields;
+  ASYLO_ASSERT_OK(ReadTestFields(
+      Sequence({Pair({0x2a, 0x03, 0x02}, {0x0a, 0x02, 0x01, 0x00}),
+                Pair({0x2a, 0x03, 0x01}, {0x02, 0x01, 0xfe})}),
+      &fields));
+  EXPECT_THAT(fields.first, Eq(-2));
+  EXPECT_THAT(fields.second, Eq(256));
+}
+
+TEST(DerReaderTest, OidSequenceRejectsMissingRepeatedAndUnknownOids) {
+  const std::vector<uint8_t> first = Pair({0x2a, 0x03, 0x01}, {0x02, 0x01, 1});
+  const std::vector<uint8_t> second = Pair({0x2a, 0x03, 0x02}, {0x0a, 0x01, 2});
+  const std::vector<uint8_t> unknown =
+      Pair({0x2a, 0x03, 0x03}, {0x02, 0x01, 3});
+
+  TestFields fields;
+  EXPECT_THAT(ReadTestFields(Sequence({}), &fields),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(ReadTestFields(Sequence({first}), &fields),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(ReadTestFields(Sequence({first, second, first}), &fields),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(ReadTestFields(Sequence({first, second, unknown}), &fields),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST(DerReaderTest, OidSequencePropagatesReadErrors) {
+  TestFields fields;
+  // The first field does not fit in an int8_t.
+  EXPECT_THAT(ReadTestFields(
+                  Sequence({Pair({0x2a, 0x03, 0x01}, {0x02, 0x02, 0x01, 0x00}),
+                            Pair({0x2a, 0x03, 0x02}, {0x0a, 0x01, 0x02})}),
+                  &fields),
+              StatusIs(error::GoogleError::OUT_OF_RANGE));
+  // The second field is an INTEGER rather than an ENUMERATED.
+  EXPECT_THAT(
+      ReadTestFields(Sequence({Pair({0x2a, 0x03, 0x01}, {0x02, 0x01, 0x01}),
+                               Pair({0x2a, 0x03, 0x02}, {0x02, 0x01, 0x02})}),
+                     &fields),
+      StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST(DerReaderTest, OidSequenceRejectsExtraElementsInPairs) {
+  TestFields fields;
+  std::vector<uint8_t> first = Pair({0x2a, 0x03, 0x01}, {0x02, 0x01, 0x01});
+  first.insert(first.end(), {0x05, 0x00});
+  first[1] += 2;
+  EXPECT_THAT(
+      ReadTestFields(
+          Sequence({first, Pair({0x2a, 0x03, 0x02}, {0x0a, 0x01, 0x02})}),
+          &fields),
+      StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -42,6 +42,25 @@ class NonceGeneratorInterface {
   // nonce-generation was not successful. |nonce|.size() must be greater than or
   // equal to NonceSize().
   virtual Status NextNonce(absl::Span<uint8_t> nonce) = 0;
+
+  // Generates |count| new nonces and writes them back to back to |nonces|.
+  // Returns a non-OK status if nonce-generation was not successful.
+  // |nonces|.size() must be greater than or equal to |count| * NonceSize().
+  // Implementations may override this method to generate all nonces at once.
+  virtual Status NextNonces(absl::Span<uint8_t> nonces, size_t count) {
+    const size_t nonce_size = NonceSize();
+    if (nonces.size() < count * nonce_size) {
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    "Nonces buffer is too small");
+    }
+    for (size_t i = 0; i < count; i++) {
+      Status status = NextNonce(nonces.subspan(i * nonce_size, nonce_size));
+      if (!status.ok()) {
+        return status;
+      }
+    }
+    return Status::OkStatus();
+  }
 };
 
 }  // namespace asylo
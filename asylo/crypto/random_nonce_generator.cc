@@ -56,6 +56,24 @@ Status RandomNonceGenerator::NextNonce(absl::Span<uint8_t> nonce) {
   return Status::OkStatus();
 }
 
+Status RandomNonceGenerator::NextNonces(absl::Span<uint8_t> nonces,
+                                        size_t count) {
+  if (nonces.size() < count * nonce_size_) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid vector parameter size: ", nonces.size(),
+                               " (vector size must be >= ",
+                               count * nonce_size_, ")"));
+  }
+
+  // Random nonces are independent of each other, hence a batch of them is
+  // drawn with a single call.
+  if (count > 0 && RAND_bytes(nonces.data(), count * nonce_size_) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  absl::StrCat("RAND_bytes failed: ", BsslLastErrorString()));
+  }
+  return Status::OkStatus();
+}
+
 RandomNonceGenerator::RandomNonceGenerator(size_t size) : nonce_size_(size) {}
 
 }  // namespace asylo
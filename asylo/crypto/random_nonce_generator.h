@@ -41,6 +41,7 @@ class RandomNonceGenerator : public NonceGeneratorInterface {
   size_t NonceSize() const override;
 
   Status NextNonce(absl::Span<uint8_t> nonce) override;
+  Status NextNonces(absl::Span<uint8_t> nonces, size_t count) override;
 
  private:
   // Creates a RandomNonceGenerator that creates nonces of size |size|.
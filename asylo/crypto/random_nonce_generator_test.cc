@@ -84,5 +84,32 @@ TEST(RandomNonceGeneratorTest, RandomNonceGeneratorIncorrectNonceSize) {
               StatusIs(error::GoogleError::INVALID_ARGUMENT));
 }
 
+// Tests that a batch of nonces generated at once has no collisions.
+TEST(RandomNonceGeneratorTest, RandomNonceGeneratorBatchGeneratesNoCollisions) {
+  // See RandomNonceGeneratorGeneratesNoCollisions for the number of nonces.
+  std::unique_ptr<RandomNonceGenerator> nonce_generator =
+      RandomNonceGenerator::CreateAesGcmNonceGenerator();
+  std::vector<uint8_t> nonces(kNumberOfGeneratedNonces * kAesGcmNonceSize);
+  ASYLO_ASSERT_OK(nonce_generator->NextNonces(absl::MakeSpan(nonces),
+                                              kNumberOfGeneratedNonces));
+  absl::flat_hash_set<std::string> generated_nonces;
+  for (int j = 0; j < nonces.size(); j += kNoncePartSize) {
+    EXPECT_TRUE(
+        generated_nonces
+            .emplace(nonces.cbegin() + j, nonces.cbegin() + j + kNoncePartSize)
+            .second);
+  }
+}
+
+// Tests that NextNonces() returns a non-OK Status if it is given a buffer too
+// small for the nonces.
+TEST(RandomNonceGeneratorTest, RandomNonceGeneratorBatchIncorrectSize) {
+  std::unique_ptr<RandomNonceGenerator> nonce_generator =
+      RandomNonceGenerator::CreateAesGcmNonceGenerator();
+  std::vector<uint8_t> nonces(2 * kAesGcmNonceSize - 1);
+  EXPECT_THAT(nonce_generator->NextNonces(absl::MakeSpan(nonces), 2),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
 }  // namespace
 }  // namespace asylo
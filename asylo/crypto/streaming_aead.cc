@@ -0,0 +1,416 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/streaming_aead.h"
+
+#include <openssl/digest.h>
+#include <openssl/hkdf.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/crypto/util/bssl_util.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+constexpr size_t kAes128KeySize = 16;
+constexpr size_t kAes256KeySize = 32;
+
+// A nonce is made of the nonce prefix of the stream, the big-endian index of
+// the segment and a byte flagging the last segment.
+constexpr size_t kNoncePrefixSize = 7;
+constexpr size_t kNonceSize = kNoncePrefixSize + sizeof(uint32_t) + 1;
+constexpr size_t kTagSize = 16;
+
+// Segments are indexed with 32 bits.
+constexpr uint64_t kMaxSegments = UINT64_C(1) << 32;
+
+Status Truncated() {
+  return Status(error::GoogleError::DATA_LOSS, "Stream is truncated");
+}
+
+}  // namespace
+
+constexpr size_t StreamingAead::kDefaultSegmentSize;
+
+StatusOr<std::unique_ptr<StreamingAead>>
+StreamingAead::CreateAesGcmStreamingAead(ByteContainerView key,
+                                         size_t segment_size) {
+  if (key.size() != kAes128KeySize && key.size() != kAes256KeySize) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Invalid AES-GCM key length: ", key.size(),
+                               " (must be 16 or 32 bytes)"));
+  }
+  if (segment_size == 0) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Segment size must be positive");
+  }
+  return absl::WrapUnique(new StreamingAead(key, segment_size));
+}
+
+size_t StreamingAead::HeaderSize() const {
+  return key_.size() + kNoncePrefixSize;
+}
+
+size_t StreamingAead::SealedSegmentSize() const {
+  return segment_size_ + kTagSize;
+}
+
+uint64_t StreamingAead::CiphertextSize(uint64_t plaintext_size) const {
+  // A stream holds at least one segment, which may be empty.
+  uint64_t segments =
+      std::max<uint64_t>((plaintext_size + segment_size_ - 1) / segment_size_,
+                         1);
+  return HeaderSize() + plaintext_size + segments * kTagSize;
+}
+
+StatusOr<uint64_t> StreamingAead::PlaintextSize(
+    uint64_t ciphertext_size) const {
+  if (ciphertext_size < HeaderSize() + kTagSize) {
+    return Truncated();
+  }
+  const uint64_t segments_size = ciphertext_size - HeaderSize();
+  uint64_t segments = segments_size / SealedSegmentSize();
+  const uint64_t last_size = segments_size % SealedSegmentSize();
+  if (last_size > 0) {
+    if (last_size < kTagSize) {
+      return Truncated();
+    }
+    segments++;
+  }
+  return segments_size - segments * kTagSize;
+}
+
+StatusOr<std::unique_ptr<StreamingAeadEncryptor>> StreamingAead::NewEncryptor(
+    ByteContainerView associated_data) const {
+  std::vector<uint8_t> header(HeaderSize());
+  if (RAND_bytes(header.data(), header.size()) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  absl::StrCat("RAND_bytes failed: ", BsslLastErrorString()));
+  }
+  std::unique_ptr<AeadKey> key;
+  ASYLO_ASSIGN_OR_RETURN(
+      key, DeriveKey(ByteContainerView(header.data(), key_.size()),
+                     associated_data));
+  return absl::WrapUnique(
+      new StreamingAeadEncryptor(this, std::move(key), std::move(header)));
+}
+
+std::unique_ptr<StreamingAeadDecryptor> StreamingAead::NewDecryptor(
+    ByteContainerView associated_data) const {
+  return absl::WrapUnique(new StreamingAeadDecryptor(this, associated_data));
+}
+
+Status StreamingAead::Encrypt(uint64_t plaintext_size,
+                              const ReadFunction &read_plaintext,
+                              ByteContainerView associated_data,
+                              const AppendFunction &append_ciphertext) const {
+  std::unique_ptr<StreamingAeadEncryptor> encryptor;
+  ASYLO_ASSIGN_OR_RETURN(encryptor, NewEncryptor(associated_data));
+
+  CleansingVector<uint8_t> buffer(segment_size_);
+  std::vector<uint8_t> sealed;
+  uint64_t read_offset = 0;
+  while (read_offset < plaintext_size) {
+    size_t length =
+        std::min<uint64_t>(buffer.size(), plaintext_size - read_offset);
+    ASYLO_RETURN_IF_ERROR(
+        read_plaintext(read_offset, absl::MakeSpan(buffer.data(), length)));
+    read_offset += length;
+    sealed.clear();
+    ASYLO_RETURN_IF_ERROR(
+        encryptor->Update(ByteContainerView(buffer.data(), length), &sealed));
+    ASYLO_RETURN_IF_ERROR(append_ciphertext(sealed));
+  }
+  sealed.clear();
+  ASYLO_RETURN_IF_ERROR(encryptor->Finalize(&sealed));
+  return append_ciphertext(sealed);
+}
+
+Status StreamingAead::Decrypt(uint64_t ciphertext_size,
+                              const ReadFunction &read_ciphertext,
+                              ByteContainerView associated_data,
+                              const AppendFunction &append_plaintext) const {
+  std::unique_ptr<StreamingAeadDecryptor> decryptor =
+      NewDecryptor(associated_data);
+
+  std::vector<uint8_t> buffer(SealedSegmentSize());
+  CleansingVector<uint8_t> opened;
+  uint64_t read_offset = 0;
+  while (read_offset < ciphertext_size) {
+    size_t length =
+        std::min<uint64_t>(buffer.size(), ciphertext_size - read_offset);
+    ASYLO_RETURN_IF_ERROR(
+        read_ciphertext(read_offset, absl::MakeSpan(buffer.data(), length)));
+    read_offset += length;
+    opened.clear();
+    ASYLO_RETURN_IF_ERROR(
+        decryptor->Update(ByteContainerView(buffer.data(), length), &opened));
+    ASYLO_RETURN_IF_ERROR(append_plaintext(opened));
+  }
+  opened.clear();
+  ASYLO_RETURN_IF_ERROR(decryptor->Finalize(&opened));
+  return append_plaintext(opened);
+}
+
+StatusOr<size_t> StreamingAead::DecryptRange(
+    uint64_t ciphertext_size, const ReadFunction &read_ciphertext,
+    ByteContainerView associated_data, uint64_t offset,
+    absl::Span<uint8_t> plaintext) const {
+  uint64_t plaintext_size;
+  ASYLO_ASSIGN_OR_RETURN(plaintext_size, PlaintextSize(ciphertext_size));
+  if (offset >= plaintext_size || plaintext.empty()) {
+    return 0;
+  }
+
+  std::vector<uint8_t> header(HeaderSize());
+  ASYLO_RETURN_IF_ERROR(read_ciphertext(0, absl::MakeSpan(header)));
+  const ByteContainerView nonce_prefix(header.data() + key_.size(),
+                                       kNoncePrefixSize);
+  std::unique_ptr<AeadKey> key;
+  ASYLO_ASSIGN_OR_RETURN(
+      key, DeriveKey(ByteContainerView(header.data(), key_.size()),
+                     associated_data));
+
+  const uint64_t end =
+      std::min<uint64_t>(offset + plaintext.size(), plaintext_size);
+  const uint64_t last_segment =
+      plaintext_size == 0 ? 0 : (plaintext_size - 1) / segment_size_;
+  if (last_segment >= kMaxSegments) {
+    return Status(error::GoogleError::DATA_LOSS,
+                  "Stream exceeds the maximum number of segments");
+  }
+  std::vector<uint8_t> sealed(SealedSegmentSize());
+  CleansingVector<uint8_t> opened(SealedSegmentSize());
+  uint8_t nonce[kNonceSize];
+  size_t read = 0;
+  for (uint64_t segment = offset / segment_size_; segment * segment_size_ < end;
+       segment++) {
+    const uint64_t sealed_offset = HeaderSize() + segment * SealedSegmentSize();
+    const size_t sealed_size = std::min<uint64_t>(
+        SealedSegmentSize(), ciphertext_size - sealed_offset);
+    ASYLO_RETURN_IF_ERROR(read_ciphertext(
+        sealed_offset, absl::MakeSpan(sealed.data(), sealed_size)));
+    SegmentNonce(nonce_prefix, segment, segment == last_segment,
+                 absl::MakeSpan(nonce));
+    size_t opened_size;
+    if (!key->Open(ByteContainerView(sealed.data(), sealed_size),
+                   /*associated_data=*/"", nonce, absl::MakeSpan(opened),
+                   &opened_size)
+             .ok()) {
+      return Status(
+          error::GoogleError::DATA_LOSS,
+          absl::StrCat("Segment ", segment, " failed authentication"));
+    }
+
+    const uint64_t segment_begin = segment * segment_size_;
+    const uint64_t copy_begin = std::max(offset, segment_begin);
+    const uint64_t copy_end = std::min(end, segment_begin + opened_size);
+    std::copy(opened.begin() + (copy_begin - segment_begin),
+              opened.begin() + (copy_end - segment_begin),
+              plaintext.begin() + read);
+    read += copy_end - copy_begin;
+  }
+  return read;
+}
+
+StreamingAead::StreamingAead(ByteContainerView key, size_t segment_size)
+    : key_(key.begin(), key.end()), segment_size_(segment_size) {}
+
+StatusOr<std::unique_ptr<AeadKey>> StreamingAead::DeriveKey(
+    ByteContainerView salt, ByteContainerView associated_data) const {
+  CleansingVector<uint8_t> stream_key(key_.size());
+  if (HKDF(stream_key.data(), stream_key.size(), EVP_sha256(), key_.data(),
+           key_.size(), salt.data(), salt.size(), associated_data.data(),
+           associated_data.size()) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  absl::StrCat("HKDF failed: ", BsslLastErrorString()));
+  }
+  return AeadKey::CreateAesGcmKey(stream_key);
+}
+
+void StreamingAead::SegmentNonce(ByteContainerView nonce_prefix,
+                                 uint32_t index, bool last,
+                                 absl::Span<uint8_t> nonce) const {
+  std::copy(nonce_prefix.begin(), nonce_prefix.end(), nonce.begin());
+  for (int i = 0; i < 4; i++) {
+    nonce[kNoncePrefixSize + i] = index >> (24 - 8 * i);
+  }
+  nonce[kNonceSize - 1] = last ? 1 : 0;
+}
+
+StreamingAeadEncryptor::StreamingAeadEncryptor(const StreamingAead *aead,
+                                               std::unique_ptr<AeadKey> key,
+                                               std::vector<uint8_t> header)
+    : aead_(aead),
+      key_(std::move(key)),
+      header_(std::move(header)),
+      header_written_(false),
+      finalized_(false),
+      segment_index_(0) {
+  buffer_.reserve(aead_->segment_size_);
+}
+
+Status StreamingAeadEncryptor::Update(ByteContainerView plaintext,
+                                      std::vector<uint8_t> *ciphertext) {
+  if (finalized_) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Stream is already finalized");
+  }
+  if (!header_written_) {
+    ciphertext->insert(ciphertext->end(), header_.begin(), header_.end());
+    header_written_ = true;
+  }
+
+  // A full segment is only sealed once more plaintext follows, since the last
+  // segment of the stream is sealed differently.
+  const uint8_t *data = plaintext.data();
+  size_t size = plaintext.size();
+  while (size > 0) {
+    if (buffer_.size() == aead_->segment_size_) {
+      ASYLO_RETURN_IF_ERROR(SealSegment(/*last=*/false, ciphertext));
+    }
+    size_t length = std::min(size, aead_->segment_size_ - buffer_.size());
+    buffer_.insert(buffer_.end(), data, data + length);
+    data += length;
+    size -= length;
+  }
+  return Status::OkStatus();
+}
+
+Status StreamingAeadEncryptor::Finalize(std::vector<uint8_t> *ciphertext) {
+  ASYLO_RETURN_IF_ERROR(Update(/*plaintext=*/"", ciphertext));
+  ASYLO_RETURN_IF_ERROR(SealSegment(/*last=*/true, ciphertext));
+  finalized_ = true;
+  return Status::OkStatus();
+}
+
+Status StreamingAeadEncryptor::SealSegment(bool last,
+                                           std::vector<uint8_t> *ciphertext) {
+  if (segment_index_ >= kMaxSegments) {
+    return Status(error::GoogleError::OUT_OF_RANGE,
+                  "Stream exceeds the maximum number of segments");
+  }
+  uint8_t nonce[kNonceSize];
+  aead_->SegmentNonce(
+      ByteContainerView(header_.data() + aead_->key_.size(), kNoncePrefixSize),
+      segment_index_, last, absl::MakeSpan(nonce));
+
+  const size_t offset = ciphertext->size();
+  ciphertext->resize(offset + buffer_.size() + kTagSize);
+  size_t sealed_size;
+  ASYLO_RETURN_IF_ERROR(key_->Seal(
+      buffer_, /*associated_data=*/"", nonce,
+      absl::MakeSpan(ciphertext->data() + offset, ciphertext->size() - offset),
+      &sealed_size));
+  ciphertext->resize(offset + sealed_size);
+  buffer_.clear();
+  segment_index_++;
+  return Status::OkStatus();
+}
+
+StreamingAeadDecryptor::StreamingAeadDecryptor(
+    const StreamingAead *aead, ByteContainerView associated_data)
+    : aead_(aead),
+      associated_data_(associated_data.begin(), associated_data.end()),
+      finalized_(false),
+      segment_index_(0) {}
+
+Status StreamingAeadDecryptor::Update(ByteContainerView ciphertext,
+                                      CleansingVector<uint8_t> *plaintext) {
+  if (finalized_) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Stream is already finalized");
+  }
+  buffer_.insert(buffer_.end(), ciphertext.begin(), ciphertext.end());
+
+  if (!key_) {
+    if (buffer_.size() < aead_->HeaderSize()) {
+      return Status::OkStatus();
+    }
+    const size_t salt_size = aead_->key_.size();
+    ASYLO_ASSIGN_OR_RETURN(
+        key_, aead_->DeriveKey(ByteContainerView(buffer_.data(), salt_size),
+                               associated_data_));
+    nonce_prefix_.assign(buffer_.begin() + salt_size,
+                         buffer_.begin() + aead_->HeaderSize());
+    buffer_.erase(buffer_.begin(), buffer_.begin() + aead_->HeaderSize());
+  }
+
+  // A full segment is only opened once more ciphertext follows, since it may
+  // be the last segment of the stream.
+  size_t opened = 0;
+  while (buffer_.size() - opened > aead_->SealedSegmentSize()) {
+    ASYLO_RETURN_IF_ERROR(OpenSegment(opened, /*last=*/false, plaintext));
+    opened += aead_->SealedSegmentSize();
+  }
+  buffer_.erase(buffer_.begin(), buffer_.begin() + opened);
+  return Status::OkStatus();
+}
+
+Status StreamingAeadDecryptor::Finalize(CleansingVector<uint8_t> *plaintext) {
+  if (finalized_) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Stream is already finalized");
+  }
+  if (!key_ || buffer_.size() < kTagSize) {
+    return Truncated();
+  }
+  ASYLO_RETURN_IF_ERROR(OpenSegment(/*offset=*/0, /*last=*/true, plaintext));
+  buffer_.clear();
+  finalized_ = true;
+  return Status::OkStatus();
+}
+
+Status StreamingAeadDecryptor::OpenSegment(
+    size_t offset, bool last, CleansingVector<uint8_t> *plaintext) {
+  if (segment_index_ >= kMaxSegments) {
+    return Status(error::GoogleError::OUT_OF_RANGE,
+                  "Stream exceeds the maximum number of segments");
+  }
+  uint8_t nonce[kNonceSize];
+  aead_->SegmentNonce(nonce_prefix_, segment_index_, last,
+                      absl::MakeSpan(nonce));
+
+  const size_t sealed_size =
+      std::min(buffer_.size() - offset, aead_->SealedSegmentSize());
+  const size_t plaintext_offset = plaintext->size();
+  plaintext->resize(plaintext_offset + sealed_size);
+  size_t opened_size;
+  Status status = key_->Open(
+      ByteContainerView(buffer_.data() + offset, sealed_size),
+      /*associated_data=*/"", nonce,
+      absl::MakeSpan(plaintext->data() + plaintext_offset, sealed_size),
+      &opened_size);
+  if (!status.ok()) {
+    plaintext->resize(plaintext_offset);
+    return Status(error::GoogleError::DATA_LOSS,
+                  absl::StrCat("Segment ", segment_index_,
+                               " failed authentication"));
+  }
+  plaintext->resize(plaintext_offset + opened_size);
+  segment_index_++;
+  return Status::OkStatus();
+}
+
+}  // namespace asylo
@@ -0,0 +1,223 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_CRYPTO_STREAMING_AEAD_H_
+#define ASYLO_CRYPTO_STREAMING_AEAD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "asylo/crypto/aead_key.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+class StreamingAeadEncryptor;
+class StreamingAeadDecryptor;
+
+/// A streaming AEAD that seals payloads of any size, without holding more than
+/// a segment of the payload in memory at a time.
+///
+/// The payload is split into segments of a fixed size, each of which is
+/// sealed with AES-GCM. A stream starts with a header holding a random salt
+/// and a random nonce prefix. The key of the stream is derived with HKDF-SHA256
+/// from the key of the StreamingAead, the salt and the associated data of the
+/// stream, and the nonce of segment `i` is the nonce prefix followed by `i`
+/// and a flag marking the last segment. Reordering, truncating or extending
+/// the segments of a stream therefore fails authentication.
+///
+/// Decryption releases the plaintext of a segment as soon as the segment is
+/// authenticated, before the rest of the stream is. Callers must not act on
+/// the plaintext until StreamingAeadDecryptor::Finalize() succeeds, which
+/// authenticates the end of the stream.
+class StreamingAead {
+ public:
+  /// Default size of the plaintext of a segment.
+  static constexpr size_t kDefaultSegmentSize = 64 * 1024;
+
+  /// Creates a streaming AEAD using AES-GCM with a key of the size of `key`,
+  /// which must be 16 or 32 bytes, and plaintext segments of `segment_size`
+  /// bytes.
+  ///
+  /// \param key The key from which the keys of streams are derived.
+  /// \param segment_size The size of the plaintext of a segment.
+  /// \return The created streaming AEAD, or a non-OK Status if creation
+  ///         failed.
+  static StatusOr<std::unique_ptr<StreamingAead>> CreateAesGcmStreamingAead(
+      ByteContainerView key, size_t segment_size = kDefaultSegmentSize);
+
+  /// Gets the size of the header of a stream.
+  size_t HeaderSize() const;
+
+  /// Gets the size of the plaintext of a segment.
+  size_t SegmentSize() const { return segment_size_; }
+
+  /// Gets the size of a sealed segment.
+  size_t SealedSegmentSize() const;
+
+  /// Gets the size of the stream sealing `plaintext_size` bytes.
+  uint64_t CiphertextSize(uint64_t plaintext_size) const;
+
+  /// Gets the size of the payload of a stream of `ciphertext_size` bytes, or a
+  /// non-OK Status if no stream has that size.
+  StatusOr<uint64_t> PlaintextSize(uint64_t ciphertext_size) const;
+
+  /// Starts sealing a stream with `associated_data`.
+  StatusOr<std::unique_ptr<StreamingAeadEncryptor>> NewEncryptor(
+      ByteContainerView associated_data) const;
+
+  /// Starts opening a stream sealed with `associated_data`.
+  std::unique_ptr<StreamingAeadDecryptor> NewDecryptor(
+      ByteContainerView associated_data) const;
+
+  /// Reads `buffer.size()` bytes at `offset` of a source into `buffer`.
+  using ReadFunction =
+      std::function<Status(uint64_t offset, absl::Span<uint8_t> buffer)>;
+
+  /// Appends `data` to a sink.
+  using AppendFunction = std::function<Status(ByteContainerView data)>;
+
+  /// Seals the `plaintext_size` bytes of a payload read with `read_plaintext`,
+  /// passing the stream to `append_ciphertext` in order.
+  Status Encrypt(uint64_t plaintext_size, const ReadFunction &read_plaintext,
+                 ByteContainerView associated_data,
+                 const AppendFunction &append_ciphertext) const;
+
+  /// Opens the stream of `ciphertext_size` bytes read with `read_ciphertext`,
+  /// passing the payload to `append_plaintext` in order. On failure,
+  /// `append_plaintext` may have received part of the payload, which must not
+  /// be used.
+  Status Decrypt(uint64_t ciphertext_size, const ReadFunction &read_ciphertext,
+                 ByteContainerView associated_data,
+                 const AppendFunction &append_plaintext) const;
+
+  /// Opens `plaintext.size()` bytes at `offset` of the payload of the stream
+  /// of `ciphertext_size` bytes read with `read_ciphertext`, reading only the
+  /// segments that hold them. The segments read are authenticated, including
+  /// the last segment if the range reaches the end of the payload.
+  ///
+  /// \return The number of bytes read, which is less than `plaintext.size()`
+  ///         if the payload ends first, or a non-OK Status if a segment fails
+  ///         to open.
+  StatusOr<size_t> DecryptRange(uint64_t ciphertext_size,
+                                const ReadFunction &read_ciphertext,
+                                ByteContainerView associated_data,
+                                uint64_t offset,
+                                absl::Span<uint8_t> plaintext) const;
+
+ private:
+  friend class StreamingAeadEncryptor;
+  friend class StreamingAeadDecryptor;
+
+  StreamingAead(ByteContainerView key, size_t segment_size);
+
+  // Derives the key of a stream from the |salt| of its header and its
+  // |associated_data|.
+  StatusOr<std::unique_ptr<AeadKey>> DeriveKey(
+      ByteContainerView salt, ByteContainerView associated_data) const;
+
+  // Writes the nonce of segment |index| of a stream with |nonce_prefix| to
+  // |nonce|.
+  void SegmentNonce(ByteContainerView nonce_prefix, uint32_t index, bool last,
+                    absl::Span<uint8_t> nonce) const;
+
+  const CleansingVector<uint8_t> key_;
+  const size_t segment_size_;
+};
+
+/// Seals a stream incrementally. Obtained from StreamingAead::NewEncryptor().
+class StreamingAeadEncryptor {
+ public:
+  /// Seals `plaintext` as the next part of the payload, appending the header
+  /// and the segments completed so far to `ciphertext`.
+  Status Update(ByteContainerView plaintext, std::vector<uint8_t> *ciphertext);
+
+  /// Seals the rest of the payload as the last segment and appends it to
+  /// `ciphertext`. No other method may be called afterwards.
+  Status Finalize(std::vector<uint8_t> *ciphertext);
+
+ private:
+  friend class StreamingAead;
+
+  StreamingAeadEncryptor(const StreamingAead *aead,
+                         std::unique_ptr<AeadKey> key,
+                         std::vector<uint8_t> header);
+
+  // Seals the buffered plaintext as the next segment.
+  Status SealSegment(bool last, std::vector<uint8_t> *ciphertext);
+
+  const StreamingAead *const aead_;
+  const std::unique_ptr<AeadKey> key_;
+  std::vector<uint8_t> header_;
+  bool header_written_;
+  bool finalized_;
+  uint64_t segment_index_;
+
+  // Plaintext of the next segment.
+  CleansingVector<uint8_t> buffer_;
+};
+
+/// Opens a stream incrementally. Obtained from StreamingAead::NewDecryptor().
+class StreamingAeadDecryptor {
+ public:
+  /// Consumes `ciphertext` as the next part of the stream, appending the
+  /// plaintext of the segments opened so far to `plaintext`. The last segment
+  /// is only opened by Finalize().
+  Status Update(ByteContainerView ciphertext,
+                CleansingVector<uint8_t> *plaintext);
+
+  /// Opens the last segment of the stream and appends its plaintext to
+  /// `plaintext`. Fails if the stream is truncated. No other method may be
+  /// called afterwards.
+  Status Finalize(CleansingVector<uint8_t> *plaintext);
+
+ private:
+  friend class StreamingAead;
+
+  StreamingAeadDecryptor(const StreamingAead *aead,
+                         ByteContainerView associated_data);
+
+  // Opens the segment at |offset| of the buffer, which is either a full
+  // segment or the rest of the buffer.
+  Status OpenSegment(size_t offset, bool last,
+                     CleansingVector<uint8_t> *plaintext);
+
+  const StreamingAead *const aead_;
+  const std::vector<uint8_t> associated_data_;
+
+  // Set once the header has been read.
+  std::unique_ptr<AeadKey> key_;
+  std::vector<uint8_t> nonce_prefix_;
+
+  bool finalized_;
+  uint64_t segment_index_;
+
+  // Header or segments not opened yet.
+  std::vector<uint8_t> buffer_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_CRYPTO_STREAMING_AEAD_H_
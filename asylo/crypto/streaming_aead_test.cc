@@ -0,0 +1,263 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/crypto/streaming_aead.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/types/span.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Not;
+
+constexpr char kKey[] = "0123456789abcdef0123456789abcdef";
+constexpr char kAssociatedData[] = "associated data";
+constexpr size_t kSegmentSize = 64;
+
+// Returns a function reading from |data|.
+StreamingAead::ReadFunction ReaderOf(const std::vector<uint8_t> *data) {
+  return [data](uint64_t offset, absl::Span<uint8_t> buffer) {
+    if (offset + buffer.size() > data->size()) {
+      return Status(error::GoogleError::OUT_OF_RANGE, "Read past end");
+    }
+    std::copy(data->begin() + offset, data->begin() + offset + buffer.size(),
+              buffer.begin());
+    return Status::OkStatus();
+  };
+}
+
+// Returns a function appending to |data|.
+StreamingAead::AppendFunction AppenderTo(std::vector<uint8_t> *data) {
+  return [data](ByteContainerView appended) {
+    data->insert(data->end(), appended.begin(), appended.end());
+    return Status::OkStatus();
+  };
+}
+
+std::vector<uint8_t> Payload(size_t size) {
+  std::vector<uint8_t> payload(size);
+  for (size_t i = 0; i < size; i++) {
+    payload[i] = i * 31 + 7;
+  }
+  return payload;
+}
+
+class StreamingAeadTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        aead_, StreamingAead::CreateAesGcmStreamingAead(
+                   ByteContainerView(kKey, 32), kSegmentSize));
+  }
+
+  // Seals |payload|, passing it to the encryptor in chunks of |chunk_size|.
+  std::vector<uint8_t> Seal(const std::vector<uint8_t> &payload,
+                            size_t chunk_size) {
+    std::unique_ptr<StreamingAeadEncryptor> encryptor;
+    auto encryptor_result = aead_->NewEncryptor(kAssociatedData);
+    EXPECT_THAT(encryptor_result, IsOk());
+    encryptor = std::move(encryptor_result).ValueOrDie();
+    std::vector<uint8_t> ciphertext;
+    for (size_t offset = 0; offset < payload.size(); offset += chunk_size) {
+      size_t length = std::min(chunk_size, payload.size() - offset);
+      EXPECT_THAT(encryptor->Update(
+                      ByteContainerView(payload.data() + offset, length),
+                      &ciphertext),
+                  IsOk());
+    }
+    EXPECT_THAT(encryptor->Finalize(&ciphertext), IsOk());
+    return ciphertext;
+  }
+
+  // Opens |ciphertext|, passing it to the decryptor in chunks of |chunk_size|.
+  Status Open(const std::vector<uint8_t> &ciphertext, size_t chunk_size,
+              ByteContainerView associated_data,
+              CleansingVector<uint8_t> *plaintext) {
+    std::unique_ptr<StreamingAeadDecryptor> decryptor =
+        aead_->NewDecryptor(associated_data);
+    for (size_t offset = 0; offset < ciphertext.size(); offset += chunk_size) {
+      size_t length = std::min(chunk_size, ciphertext.size() - offset);
+      ASYLO_RETURN_IF_ERROR(decryptor->Update(
+          ByteContainerView(ciphertext.data() + offset, length), plaintext));
+    }
+    return decryptor->Finalize(plaintext);
+  }
+
+  std::unique_ptr<StreamingAead> aead_;
+};
+
+TEST_F(StreamingAeadTest, RejectsInvalidArguments) {
+  EXPECT_THAT(StreamingAead::CreateAesGcmStreamingAead(
+                  ByteContainerView(kKey, 24), kSegmentSize)
+                  .status(),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(StreamingAead::CreateAesGcmStreamingAead(
+                  ByteContainerView(kKey, 16), /*segment_size=*/0)
+                  .status(),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST_F(StreamingAeadTest, RoundTrip) {
+  const std::vector<size_t> sizes = {0,
+                                     1,
+                                     kSegmentSize - 1,
+                                     kSegmentSize,
+                                     kSegmentSize + 1,
+                                     3 * kSegmentSize,
+                                     10 * kSegmentSize + 5};
+  const std::vector<size_t> chunk_sizes = {1, 7, kSegmentSize, 1000};
+  for (size_t size : sizes) {
+    for (size_t chunk_size : chunk_sizes) {
+      SCOPED_TRACE(testing::Message() << size << " bytes in chunks of "
+                                      << chunk_size);
+      std::vector<uint8_t> payload = Payload(size);
+      std::vector<uint8_t> ciphertext = Seal(payload, chunk_size);
+      EXPECT_THAT(ciphertext.size(), Eq(aead_->CiphertextSize(size)));
+      EXPECT_THAT(aead_->PlaintextSize(ciphertext.size()), IsOkAndHolds(size));
+
+      CleansingVector<uint8_t> plaintext;
+      ASYLO_ASSERT_OK(Open(ciphertext, chunk_size, kAssociatedData,
+                           &plaintext));
+      EXPECT_THAT(ByteContainerView(plaintext),
+                  Eq(ByteContainerView(payload)));
+    }
+  }
+}
+
+TEST_F(StreamingAeadTest, StreamsAreIndependent) {
+  std::vector<uint8_t> payload = Payload(kSegmentSize);
+  EXPECT_THAT(Seal(payload, kSegmentSize),
+              Not(Eq(Seal(payload, kSegmentSize))));
+}
+
+TEST_F(StreamingAeadTest, RejectsWrongAssociatedData) {
+  std::vector<uint8_t> ciphertext = Seal(Payload(100), 100);
+  CleansingVector<uint8_t> plaintext;
+  EXPECT_THAT(Open(ciphertext, 100, "other data", &plaintext),
+              StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+TEST_F(StreamingAeadTest, RejectsTruncatedStream) {
+  const size_t size = 3 * kSegmentSize;
+  std::vector<uint8_t> ciphertext = Seal(Payload(size), size);
+
+  // Drop the last segment, which leaves a stream of full segments.
+  ciphertext.resize(ciphertext.size() - aead_->SealedSegmentSize());
+  CleansingVector<uint8_t> plaintext;
+  EXPECT_THAT(Open(ciphertext, ciphertext.size(), kAssociatedData, &plaintext),
+              StatusIs(error::GoogleError::DATA_LOSS));
+
+  // Drop everything but the header.
+  ciphertext.resize(aead_->HeaderSize());
+  plaintext.clear();
+  EXPECT_THAT(Open(ciphertext, ciphertext.size(), kAssociatedData, &plaintext),
+              StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+TEST_F(StreamingAeadTest, RejectsExtendedStream) {
+  const size_t size = kSegmentSize + 10;
+  std::vector<uint8_t> ciphertext = Seal(Payload(size), size);
+  std::vector<uint8_t> other = Seal(Payload(size), size);
+
+  // Append the last segment of another stream.
+  ciphertext.insert(ciphertext.end(),
+                    other.begin() + aead_->HeaderSize() +
+                        aead_->SealedSegmentSize(),
+                    other.end());
+  CleansingVector<uint8_t> plaintext;
+  EXPECT_THAT(Open(ciphertext, ciphertext.size(), kAssociatedData, &plaintext),
+              StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+TEST_F(StreamingAeadTest, RejectsReorderedSegments) {
+  const size_t size = 3 * kSegmentSize;
+  std::vector<uint8_t> ciphertext = Seal(Payload(size), size);
+  auto first = ciphertext.begin() + aead_->HeaderSize();
+  std::swap_ranges(first, first + aead_->SealedSegmentSize(),
+                   first + aead_->SealedSegmentSize());
+  CleansingVector<uint8_t> plaintext;
+  EXPECT_THAT(Open(ciphertext, ciphertext.size(), kAssociatedData, &plaintext),
+              StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+TEST_F(StreamingAeadTest, EncryptsThroughCallbacks) {
+  std::vector<uint8_t> payload = Payload(20 * kSegmentSize + 17);
+  std::vector<uint8_t> sealed;
+  ASYLO_ASSERT_OK(aead_->Encrypt(payload.size(), ReaderOf(&payload),
+                                 kAssociatedData, AppenderTo(&sealed)));
+  EXPECT_THAT(sealed.size(), Eq(aead_->CiphertextSize(payload.size())));
+
+  std::vector<uint8_t> opened;
+  ASYLO_ASSERT_OK(aead_->Decrypt(sealed.size(), ReaderOf(&sealed),
+                                 kAssociatedData, AppenderTo(&opened)));
+  EXPECT_THAT(opened, Eq(payload));
+
+  sealed[sealed.size() / 2] ^= 1;
+  opened.clear();
+  EXPECT_THAT(aead_->Decrypt(sealed.size(), ReaderOf(&sealed),
+                             kAssociatedData, AppenderTo(&opened)),
+              StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+TEST_F(StreamingAeadTest, DecryptsRanges) {
+  std::vector<uint8_t> payload = Payload(5 * kSegmentSize + 9);
+  std::vector<uint8_t> sealed = Seal(payload, payload.size());
+
+  for (uint64_t offset : {0, 1, 63, 64, 100, 320, 328}) {
+    for (size_t length : {1, 10, 64, 200, 1000}) {
+      SCOPED_TRACE(testing::Message() << length << " bytes at " << offset);
+      std::vector<uint8_t> buffer(length);
+      size_t expected = std::min<size_t>(length, payload.size() - offset);
+      EXPECT_THAT(
+          aead_->DecryptRange(sealed.size(), ReaderOf(&sealed),
+                              kAssociatedData, offset, absl::MakeSpan(buffer)),
+          IsOkAndHolds(expected));
+      EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + expected,
+                             payload.begin() + offset));
+    }
+  }
+  std::vector<uint8_t> buffer(10);
+  EXPECT_THAT(aead_->DecryptRange(sealed.size(), ReaderOf(&sealed),
+                                  kAssociatedData, payload.size(),
+                                  absl::MakeSpan(buffer)),
+              IsOkAndHolds(0));
+
+  // Only the segments read are authenticated.
+  sealed[aead_->HeaderSize() + 2 * aead_->SealedSegmentSize()] ^= 1;
+  EXPECT_THAT(aead_->DecryptRange(sealed.size(), ReaderOf(&sealed),
+                                  kAssociatedData, 0, absl::MakeSpan(buffer)),
+              IsOkAndHolds(10));
+  EXPECT_THAT(aead_->DecryptRange(sealed.size(), ReaderOf(&sealed),
+                                  kAssociatedData, 2 * kSegmentSize,
+                                  absl::MakeSpan(buffer)),
+              StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+}  // namespace
+}  // namespace asylo
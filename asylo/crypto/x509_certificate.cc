@@ -249,31 +249,6 @@ std::vector<char> ToCharVector(absl::string_view str) {
   return vec;
 }
 
-// Converts |asn1_time| to an absl::Time.
-StatusOr<absl::Time> AbslTimeFromAsn1Time(const ASN1_TIME &asn1_time) {
-  constexpr absl::Duration kOneDay = absl::Hours(24);
-
-  static absl::once_flag once_init;
-  static ASN1_TIME *unix_epoch;
-  absl::call_once(once_init, [] {
-    unix_epoch = ASN1_TIME_new();
-    CHECK_NE(ASN1_TIME_set(unix_epoch, 0), nullptr) << BsslLastErrorString();
-  });
-
-  int num_days;
-  int num_seconds;
-  if (ASN1_TIME_diff(&num_days, &num_seconds, unix_epoch, &asn1_time) != 1) {
-    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
-  }
-  absl::Time time =
-      absl::UnixEpoch() + num_days * kOneDay + absl::Seconds(num_seconds);
-  if (time == absl::InfinitePast() || time == absl::InfiniteFuture()) {
-    return Status(error::GoogleError::OUT_OF_RANGE,
-                  "Time is too large or too small");
-  }
-  return time;
-}
-
 // Converts |time| to an ASN1_TIME.
 StatusOr<bssl::UniquePtr<ASN1_TIME>> Asn1TimeFromAbslTime(absl::Time time) {
   intmax_t unix_seconds = absl::ToUnixSeconds(time);
@@ -603,6 +578,30 @@ Status AddExtensions(absl::Span<const X509Extension> extensions, X509 *x509) {
 
 }  // namespace
 
+StatusOr<absl::Time> AbslTimeFromAsn1Time(const ASN1_TIME &asn1_time) {
+  constexpr absl::Duration kOneDay = absl::Hours(24);
+
+  static absl::once_flag once_init;
+  static ASN1_TIME *unix_epoch;
+  absl::call_once(once_init, [] {
+    unix_epoch = ASN1_TIME_new();
+    CHECK_NE(ASN1_TIME_set(unix_epoch, 0), nullptr) << BsslLastErrorString();
+  });
+
+  int num_days;
+  int num_seconds;
+  if (ASN1_TIME_diff(&num_days, &num_seconds, unix_epoch, &asn1_time) != 1) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+  absl::Time time =
+      absl::UnixEpoch() + num_days * kOneDay + absl::Seconds(num_seconds);
+  if (time == absl::InfinitePast() || time == absl::InfiniteFuture()) {
+    return Status(error::GoogleError::OUT_OF_RANGE,
+                  "Time is too large or too small");
+  }
+  return time;
+}
+
 bool operator==(const X509NameEntry &lhs, const X509NameEntry &rhs) {
   return lhs.field == rhs.field && lhs.value == rhs.value;
 }
@@ -1094,6 +1093,22 @@ StatusOr<std::vector<X509Extension>> X509Certificate::GetOtherExtensions()
   return extensions;
 }
 
+StatusOr<absl::optional<std::vector<uint8_t>>>
+X509Certificate::GetExtensionValue(const ObjectId &oid) const {
+  int index = X509_get_ext_by_OBJ(x509_.get(), &oid.GetBsslObject(),
+                                  /*lastpos=*/-1);
+  if (index == -1) {
+    return absl::nullopt;
+  }
+  X509_EXTENSION *extension = X509_get_ext(x509_.get(), index);
+  if (extension == nullptr) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+  const ASN1_OCTET_STRING *data = X509_EXTENSION_get_data(extension);
+  const uint8_t *value = ASN1_STRING_get0_data(data);
+  return std::vector<uint8_t>(value, value + ASN1_STRING_length(data));
+}
+
 X509Certificate::X509Certificate(bssl::UniquePtr<X509> x509)
     : x509_(std::move(x509)) {}
 
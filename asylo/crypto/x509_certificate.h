@@ -267,6 +267,12 @@ class X509Certificate : public CertificateInterface {
   // extracted by other methods of X509Certificate.
   StatusOr<std::vector<X509Extension>> GetOtherExtensions() const;
 
+  // Returns the DER encoding of the value of the extension with OID |oid|, or
+  // absl::nullopt if the certificate does not have such an extension. Unlike
+  // GetOtherExtensions(), this does not build an Asn1Value of the extension.
+  StatusOr<absl::optional<std::vector<uint8_t>>> GetExtensionValue(
+      const ObjectId &oid) const;
+
  private:
   friend struct X509CertificateBuilder;
 
@@ -298,6 +304,10 @@ class X509Certificate : public CertificateInterface {
   bssl::UniquePtr<X509> x509_;
 };
 
+// Converts |asn1_time| to an absl::Time. Returns an OUT_OF_RANGE error if the
+// time cannot be represented.
+StatusOr<absl::Time> AbslTimeFromAsn1Time(const ASN1_TIME &asn1_time);
+
 // Creates and returns an X509_REQ object equivalent to the data in |csr|.
 // Returns a non-OK Status if the certificate signing request could not be
 // transformed to the equivalent X509_REQ object.
@@ -895,6 +895,12 @@ TEST_F(X509CertificateTest, SignAndBuildSucceedsWithExtensions) {
                 Eq(builder.other_extensions[i].is_critical));
     EXPECT_THAT(final_extensions[i].value,
                 Eq(builder.other_extensions[i].value));
+
+    std::vector<uint8_t> value_der;
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        value_der, builder.other_extensions[i].value.SerializeToDer());
+    EXPECT_THAT(certificate->GetExtensionValue(builder.other_extensions[i].oid),
+                IsOkAndHolds(Optional(Eq(value_der))));
   }
 }
 
@@ -952,6 +958,10 @@ TEST_F(X509CertificateTest, SignAndBuildSucceedsWithoutExtensions) {
   EXPECT_THAT(certificate->GetCrlDistributionPoints(), IsOkAndHolds(Nullopt()));
 
   EXPECT_THAT(certificate->GetOtherExtensions(), IsOkAndHolds(IsEmpty()));
+
+  ObjectId oid;
+  ASYLO_ASSERT_OK_AND_ASSIGN(oid, ObjectId::CreateFromOidString("1.2.3.4.5"));
+  EXPECT_THAT(certificate->GetExtensionValue(oid), IsOkAndHolds(Nullopt()));
 }
 
 TEST_F(X509CertificateTest, SignAndBuildFailsWithMissingFields) {
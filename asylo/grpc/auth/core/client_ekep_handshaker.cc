@@ -26,6 +26,7 @@
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
 #include "asylo/crypto/sha256_hash.h"
 #include "asylo/util/logging.h"
 #include "asylo/grpc/auth/core/ekep_crypto.h"
@@ -54,9 +55,14 @@ ClientEkepHandshaker::ClientEkepHandshaker(const EkepHandshakerOptions &options)
       self_assertions_(options.self_assertions),
       accepted_peer_assertions_(options.accepted_peer_assertions),
       available_cipher_suites_({CURVE25519_SHA256}),
-      available_record_protocols_({ALTSRP_AES128_GCM}),
+      available_record_protocols_(options.record_protocols),
+      max_protected_frame_size_(options.max_protected_frame_size),
       available_ekep_versions_({"EKEP v1"}),
       additional_authenticated_data_(options.additional_authenticated_data),
+      ticket_cache_(options.resumption.ticket_cache),
+      peer_name_(options.resumption.peer_name),
+      session_offered_(false),
+      session_resumed_(false),
       selected_cipher_suite_(UNKNOWN_HANDSHAKE_CIPHER),
       selected_record_protocol_(UNKNOWN_RECORD_PROTOCOL),
       expected_message_type_(SERVER_PRECOMMIT),
@@ -219,6 +225,19 @@ Status ClientEkepHandshaker::HandleServerPrecommit(
                                ProtoEnumValueName(record_protocol)));
   }
 
+  // Verify that the server did not select a larger frame size than the client
+  // proposed.
+  uint32_t max_protected_frame_size =
+      server_precommit.max_protected_frame_size();
+  if (max_protected_frame_size != 0 &&
+      (max_protected_frame_size_ == 0 ||
+       max_protected_frame_size > max_protected_frame_size_)) {
+    return Status(Abort::PROTOCOL_ERROR,
+                  absl::StrCat("Selected max protected frame size is invalid: ",
+                               max_protected_frame_size));
+  }
+  SetMaxProtectedFrameSize(max_protected_frame_size);
+
   // Verify that the server sent an adequately-sized challenge.
   if (server_precommit.challenge().size() != kEkepChallengeSize) {
     return Status(Abort::PROTOCOL_ERROR,
@@ -226,6 +245,30 @@ Status ClientEkepHandshaker::HandleServerPrecommit(
                                server_precommit.challenge().size()));
   }
 
+  // If the server resumed the offered session, neither participant presents
+  // assertions.
+  if (server_precommit.session_resumed()) {
+    if (!session_offered_) {
+      return Status(Abort::PROTOCOL_ERROR,
+                    "Server resumed a session that was not offered by the "
+                    "client");
+    }
+    if (resumed_session_.cipher_suite != selected_cipher_suite_ ||
+        resumed_session_.record_protocol != selected_record_protocol_) {
+      return Status(Abort::PROTOCOL_ERROR,
+                    "Server resumed a session with different parameters");
+    }
+    if (!server_precommit.server_requests().empty() ||
+        !server_precommit.server_offers().empty()) {
+      return Status(Abort::PROTOCOL_ERROR,
+                    "Server exchanged assertions in a resumed session");
+    }
+    session_resumed_ = true;
+    return WriteClientId(server_precommit.server_requests().cbegin(),
+                         server_precommit.server_requests().cend(), output);
+  }
+  resumed_session_ = EkepResumableSession();
+
   // Verify that the server requested a non-empty subset of the assertions that
   // were offered by the client.
   if (server_precommit.server_requests().empty()) {
@@ -318,6 +361,15 @@ Status ClientEkepHandshaker::HandleServerId(const google::protobuf::Message &mes
                   "Server did not provide all expected assertions");
   }
 
+  // The server of a resumed session proves its identities by knowing the
+  // resumption secret instead.
+  if (session_resumed_) {
+    for (const EnclaveIdentity &identity :
+         resumed_session_.peer_identities.identities()) {
+      AddPeerIdentity(identity);
+    }
+  }
+
   std::vector<uint8_t> server_public_key;
   std::copy(server_id.dh_public_key().cbegin(),
             server_id.dh_public_key().cend(),
@@ -327,9 +379,25 @@ Status ClientEkepHandshaker::HandleServerId(const google::protobuf::Message &mes
   // and the server's public key.
   std::string transcript_hash;
   ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&transcript_hash));
-  return DeriveSecrets(selected_cipher_suite_, transcript_hash,
-                       server_public_key, dh_private_key_, &master_secret_,
-                       &authenticator_secret_);
+  ASYLO_RETURN_IF_ERROR(DeriveSecrets(
+      selected_cipher_suite_, transcript_hash, server_public_key,
+      dh_private_key_, resumed_session_.resumption_secret, &master_secret_,
+      &authenticator_secret_));
+
+  // Derive the resumption secret for the ticket the server may issue. The
+  // handshake does not depend on it, so a failure only means that no ticket is
+  // stored for this session.
+  if (ticket_cache_) {
+    Status status =
+        DeriveResumptionSecret(selected_cipher_suite_, transcript_hash,
+                               master_secret_, &next_resumption_secret_);
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to derive resumption secret, not storing a session "
+                 << "ticket: " << status;
+      next_resumption_secret_.clear();
+    }
+  }
+  return Status::OkStatus();
 }
 
 Status ClientEkepHandshaker::HandleServerFinish(const google::protobuf::Message &message,
@@ -360,7 +428,9 @@ Status ClientEkepHandshaker::HandleServerFinish(const google::protobuf::Message
                   "Server handshake authenticator value is incorrect");
   }
 
-  return WriteClientFinish(output);
+  ASYLO_RETURN_IF_ERROR(WriteClientFinish(output));
+  StoreSessionTicket(server_finish);
+  return Status::OkStatus();
 }
 
 Status ClientEkepHandshaker::WriteClientPrecommit(std::string *output) {
@@ -380,6 +450,10 @@ Status ClientEkepHandshaker::WriteClientPrecommit(std::string *output) {
     ekep_version->set_name(version_name);
   }
 
+  if (max_protected_frame_size_ != 0) {
+    client_precommit.set_max_protected_frame_size(max_protected_frame_size_);
+  }
+
   if (!additional_authenticated_data_.empty()) {
     client_precommit.mutable_options()->set_data(
         additional_authenticated_data_);
@@ -391,6 +465,15 @@ Status ClientEkepHandshaker::WriteClientPrecommit(std::string *output) {
   }
   client_precommit.set_challenge(challenge.data(), challenge.size());
 
+  // Offer to resume a previous session with the server. Assertions are offered
+  // and requested regardless, in case the server does not resume it.
+  std::string session_ticket;
+  if (ticket_cache_ &&
+      ticket_cache_->Take(peer_name_, &session_ticket, &resumed_session_)) {
+    client_precommit.set_session_ticket(std::move(session_ticket));
+    session_offered_ = true;
+  }
+
   for (const AssertionDescription &description : self_assertions_) {
     // Note that assertion generators were verified during creation of the
     // handshaker so there is no need to check whether the call to
@@ -499,6 +582,26 @@ Status ClientEkepHandshaker::WriteClientFinish(std::string *output) {
   return WriteFrameAndUpdateTranscript(CLIENT_FINISH, client_finish, output);
 }
 
+void ClientEkepHandshaker::StoreSessionTicket(
+    const ServerFinish &server_finish) {
+  // A ticket is useless without the resumption secret to redeem it with.
+  if (!ticket_cache_ || server_finish.session_ticket().empty() ||
+      next_resumption_secret_.empty()) {
+    return;
+  }
+
+  EkepResumableSession session;
+  session.cipher_suite = selected_cipher_suite_;
+  session.record_protocol = selected_record_protocol_;
+  session.resumption_secret = std::move(next_resumption_secret_);
+  session.peer_identities = peer_identities();
+  session.authentication_time = session_resumed_
+                                    ? resumed_session_.authentication_time
+                                    : absl::Now();
+  ticket_cache_->Store(peer_name_, server_finish.session_ticket(),
+                       std::move(session));
+}
+
 bool ClientEkepHandshaker::SetSelectedEkepVersion(
     const std::string &ekep_version) {
   // Verify that the selected EKEP version was offered by the client.
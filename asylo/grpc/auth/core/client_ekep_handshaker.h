@@ -28,6 +28,7 @@
 #include <google/protobuf/message.h>
 #include "asylo/grpc/auth/core/ekep_handshaker.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/util/cleansing_types.h"
 
 namespace asylo {
@@ -106,6 +107,10 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   // transcript.
   Status WriteClientFinish(std::string *output);
 
+  // Stores the session ticket in |server_finish|, if any, so that a later
+  // handshake with the same server can resume the session.
+  void StoreSessionTicket(const ServerFinish &server_finish);
+
   // Sets the handshaker's selected EKEP version to |ekep_version|. Returns
   // false if |ekep_version| is not a valid EKEP version for this handshaker.
   bool SetSelectedEkepVersion(const std::string &ekep_version);
@@ -133,6 +138,10 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   // preferred.
   const std::vector<RecordProtocol> available_record_protocols_;
 
+  // The largest protected record frame the client is willing to use, or zero
+  // to use the default frame size of the record protocol.
+  const uint32_t max_protected_frame_size_;
+
   // A list of supported protocol versions in order of most recent to least
   // recent.
   const std::vector<std::string> available_ekep_versions_;
@@ -140,6 +149,25 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   // Additional data that is authenticated during the handshake.
   const std::string additional_authenticated_data_;
 
+  // Holder of session tickets, or null if session resumption is disabled, and
+  // the name under which it holds the tickets of the server.
+  const std::shared_ptr<EkepTicketCache> ticket_cache_;
+  const std::string peer_name_;
+
+  // The session offered to the server for resumption. Cleared if the server
+  // does not resume it.
+  bool session_offered_;
+  EkepResumableSession resumed_session_;
+
+  // Whether the server resumed the offered session. This field is populated
+  // after validation of the ServerPrecommit message.
+  bool session_resumed_;
+
+  // The resumption secret of the session being established. This field is
+  // populated after validation of the ServerId message, if session resumption
+  // is enabled.
+  CleansingVector<uint8_t> next_resumption_secret_;
+
   // Assertions expected from the peer. This field is populated after validation
   // of the ServerPrecommit message.
   std::vector<AssertionDescription> expected_peer_assertions_;
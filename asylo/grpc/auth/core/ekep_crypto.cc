@@ -45,6 +45,7 @@ constexpr size_t kEkepSecretSize =
 
 constexpr char kEkepHkdfSalt[] = "EKEP Handshake v1";
 constexpr char kEkepHkdfSaltRecordProtocol[] = "EKEP Record Protocol v1";
+constexpr char kEkepHkdfSaltResumption[] = "EKEP Resumption v1";
 constexpr char kServerAuthenticatedText[] = "EKEP Handshake v1: Server Finish";
 constexpr char kClientAuthenticatedText[] = "EKEP Handshake v1: Client Finish";
 
@@ -86,6 +87,18 @@ Status DeriveSecrets(const HandshakeCipher &ciphersuite,
                      ByteContainerView self_dh_private_key,
                      CleansingVector<uint8_t> *master_secret,
                      CleansingVector<uint8_t> *authenticator_secret) {
+  return DeriveSecrets(ciphersuite, transcript_hash, peer_dh_public_key,
+                       self_dh_private_key, /*resumption_secret=*/"",
+                       master_secret, authenticator_secret);
+}
+
+Status DeriveSecrets(const HandshakeCipher &ciphersuite,
+                     ByteContainerView transcript_hash,
+                     ByteContainerView peer_dh_public_key,
+                     ByteContainerView self_dh_private_key,
+                     ByteContainerView resumption_secret,
+                     CleansingVector<uint8_t> *master_secret,
+                     CleansingVector<uint8_t> *authenticator_secret) {
   const EVP_MD *digest = nullptr;
   CleansingVector<uint8_t> shared_secret;
 
@@ -122,6 +135,10 @@ Status DeriveSecrets(const HandshakeCipher &ciphersuite,
           "Ciphersuite not supported: " + ProtoEnumValueName(ciphersuite));
   }
 
+  // A resumed session mixes the resumption secret into the input key material.
+  shared_secret.insert(shared_secret.end(), resumption_secret.cbegin(),
+                       resumption_secret.cend());
+
   // Derive the master and authenticator secrets using HKDF.
   std::string salt(kEkepHkdfSalt);
   CleansingVector<uint8_t> output_key;
@@ -166,7 +183,10 @@ Status DeriveRecordProtocolKey(const HandshakeCipher &ciphersuite,
   // protocol.
   switch (record_protocol) {
     case ALTSRP_AES128_GCM:
-      record_protocol_key->resize(kAltsRecordProtocolAes128GcmKeySize);
+    case ALTSRP_AES256_GCM:
+      record_protocol_key->resize(record_protocol == ALTSRP_AES128_GCM
+                                      ? kAltsRecordProtocolAes128GcmKeySize
+                                      : kAltsRecordProtocolAes256GcmKeySize);
       // Randomize the key bytes just in case the key is mistakenly used even
       // when the key derivation fails. The byte-sequence in uninitialized
       // memory could be predictable and, as a result, an attacker may be able
@@ -193,6 +213,35 @@ Status DeriveRecordProtocolKey(const HandshakeCipher &ciphersuite,
   return Status::OkStatus();
 }
 
+Status DeriveResumptionSecret(const HandshakeCipher &ciphersuite,
+                              ByteContainerView transcript_hash,
+                              ByteContainerView master_secret,
+                              CleansingVector<uint8_t> *resumption_secret) {
+  resumption_secret->clear();
+  const EVP_MD *digest = nullptr;
+  switch (ciphersuite) {
+    case CURVE25519_SHA256:
+      digest = EVP_sha256();
+      break;
+    default:
+      return Status(
+          Abort::BAD_HANDSHAKE_CIPHER,
+          "Ciphersuite not supported: " + ProtoEnumValueName(ciphersuite));
+  }
+
+  resumption_secret->resize(kEkepResumptionSecretSize);
+  std::string salt(kEkepHkdfSaltResumption);
+  if (!HKDF(resumption_secret->data(), resumption_secret->size(), digest,
+            master_secret.data(), master_secret.size(),
+            reinterpret_cast<const uint8_t *>(salt.data()), salt.size(),
+            transcript_hash.data(), transcript_hash.size())) {
+    LOG(ERROR) << "HKDF failed: " << BsslLastErrorString();
+    resumption_secret->clear();
+    return Status(Abort::INTERNAL_ERROR, "Internal error");
+  }
+  return Status::OkStatus();
+}
+
 Status ComputeClientHandshakeAuthenticator(
     const HandshakeCipher &ciphersuite, ByteContainerView authenticator_secret,
     CleansingVector<uint8_t> *authenticator) {
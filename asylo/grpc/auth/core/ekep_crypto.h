@@ -33,6 +33,8 @@ namespace asylo {
 constexpr size_t kEkepMasterSecretSize = 64;
 constexpr size_t kEkepAuthenticatorSecretSize = 64;
 constexpr size_t kAltsRecordProtocolAes128GcmKeySize = 16;
+constexpr size_t kAltsRecordProtocolAes256GcmKeySize = 32;
+constexpr size_t kEkepResumptionSecretSize = 32;
 
 // Derives EKEP secrets based on the selected |ciphersuite| and the input
 // |transcript_hash|, |peer_dh_public_key|, and |self_dh_private_key|. On
@@ -55,6 +57,31 @@ Status DeriveSecrets(const HandshakeCipher &ciphersuite,
                      CleansingVector<uint8_t> *master_secret,
                      CleansingVector<uint8_t> *authenticator_secret);
 
+// Derives EKEP secrets for a resumed session as above, additionally binding
+// them to the |resumption_secret| of the resumed session. The HKDF input key
+// material is the Diffie-Hellman shared secret followed by
+// |resumption_secret|, so an empty |resumption_secret| derives the same
+// secrets as a full handshake.
+Status DeriveSecrets(const HandshakeCipher &ciphersuite,
+                     ByteContainerView transcript_hash,
+                     ByteContainerView peer_dh_public_key,
+                     ByteContainerView self_dh_private_key,
+                     ByteContainerView resumption_secret,
+                     CleansingVector<uint8_t> *master_secret,
+                     CleansingVector<uint8_t> *authenticator_secret);
+
+// Derives the secret with which a later handshake can resume this session
+// using HKDF initialized with the hash function from |ciphersuite|, the input
+// key material |master_secret|, and |transcript_hash|. On success, writes the
+// resumption secret to |resumption_secret|.
+//
+// If the ciphersuite is unsupported, returns BAD_HANDSHAKE_CIPHER.
+// Returns INTERNAL_ERROR on other errors.
+Status DeriveResumptionSecret(const HandshakeCipher &ciphersuite,
+                              ByteContainerView transcript_hash,
+                              ByteContainerView master_secret,
+                              CleansingVector<uint8_t> *resumption_secret);
+
 // Derives a record protocol key for the given |record_protocol| using HKDF
 // initialized with the hash function from |ciphersuite| and the input key
 // material |master_secret|. On success, writes the record protocol key to
@@ -242,8 +242,18 @@ StatusOr<CleansingVector<uint8_t>> EkepHandshaker::GetRecordProtocolKey() {
   return record_protocol_key_;
 }
 
+StatusOr<uint32_t> EkepHandshaker::GetMaxProtectedFrameSize() {
+  if (!IsHandshakeCompleted()) {
+    return Status(asylo::error::GoogleError::FAILED_PRECONDITION,
+                  "Cannot retrieve max protected frame size before handshake "
+                  "is complete");
+  }
+
+  return max_protected_frame_size_;
+}
+
 EkepHandshaker::EkepHandshaker(int max_frame_size)
-    : max_frame_size_(max_frame_size) {
+    : max_frame_size_(max_frame_size), max_protected_frame_size_(0) {
   peer_identities_ = absl::make_unique<EnclaveIdentities>();
 }
 
@@ -337,6 +347,11 @@ void EkepHandshaker::SetRecordProtocol(RecordProtocol record_protocol) {
   record_protocol_ = record_protocol;
 }
 
+void EkepHandshaker::SetMaxProtectedFrameSize(
+    uint32_t max_protected_frame_size) {
+  max_protected_frame_size_ = max_protected_frame_size;
+}
+
 Status EkepHandshaker::DeriveAndSetRecordProtocolKey(
     HandshakeCipher cipher_suite, RecordProtocol record_protocol,
     ByteContainerView master_secret) {
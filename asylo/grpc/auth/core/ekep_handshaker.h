@@ -154,6 +154,12 @@ class EkepHandshaker {
   // GoogleError::FAILED_PRECONDITION.
   StatusOr<CleansingVector<uint8_t>> GetRecordProtocolKey();
 
+  // Returns the negotiated maximum size of protected record frames, or zero if
+  // the default frame size of the record protocol is used, given that the
+  // handshake has successfully completed. If the handshake has not yet
+  // completed, returns GoogleError::FAILED_PRECONDITION.
+  StatusOr<uint32_t> GetMaxProtectedFrameSize();
+
  protected:
   enum class HandshakeState {
     NOT_STARTED = 0,
@@ -198,9 +204,17 @@ class EkepHandshaker {
   // Adds an identity to the list of peer identities.
   void AddPeerIdentity(const EnclaveIdentity &identity);
 
+  // Returns the peer identities added so far. Must not be called after
+  // GetPeerIdentities().
+  const EnclaveIdentities &peer_identities() const { return *peer_identities_; }
+
   // Sets the record protocol to use after the handshake completes.
   void SetRecordProtocol(RecordProtocol record_protocol);
 
+  // Sets the maximum size of protected record frames to use after the
+  // handshake completes.
+  void SetMaxProtectedFrameSize(uint32_t max_protected_frame_size);
+
   // Derives and sets the record protocol key using the given |cipher_suite|,
   // |record_protocol|, |master_secret|, and the current handshake transcript.
   Status DeriveAndSetRecordProtocolKey(HandshakeCipher cipher_suite,
@@ -286,6 +300,9 @@ class EkepHandshaker {
 
   // The key used in the record protocol.
   CleansingVector<uint8_t> record_protocol_key_;
+
+  // The maximum size of protected record frames, or zero for the default.
+  uint32_t max_protected_frame_size_;
 };
 
 }  // namespace asylo
@@ -0,0 +1,474 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/ekep_handshaker.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/time/time.h"
+#include "asylo/grpc/auth/core/client_ekep_handshaker.h"
+#include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/grpc/auth/core/server_ekep_handshaker.h"
+#include "asylo/identity/descriptions.h"
+#include "asylo/identity/enclave_assertion_authority_config.pb.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/identity/init.h"
+#include "asylo/test/util/enclave_assertion_authority_configs.h"
+#include "asylo/test/util/proto_matchers.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/cleansing_types.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::SizeIs;
+
+constexpr uint32_t kSmallFrameSize = 4096;
+constexpr uint32_t kLargeFrameSize = 16384;
+
+constexpr char kPeerName[] = "server.example.com";
+
+// The outcome of a handshake run by EkepHandshakerTest::RunHandshake().
+struct HandshakeOutcome {
+  EkepHandshaker::Result client_result = EkepHandshaker::Result::IN_PROGRESS;
+  EkepHandshaker::Result server_result = EkepHandshaker::Result::IN_PROGRESS;
+
+  // The bytes written by the participant that aborted the handshake, if any.
+  // They are not delivered to its peer.
+  std::string abort_bytes;
+};
+
+class EkepHandshakerTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    std::vector<EnclaveAssertionAuthorityConfig> authority_configs = {
+        GetNullAssertionAuthorityTestConfig()};
+    ASSERT_THAT(InitializeEnclaveAssertionAuthorities(
+                    authority_configs.cbegin(), authority_configs.cend()),
+                IsOk());
+  }
+
+  void SetUp() override {
+    AssertionDescription null_assertion_description;
+    SetNullAssertionDescription(&null_assertion_description);
+    options_.self_assertions = {null_assertion_description};
+    options_.accepted_peer_assertions = {null_assertion_description};
+
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        issuer_, EkepTicketIssuer::Create(absl::Hours(1),
+                                          /*single_use_tickets=*/true,
+                                          /*max_redeemed_tickets=*/16));
+    cache_ = std::make_shared<EkepTicketCache>(absl::Hours(1),
+                                               /*capacity=*/4);
+  }
+
+  // Returns options_ with session resumption through issuer_ and cache_.
+  EkepHandshakerOptions ResumptionOptions() const {
+    EkepHandshakerOptions options = options_;
+    options.resumption.ticket_issuer = issuer_;
+    options.resumption.ticket_cache = cache_;
+    options.resumption.peer_name = kPeerName;
+    return options;
+  }
+
+  // Creates client and server handshakers from |client_options| and
+  // |server_options|.
+  void CreateHandshakers(const EkepHandshakerOptions &client_options,
+                         const EkepHandshakerOptions &server_options) {
+    client_ = ClientEkepHandshaker::Create(client_options);
+    ASSERT_NE(client_, nullptr);
+    server_ = ServerEkepHandshaker::Create(server_options);
+    ASSERT_NE(server_, nullptr);
+  }
+
+  // Runs a handshake between client_ and server_ by passing the bytes that
+  // each writes to the other, until neither has anything left to send or one
+  // of them aborts. If |rewrite_server_bytes| is set, it may modify the bytes
+  // of the server before they are delivered to the client.
+  HandshakeOutcome RunHandshake(
+      const std::function<void(std::string *)> &rewrite_server_bytes =
+          nullptr) {
+    HandshakeOutcome outcome;
+    std::string to_server;
+    std::string to_client;
+    outcome.client_result =
+        client_->NextHandshakeStep(/*incoming_bytes=*/nullptr, 0, &to_server);
+    while (outcome.client_result != EkepHandshaker::Result::ABORTED &&
+           !to_server.empty()) {
+      outcome.server_result = server_->NextHandshakeStep(
+          to_server.data(), to_server.size(), &to_client);
+      if (outcome.server_result == EkepHandshaker::Result::ABORTED) {
+        outcome.abort_bytes = std::move(to_client);
+        break;
+      }
+      to_server.clear();
+      if (to_client.empty()) {
+        break;
+      }
+      if (rewrite_server_bytes) {
+        rewrite_server_bytes(&to_client);
+      }
+      outcome.client_result = client_->NextHandshakeStep(
+          to_client.data(), to_client.size(), &to_server);
+    }
+    if (outcome.client_result == EkepHandshaker::Result::ABORTED) {
+      outcome.abort_bytes = std::move(to_server);
+    }
+    return outcome;
+  }
+
+  // Decodes the frame at the front of |bytes| into |message_type| and
+  // |message|.
+  void DecodeFrame(const std::string &bytes,
+                   HandshakeMessageType *message_type, std::string *message) {
+    google::protobuf::io::ArrayInputStream input(bytes.data(), bytes.size());
+    uint32_t message_size;
+    ASSERT_THAT(client_->ParseFrameHeader(&input, &message_size, message_type),
+                IsOk());
+    const void *data;
+    int size;
+    ASSERT_TRUE(input.Next(&data, &size));
+    ASSERT_GE(size, static_cast<int>(message_size));
+    message->assign(static_cast<const char *>(data), message_size);
+  }
+
+  // Returns a rewriter of server bytes that applies |rewrite| to the
+  // ServerPrecommit message, and keeps the frames that follow it.
+  std::function<void(std::string *)> RewriteServerPrecommit(
+      std::function<void(ServerPrecommit *)> rewrite) {
+    return [this, rewrite](std::string *bytes) {
+      HandshakeMessageType message_type;
+      std::string message;
+      DecodeFrame(*bytes, &message_type, &message);
+      if (message_type != SERVER_PRECOMMIT) {
+        return;
+      }
+      ServerPrecommit server_precommit;
+      ASSERT_TRUE(server_precommit.ParseFromString(message));
+      rewrite(&server_precommit);
+      std::string rest = bytes->substr(kEkepFrameHeaderSize + message.size());
+      bytes->clear();
+      {
+        google::protobuf::io::StringOutputStream output(bytes);
+        ASSERT_THAT(
+            server_->EncodeFrame(SERVER_PRECOMMIT, server_precommit, &output),
+            IsOk());
+      }
+      bytes->append(rest);
+    };
+  }
+
+  // Runs a handshake, and places in |session_resumed| whether the server
+  // resumed a session.
+  HandshakeOutcome RunHandshakeAndCheckResumption(bool *session_resumed) {
+    *session_resumed = false;
+    return RunHandshake(RewriteServerPrecommit(
+        [session_resumed](ServerPrecommit *server_precommit) {
+          *session_resumed = server_precommit->session_resumed();
+        }));
+  }
+
+  // Runs a full handshake that leaves a session ticket in cache_, and returns
+  // the client's side of the session in |session|.
+  void EstablishResumableSession(EkepResumableSession *session) {
+    ASSERT_NO_FATAL_FAILURE(
+        CreateHandshakers(ResumptionOptions(), ResumptionOptions()));
+    bool session_resumed;
+    ExpectCompleted(RunHandshakeAndCheckResumption(&session_resumed),
+                    ALTSRP_AES128_GCM, 16, 0);
+    EXPECT_FALSE(session_resumed);
+
+    std::string ticket;
+    ASSERT_TRUE(cache_->Take(kPeerName, &ticket, session));
+    cache_->Store(kPeerName, ticket, *session);
+  }
+
+  // Expects the peer identities of client_ and server_ to equal those
+  // authenticated in |session|.
+  void ExpectPeerIdentities(const EkepResumableSession &session) {
+    std::unique_ptr<EnclaveIdentities> identities;
+    ASYLO_ASSERT_OK_AND_ASSIGN(identities, client_->GetPeerIdentities());
+    EXPECT_THAT(*identities, EqualsProto(session.peer_identities));
+    ASYLO_ASSERT_OK_AND_ASSIGN(identities, server_->GetPeerIdentities());
+    EXPECT_THAT(*identities, EqualsProto(session.peer_identities));
+  }
+
+  // Expects |outcome| to hold an Abort message with the given |code|.
+  void ExpectAbort(const HandshakeOutcome &outcome, Abort::ErrorCode code) {
+    HandshakeMessageType message_type;
+    std::string message;
+    ASSERT_NO_FATAL_FAILURE(
+        DecodeFrame(outcome.abort_bytes, &message_type, &message));
+    ASSERT_EQ(message_type, ABORT);
+    Abort abort;
+    ASSERT_TRUE(abort.ParseFromString(message));
+    EXPECT_EQ(abort.code(), code) << abort.message();
+  }
+
+  // Expects both handshakers to have completed with |record_protocol|, the
+  // same record protocol key of |key_size| bytes, and |frame_size| as the
+  // max protected frame size.
+  void ExpectCompleted(const HandshakeOutcome &outcome,
+                       RecordProtocol record_protocol, size_t key_size,
+                       uint32_t frame_size) {
+    ASSERT_EQ(outcome.client_result, EkepHandshaker::Result::COMPLETED);
+    ASSERT_EQ(outcome.server_result, EkepHandshaker::Result::COMPLETED);
+
+    EXPECT_THAT(client_->GetRecordProtocol(), IsOkAndHolds(record_protocol));
+    EXPECT_THAT(server_->GetRecordProtocol(), IsOkAndHolds(record_protocol));
+
+    CleansingVector<uint8_t> client_key;
+    ASYLO_ASSERT_OK_AND_ASSIGN(client_key, client_->GetRecordProtocolKey());
+    EXPECT_THAT(client_key, SizeIs(key_size));
+    EXPECT_THAT(server_->GetRecordProtocolKey(), IsOkAndHolds(Eq(client_key)));
+
+    EXPECT_THAT(client_->GetMaxProtectedFrameSize(), IsOkAndHolds(frame_size));
+    EXPECT_THAT(server_->GetMaxProtectedFrameSize(), IsOkAndHolds(frame_size));
+  }
+
+  EkepHandshakerOptions options_;
+  std::shared_ptr<EkepTicketIssuer> issuer_;
+  std::shared_ptr<EkepTicketCache> cache_;
+  std::unique_ptr<EkepHandshaker> client_;
+  std::unique_ptr<EkepHandshaker> server_;
+};
+
+// Verifies that the participants use the smaller of the frame sizes that they
+// propose.
+TEST_F(EkepHandshakerTest, SelectsSmallerProposedFrameSize) {
+  EkepHandshakerOptions small_options = options_;
+  small_options.max_protected_frame_size = kSmallFrameSize;
+  EkepHandshakerOptions large_options = options_;
+  large_options.max_protected_frame_size = kLargeFrameSize;
+
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(small_options, large_options));
+  ExpectCompleted(RunHandshake(), ALTSRP_AES128_GCM, 16, kSmallFrameSize);
+
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(large_options, small_options));
+  ExpectCompleted(RunHandshake(), ALTSRP_AES128_GCM, 16, kSmallFrameSize);
+}
+
+// Verifies that the participants use the default frame size of the record
+// protocol if either of them does not propose a frame size.
+TEST_F(EkepHandshakerTest, SelectsDefaultFrameSizeIfOnlyOneIsProposed) {
+  EkepHandshakerOptions proposing_options = options_;
+  proposing_options.max_protected_frame_size = kSmallFrameSize;
+
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(options_, proposing_options));
+  ExpectCompleted(RunHandshake(), ALTSRP_AES128_GCM, 16, 0);
+
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(proposing_options, options_));
+  ExpectCompleted(RunHandshake(), ALTSRP_AES128_GCM, 16, 0);
+}
+
+// Verifies that the client aborts the handshake if the server selects a larger
+// frame size than the client proposed.
+TEST_F(EkepHandshakerTest, ClientRejectsLargerFrameSizeThanProposed) {
+  EkepHandshakerOptions client_options = options_;
+  client_options.max_protected_frame_size = kSmallFrameSize;
+  EkepHandshakerOptions server_options = options_;
+  server_options.max_protected_frame_size = kSmallFrameSize;
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(client_options, server_options));
+
+  HandshakeOutcome outcome =
+      RunHandshake(RewriteServerPrecommit([](ServerPrecommit *precommit) {
+        precommit->set_max_protected_frame_size(kLargeFrameSize);
+      }));
+  EXPECT_EQ(outcome.client_result, EkepHandshaker::Result::ABORTED);
+  ExpectAbort(outcome, Abort::PROTOCOL_ERROR);
+}
+
+// Verifies that the client aborts the handshake if the server selects a frame
+// size although the client did not propose one.
+TEST_F(EkepHandshakerTest, ClientRejectsFrameSizeIfNoneWasProposed) {
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(options_, options_));
+
+  HandshakeOutcome outcome =
+      RunHandshake(RewriteServerPrecommit([](ServerPrecommit *precommit) {
+        precommit->set_max_protected_frame_size(kSmallFrameSize);
+      }));
+  EXPECT_EQ(outcome.client_result, EkepHandshaker::Result::ABORTED);
+  ExpectAbort(outcome, Abort::PROTOCOL_ERROR);
+}
+
+// Verifies that the participants derive a 256-bit record protocol key for
+// ALTSRP_AES256_GCM.
+TEST_F(EkepHandshakerTest, DerivesAes256RecordProtocolKey) {
+  options_.record_protocols = {ALTSRP_AES256_GCM};
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(options_, options_));
+  ExpectCompleted(RunHandshake(), ALTSRP_AES256_GCM, 32, 0);
+}
+
+// Verifies that the server selects the record protocol that the client prefers
+// among those that the server supports.
+TEST_F(EkepHandshakerTest, SelectsRecordProtocolPreferredByClient) {
+  EkepHandshakerOptions client_options = options_;
+  client_options.record_protocols = {ALTSRP_AES256_GCM, ALTSRP_AES128_GCM};
+  EkepHandshakerOptions server_options = options_;
+  server_options.record_protocols = {ALTSRP_AES128_GCM, ALTSRP_AES256_GCM};
+
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(client_options, server_options));
+  ExpectCompleted(RunHandshake(), ALTSRP_AES256_GCM, 32, 0);
+
+  server_options.record_protocols = {ALTSRP_AES128_GCM};
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(client_options, server_options));
+  ExpectCompleted(RunHandshake(), ALTSRP_AES128_GCM, 16, 0);
+}
+
+// Verifies that the server aborts the handshake if it supports none of the
+// record protocols of the client.
+TEST_F(EkepHandshakerTest, ServerRejectsUnsupportedRecordProtocols) {
+  EkepHandshakerOptions client_options = options_;
+  client_options.record_protocols = {ALTSRP_AES256_GCM};
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(client_options, options_));
+
+  HandshakeOutcome outcome = RunHandshake();
+  EXPECT_EQ(outcome.server_result, EkepHandshaker::Result::ABORTED);
+  ExpectAbort(outcome, Abort::BAD_RECORD_PROTOCOL);
+}
+
+// Verifies that a client resumes a session with the ticket issued in a full
+// handshake, that both participants authenticate the identities of the
+// original session, and that the ticket issued for the resumed session expires
+// with the original authentication.
+TEST_F(EkepHandshakerTest, ResumesSessionWithTicket) {
+  EkepResumableSession original_session;
+  ASSERT_NO_FATAL_FAILURE(EstablishResumableSession(&original_session));
+  ASSERT_THAT(original_session.peer_identities.identities(), SizeIs(1));
+
+  ASSERT_NO_FATAL_FAILURE(
+      CreateHandshakers(ResumptionOptions(), ResumptionOptions()));
+  bool session_resumed;
+  ExpectCompleted(RunHandshakeAndCheckResumption(&session_resumed),
+                  ALTSRP_AES128_GCM, 16, 0);
+  EXPECT_TRUE(session_resumed);
+  ExpectPeerIdentities(original_session);
+
+  std::string ticket;
+  EkepResumableSession client_session;
+  ASSERT_TRUE(cache_->Take(kPeerName, &ticket, &client_session));
+  EXPECT_EQ(client_session.authentication_time,
+            original_session.authentication_time);
+  EkepResumableSession server_session;
+  ASYLO_ASSERT_OK_AND_ASSIGN(server_session, issuer_->Redeem(ticket));
+  EXPECT_LE(server_session.authentication_time,
+            original_session.authentication_time);
+  EXPECT_GT(server_session.authentication_time,
+            original_session.authentication_time - absl::Seconds(10));
+}
+
+// Verifies that the participants of a resumed session derive different keys if
+// the client does not know the resumption secret of the ticket it presents,
+// and that the client rejects the authenticator of the server.
+TEST_F(EkepHandshakerTest, RejectsWrongResumptionSecret) {
+  EkepResumableSession session;
+  ASSERT_NO_FATAL_FAILURE(EstablishResumableSession(&session));
+  std::string ticket;
+  ASSERT_TRUE(cache_->Take(kPeerName, &ticket, &session));
+  session.resumption_secret[0] ^= 1;
+  cache_->Store(kPeerName, ticket, session);
+
+  ASSERT_NO_FATAL_FAILURE(
+      CreateHandshakers(ResumptionOptions(), ResumptionOptions()));
+  bool session_resumed;
+  HandshakeOutcome outcome = RunHandshakeAndCheckResumption(&session_resumed);
+  EXPECT_TRUE(session_resumed);
+  EXPECT_EQ(outcome.client_result, EkepHandshaker::Result::ABORTED);
+  ExpectAbort(outcome, Abort::BAD_AUTHENTICATOR);
+}
+
+// Verifies that the server does not resume a session with a tampered ticket,
+// and falls back to a full handshake.
+TEST_F(EkepHandshakerTest, FallsBackToFullHandshakeOnTamperedTicket) {
+  EkepResumableSession session;
+  ASSERT_NO_FATAL_FAILURE(EstablishResumableSession(&session));
+  std::string ticket;
+  ASSERT_TRUE(cache_->Take(kPeerName, &ticket, &session));
+  ticket.back() ^= 1;
+  cache_->Store(kPeerName, ticket, session);
+
+  ASSERT_NO_FATAL_FAILURE(
+      CreateHandshakers(ResumptionOptions(), ResumptionOptions()));
+  bool session_resumed;
+  ExpectCompleted(RunHandshakeAndCheckResumption(&session_resumed),
+                  ALTSRP_AES128_GCM, 16, 0);
+  EXPECT_FALSE(session_resumed);
+}
+
+// Verifies that the client aborts the handshake if the server claims to resume
+// a session that the client did not offer.
+TEST_F(EkepHandshakerTest, ClientRejectsUnsolicitedSessionResumption) {
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(options_, options_));
+
+  HandshakeOutcome outcome =
+      RunHandshake(RewriteServerPrecommit([](ServerPrecommit *precommit) {
+        precommit->set_session_resumed(true);
+      }));
+  EXPECT_EQ(outcome.client_result, EkepHandshaker::Result::ABORTED);
+  ExpectAbort(outcome, Abort::PROTOCOL_ERROR);
+}
+
+// Verifies that the server does not resume a session whose cipher suite
+// differs from the selected one, and falls back to a full handshake.
+TEST_F(EkepHandshakerTest, FallsBackToFullHandshakeOnCipherSuiteMismatch) {
+  EkepResumableSession session;
+  ASSERT_NO_FATAL_FAILURE(EstablishResumableSession(&session));
+  std::string ticket;
+  ASSERT_TRUE(cache_->Take(kPeerName, &ticket, &session));
+  session.cipher_suite = UNKNOWN_HANDSHAKE_CIPHER;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer_->Issue(session));
+  cache_->Store(kPeerName, ticket, session);
+
+  ASSERT_NO_FATAL_FAILURE(
+      CreateHandshakers(ResumptionOptions(), ResumptionOptions()));
+  bool session_resumed;
+  ExpectCompleted(RunHandshakeAndCheckResumption(&session_resumed),
+                  ALTSRP_AES128_GCM, 16, 0);
+  EXPECT_FALSE(session_resumed);
+}
+
+// Verifies that the server does not resume a session whose record protocol
+// differs from the selected one, and falls back to a full handshake.
+TEST_F(EkepHandshakerTest, FallsBackToFullHandshakeOnRecordProtocolMismatch) {
+  EkepResumableSession session;
+  ASSERT_NO_FATAL_FAILURE(EstablishResumableSession(&session));
+  ASSERT_EQ(session.record_protocol, ALTSRP_AES128_GCM);
+
+  EkepHandshakerOptions client_options = ResumptionOptions();
+  client_options.record_protocols = {ALTSRP_AES256_GCM};
+  EkepHandshakerOptions server_options = ResumptionOptions();
+  server_options.record_protocols = {ALTSRP_AES128_GCM, ALTSRP_AES256_GCM};
+  ASSERT_NO_FATAL_FAILURE(CreateHandshakers(client_options, server_options));
+  bool session_resumed;
+  ExpectCompleted(RunHandshakeAndCheckResumption(&session_resumed),
+                  ALTSRP_AES256_GCM, 32, 0);
+  EXPECT_FALSE(session_resumed);
+}
+
+}  // namespace
+}  // namespace asylo
@@ -25,6 +25,7 @@
 #include "asylo/identity/attestation/enclave_assertion_generator.h"
 #include "asylo/identity/attestation/enclave_assertion_verifier.h"
 #include "asylo/identity/enclave_assertion_authority.h"
+#include "asylo/util/proto_enum_util.h"
 #include "asylo/util/status.h"
 
 namespace asylo {
@@ -62,6 +63,19 @@ Status EkepHandshakerOptions::Validate() const {
                   "max_frame_size");
   }
 
+  if (record_protocols.empty()) {
+    return Status(asylo::error::GoogleError::INVALID_ARGUMENT,
+                  "Must supply at least one record protocol");
+  }
+  for (RecordProtocol record_protocol : record_protocols) {
+    if (record_protocol != ALTSRP_AES128_GCM &&
+        record_protocol != ALTSRP_AES256_GCM) {
+      return Status(asylo::error::GoogleError::INVALID_ARGUMENT,
+                    absl::StrCat("Unsupported record protocol: ",
+                                 ProtoEnumValueName(record_protocol)));
+    }
+  }
+
   if (self_assertions.empty()) {
     return Status(asylo::error::GoogleError::INVALID_ARGUMENT,
                   "Must supply at least one self assertion");
@@ -19,9 +19,13 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_EKEP_HANDSHAKER_UTIL_H_
 #define ASYLO_GRPC_AUTH_CORE_EKEP_HANDSHAKER_UTIL_H_
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/identity/attestation/enclave_assertion_generator.h"
 #include "asylo/identity/attestation/enclave_assertion_verifier.h"
 #include "asylo/identity/identity.pb.h"
@@ -29,6 +33,21 @@
 
 namespace asylo {
 
+// Session resumption state shared by the EKEP handshakers of a credentials
+// object. Resumption is disabled if the field for the role of the handshaker
+// is null.
+struct EkepResumptionOptions {
+  // Issues session tickets to clients and redeems them. Used by servers.
+  std::shared_ptr<EkepTicketIssuer> ticket_issuer;
+
+  // Holds the session tickets issued by servers. Used by clients.
+  std::shared_ptr<EkepTicketCache> ticket_cache;
+
+  // The name under which a client files the tickets of its peer, such as the
+  // address of the server.
+  std::string peer_name;
+};
+
 // Configuration options for an EKEP handshake. These options can be validated
 // by calling Validate(). See the comment above Validate() for restrictions on
 // field values.
@@ -45,6 +64,17 @@ struct EkepHandshakerOptions {
   // Additional data presented by the EKEP participant during the handshake.
   std::string additional_authenticated_data;
 
+  // Record protocols supported by the EKEP participant. A client lists them in
+  // order of preference, and the server selects the first one it supports.
+  std::vector<RecordProtocol> record_protocols = {ALTSRP_AES128_GCM};
+
+  // The largest protected record frame the EKEP participant is willing to use,
+  // or zero to use the default frame size of the record protocol.
+  uint32_t max_protected_frame_size = 0;
+
+  // Session resumption state of the EKEP participant.
+  EkepResumptionOptions resumption;
+
   // Validates the handshaker options. All of the following conditions must
   // hold, otherwise returns INVALID_ARGUMENT:
   //   * max_frame_size is non-zero and does not exceed
@@ -57,6 +87,8 @@ struct EkepHandshakerOptions {
   //   appropriate assertion-verification library available
   //   * The size of additional_authenticated_data is less than or equal to
   //   max_frame_size
+  //   * record_protocols is non-empty and contains only supported record
+  //   protocols
   Status Validate() const;
 };
 
@@ -0,0 +1,235 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/types/span.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+// Size of the key that seals tickets.
+constexpr size_t kTicketKeySize = 32;
+
+// Size of the random ticket identifiers.
+constexpr size_t kTicketIdSize = 16;
+
+// Associated data of sealed tickets.
+constexpr char kTicketAssociatedData[] = "EKEP Session Ticket v1";
+
+}  // namespace
+
+StatusOr<std::unique_ptr<EkepTicketIssuer>> EkepTicketIssuer::Create(
+    absl::Duration ticket_lifetime, bool single_use_tickets,
+    size_t max_redeemed_tickets) {
+  CleansingVector<uint8_t> key(kTicketKeySize);
+  if (RAND_bytes(key.data(), key.size()) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to generate ticket key");
+  }
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSIGN_OR_RETURN(cryptor, AeadCryptor::CreateAesGcmSivCryptor(key));
+  return absl::WrapUnique(new EkepTicketIssuer(std::move(cryptor),
+                                               ticket_lifetime,
+                                               single_use_tickets,
+                                               max_redeemed_tickets));
+}
+
+EkepTicketIssuer::EkepTicketIssuer(std::unique_ptr<AeadCryptor> cryptor,
+                                   absl::Duration ticket_lifetime,
+                                   bool single_use_tickets,
+                                   size_t max_redeemed_tickets)
+    : ticket_lifetime_(ticket_lifetime),
+      single_use_tickets_(single_use_tickets),
+      max_redeemed_tickets_(max_redeemed_tickets),
+      cryptor_(std::move(cryptor)) {}
+
+StatusOr<std::string> EkepTicketIssuer::Issue(
+    const EkepResumableSession &session) {
+  absl::Time now = absl::Now();
+  absl::Time expiration =
+      std::min(now, session.authentication_time) + ticket_lifetime_;
+  if (now >= expiration) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Session authentication has expired");
+  }
+
+  EkepSessionTicketContents contents;
+  std::vector<uint8_t> ticket_id(kTicketIdSize);
+  if (RAND_bytes(ticket_id.data(), ticket_id.size()) != 1) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to generate ticket ID");
+  }
+  contents.set_ticket_id(ticket_id.data(), ticket_id.size());
+  contents.set_expiration_time_micros(absl::ToUnixMicros(expiration));
+  contents.set_cipher_suite(session.cipher_suite);
+  contents.set_record_protocol(session.record_protocol);
+  contents.set_resumption_secret(session.resumption_secret.data(),
+                                 session.resumption_secret.size());
+  *contents.mutable_peer_identities() = session.peer_identities;
+  contents.set_authentication_time_micros(
+      absl::ToUnixMicros(session.authentication_time));
+
+  CleansingVector<uint8_t> serialized(contents.ByteSizeLong());
+  if (!contents.SerializeToArray(serialized.data(), serialized.size())) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Failed to serialize ticket contents");
+  }
+
+  EkepSessionTicket ticket;
+  std::vector<uint8_t> nonce;
+  std::vector<uint8_t> sealed_contents;
+  size_t sealed_size;
+  {
+    absl::MutexLock lock(&mu_);
+    nonce.resize(cryptor_->NonceSize());
+    sealed_contents.resize(serialized.size() + cryptor_->MaxSealOverhead());
+    ASYLO_RETURN_IF_ERROR(cryptor_->Seal(serialized, kTicketAssociatedData,
+                                         absl::MakeSpan(nonce),
+                                         absl::MakeSpan(sealed_contents),
+                                         &sealed_size));
+  }
+  ticket.set_nonce(nonce.data(), nonce.size());
+  ticket.set_sealed_contents(sealed_contents.data(), sealed_size);
+  return ticket.SerializeAsString();
+}
+
+StatusOr<EkepResumableSession> EkepTicketIssuer::Redeem(
+    ByteContainerView ticket) {
+  EkepSessionTicket parsed_ticket;
+  if (!parsed_ticket.ParseFromArray(ticket.data(), ticket.size())) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Failed to parse ticket");
+  }
+
+  CleansingVector<uint8_t> serialized(parsed_ticket.sealed_contents().size());
+  size_t serialized_size;
+  EkepSessionTicketContents contents;
+  absl::MutexLock lock(&mu_);
+  if (parsed_ticket.nonce().size() != cryptor_->NonceSize() ||
+      !cryptor_
+           ->Open(parsed_ticket.sealed_contents(), kTicketAssociatedData,
+                  parsed_ticket.nonce(), absl::MakeSpan(serialized),
+                  &serialized_size)
+           .ok()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Ticket was not issued by this issuer");
+  }
+  if (!contents.ParseFromArray(serialized.data(), serialized_size)) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Failed to parse ticket contents");
+  }
+
+  if (absl::Now() >= absl::FromUnixMicros(contents.expiration_time_micros())) {
+    return Status(error::GoogleError::FAILED_PRECONDITION,
+                  "Ticket has expired");
+  }
+  if (single_use_tickets_) {
+    ASYLO_RETURN_IF_ERROR(RecordRedeemed(contents));
+  }
+
+  EkepResumableSession session;
+  session.cipher_suite = contents.cipher_suite();
+  session.record_protocol = contents.record_protocol();
+  session.resumption_secret.assign(contents.resumption_secret().cbegin(),
+                                   contents.resumption_secret().cend());
+  session.peer_identities = contents.peer_identities();
+  session.authentication_time =
+      absl::FromUnixMicros(contents.authentication_time_micros());
+  return std::move(session);
+}
+
+Status EkepTicketIssuer::RecordRedeemed(
+    const EkepSessionTicketContents &contents) {
+  if (redeemed_.find(contents.ticket_id()) != redeemed_.end()) {
+    return Status(error::GoogleError::ALREADY_EXISTS,
+                  "Ticket was already redeemed");
+  }
+
+  if (redeemed_.size() >= max_redeemed_tickets_) {
+    // Forget the tickets that expired, since they are rejected anyway.
+    absl::Time now = absl::Now();
+    for (auto it = redeemed_.begin(); it != redeemed_.end();) {
+      it = now >= it->second ? redeemed_.erase(it) : std::next(it);
+    }
+    if (redeemed_.size() >= max_redeemed_tickets_) {
+      return Status(error::GoogleError::RESOURCE_EXHAUSTED,
+                    "Too many redeemed tickets to remember");
+    }
+  }
+
+  redeemed_.emplace(
+      contents.ticket_id(),
+      absl::FromUnixMicros(contents.expiration_time_micros()));
+  return Status::OkStatus();
+}
+
+EkepTicketCache::EkepTicketCache(absl::Duration ticket_lifetime,
+                                 size_t capacity)
+    : ticket_lifetime_(ticket_lifetime), capacity_(capacity) {}
+
+void EkepTicketCache::Store(const std::string &peer_name, std::string ticket,
+                            EkepResumableSession session) {
+  if (capacity_ == 0) {
+    return;
+  }
+
+  absl::MutexLock lock(&mu_);
+  if (entries_.size() >= capacity_ &&
+      entries_.find(peer_name) == entries_.end()) {
+    auto oldest = std::min_element(
+        entries_.begin(), entries_.end(),
+        [](const std::pair<const std::string, Entry> &lhs,
+           const std::pair<const std::string, Entry> &rhs) {
+          return lhs.second.expiration < rhs.second.expiration;
+        });
+    entries_.erase(oldest);
+  }
+  absl::Time expiration =
+      std::min(absl::Now(), session.authentication_time) + ticket_lifetime_;
+  entries_[peer_name] =
+      Entry{std::move(ticket), std::move(session), expiration};
+}
+
+bool EkepTicketCache::Take(const std::string &peer_name, std::string *ticket,
+                           EkepResumableSession *session) {
+  absl::MutexLock lock(&mu_);
+  auto it = entries_.find(peer_name);
+  if (it == entries_.end()) {
+    return false;
+  }
+
+  Entry entry = std::move(it->second);
+  entries_.erase(it);
+  if (absl::Now() >= entry.expiration) {
+    return false;
+  }
+  *ticket = std::move(entry.ticket);
+  *session = std::move(entry.session);
+  return true;
+}
+
+}  // namespace asylo
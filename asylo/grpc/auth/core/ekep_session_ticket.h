@@ -0,0 +1,155 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_TICKET_H_
+#define ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_TICKET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "asylo/crypto/aead_cryptor.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+// The state of a completed EKEP session that a later handshake between the
+// same participants can resume without presenting assertions.
+struct EkepResumableSession {
+  HandshakeCipher cipher_suite = UNKNOWN_HANDSHAKE_CIPHER;
+  RecordProtocol record_protocol = UNKNOWN_RECORD_PROTOCOL;
+
+  // The secret derived from the master secret of the session. Only the two
+  // participants of the session know it.
+  CleansingVector<uint8_t> resumption_secret;
+
+  // The peer identities authenticated in the session.
+  EnclaveIdentities peer_identities;
+
+  // The time at which |peer_identities| were authenticated with assertions. A
+  // resumed session keeps the time of the session it resumes, so that resuming
+  // a session never extends the validity of the original authentication.
+  absl::Time authentication_time = absl::InfinitePast();
+};
+
+// Issues EKEP session tickets to the clients of a server, and redeems them
+// when clients resume their sessions.
+//
+// A ticket holds the server's side of an EkepResumableSession, sealed with a
+// random key that never leaves the issuer. Consequently, only the issuer can
+// redeem its tickets, and tickets do not survive the issuer. Tickets expire
+// after the lifetime given at creation, counted from the authentication time
+// of the session. If tickets are single-use, the issuer
+// remembers the tickets it redeemed until they expire, and rejects them
+// afterwards.
+//
+// This class is thread-safe.
+class EkepTicketIssuer {
+ public:
+  // Creates an issuer of tickets that can be redeemed for |ticket_lifetime|.
+  // If |single_use_tickets| is true, each ticket can be redeemed once, and at
+  // most |max_redeemed_tickets| unexpired tickets are remembered; further
+  // tickets are rejected until remembered ones expire.
+  static StatusOr<std::unique_ptr<EkepTicketIssuer>> Create(
+      absl::Duration ticket_lifetime, bool single_use_tickets,
+      size_t max_redeemed_tickets);
+
+  // Issues a ticket for |session|, as an opaque string to pass to the client.
+  // Returns FAILED_PRECONDITION if the authentication of |session| is older
+  // than the ticket lifetime.
+  StatusOr<std::string> Issue(const EkepResumableSession &session)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the session for which |ticket| was issued. Returns
+  // INVALID_ARGUMENT if |ticket| was not issued by this issuer,
+  // FAILED_PRECONDITION if it expired, ALREADY_EXISTS if it is single-use and
+  // was already redeemed, and RESOURCE_EXHAUSTED if no more tickets can be
+  // remembered as redeemed.
+  StatusOr<EkepResumableSession> Redeem(ByteContainerView ticket)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  EkepTicketIssuer(std::unique_ptr<AeadCryptor> cryptor,
+                   absl::Duration ticket_lifetime, bool single_use_tickets,
+                   size_t max_redeemed_tickets);
+
+  // Records |contents| as redeemed, unless it already was.
+  Status RecordRedeemed(const EkepSessionTicketContents &contents)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const absl::Duration ticket_lifetime_;
+  const bool single_use_tickets_;
+  const size_t max_redeemed_tickets_;
+
+  std::unique_ptr<AeadCryptor> cryptor_ ABSL_GUARDED_BY(mu_);
+
+  // Expiration times of redeemed tickets, by ticket ID.
+  std::unordered_map<std::string, absl::Time> redeemed_ ABSL_GUARDED_BY(mu_);
+
+  absl::Mutex mu_;
+};
+
+// Holds the EKEP session tickets that servers issued to a client, one per
+// server, until they expire or are used.
+//
+// This class is thread-safe.
+class EkepTicketCache {
+ public:
+  // Creates a cache that holds tickets for at most |capacity| servers, and
+  // drops tickets older than |ticket_lifetime|, or whose sessions were
+  // authenticated longer than |ticket_lifetime| ago.
+  EkepTicketCache(absl::Duration ticket_lifetime, size_t capacity);
+
+  // Stores |ticket| and the client's side of |session| for the server named
+  // |peer_name|, replacing any ticket held for it. If the cache is full, drops
+  // the oldest ticket.
+  void Store(const std::string &peer_name, std::string ticket,
+             EkepResumableSession session) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Removes the ticket held for the server named |peer_name| and returns it in
+  // |ticket| and |session|. Returns false if no unexpired ticket is held.
+  bool Take(const std::string &peer_name, std::string *ticket,
+            EkepResumableSession *session) ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct Entry {
+    std::string ticket;
+    EkepResumableSession session;
+    absl::Time expiration;
+  };
+
+  const absl::Duration ticket_lifetime_;
+  const size_t capacity_;
+
+  std::unordered_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mu_);
+  absl::Mutex mu_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_TICKET_H_
@@ -0,0 +1,249 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+
+#include <memory>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/test/util/proto_matchers.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/cleansing_types.h"
+
+namespace asylo {
+namespace {
+
+constexpr char kPeerName[] = "server.example.com";
+
+class EkepSessionTicketTest : public ::testing::Test {
+ protected:
+  EkepSessionTicketTest() {
+    session_.cipher_suite = CURVE25519_SHA256;
+    session_.record_protocol = ALTSRP_AES128_GCM;
+    session_.resumption_secret = CleansingVector<uint8_t>(32, 0xab);
+    EnclaveIdentity *identity = session_.peer_identities.add_identities();
+    identity->mutable_description()->set_identity_type(NULL_IDENTITY);
+    identity->mutable_description()->set_authority_type("Any");
+    identity->set_identity("Peer identity");
+    session_.authentication_time = absl::Now();
+  }
+
+  std::unique_ptr<EkepTicketIssuer> CreateIssuer(
+      absl::Duration ticket_lifetime, bool single_use_tickets,
+      size_t max_redeemed_tickets) {
+    auto issuer_result = EkepTicketIssuer::Create(
+        ticket_lifetime, single_use_tickets, max_redeemed_tickets);
+    EXPECT_THAT(issuer_result, IsOk());
+    return std::move(issuer_result).ValueOrDie();
+  }
+
+  void ExpectSessionEquals(const EkepResumableSession &actual) {
+    EXPECT_EQ(actual.cipher_suite, session_.cipher_suite);
+    EXPECT_EQ(actual.record_protocol, session_.record_protocol);
+    EXPECT_EQ(actual.resumption_secret, session_.resumption_secret);
+    EXPECT_THAT(actual.peer_identities, EqualsProto(session_.peer_identities));
+    EXPECT_EQ(absl::ToUnixMicros(actual.authentication_time),
+              absl::ToUnixMicros(session_.authentication_time));
+  }
+
+  EkepResumableSession session_;
+};
+
+// Verifies that a ticket can be redeemed for the session it was issued for.
+TEST_F(EkepSessionTicketTest, RedeemIssuedTicket) {
+  auto issuer = CreateIssuer(absl::Hours(1), /*single_use_tickets=*/true,
+                             /*max_redeemed_tickets=*/16);
+
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(session_));
+  EkepResumableSession redeemed;
+  ASYLO_ASSERT_OK_AND_ASSIGN(redeemed, issuer->Redeem(ticket));
+  ExpectSessionEquals(redeemed);
+}
+
+// Verifies that tickets issued by another issuer, and corrupted tickets, are
+// rejected.
+TEST_F(EkepSessionTicketTest, RejectForeignAndCorruptedTickets) {
+  auto issuer = CreateIssuer(absl::Hours(1), /*single_use_tickets=*/false,
+                             /*max_redeemed_tickets=*/16);
+  auto other_issuer = CreateIssuer(absl::Hours(1),
+                                   /*single_use_tickets=*/false,
+                                   /*max_redeemed_tickets=*/16);
+
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, other_issuer->Issue(session_));
+  EXPECT_THAT(issuer->Redeem(ticket),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(session_));
+  ticket.back() ^= 1;
+  EXPECT_THAT(issuer->Redeem(ticket),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+  EXPECT_THAT(issuer->Redeem("not a ticket"),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+// Verifies that expired tickets are rejected.
+TEST_F(EkepSessionTicketTest, RejectExpiredTicket) {
+  auto issuer = CreateIssuer(absl::Milliseconds(100),
+                             /*single_use_tickets=*/true,
+                             /*max_redeemed_tickets=*/16);
+
+  session_.authentication_time = absl::Now();
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(session_));
+  absl::SleepFor(absl::Milliseconds(200));
+  EXPECT_THAT(issuer->Redeem(ticket),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+}
+
+// Verifies that a ticket expires the ticket lifetime after the authentication
+// of its session, rather than after its issuance, so that re-issuing tickets
+// for resumed sessions does not extend the authentication.
+TEST_F(EkepSessionTicketTest, TicketExpiresWithAuthentication) {
+  auto issuer = CreateIssuer(absl::Hours(1), /*single_use_tickets=*/false,
+                             /*max_redeemed_tickets=*/16);
+
+  session_.authentication_time =
+      absl::Now() - absl::Hours(1) + absl::Milliseconds(100);
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(session_));
+  EkepResumableSession redeemed;
+  ASYLO_ASSERT_OK_AND_ASSIGN(redeemed, issuer->Redeem(ticket));
+  ExpectSessionEquals(redeemed);
+
+  // A ticket issued for the redeemed session expires with the first one.
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(redeemed));
+  absl::SleepFor(absl::Milliseconds(200));
+  EXPECT_THAT(issuer->Redeem(ticket),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+  EXPECT_THAT(issuer->Issue(redeemed),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+}
+
+// Verifies that no ticket is issued for a session whose authentication is
+// older than the ticket lifetime, or whose authentication time is not set.
+TEST_F(EkepSessionTicketTest, RejectIssueForExpiredAuthentication) {
+  auto issuer = CreateIssuer(absl::Hours(1), /*single_use_tickets=*/false,
+                             /*max_redeemed_tickets=*/16);
+
+  session_.authentication_time = absl::Now() - absl::Hours(2);
+  EXPECT_THAT(issuer->Issue(session_),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+  EXPECT_THAT(issuer->Issue(EkepResumableSession()),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+}
+
+// Verifies that single-use tickets can only be redeemed once, and that other
+// tickets can be redeemed repeatedly.
+TEST_F(EkepSessionTicketTest, RejectReplayedSingleUseTicket) {
+  auto single_use_issuer = CreateIssuer(
+      absl::Hours(1), /*single_use_tickets=*/true, /*max_redeemed_tickets=*/16);
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, single_use_issuer->Issue(session_));
+  EXPECT_THAT(single_use_issuer->Redeem(ticket), IsOk());
+  EXPECT_THAT(single_use_issuer->Redeem(ticket),
+              StatusIs(error::GoogleError::ALREADY_EXISTS));
+
+  auto reusable_issuer =
+      CreateIssuer(absl::Hours(1), /*single_use_tickets=*/false,
+                   /*max_redeemed_tickets=*/16);
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, reusable_issuer->Issue(session_));
+  EXPECT_THAT(reusable_issuer->Redeem(ticket), IsOk());
+  EXPECT_THAT(reusable_issuer->Redeem(ticket), IsOk());
+}
+
+// Verifies that an issuer rejects single-use tickets once it cannot remember
+// any more redeemed tickets.
+TEST_F(EkepSessionTicketTest, RejectTicketsWhenReplaySetIsFull) {
+  auto issuer = CreateIssuer(absl::Hours(1), /*single_use_tickets=*/true,
+                             /*max_redeemed_tickets=*/1);
+
+  std::string first_ticket;
+  std::string second_ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(first_ticket, issuer->Issue(session_));
+  ASYLO_ASSERT_OK_AND_ASSIGN(second_ticket, issuer->Issue(session_));
+  EXPECT_THAT(issuer->Redeem(first_ticket), IsOk());
+  EXPECT_THAT(issuer->Redeem(second_ticket),
+              StatusIs(error::GoogleError::RESOURCE_EXHAUSTED));
+}
+
+// Verifies that a cached ticket can be taken once.
+TEST_F(EkepSessionTicketTest, CacheTakeRemovesTicket) {
+  EkepTicketCache cache(absl::Hours(1), /*capacity=*/4);
+
+  std::string ticket;
+  EkepResumableSession session;
+  EXPECT_FALSE(cache.Take(kPeerName, &ticket, &session));
+
+  cache.Store(kPeerName, "ticket", session_);
+  ASSERT_TRUE(cache.Take(kPeerName, &ticket, &session));
+  EXPECT_EQ(ticket, "ticket");
+  ExpectSessionEquals(session);
+  EXPECT_FALSE(cache.Take(kPeerName, &ticket, &session));
+}
+
+// Verifies that expired tickets are not returned by the cache.
+TEST_F(EkepSessionTicketTest, CacheDropsExpiredTickets) {
+  EkepTicketCache cache(absl::ZeroDuration(), /*capacity=*/4);
+
+  cache.Store(kPeerName, "ticket", session_);
+  absl::SleepFor(absl::Milliseconds(1));
+  std::string ticket;
+  EkepResumableSession session;
+  EXPECT_FALSE(cache.Take(kPeerName, &ticket, &session));
+}
+
+// Verifies that the cache drops tickets of sessions whose authentication is
+// older than the ticket lifetime.
+TEST_F(EkepSessionTicketTest, CacheDropsTicketsOfExpiredAuthentication) {
+  EkepTicketCache cache(absl::Hours(1), /*capacity=*/4);
+
+  session_.authentication_time = absl::Now() - absl::Hours(2);
+  cache.Store(kPeerName, "ticket", session_);
+  std::string ticket;
+  EkepResumableSession session;
+  EXPECT_FALSE(cache.Take(kPeerName, &ticket, &session));
+}
+
+// Verifies that a full cache drops the oldest ticket.
+TEST_F(EkepSessionTicketTest, CacheEvictsOldestTicket) {
+  EkepTicketCache cache(absl::Hours(1), /*capacity=*/2);
+
+  for (const char *peer_name : {"first", "second", "third"}) {
+    session_.authentication_time = absl::Now();
+    cache.Store(peer_name, absl::StrCat(peer_name, " ticket"), session_);
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+
+  std::string ticket;
+  EkepResumableSession session;
+  EXPECT_FALSE(cache.Take("first", &ticket, &session));
+  EXPECT_TRUE(cache.Take("second", &ticket, &session));
+  EXPECT_TRUE(cache.Take("third", &ticket, &session));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -21,8 +21,11 @@
 #include <iterator>
 #include <utility>
 
+#include "absl/memory/memory.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/grpc/auth/core/enclave_security_connector.h"
 #include "asylo/grpc/auth/enclave_credentials_options.h"
+#include "asylo/util/logging.h"
 #include "src/core/lib/channel/channel_args.h"
 #include "src/core/lib/gprpp/ref_counted_ptr.h"
 #include "src/core/lib/security/credentials/credentials.h"
@@ -40,6 +43,11 @@ grpc_enclave_channel_credentials::create_security_connector(
 // Creates a grpc_enclave_server_security_connector object.
 grpc_core::RefCountedPtr<grpc_server_security_connector>
 grpc_enclave_server_credentials::create_security_connector() {
+  if (!resumption_status.ok()) {
+    LOG(ERROR) << "Failed to set up session resumption: "
+               << resumption_status;
+    return nullptr;
+  }
   return grpc_enclave_server_security_connector_create(this->Ref());
 }
 
@@ -53,7 +61,16 @@ grpc_enclave_channel_credentials::grpc_enclave_channel_credentials(
       accepted_peer_assertions(
           std::make_move_iterator(options.accepted_peer_assertions.begin()),
           std::make_move_iterator(options.accepted_peer_assertions.end())),
-      peer_acl(std::move(options.peer_acl)) {}
+      peer_acl(std::move(options.peer_acl)),
+      record_protocols(std::move(options.record_protocols)),
+      max_protected_frame_size(options.max_protected_frame_size) {
+  const asylo::SessionResumptionOptions &resumption =
+      options.session_resumption;
+  if (resumption.enabled) {
+    ticket_cache = std::make_shared<asylo::EkepTicketCache>(
+        resumption.ticket_lifetime, resumption.max_tickets);
+  }
+}
 
 grpc_enclave_server_credentials::grpc_enclave_server_credentials(
     asylo::EnclaveCredentialsOptions options)
@@ -65,4 +82,19 @@ grpc_enclave_server_credentials::grpc_enclave_server_credentials(
       accepted_peer_assertions(
           std::make_move_iterator(options.accepted_peer_assertions.begin()),
           std::make_move_iterator(options.accepted_peer_assertions.end())),
-      peer_acl(std::move(options.peer_acl)) {}
+      peer_acl(std::move(options.peer_acl)),
+      record_protocols(std::move(options.record_protocols)),
+      max_protected_frame_size(options.max_protected_frame_size) {
+  const asylo::SessionResumptionOptions &resumption =
+      options.session_resumption;
+  if (resumption.enabled) {
+    auto issuer_result = asylo::EkepTicketIssuer::Create(
+        resumption.ticket_lifetime, resumption.single_use_tickets,
+        resumption.max_tickets);
+    if (issuer_result.ok()) {
+      ticket_issuer = std::move(issuer_result).ValueOrDie();
+    } else {
+      resumption_status = issuer_result.status();
+    }
+  }
+}
@@ -19,13 +19,18 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_H_
 #define ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_H_
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "absl/types/optional.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/grpc/auth/enclave_credentials_options.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/identity/identity_acl.pb.h"
+#include "asylo/util/status.h"
 #include "src/core/lib/gprpp/ref_counted_ptr.h"
 #include "src/core/lib/security/credentials/credentials.h"
 
@@ -58,6 +63,17 @@ struct grpc_enclave_channel_credentials final
 
   // Optional ACL enforced on the server's identity.
   absl::optional<asylo::IdentityAclPredicate> peer_acl;
+
+  // Record protocols accepted by the client, in order of preference.
+  std::vector<asylo::RecordProtocol> record_protocols;
+
+  // The largest protected record frame proposed by the client, or zero for the
+  // default of the record protocol.
+  uint32_t max_protected_frame_size;
+
+  // Session tickets held by the client, shared by all its channels. Null if
+  // session resumption is disabled.
+  std::shared_ptr<asylo::EkepTicketCache> ticket_cache;
 };
 
 struct grpc_enclave_server_credentials final : public grpc_server_credentials {
@@ -81,6 +97,22 @@ struct grpc_enclave_server_credentials final : public grpc_server_credentials {
 
   // Optional ACL enforced on the client's identity.
   absl::optional<asylo::IdentityAclPredicate> peer_acl;
+
+  // Record protocols accepted by the server, in order of preference.
+  std::vector<asylo::RecordProtocol> record_protocols;
+
+  // The largest protected record frame proposed by the server, or zero for the
+  // default of the record protocol.
+  uint32_t max_protected_frame_size;
+
+  // Issuer of session tickets to clients, shared by all connections to the
+  // server. Null if session resumption is disabled.
+  std::shared_ptr<asylo::EkepTicketIssuer> ticket_issuer;
+
+  // The error that prevented setting up the requested session resumption, if
+  // any. No security connector is created for such credentials, so that the
+  // server fails to listen rather than run without session resumption.
+  asylo::Status resumption_status;
 };
 
 #endif  // ASYLO_GRPC_AUTH_CORE_ENCLAVE_CREDENTIALS_H_
@@ -24,6 +24,7 @@
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "asylo/util/logging.h"
+#include "asylo/grpc/auth/core/ekep_handshaker_util.h"
 #include "asylo/grpc/auth/core/enclave_credentials.h"
 #include "asylo/grpc/auth/core/enclave_grpc_security_constants.h"
 #include "asylo/grpc/auth/core/enclave_transport_security.h"
@@ -169,11 +170,17 @@ class grpc_enclave_channel_security_connector final
     grpc_enclave_channel_credentials *channel_creds =
         CHECK_NOTNULL(dynamic_cast<grpc_enclave_channel_credentials *>(
             this->mutable_channel_creds()));
+    asylo::EkepResumptionOptions resumption;
+    resumption.ticket_cache = channel_creds->ticket_cache;
+    if (target_ != nullptr) {
+      resumption.peer_name = target_;
+    }
     tsi_result result = tsi_enclave_handshaker_create(
         /*is_client=*/true, absl::MakeSpan(channel_creds->self_assertions),
         absl::MakeSpan(channel_creds->accepted_peer_assertions),
         channel_creds->additional_authenticated_data, channel_creds->peer_acl,
-        &tsi_handshaker);
+        resumption, channel_creds->record_protocols,
+        channel_creds->max_protected_frame_size, &tsi_handshaker);
     if (result != TSI_OK) {
       gpr_log(GPR_ERROR, "Enclave handshaker creation failed with error %s.",
               tsi_result_to_string(result));
@@ -218,11 +225,14 @@ class grpc_enclave_server_security_connector final
     grpc_enclave_server_credentials *server_creds =
         CHECK_NOTNULL(dynamic_cast<grpc_enclave_server_credentials *>(
             this->mutable_server_creds()));
+    asylo::EkepResumptionOptions resumption;
+    resumption.ticket_issuer = server_creds->ticket_issuer;
     tsi_result result = tsi_enclave_handshaker_create(
         /*is_client=*/false, absl::MakeSpan(server_creds->self_assertions),
         absl::MakeSpan(server_creds->accepted_peer_assertions),
         server_creds->additional_authenticated_data, server_creds->peer_acl,
-        &tsi_handshaker);
+        resumption, server_creds->record_protocols,
+        server_creds->max_protected_frame_size, &tsi_handshaker);
     if (result != TSI_OK) {
       gpr_log(GPR_ERROR, "Enclave handshaker creation failed with error %s.",
               tsi_result_to_string(result));
@@ -19,13 +19,16 @@
 #include "asylo/grpc/auth/core/enclave_transport_security.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <google/protobuf/io/coded_stream.h>
 #include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "asylo/grpc/auth/core/client_ekep_handshaker.h"
@@ -39,10 +42,13 @@
 #include "asylo/identity/identity_acl_evaluator.h"
 #include "asylo/util/cleansing_types.h"
 #include "asylo/util/statusor.h"
+#include "asylo/util/worker_pool.h"
 #include "include/grpc/support/log.h"
 #include "src/core/lib/gpr/string.h"
+#include "src/core/lib/iomgr/exec_ctx.h"
 #include "src/core/lib/surface/api_trace.h"
 #include "src/core/tsi/alts/frame_protector/alts_frame_protector.h"
+#include "src/core/tsi/alts/zero_copy_frame_protector/alts_zero_copy_grpc_protector.h"
 #include "src/core/tsi/transport_security.h"
 
 namespace asylo {
@@ -50,6 +56,16 @@ namespace {
 
 constexpr int kEnclavePeerPropertyCount = 3;
 
+// Returns the pool that runs handshake steps off the gRPC I/O threads.
+// Handshake steps may generate and verify assertions, which can involve slow
+// calls to the Assertion Generator Enclave or to the hardware, and must not
+// stall the other connections served by the same poller.
+WorkerPool *GetHandshakePool() {
+  static WorkerPool *pool =
+      new WorkerPool(/*max_workers=*/4, /*idle_timeout=*/absl::Seconds(10));
+  return pool;
+}
+
 }  // namespace
 
 // --- tsi_handshaker_result implementation. ---
@@ -60,24 +76,49 @@ class TsiEnclaveHandshakerResult {
   TsiEnclaveHandshakerResult(
       bool is_client, RecordProtocol record_protocol,
       const CleansingVector<uint8_t> &record_protocol_key,
+      uint32_t max_protected_frame_size,
       std::unique_ptr<EnclaveIdentities> peer_identities,
       std::string unused_bytes)
       : is_client_(is_client),
         record_protocol_(record_protocol),
         record_protocol_key_(record_protocol_key),
+        max_protected_frame_size_(max_protected_frame_size),
         peer_identities_(std::move(peer_identities)),
         unused_bytes_(std::move(unused_bytes)) {}
 
   // Creates a frame protector that uses a max frame size of
   // |max_output_protected_frame_size|, if non-null, and places the result in
-  // |protector|.
+  // |protector|. A frame size negotiated during the handshake takes precedence.
   tsi_result CreateFrameProtector(size_t *max_output_protected_frame_size,
                                   tsi_frame_protector **protector) {
+    size_t frame_size;
     switch (record_protocol_) {
       case ALTSRP_AES128_GCM:
+      case ALTSRP_AES256_GCM:
         return alts_create_frame_protector(
             record_protocol_key_.data(), record_protocol_key_.size(),
-            is_client_, /*is_rekey=*/false, max_output_protected_frame_size,
+            is_client_, /*is_rekey=*/false,
+            SelectFrameSize(max_output_protected_frame_size, &frame_size),
+            protector);
+      default:
+        return TSI_INTERNAL_ERROR;
+    }
+  }
+
+  // Creates a zero-copy gRPC protector, which protects and unprotects slice
+  // buffers in place, and places the result in |protector|. Frame sizes are
+  // selected as in CreateFrameProtector().
+  tsi_result CreateZeroCopyProtector(size_t *max_output_protected_frame_size,
+                                     tsi_zero_copy_grpc_protector **protector) {
+    size_t frame_size;
+    switch (record_protocol_) {
+      case ALTSRP_AES128_GCM:
+      case ALTSRP_AES256_GCM:
+        return alts_zero_copy_grpc_protector_create(
+            record_protocol_key_.data(), record_protocol_key_.size(),
+            /*is_rekey=*/false, is_client_, /*is_integrity_only=*/false,
+            /*enable_extra_copy=*/false,
+            SelectFrameSize(max_output_protected_frame_size, &frame_size),
             protector);
       default:
         return TSI_INTERNAL_ERROR;
@@ -143,6 +184,23 @@ class TsiEnclaveHandshakerResult {
   }
 
  private:
+  // Returns the max frame size to configure a protector with. Both peers must
+  // use the same size, so the size negotiated during the handshake, if any,
+  // replaces the size requested by the caller. It is written through
+  // |max_output_protected_frame_size| if that is non-null, so that the caller
+  // learns the size in use, and to |frame_size| otherwise.
+  size_t *SelectFrameSize(size_t *max_output_protected_frame_size,
+                          size_t *frame_size) const {
+    if (max_protected_frame_size_ == 0) {
+      return max_output_protected_frame_size;
+    }
+    size_t *selected = max_output_protected_frame_size != nullptr
+                           ? max_output_protected_frame_size
+                           : frame_size;
+    *selected = max_protected_frame_size_;
+    return selected;
+  }
+
   // True if this is a client handshaker result. Required for configuration of
   // the frame protector.
   bool is_client_;
@@ -153,6 +211,9 @@ class TsiEnclaveHandshakerResult {
   // The record protocol key to use for frame protection.
   CleansingVector<uint8_t> record_protocol_key_;
 
+  // The max frame size negotiated during the handshake, or zero if none was.
+  uint32_t max_protected_frame_size_;
+
   // The peer's enclave identities.
   std::unique_ptr<EnclaveIdentities> peer_identities_;
 
@@ -175,6 +236,16 @@ tsi_result enclave_handshaker_result_extract_peer(
   return result->impl->ExtractPeer(peer);
 }
 
+tsi_result enclave_handshaker_result_create_zero_copy_grpc_protector(
+    const tsi_handshaker_result *self, size_t *max_output_protected_frame_size,
+    tsi_zero_copy_grpc_protector **protector) {
+  const tsi_enclave_handshaker_result *result =
+      reinterpret_cast<const tsi_enclave_handshaker_result *>(self);
+
+  return result->impl->CreateZeroCopyProtector(max_output_protected_frame_size,
+                                               protector);
+}
+
 tsi_result enclave_handshaker_result_create_frame_protector(
     const tsi_handshaker_result *self, size_t *max_output_protected_frame_size,
     tsi_frame_protector **protector) {
@@ -202,7 +273,7 @@ void enclave_handshaker_result_destroy(tsi_handshaker_result *self) {
 
 const tsi_handshaker_result_vtable handshaker_result_vtable = {
     enclave_handshaker_result_extract_peer,
-    nullptr /* create_zero_copy_grpc_protector */,
+    enclave_handshaker_result_create_zero_copy_grpc_protector,
     enclave_handshaker_result_create_frame_protector,
     enclave_handshaker_result_get_unused_bytes,
     enclave_handshaker_result_destroy,
@@ -227,16 +298,33 @@ tsi_result enclave_handshaker_result_create(
 
 // Implementation of tsi_handshaker that uses an underlying EkepHandshaker
 // object to perform an Enclave Key Exchange Protocol (EKEP) handshake.
+//
+// When gRPC provides a completion callback and |pool| has a free worker, a
+// handshake step runs on that worker and its result is delivered through the
+// callback, so that assertion generation and verification do not block the
+// gRPC I/O thread.
 struct tsi_enclave_handshaker {
   tsi_handshaker base;
   bool is_client;
   const absl::optional<IdentityAclPredicate> peer_acl;
   std::unique_ptr<EkepHandshaker> handshaker;
+  WorkerPool *pool;
+  std::string incoming_bytes;
   std::string outgoing_bytes;
 
   tsi_enclave_handshaker(bool is_client,
                          const absl::optional<IdentityAclPredicate> &peer_acl,
-                         std::unique_ptr<EkepHandshaker> ekep_handshaker);
+                         std::unique_ptr<EkepHandshaker> ekep_handshaker,
+                         WorkerPool *pool);
+
+  // Runs the next step of the handshake on |received_bytes|, and places the
+  // bytes to send to the peer in |bytes_to_send| and |bytes_to_send_size| and
+  // the result of a completed handshake in |handshaker_result|.
+  tsi_result next_step(const unsigned char *received_bytes,
+                       size_t received_bytes_size,
+                       const unsigned char **bytes_to_send,
+                       size_t *bytes_to_send_size,
+                       tsi_handshaker_result **handshaker_result);
 
   tsi_result evaluate_acl(const std::vector<EnclaveIdentity> &identities);
 };
@@ -265,18 +353,57 @@ tsi_result enclave_handshaker_next(
 
   tsi_enclave_handshaker *tsi_handshaker =
       reinterpret_cast<tsi_enclave_handshaker *>(self);
-  EkepHandshaker *handshaker = tsi_handshaker->handshaker.get();
+  if (!cb || !tsi_handshaker->pool) {
+    return tsi_handshaker->next_step(received_bytes, received_bytes_size,
+                                     bytes_to_send, bytes_to_send_size,
+                                     handshaker_result);
+  }
 
+  // Run the step on the pool. gRPC does not call next() again before |cb|
+  // runs, and does not destroy the handshaker in the meantime, but it may reuse
+  // its buffer of received bytes, so they are copied.
+  //
+  // Steps are only handed to free workers. A step may block on a nested
+  // handshake, such as the one a remote assertion generator makes with its
+  // assertion service, whose steps would otherwise wait for the pool that the
+  // blocked step occupies. Without a free worker the step runs here instead.
+  tsi_handshaker->incoming_bytes.assign(
+      reinterpret_cast<const char *>(received_bytes), received_bytes_size);
+  auto step = [tsi_handshaker, cb, user_data] {
+    grpc_core::ExecCtx exec_ctx;
+    const unsigned char *bytes_to_send = nullptr;
+    size_t bytes_to_send_size = 0;
+    tsi_handshaker_result *handshaker_result = nullptr;
+    tsi_result result = tsi_handshaker->next_step(
+        reinterpret_cast<const unsigned char *>(
+            tsi_handshaker->incoming_bytes.data()),
+        tsi_handshaker->incoming_bytes.size(), &bytes_to_send,
+        &bytes_to_send_size, &handshaker_result);
+    cb(result, user_data, bytes_to_send, bytes_to_send_size,
+       handshaker_result);
+  };
+  if (!tsi_handshaker->pool->TrySchedule(std::move(step))) {
+    return tsi_handshaker->next_step(received_bytes, received_bytes_size,
+                                     bytes_to_send, bytes_to_send_size,
+                                     handshaker_result);
+  }
+  return TSI_ASYNC;
+}
+
+tsi_result tsi_enclave_handshaker::next_step(
+    const unsigned char *received_bytes, size_t received_bytes_size,
+    const unsigned char **bytes_to_send, size_t *bytes_to_send_size,
+    tsi_handshaker_result **handshaker_result) {
   // Run the next step of the handshake.
   EkepHandshaker::Result handshake_step_result = handshaker->NextHandshakeStep(
       reinterpret_cast<const char *>(received_bytes), received_bytes_size,
-      &tsi_handshaker->outgoing_bytes);
+      &outgoing_bytes);
 
   // Write the outgoing bytes.
-  if (!tsi_handshaker->outgoing_bytes.empty()) {
-    *bytes_to_send = reinterpret_cast<const unsigned char *>(
-        tsi_handshaker->outgoing_bytes.data());
-    *bytes_to_send_size = tsi_handshaker->outgoing_bytes.size();
+  if (!outgoing_bytes.empty()) {
+    *bytes_to_send =
+        reinterpret_cast<const unsigned char *>(outgoing_bytes.data());
+    *bytes_to_send_size = outgoing_bytes.size();
   }
 
   *handshaker_result = nullptr;
@@ -312,6 +439,15 @@ tsi_result enclave_handshaker_next(
         return TSI_INTERNAL_ERROR;
       }
 
+      StatusOr<uint32_t> frame_size_result =
+          handshaker->GetMaxProtectedFrameSize();
+      if (!frame_size_result.ok()) {
+        gpr_log(
+            GPR_ERROR, "Failed to retrieve max protected frame size: %s",
+            std::string(frame_size_result.status().error_message()).c_str());
+        return TSI_INTERNAL_ERROR;
+      }
+
       StatusOr<std::unique_ptr<EnclaveIdentities>> identities_result =
           handshaker->GetPeerIdentities();
       if (!identities_result.ok()) {
@@ -324,7 +460,7 @@ tsi_result enclave_handshaker_next(
       std::unique_ptr<EnclaveIdentities> identities =
           std::move(identities_result).ValueOrDie();
 
-      tsi_result acl_eval_result = tsi_handshaker->evaluate_acl(
+      tsi_result acl_eval_result = evaluate_acl(
           {identities->identities().begin(), identities->identities().end()});
       if (acl_eval_result != TSI_OK) {
         return acl_eval_result;
@@ -333,12 +469,13 @@ tsi_result enclave_handshaker_next(
       // Create the handshaker result object.
       tsi_result result = enclave_handshaker_result_create(
           absl::make_unique<TsiEnclaveHandshakerResult>(
-              tsi_handshaker->is_client, record_protocol_result.ValueOrDie(),
-              key_result.ValueOrDie(), std::move(identities),
+              is_client, record_protocol_result.ValueOrDie(),
+              key_result.ValueOrDie(), frame_size_result.ValueOrDie(),
+              std::move(identities),
               unused_bytes_result.ValueOrDie()),
           handshaker_result);
       if (result == TSI_OK) {
-        self->handshaker_result_created = true;
+        base.handshaker_result_created = true;
       }
       return result;
     }
@@ -360,10 +497,12 @@ const tsi_handshaker_vtable handshaker_vtable = {
 
 tsi_enclave_handshaker::tsi_enclave_handshaker(
     bool is_client, const absl::optional<IdentityAclPredicate> &peer_acl,
-    std::unique_ptr<EkepHandshaker> ekep_handshaker)
+    std::unique_ptr<EkepHandshaker> ekep_handshaker,
+    WorkerPool *pool)
     : is_client(is_client),
       peer_acl(peer_acl),
-      handshaker(std::move(ekep_handshaker)) {
+      handshaker(std::move(ekep_handshaker)),
+      pool(pool) {
   base.handshaker_result_created = false;
   base.handshake_shutdown = false;
   base.vtable = &handshaker_vtable;
@@ -397,14 +536,18 @@ tsi_result tsi_enclave_handshaker_create(
     absl::Span<asylo::AssertionDescription> accepted_peer_assertions,
     absl::string_view additional_authenticated_data,
     const absl::optional<asylo::IdentityAclPredicate> &peer_acl,
-    tsi_handshaker **handshaker) {
+    const asylo::EkepResumptionOptions &resumption,
+    absl::Span<const asylo::RecordProtocol> record_protocols,
+    uint32_t max_protected_frame_size, tsi_handshaker **handshaker) {
   GRPC_API_TRACE(
       "tsi_enclave_handshaker_create(is_client=%d, self_assertions=%p, "
       "accepted_peer_assertions=%p, additional_authenticated_data=%p, "
-      "peer_acl=%d, handshaker=%p)",
-      6,
+      "peer_acl=%d, resumption=%p, record_protocols=%p, "
+      "max_protected_frame_size=%u, handshaker=%p)",
+      9,
       (is_client, self_assertions.data(), accepted_peer_assertions.data(),
-       additional_authenticated_data.data(), peer_acl.has_value(), handshaker));
+       additional_authenticated_data.data(), peer_acl.has_value(), &resumption,
+       record_protocols.data(), max_protected_frame_size, handshaker));
 
   // Convert arguments to handshaker options.
   asylo::EkepHandshakerOptions options;
@@ -413,6 +556,12 @@ tsi_result tsi_enclave_handshaker_create(
   options.self_assertions = {self_assertions.cbegin(), self_assertions.cend()};
   options.accepted_peer_assertions = {accepted_peer_assertions.cbegin(),
                                       accepted_peer_assertions.cend()};
+  options.resumption = resumption;
+  if (!record_protocols.empty()) {
+    options.record_protocols = {record_protocols.cbegin(),
+                                record_protocols.cend()};
+  }
+  options.max_protected_frame_size = max_protected_frame_size;
 
   if (!options.additional_authenticated_data.empty()) {
     gpr_log(GPR_DEBUG, "additional authenticated data: %s",
@@ -442,7 +591,8 @@ tsi_result tsi_enclave_handshaker_create(
 
   asylo::tsi_enclave_handshaker *tsi_handshaker =
       new asylo::tsi_enclave_handshaker(is_client, peer_acl,
-                                        std::move(ekep_handshaker));
+                                        std::move(ekep_handshaker),
+                                        asylo::GetHandshakePool());
 
   *handshaker = &tsi_handshaker->base;
   return TSI_OK;
@@ -0,0 +1,454 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/enclave_transport_security.h"
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/identity/descriptions.h"
+#include "asylo/identity/enclave_assertion_authority_config.pb.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/identity/init.h"
+#include "asylo/test/util/enclave_assertion_authority_configs.h"
+#include "asylo/test/util/status_matchers.h"
+#include "include/grpc/grpc.h"
+#include "include/grpc/slice_buffer.h"
+#include "src/core/lib/iomgr/exec_ctx.h"
+#include "src/core/tsi/transport_security_grpc.h"
+#include "src/core/tsi/transport_security_interface.h"
+
+namespace asylo {
+namespace {
+
+constexpr uint32_t kSmallFrameSize = 4096;
+constexpr uint32_t kLargeFrameSize = 16384;
+
+// Length of the data protected in round trips. Spans several frames of
+// kSmallFrameSize.
+constexpr size_t kPayloadSize = 5 * kSmallFrameSize + 123;
+
+// Outcome of an asynchronous handshake step, as delivered to the callback.
+struct AsyncStep {
+  absl::Notification done;
+  tsi_result result = TSI_INTERNAL_ERROR;
+  std::string bytes_to_send;
+  tsi_handshaker_result *handshaker_result = nullptr;
+};
+
+// Records the outcome of an asynchronous handshake step in the AsyncStep
+// pointed to by |user_data|.
+void OnNextDone(tsi_result status, void *user_data,
+                const unsigned char *bytes_to_send, size_t bytes_to_send_size,
+                tsi_handshaker_result *handshaker_result) {
+  AsyncStep *step = static_cast<AsyncStep *>(user_data);
+  step->result = status;
+  step->bytes_to_send.assign(reinterpret_cast<const char *>(bytes_to_send),
+                             bytes_to_send_size);
+  step->handshaker_result = handshaker_result;
+  step->done.Notify();
+}
+
+// Returns the contents of |buffer| as a string.
+std::string SliceBufferToString(const grpc_slice_buffer &buffer) {
+  std::string contents;
+  for (size_t i = 0; i < buffer.count; ++i) {
+    contents.append(
+        reinterpret_cast<const char *>(GRPC_SLICE_START_PTR(buffer.slices[i])),
+        GRPC_SLICE_LENGTH(buffer.slices[i]));
+  }
+  return contents;
+}
+
+class EnclaveTransportSecurityTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    std::vector<EnclaveAssertionAuthorityConfig> authority_configs = {
+        GetNullAssertionAuthorityTestConfig()};
+    ASSERT_THAT(InitializeEnclaveAssertionAuthorities(
+                    authority_configs.cbegin(), authority_configs.cend()),
+                IsOk());
+  }
+
+  void SetUp() override { grpc_init(); }
+
+  void TearDown() override {
+    absl::MutexLock lock(&mu_);
+    for (tsi_zero_copy_grpc_protector *protector : protectors_) {
+      tsi_zero_copy_grpc_protector_destroy(protector);
+    }
+    for (tsi_handshaker_result *result : results_) {
+      tsi_handshaker_result_destroy(result);
+    }
+    for (tsi_handshaker *handshaker : handshakers_) {
+      tsi_handshaker_destroy(handshaker);
+    }
+    grpc_shutdown();
+  }
+
+  // Creates a client or server handshaker that authenticates with null
+  // assertions and proposes |record_protocols| and |max_protected_frame_size|.
+  tsi_handshaker *CreateHandshaker(
+      bool is_client, std::vector<RecordProtocol> record_protocols,
+      uint32_t max_protected_frame_size) {
+    std::vector<AssertionDescription> assertions(1);
+    SetNullAssertionDescription(&assertions[0]);
+    std::vector<AssertionDescription> peer_assertions = assertions;
+
+    tsi_handshaker *handshaker = nullptr;
+    EXPECT_EQ(tsi_enclave_handshaker_create(
+                  is_client, absl::MakeSpan(assertions),
+                  absl::MakeSpan(peer_assertions),
+                  /*additional_authenticated_data=*/"",
+                  /*peer_acl=*/absl::nullopt, EkepResumptionOptions(),
+                  record_protocols, max_protected_frame_size, &handshaker),
+              TSI_OK);
+    absl::MutexLock lock(&mu_);
+    handshakers_.push_back(handshaker);
+    return handshaker;
+  }
+
+  // Runs a handshake between |client| and |server| by passing the bytes of
+  // each to the other, and places the handshake results in |client_result|
+  // and |server_result|.
+  void RunHandshake(tsi_handshaker *client, tsi_handshaker *server,
+                    tsi_handshaker_result **client_result,
+                    tsi_handshaker_result **server_result) {
+    grpc_core::ExecCtx exec_ctx;
+    std::string to_server;
+    std::string to_client;
+    *client_result = nullptr;
+    *server_result = nullptr;
+
+    // Alternate between the peers until both have a result. Without a
+    // callback, the handshakers run each step synchronously.
+    tsi_handshaker *peers[] = {client, server};
+    tsi_handshaker_result **results[] = {client_result, server_result};
+    std::string *inboxes[] = {&to_client, &to_server};
+    std::string *outboxes[] = {&to_server, &to_client};
+    for (int turn = 0; !*client_result || !*server_result; turn ^= 1) {
+      if (*results[turn]) {
+        continue;
+      }
+      const unsigned char *bytes_to_send = nullptr;
+      size_t bytes_to_send_size = 0;
+      tsi_result result = tsi_handshaker_next(
+          peers[turn],
+          reinterpret_cast<const unsigned char *>(inboxes[turn]->data()),
+          inboxes[turn]->size(), &bytes_to_send, &bytes_to_send_size,
+          results[turn], /*cb=*/nullptr, /*user_data=*/nullptr);
+      ASSERT_TRUE(result == TSI_OK || result == TSI_INCOMPLETE_DATA)
+          << tsi_result_to_string(result);
+      inboxes[turn]->clear();
+      outboxes[turn]->append(reinterpret_cast<const char *>(bytes_to_send),
+                             bytes_to_send_size);
+    }
+    absl::MutexLock lock(&mu_);
+    results_.push_back(*client_result);
+    results_.push_back(*server_result);
+  }
+
+  // Like RunHandshake(), but passes a callback to each step, and expects the
+  // step to complete asynchronously and deliver its outcome to the callback.
+  // If |synchronous_steps| is not null, steps may complete synchronously as
+  // well, and are counted in |*synchronous_steps|.
+  void RunAsyncHandshake(tsi_handshaker *client, tsi_handshaker *server,
+                         tsi_handshaker_result **client_result,
+                         tsi_handshaker_result **server_result,
+                         int *synchronous_steps = nullptr) {
+    std::string to_server;
+    std::string to_client;
+    *client_result = nullptr;
+    *server_result = nullptr;
+
+    tsi_handshaker *peers[] = {client, server};
+    tsi_handshaker_result **results[] = {client_result, server_result};
+    std::string *inboxes[] = {&to_client, &to_server};
+    std::string *outboxes[] = {&to_server, &to_client};
+    for (int turn = 0; !*client_result || !*server_result; turn ^= 1) {
+      if (*results[turn]) {
+        continue;
+      }
+      AsyncStep step;
+      const unsigned char *bytes_to_send = nullptr;
+      size_t bytes_to_send_size = 0;
+      tsi_handshaker_result *handshaker_result = nullptr;
+      tsi_result result;
+      {
+        grpc_core::ExecCtx exec_ctx;
+        result = tsi_handshaker_next(
+            peers[turn],
+            reinterpret_cast<const unsigned char *>(inboxes[turn]->data()),
+            inboxes[turn]->size(), &bytes_to_send, &bytes_to_send_size,
+            &handshaker_result, OnNextDone, &step);
+      }
+      if (result == TSI_ASYNC) {
+        // The received bytes are copied, so the caller may reuse its buffer
+        // before the step completes.
+        inboxes[turn]->assign(inboxes[turn]->size(), '\0');
+        inboxes[turn]->clear();
+        step.done.WaitForNotification();
+      } else {
+        ASSERT_NE(synchronous_steps, nullptr)
+            << "Step completed synchronously: " << tsi_result_to_string(result);
+        ++*synchronous_steps;
+        inboxes[turn]->clear();
+        step.result = result;
+        step.bytes_to_send.assign(reinterpret_cast<const char *>(bytes_to_send),
+                                  bytes_to_send_size);
+        step.handshaker_result = handshaker_result;
+      }
+      ASSERT_TRUE(step.result == TSI_OK || step.result == TSI_INCOMPLETE_DATA)
+          << tsi_result_to_string(step.result);
+      *results[turn] = step.handshaker_result;
+      outboxes[turn]->append(step.bytes_to_send);
+    }
+    absl::MutexLock lock(&mu_);
+    results_.push_back(*client_result);
+    results_.push_back(*server_result);
+  }
+
+  // Creates a zero-copy protector from |result|, passing
+  // |max_output_protected_frame_size| through.
+  tsi_zero_copy_grpc_protector *CreateProtector(
+      tsi_handshaker_result *result, size_t *max_output_protected_frame_size) {
+    tsi_zero_copy_grpc_protector *protector = nullptr;
+    EXPECT_EQ(tsi_handshaker_result_create_zero_copy_grpc_protector(
+                  result, max_output_protected_frame_size, &protector),
+              TSI_OK);
+    absl::MutexLock lock(&mu_);
+    protectors_.push_back(protector);
+    return protector;
+  }
+
+  // Protects |payload| with |sender| and expects |receiver| to unprotect it.
+  void ExpectRoundTrip(tsi_zero_copy_grpc_protector *sender,
+                       tsi_zero_copy_grpc_protector *receiver,
+                       const std::string &payload) {
+    grpc_core::ExecCtx exec_ctx;
+    grpc_slice_buffer unprotected;
+    grpc_slice_buffer protected_slices;
+    grpc_slice_buffer received;
+    grpc_slice_buffer_init(&unprotected);
+    grpc_slice_buffer_init(&protected_slices);
+    grpc_slice_buffer_init(&received);
+
+    grpc_slice_buffer_add(&unprotected, grpc_slice_from_copied_buffer(
+                                            payload.data(), payload.size()));
+    EXPECT_EQ(tsi_zero_copy_grpc_protector_protect(sender, &unprotected,
+                                                   &protected_slices),
+              TSI_OK);
+    EXPECT_NE(SliceBufferToString(protected_slices), payload);
+    EXPECT_EQ(tsi_zero_copy_grpc_protector_unprotect(
+                  receiver, &protected_slices, &received),
+              TSI_OK);
+    EXPECT_EQ(SliceBufferToString(received), payload);
+
+    grpc_slice_buffer_destroy(&unprotected);
+    grpc_slice_buffer_destroy(&protected_slices);
+    grpc_slice_buffer_destroy(&received);
+  }
+
+  // Outcome of a handshake step whose callback runs a nested handshake first.
+  struct NestedStep {
+    EnclaveTransportSecurityTest *test;
+    AsyncStep step;
+    int synchronous_steps = 0;
+  };
+
+  // Runs a handshake from the callback of a handshake step and blocks until it
+  // completes, as a remote assertion generator does with its assertion service.
+  // Then records the outcome of the step in the NestedStep pointed to by
+  // |user_data|.
+  static void OnNextDoneAfterNestedHandshake(
+      tsi_result status, void *user_data, const unsigned char *bytes_to_send,
+      size_t bytes_to_send_size, tsi_handshaker_result *handshaker_result) {
+    NestedStep *nested = static_cast<NestedStep *>(user_data);
+    EnclaveTransportSecurityTest *test = nested->test;
+    tsi_handshaker_result *client_result;
+    tsi_handshaker_result *server_result;
+    test->RunAsyncHandshake(
+        test->CreateHandshaker(/*is_client=*/true, {ALTSRP_AES128_GCM},
+                               kSmallFrameSize),
+        test->CreateHandshaker(/*is_client=*/false, {ALTSRP_AES128_GCM},
+                               kSmallFrameSize),
+        &client_result, &server_result, &nested->synchronous_steps);
+    OnNextDone(status, &nested->step, bytes_to_send, bytes_to_send_size,
+               handshaker_result);
+  }
+
+  // Guards the members below, since nested handshakes run on other threads.
+  absl::Mutex mu_;
+  std::vector<tsi_handshaker *> handshakers_ ABSL_GUARDED_BY(mu_);
+  std::vector<tsi_handshaker_result *> results_ ABSL_GUARDED_BY(mu_);
+  std::vector<tsi_zero_copy_grpc_protector *> protectors_ ABSL_GUARDED_BY(mu_);
+};
+
+// Verifies that data protected by the zero-copy protector of one peer can be
+// unprotected by that of the other peer, in both directions, for each record
+// protocol.
+TEST_F(EnclaveTransportSecurityTest, ZeroCopyProtectorsRoundTrip) {
+  const std::string payload(kPayloadSize, 'p');
+  for (RecordProtocol record_protocol :
+       {ALTSRP_AES128_GCM, ALTSRP_AES256_GCM}) {
+    SCOPED_TRACE(RecordProtocol_Name(record_protocol));
+    tsi_handshaker_result *client_result;
+    tsi_handshaker_result *server_result;
+    ASSERT_NO_FATAL_FAILURE(RunHandshake(
+        CreateHandshaker(/*is_client=*/true, {record_protocol},
+                         kSmallFrameSize),
+        CreateHandshaker(/*is_client=*/false, {record_protocol},
+                         kSmallFrameSize),
+        &client_result, &server_result));
+
+    tsi_zero_copy_grpc_protector *client_protector = CreateProtector(
+        client_result, /*max_output_protected_frame_size=*/nullptr);
+    tsi_zero_copy_grpc_protector *server_protector = CreateProtector(
+        server_result, /*max_output_protected_frame_size=*/nullptr);
+    ExpectRoundTrip(client_protector, server_protector, payload);
+    ExpectRoundTrip(server_protector, client_protector, payload);
+  }
+}
+
+// Verifies that the frame size negotiated during the handshake replaces the
+// one requested by the caller, and is reported back to the caller.
+TEST_F(EnclaveTransportSecurityTest, ReportsNegotiatedFrameSize) {
+  tsi_handshaker_result *client_result;
+  tsi_handshaker_result *server_result;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(
+      CreateHandshaker(/*is_client=*/true, {ALTSRP_AES128_GCM},
+                       kLargeFrameSize),
+      CreateHandshaker(/*is_client=*/false, {ALTSRP_AES128_GCM},
+                       kSmallFrameSize),
+      &client_result, &server_result));
+
+  size_t client_frame_size = kLargeFrameSize;
+  size_t server_frame_size = kLargeFrameSize;
+  tsi_zero_copy_grpc_protector *client_protector =
+      CreateProtector(client_result, &client_frame_size);
+  tsi_zero_copy_grpc_protector *server_protector =
+      CreateProtector(server_result, &server_frame_size);
+  EXPECT_EQ(client_frame_size, kSmallFrameSize);
+  EXPECT_EQ(server_frame_size, kSmallFrameSize);
+  ExpectRoundTrip(client_protector, server_protector,
+                  std::string(kPayloadSize, 'p'));
+}
+
+// Verifies that the frame size requested by the caller is used if none was
+// negotiated during the handshake.
+TEST_F(EnclaveTransportSecurityTest, KeepsRequestedFrameSizeIfNoneNegotiated) {
+  tsi_handshaker_result *client_result;
+  tsi_handshaker_result *server_result;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(
+      CreateHandshaker(/*is_client=*/true, {ALTSRP_AES128_GCM},
+                       /*max_protected_frame_size=*/0),
+      CreateHandshaker(/*is_client=*/false, {ALTSRP_AES128_GCM},
+                       kSmallFrameSize),
+      &client_result, &server_result));
+
+  size_t client_frame_size = kSmallFrameSize;
+  size_t server_frame_size = kSmallFrameSize;
+  tsi_zero_copy_grpc_protector *client_protector =
+      CreateProtector(client_result, &client_frame_size);
+  tsi_zero_copy_grpc_protector *server_protector =
+      CreateProtector(server_result, &server_frame_size);
+  EXPECT_EQ(client_frame_size, kSmallFrameSize);
+  EXPECT_EQ(server_frame_size, kSmallFrameSize);
+  ExpectRoundTrip(client_protector, server_protector,
+                  std::string(kPayloadSize, 'p'));
+}
+
+// Verifies that, given a callback, the handshakers run each step off the
+// calling thread and deliver its outcome through the callback, and that the
+// resulting protectors interoperate.
+TEST_F(EnclaveTransportSecurityTest, RunsStepsAsynchronouslyWithCallback) {
+  tsi_handshaker_result *client_result;
+  tsi_handshaker_result *server_result;
+  ASSERT_NO_FATAL_FAILURE(RunAsyncHandshake(
+      CreateHandshaker(/*is_client=*/true, {ALTSRP_AES128_GCM},
+                       kSmallFrameSize),
+      CreateHandshaker(/*is_client=*/false, {ALTSRP_AES128_GCM},
+                       kSmallFrameSize),
+      &client_result, &server_result));
+
+  tsi_zero_copy_grpc_protector *client_protector = CreateProtector(
+      client_result, /*max_output_protected_frame_size=*/nullptr);
+  tsi_zero_copy_grpc_protector *server_protector = CreateProtector(
+      server_result, /*max_output_protected_frame_size=*/nullptr);
+  ExpectRoundTrip(client_protector, server_protector,
+                  std::string(kPayloadSize, 'p'));
+}
+
+// Verifies that handshakes complete when more of them than the handshake pool
+// has workers block in a step on a nested handshake. The steps of the nested
+// handshakes must not wait for the blocked workers.
+TEST_F(EnclaveTransportSecurityTest, CompletesNestedHandshakesBeyondPoolSize) {
+  // More than the workers of the handshake pool.
+  constexpr int kHandshakes = 8;
+  std::vector<tsi_handshaker *> clients;
+  for (int i = 0; i < kHandshakes; i++) {
+    clients.push_back(CreateHandshaker(/*is_client=*/true, {ALTSRP_AES128_GCM},
+                                       kSmallFrameSize));
+  }
+
+  // Start the first step of each client concurrently. Steps that find no free
+  // worker complete synchronously, without running a nested handshake.
+  std::vector<NestedStep> steps(kHandshakes);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kHandshakes; i++) {
+    steps[i].test = this;
+    threads.emplace_back([&clients, &steps, i] {
+      grpc_core::ExecCtx exec_ctx;
+      const unsigned char *bytes_to_send = nullptr;
+      size_t bytes_to_send_size = 0;
+      tsi_handshaker_result *handshaker_result = nullptr;
+      tsi_result result = tsi_handshaker_next(
+          clients[i], /*received_bytes=*/nullptr, /*received_bytes_size=*/0,
+          &bytes_to_send, &bytes_to_send_size, &handshaker_result,
+          OnNextDoneAfterNestedHandshake, &steps[i]);
+      if (result != TSI_ASYNC) {
+        OnNextDone(result, &steps[i].step, bytes_to_send, bytes_to_send_size,
+                   handshaker_result);
+      }
+    });
+  }
+
+  for (NestedStep &nested : steps) {
+    nested.step.done.WaitForNotification();
+    EXPECT_EQ(nested.step.result, TSI_OK)
+        << tsi_result_to_string(nested.step.result);
+    EXPECT_FALSE(nested.step.bytes_to_send.empty());
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace
+}  // namespace asylo
@@ -21,8 +21,11 @@
 #include <openssl/curve25519.h>
 #include <openssl/rand.h>
 
+#include <algorithm>
+
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "absl/memory/memory.h"
+#include "absl/time/clock.h"
 #include "asylo/crypto/sha256_hash.h"
 #include "asylo/util/logging.h"
 #include "asylo/grpc/auth/core/ekep_crypto.h"
@@ -60,11 +63,15 @@ ServerEkepHandshaker::ServerEkepHandshaker(const EkepHandshakerOptions &options)
       self_assertions_(options.self_assertions),
       accepted_peer_assertions_(options.accepted_peer_assertions),
       available_cipher_suites_({CURVE25519_SHA256}),
-      available_record_protocols_({ALTSRP_AES128_GCM}),
+      available_record_protocols_(options.record_protocols),
+      max_protected_frame_size_(options.max_protected_frame_size),
       available_ekep_versions_({"EKEP v1"}),
       additional_authenticated_data_(options.additional_authenticated_data),
+      ticket_issuer_(options.resumption.ticket_issuer),
+      session_resumed_(false),
       selected_cipher_suite_(UNKNOWN_HANDSHAKE_CIPHER),
       selected_record_protocol_(UNKNOWN_RECORD_PROTOCOL),
+      selected_max_protected_frame_size_(0),
       expected_message_type_(CLIENT_PRECOMMIT),
       // The handshake is in progress for the server because it relies on the
       // client to act first.
@@ -224,12 +231,28 @@ Status ServerEkepHandshaker::HandleClientPrecommit(
     return Status(Abort::BAD_RECORD_PROTOCOL, "No compatible record_protocol");
   }
 
+  // Use the smaller of the frame sizes proposed by the participants, or the
+  // default frame size if either of them did not propose one.
+  if (client_precommit.max_protected_frame_size() != 0 &&
+      max_protected_frame_size_ != 0) {
+    selected_max_protected_frame_size_ = std::min(
+        client_precommit.max_protected_frame_size(), max_protected_frame_size_);
+  }
+  SetMaxProtectedFrameSize(selected_max_protected_frame_size_);
+
   // Verify that the client sent an adequately-sized challenge.
   if (client_precommit.challenge().size() != kEkepChallengeSize) {
     return Status(Abort::PROTOCOL_ERROR,
                   "Received a challenge with incorrect size");
   }
 
+  // A session that is resumed needs no assertions. Otherwise, fall back to a
+  // full handshake.
+  if (!client_precommit.session_ticket().empty() &&
+      ResumeSession(client_precommit.session_ticket())) {
+    return WriteServerPrecommit(output);
+  }
+
   for (const AssertionOffer &offer : client_precommit.client_offers()) {
     const AssertionDescription &offer_desc = offer.description();
     // Request any assertion that the peer offered and that this handshaker is
@@ -318,6 +341,15 @@ Status ServerEkepHandshaker::HandleClientId(const google::protobuf::Message &mes
                   "Client did not provide all expected assertions");
   }
 
+  // The client of a resumed session proves its identities by knowing the
+  // resumption secret instead.
+  if (session_resumed_) {
+    for (const EnclaveIdentity &identity :
+         resumed_session_.peer_identities.identities()) {
+      AddPeerIdentity(identity);
+    }
+  }
+
   std::copy(client_id.dh_public_key().cbegin(),
             client_id.dh_public_key().cend(),
             std::back_inserter(client_public_key_));
@@ -362,6 +394,13 @@ Status ServerEkepHandshaker::WriteServerPrecommit(std::string *output) {
       selected_ekep_version_);
   server_precommit.set_selected_cipher_suite(selected_cipher_suite_);
   server_precommit.set_selected_record_protocol(selected_record_protocol_);
+  if (session_resumed_) {
+    server_precommit.set_session_resumed(true);
+  }
+  if (selected_max_protected_frame_size_ != 0) {
+    server_precommit.set_max_protected_frame_size(
+        selected_max_protected_frame_size_);
+  }
 
   if (!additional_authenticated_data_.empty()) {
     server_precommit.mutable_options()->set_data(
@@ -466,9 +505,10 @@ Status ServerEkepHandshaker::WriteServerFinish(std::string *output) {
   std::string transcript_hash;
   ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&transcript_hash));
 
-  ASYLO_RETURN_IF_ERROR(DeriveSecrets(selected_cipher_suite_, transcript_hash,
-                                      client_public_key_, dh_private_key_,
-                                      &master_secret_, &authenticator_secret_));
+  ASYLO_RETURN_IF_ERROR(DeriveSecrets(
+      selected_cipher_suite_, transcript_hash, client_public_key_,
+      dh_private_key_, resumed_session_.resumption_secret, &master_secret_,
+      &authenticator_secret_));
 
   CleansingVector<uint8_t> authenticator;
   ASYLO_RETURN_IF_ERROR(ComputeServerHandshakeAuthenticator(
@@ -477,10 +517,65 @@ Status ServerEkepHandshaker::WriteServerFinish(std::string *output) {
   ServerFinish server_finish;
   server_finish.set_handshake_authenticator(authenticator.data(),
                                             authenticator.size());
+  if (ticket_issuer_) {
+    IssueSessionTicket(transcript_hash, &server_finish);
+  }
 
   return WriteFrameAndUpdateTranscript(SERVER_FINISH, server_finish, output);
 }
 
+bool ServerEkepHandshaker::ResumeSession(const std::string &ticket) {
+  if (!ticket_issuer_) {
+    return false;
+  }
+
+  StatusOr<EkepResumableSession> session_result =
+      ticket_issuer_->Redeem(ticket);
+  if (!session_result.ok()) {
+    LOG(INFO) << "Not resuming session: " << session_result.status();
+    return false;
+  }
+  EkepResumableSession session = std::move(session_result).ValueOrDie();
+  if (session.cipher_suite != selected_cipher_suite_ ||
+      session.record_protocol != selected_record_protocol_) {
+    LOG(INFO) << "Not resuming session: negotiated parameters differ from "
+              << "those of the session";
+    return false;
+  }
+
+  resumed_session_ = std::move(session);
+  session_resumed_ = true;
+  return true;
+}
+
+void ServerEkepHandshaker::IssueSessionTicket(
+    const std::string &transcript_hash, ServerFinish *server_finish) {
+  EkepResumableSession session;
+  session.cipher_suite = selected_cipher_suite_;
+  session.record_protocol = selected_record_protocol_;
+  session.peer_identities = peer_identities();
+
+  // A resumed session was authenticated when the session it resumes was, so
+  // its ticket expires no later than the ticket it was resumed with.
+  session.authentication_time = session_resumed_
+                                    ? resumed_session_.authentication_time
+                                    : absl::Now();
+  Status status =
+      DeriveResumptionSecret(selected_cipher_suite_, transcript_hash,
+                             master_secret_, &session.resumption_secret);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to derive resumption secret: " << status;
+    return;
+  }
+
+  StatusOr<std::string> ticket_result = ticket_issuer_->Issue(session);
+  if (!ticket_result.ok()) {
+    LOG(ERROR) << "Failed to issue session ticket: " << ticket_result.status();
+    return;
+  }
+  server_finish->set_session_ticket(std::move(ticket_result).ValueOrDie());
+}
+
 bool ServerEkepHandshaker::SetSelectedEkepVersion(
     const google::protobuf::RepeatedPtrField<EkepVersion> &ekep_versions) {
   // Choose the first compatible EKEP version available.
@@ -28,6 +28,7 @@
 #include <google/protobuf/message.h>
 #include "asylo/grpc/auth/core/ekep_handshaker.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/util/cleansing_types.h"
 
 namespace asylo {
@@ -100,6 +101,18 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // transcript.
   Status WriteServerFinish(std::string *output);
 
+  // Attempts to resume the session for which |ticket| was issued, using the
+  // negotiated cipher suite and record protocol. Returns false if the session
+  // cannot be resumed, in which case the handshake falls back to a full
+  // handshake.
+  bool ResumeSession(const std::string &ticket);
+
+  // Issues a ticket with which the client can resume the session being
+  // established, and sets it in |server_finish|. Failure to issue a ticket
+  // does not fail the handshake.
+  void IssueSessionTicket(const std::string &transcript_hash,
+                          ServerFinish *server_finish);
+
   // Sets the handshaker's selected EKEP version to first compatible EKEP
   // version in |ekep_versions|. Returns false if there is no compatible EKEP
   // version in |ekep_versions|.
@@ -129,6 +142,10 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // A list of supported record protocols.
   const std::vector<RecordProtocol> available_record_protocols_;
 
+  // The largest protected record frame the server is willing to use, or zero
+  // to use the default frame size of the record protocol.
+  const uint32_t max_protected_frame_size_;
+
   // A list of supported protocol versions in order of most recent to least
   // recent.
   const std::vector<std::string> available_ekep_versions_;
@@ -136,6 +153,14 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // Additional data that is authenticated during the handshake.
   const std::string additional_authenticated_data_;
 
+  // Issuer of session tickets, or null if session resumption is disabled.
+  const std::shared_ptr<EkepTicketIssuer> ticket_issuer_;
+
+  // Whether the handshake resumes a previous session, and that session. These
+  // fields are populated after validation of the ClientPrecommit message.
+  bool session_resumed_;
+  EkepResumableSession resumed_session_;
+
   // Assertions requested by the client that the server is willing to offer.
   // This field is populated after validation of the ClientPrecommit message.
   std::vector<AssertionRequest> promised_assertions_;
@@ -153,6 +178,11 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // message.
   RecordProtocol selected_record_protocol_;
 
+  // The selected maximum size of protected record frames, or zero for the
+  // default. This field is populated after validation of the ClientPrecommit
+  // message.
+  uint32_t selected_max_protected_frame_size_;
+
   // The selected EKEP version for the handshake. This field is populated after
   // validation of the ClientPrecommit message.
   std::string selected_ekep_version_;
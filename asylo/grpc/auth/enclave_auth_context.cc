@@ -133,4 +133,14 @@ StatusOr<bool> EnclaveAuthContext::EvaluateAcl(
   return EvaluateAcl(acl, explanation);
 }
 
+StatusOr<bool> EnclaveAuthContext::EvaluateAcl(
+    const CompiledIdentityAcl &acl) const {
+  return EvaluateAcl(acl, /*explanation=*/nullptr);
+}
+
+StatusOr<bool> EnclaveAuthContext::EvaluateAcl(const CompiledIdentityAcl &acl,
+                                               std::string *explanation) const {
+  return acl.Evaluate(identities_, explanation);
+}
+
 }  // namespace asylo
@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/identity/compiled_identity_acl.h"
 #include "asylo/identity/delegating_identity_expectation_matcher.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/identity/identity_acl.pb.h"
@@ -121,6 +122,28 @@ class EnclaveAuthContext {
       const EnclaveIdentityExpectation &expectation,
       std::string *explanation) const;
 
+  /// Evaluates the peer's identities against the precompiled `acl`. Prefer
+  /// this to evaluating an `IdentityAclPredicate` when checking the same ACL
+  /// on every call, since the compiled ACL memoizes its results per set of
+  /// peer identities.
+  ///
+  /// \param acl The compiled ACL against which to evaluate the peer's
+  ///            identities.
+  /// \return A bool indicating whether the peer's identities match `acl`, or a
+  ///         non-OK Status if an error occurred while evaluating the ACL.
+  virtual StatusOr<bool> EvaluateAcl(const CompiledIdentityAcl &acl) const;
+
+  /// Evaluates the peer's identities against the precompiled `acl`.
+  ///
+  /// \param acl The compiled ACL against which to evaluate the peer's
+  ///            identities.
+  /// \param[out] explanation An explanation of why the peer's identities did
+  ///             not match `acl`, if the result is false.
+  /// \return A bool indicating whether the peer's identities match `acl`, or a
+  ///         non-OK Status if an error occurred while evaluating the ACL.
+  virtual StatusOr<bool> EvaluateAcl(const CompiledIdentityAcl &acl,
+                                     std::string *explanation) const;
+
  private:
   // Creates an EnclaveAuthContext for the given peer's |identities| and the
   // session |record_protocol|.
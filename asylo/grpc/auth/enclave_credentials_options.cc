@@ -17,6 +17,8 @@
  */
 #include "asylo/grpc/auth/enclave_credentials_options.h"
 
+#include <algorithm>
+
 #include "asylo/identity/identity_acl.pb.h"
 
 namespace asylo {
@@ -48,6 +50,18 @@ EnclaveCredentialsOptions &EnclaveCredentialsOptions::Add(
       peer_acl = additional.peer_acl;
     }
   }
+  if (additional.session_resumption.enabled) {
+    session_resumption = additional.session_resumption;
+  }
+  for (RecordProtocol record_protocol : additional.record_protocols) {
+    if (std::find(record_protocols.cbegin(), record_protocols.cend(),
+                  record_protocol) == record_protocols.cend()) {
+      record_protocols.push_back(record_protocol);
+    }
+  }
+  if (additional.max_protected_frame_size != 0) {
+    max_protected_frame_size = additional.max_protected_frame_size;
+  }
 
   return *this;
 }
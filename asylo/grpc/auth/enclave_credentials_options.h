@@ -19,15 +19,41 @@
 #ifndef ASYLO_GRPC_AUTH_ENCLAVE_CREDENTIALS_OPTIONS_H_
 #define ASYLO_GRPC_AUTH_ENCLAVE_CREDENTIALS_OPTIONS_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/identity/assertion_description_util.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/identity/identity_acl.pb.h"
 
 namespace asylo {
 
+/// Options for resuming the sessions of peers that completed a handshake
+/// before, without exchanging assertions again.
+///
+/// Servers issue session tickets to their clients, and clients offer the
+/// tickets when reconnecting to the same target. A resumed session carries the
+/// peer identities that were authenticated when the ticket was issued.
+struct SessionResumptionOptions {
+  /// Whether session resumption is enabled.
+  bool enabled = false;
+
+  /// The time after which an issued session ticket is no longer accepted.
+  absl::Duration ticket_lifetime = absl::Hours(1);
+
+  /// Whether a server accepts each session ticket only once.
+  bool single_use_tickets = true;
+
+  /// The number of session tickets a client holds, or the number of redeemed
+  /// session tickets a server remembers in order to reject replays.
+  size_t max_tickets = 1024;
+};
+
 /// Options used to configure a `::grpc::ChannelCredentials` object or a
 /// `::grpc::ServerCredentials` object for use in an enclave system.
 struct EnclaveCredentialsOptions {
@@ -53,6 +79,20 @@ struct EnclaveCredentialsOptions {
   /// authenticated peer's identities will cause gRPC channel establishment to
   /// fail.
   absl::optional<IdentityAclPredicate> peer_acl;
+
+  /// Session resumption options. Disabled by default.
+  SessionResumptionOptions session_resumption;
+
+  /// Record protocols that may protect the channel once it is established, in
+  /// order of preference. If empty, `ALTSRP_AES128_GCM` is used.
+  std::vector<RecordProtocol> record_protocols;
+
+  /// The largest protected record frame, in bytes, that the credential holder
+  /// is willing to use. Larger frames reduce the per-frame overhead of bulk
+  /// transfers. The peers use the smaller of their sizes. If zero, or if the
+  /// peer does not set a size, the default size of the record protocol is
+  /// used.
+  uint32_t max_protected_frame_size = 0;
 };
 
 }  // namespace asylo
@@ -20,6 +20,7 @@
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/grpc/auth/null_credentials_options.h"
 #include "asylo/grpc/auth/sgx_local_credentials_options.h"
 #include "asylo/identity/descriptions.h"
@@ -30,6 +31,7 @@
 namespace asylo {
 namespace {
 
+using ::testing::ElementsAre;
 using ::testing::Test;
 using ::testing::UnorderedElementsAre;
 
@@ -151,5 +153,19 @@ TEST_F(EnclaveCredentialsOptionsTest, CombineIdentityAclPredicates) {
   EXPECT_THAT(lhs.Add(rhs).peer_acl, Optional(EqualsProto(combined)));
 }
 
+TEST_F(EnclaveCredentialsOptionsTest, CombineRecordProtocolOptions) {
+  EnclaveCredentialsOptions lhs = BidirectionalNullCredentialsOptions();
+  lhs.record_protocols = {ALTSRP_AES256_GCM, ALTSRP_AES128_GCM};
+
+  EnclaveCredentialsOptions rhs = BidirectionalNullCredentialsOptions();
+  rhs.record_protocols = {ALTSRP_AES128_GCM};
+  rhs.max_protected_frame_size = 1 << 20;
+
+  EnclaveCredentialsOptions combined = lhs.Add(rhs);
+  EXPECT_THAT(combined.record_protocols,
+              ElementsAre(ALTSRP_AES256_GCM, ALTSRP_AES128_GCM));
+  EXPECT_EQ(combined.max_protected_frame_size, 1 << 20);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -0,0 +1,288 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of channels secured by the enclave gRPC stack over loopback: the
+// rate and latency of EKEP handshakes, and the throughput of secure streams.
+// The client and the server run in this process, and authenticate with null
+// assertions and SGX local assertions of a fake enclave. Each benchmark thread
+// uses its own channels, hence the number of threads is the number of
+// concurrent connections. Run with --benchmarks=all.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/grpc/auth/enclave_channel_credentials.h"
+#include "asylo/grpc/auth/enclave_credentials_options.h"
+#include "asylo/grpc/auth/enclave_server_credentials.h"
+#include "asylo/grpc/auth/null_credentials_options.h"
+#include "asylo/grpc/auth/sgx_local_credentials_options.h"
+#include "asylo/grpc/auth/test/secure_channel_benchmark.grpc.pb.h"
+#include "asylo/identity/enclave_assertion_authority_config.pb.h"
+#include "asylo/identity/init.h"
+#include "asylo/identity/sgx/fake_enclave.h"
+#include "asylo/test/util/enclave_assertion_authority_configs.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status.h"
+#include "include/grpcpp/grpcpp.h"
+
+namespace asylo {
+namespace {
+
+constexpr char kAddress[] = "[::1]";
+
+// Deadline for connecting a channel.
+constexpr absl::Duration kConnectionDeadline = absl::Seconds(10);
+
+// Assertions that the client offers and requests.
+enum Assertions {
+  kNull = 0,
+  kSgxLocal = 1,
+  kNullAndSgxLocal = 2,
+};
+
+class EchoBenchmarkImpl final : public test::EchoBenchmark::Service {
+ private:
+  ::grpc::Status Echo(
+      ::grpc::ServerContext *context,
+      ::grpc::ServerReaderWriter<test::EchoMessage, test::EchoMessage> *stream)
+      override {
+    test::EchoMessage message;
+    while (stream->Read(&message)) {
+      if (!stream->Write(message)) {
+        break;
+      }
+    }
+    return ::grpc::Status::OK;
+  }
+};
+
+// Returns credentials options for offering and accepting |assertions|, with
+// session resumption enabled if |resumption| is true.
+EnclaveCredentialsOptions CreateOptions(Assertions assertions,
+                                        bool resumption) {
+  EnclaveCredentialsOptions options;
+  switch (assertions) {
+    case kNull:
+      options = BidirectionalNullCredentialsOptions();
+      break;
+    case kSgxLocal:
+      options = BidirectionalSgxLocalCredentialsOptions();
+      break;
+    case kNullAndSgxLocal:
+      options = BidirectionalNullCredentialsOptions().Add(
+          BidirectionalSgxLocalCredentialsOptions());
+      break;
+  }
+  options.session_resumption.enabled = resumption;
+  return options;
+}
+
+// A server that accepts any of the benchmarked assertions and record
+// protocols.
+class BenchmarkServer {
+ public:
+  explicit BenchmarkServer(bool resumption) {
+    EnclaveCredentialsOptions options =
+        CreateOptions(kNullAndSgxLocal, resumption);
+    options.record_protocols = {ALTSRP_AES128_GCM, ALTSRP_AES256_GCM};
+
+    ::grpc::ServerBuilder builder;
+    builder.RegisterService(&service_);
+    int port = 0;
+    builder.AddListeningPort(absl::StrCat(kAddress, ":", port),
+                             EnclaveServerCredentials(options), &port);
+    server_ = builder.BuildAndStart();
+    CHECK(server_ != nullptr && port != 0);
+    address_ = absl::StrCat(kAddress, ":", port);
+  }
+
+  const std::string &address() const { return address_; }
+
+ private:
+  EchoBenchmarkImpl service_;
+  std::unique_ptr<::grpc::Server> server_;
+  std::string address_;
+};
+
+// Enters a fake enclave of random identity and initializes the assertion
+// authorities.
+bool InitializeEnclave() {
+  sgx::FakeEnclave enclave;
+  enclave.SetRandomIdentity();
+  sgx::FakeEnclave::EnterEnclave(enclave);
+
+  std::vector<EnclaveAssertionAuthorityConfig> configs = {
+      GetNullAssertionAuthorityTestConfig(),
+      GetSgxLocalAssertionAuthorityTestConfig()};
+  Status status =
+      InitializeEnclaveAssertionAuthorities(configs.cbegin(), configs.cend());
+  CHECK(status.ok()) << status;
+  return true;
+}
+
+// Returns the address of a server that issues session tickets if |resumption|
+// is true. The servers are started once per process.
+const std::string &GetServerAddress(bool resumption) {
+  static const bool initialized = InitializeEnclave();
+  (void)initialized;
+  static BenchmarkServer *server = new BenchmarkServer(/*resumption=*/false);
+  static BenchmarkServer *resumption_server =
+      new BenchmarkServer(/*resumption=*/true);
+  return resumption ? resumption_server->address() : server->address();
+}
+
+// Connects a new channel to |address| with |credentials|. The channel does not
+// share connections with other channels, hence connecting it runs a handshake.
+std::shared_ptr<::grpc::Channel> Connect(
+    const std::string &address,
+    const std::shared_ptr<::grpc::ChannelCredentials> &credentials) {
+  ::grpc::ChannelArguments args;
+  args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+  std::shared_ptr<::grpc::Channel> channel =
+      ::grpc::CreateCustomChannel(address, credentials, args);
+  CHECK(channel->WaitForConnected(
+      absl::ToChronoTime(absl::Now() + kConnectionDeadline)))
+      << "Failed to connect to " << address;
+  return channel;
+}
+
+// Returns the |percentile| of |latencies|, which is reordered.
+double Percentile(std::vector<double> *latencies, double percentile) {
+  if (latencies->empty()) {
+    return 0;
+  }
+  size_t rank = std::min(
+      latencies->size() - 1,
+      static_cast<size_t>(percentile / 100 * latencies->size()));
+  std::nth_element(latencies->begin(), latencies->begin() + rank,
+                   latencies->end());
+  return (*latencies)[rank];
+}
+
+// Handshake latencies in microseconds of all threads of a BM_Handshake run.
+absl::Mutex handshake_latencies_mu;
+std::vector<double> *handshake_latencies
+    ABSL_GUARDED_BY(handshake_latencies_mu) = new std::vector<double>();
+
+// Connects a new channel per iteration with the assertions given by the first
+// argument, and with session resumption if the second argument is non-zero.
+// Reports the rate of handshakes, and the median and 99th percentile of the
+// handshake latencies of all threads in microseconds.
+void BM_Handshake(benchmark::State &state) {
+  Assertions assertions = static_cast<Assertions>(state.range(0));
+  bool resumption = state.range(1) != 0;
+  const std::string &address = GetServerAddress(resumption);
+
+  // Threads only record latencies once all threads have entered the loop.
+  if (state.thread_index == 0) {
+    absl::MutexLock lock(&handshake_latencies_mu);
+    handshake_latencies->clear();
+  }
+
+  // The credentials hold the session tickets of the client, so they are shared
+  // by all channels of the thread.
+  std::shared_ptr<::grpc::ChannelCredentials> credentials =
+      EnclaveChannelCredentials(CreateOptions(assertions, resumption));
+  for (auto _ : state) {
+    absl::Time start = absl::Now();
+    std::shared_ptr<::grpc::Channel> channel = Connect(address, credentials);
+    double latency = absl::ToDoubleMicroseconds(absl::Now() - start);
+
+    state.PauseTiming();
+    {
+      absl::MutexLock lock(&handshake_latencies_mu);
+      handshake_latencies->push_back(latency);
+    }
+    channel.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  // All threads have left the loop, hence recorded all their latencies. Thread
+  // counters are summed, so only one thread reports the percentiles.
+  if (state.thread_index == 0) {
+    absl::MutexLock lock(&handshake_latencies_mu);
+    state.counters["p50_us"] = Percentile(handshake_latencies, 50);
+    state.counters["p99_us"] = Percentile(handshake_latencies, 99);
+  }
+}
+
+void HandshakeArguments(benchmark::internal::Benchmark *benchmark) {
+  for (int assertions : {kNull, kSgxLocal, kNullAndSgxLocal}) {
+    for (int resumption : {0, 1}) {
+      benchmark->Args({assertions, resumption});
+    }
+  }
+}
+BENCHMARK(BM_Handshake)
+    ->ArgNames({"assertions", "resumption"})
+    ->Apply(HandshakeArguments)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// Echoes a message of the size given by the first argument per iteration on a
+// stream protected by the record protocol given by the second argument, and
+// reports the throughput in both directions.
+void BM_StreamThroughput(benchmark::State &state) {
+  size_t message_size = state.range(0);
+  EnclaveCredentialsOptions options =
+      CreateOptions(kNull, /*resumption=*/false);
+  options.record_protocols = {static_cast<RecordProtocol>(state.range(1))};
+  std::shared_ptr<::grpc::Channel> channel =
+      Connect(GetServerAddress(/*resumption=*/false),
+              EnclaveChannelCredentials(options));
+  std::unique_ptr<test::EchoBenchmark::Stub> stub =
+      test::EchoBenchmark::NewStub(channel);
+
+  ::grpc::ClientContext context;
+  std::unique_ptr<
+      ::grpc::ClientReaderWriter<test::EchoMessage, test::EchoMessage>>
+      stream = stub->Echo(&context);
+  test::EchoMessage request;
+  request.set_payload(std::string(message_size, 'p'));
+  test::EchoMessage response;
+  for (auto _ : state) {
+    CHECK(stream->Write(request));
+    CHECK(stream->Read(&response));
+  }
+  CHECK(stream->WritesDone());
+  ::grpc::Status status = stream->Finish();
+  CHECK(status.ok()) << status.error_message();
+  state.SetBytesProcessed(2 * state.iterations() * message_size);
+}
+BENCHMARK(BM_StreamThroughput)
+    ->ArgNames({"message_size", "record_protocol"})
+    ->Args({1 << 10, ALTSRP_AES128_GCM})
+    ->Args({64 << 10, ALTSRP_AES128_GCM})
+    ->Args({1 << 20, ALTSRP_AES128_GCM})
+    ->Args({1 << 20, ALTSRP_AES256_GCM})
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace asylo
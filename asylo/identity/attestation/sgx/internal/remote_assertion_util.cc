@@ -32,11 +32,11 @@
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
-#include "absl/types/span.h"
 #include "asylo/crypto/algorithms.pb.h"
 #include "asylo/crypto/certificate.pb.h"
 #include "asylo/crypto/certificate_interface.h"
 #include "asylo/crypto/certificate_util.h"
+#include "asylo/crypto/certificate_verification_cache.h"
 #include "asylo/crypto/ecdsa_p256_sha256_signing_key.h"
 #include "asylo/crypto/keys.pb.h"
 #include "asylo/crypto/signing_key.h"
@@ -81,26 +81,35 @@ StatusOr<std::unique_ptr<VerifyingKey>> CreateVerifyingKey(
                       key_proto.signature_scheme()));
 }
 
-StatusOr<CertificateInterfaceVector>
+// Returns the cache for parsing and verifying the certificate chains of remote
+// assertions, which share the Intel certificates of the platforms they come
+// from.
+CertificateVerificationCache *GetCertificateVerificationCache() {
+  static CertificateVerificationCache *cache = new CertificateVerificationCache;
+  return cache;
+}
+
+StatusOr<SharedCertificateInterfaceVector>
 VerifyCertificateChainsAndExtractIntelCertificateChain(
     const google::protobuf::RepeatedPtrField<CertificateChain> &certificate_chains,
     const CertificateInterface &intel_root,
     CertificateInterfaceSpan additional_root_certificates,
     absl::string_view verifying_key_der) {
-  CertificateInterfaceVector intel_cert_chain;
+  SharedCertificateInterfaceVector intel_cert_chain;
   CertificateFactoryMap factory_map;
   factory_map.emplace(Certificate::X509_DER, X509Certificate::Create);
   factory_map.emplace(Certificate::X509_PEM, X509Certificate::Create);
   factory_map.emplace(Certificate::SGX_ATTESTATION_KEY_CERTIFICATE,
                       AttestationKeyCertificateImpl::Create);
 
-  std::vector<std::unique_ptr<CertificateInterface>> verified_root_certificates;
+  CertificateVerificationCache *cache = GetCertificateVerificationCache();
+  SharedCertificateInterfaceVector verified_root_certificates;
   VerificationConfig config(/*all_fields=*/true);
   for (const CertificateChain &certificate_chain : certificate_chains) {
-    CertificateInterfaceVector certificate_vector;
+    SharedCertificateInterfaceVector certificate_vector;
     ASYLO_ASSIGN_OR_RETURN(
         certificate_vector,
-        CreateCertificateChain(factory_map, certificate_chain));
+        cache->CreateCertificateChain(factory_map, certificate_chain));
 
     std::string cert_chain_end_user_key_der;
     ASYLO_ASSIGN_OR_RETURN(cert_chain_end_user_key_der,
@@ -108,8 +117,7 @@ VerifyCertificateChainsAndExtractIntelCertificateChain(
     if (cert_chain_end_user_key_der != verifying_key_der) {
       continue;
     }
-    Status verified =
-        VerifyCertificateChain(absl::MakeConstSpan(certificate_vector), config);
+    Status verified = cache->VerifyCertificateChain(certificate_vector, config);
     if (!verified.ok()) {
       return verified.WithPrependedContext(absl::StrCat(
           "Failed to verify certificate chain with root cert ",
@@ -119,8 +127,7 @@ VerifyCertificateChainsAndExtractIntelCertificateChain(
     if (*certificate_vector.back() == intel_root) {
       intel_cert_chain = std::move(certificate_vector);
     } else {
-      verified_root_certificates.emplace_back(
-          certificate_vector.rbegin()->release());
+      verified_root_certificates.push_back(certificate_vector.back());
     }
   }
 
@@ -136,7 +143,8 @@ VerifyCertificateChainsAndExtractIntelCertificateChain(
     if (!std::any_of(verified_root_certificates.begin(),
                      verified_root_certificates.end(),
                      [&required_root_certificate](
-                         const std::unique_ptr<CertificateInterface> &other) {
+                         const std::shared_ptr<const CertificateInterface>
+                             &other) {
                        return *required_root_certificate == *other;
                      })) {
       std::string subject_key;
@@ -181,17 +189,6 @@ Status VerifyAgeExpectation(const IdentityAclPredicate &age_expectation,
   return Status::OkStatus();
 }
 
-StatusOr<SgxExtensions> ExtractSgxExtensions(
-    absl::Span<X509Extension> pck_extensions) {
-  for (const X509Extension &extension : pck_extensions) {
-    if (extension.oid == GetSgxExtensionsOid()) {
-      return ReadSgxExtensions(extension.value);
-    }
-  }
-  return Status(error::GoogleError::INVALID_ARGUMENT,
-                "PCK certificate does not contain SGX extensions");
-}
-
 StatusOr<MachineConfiguration> ExtractMachineConfiguration(
     const CertificateInterface *pck_certificate) {
   X509Certificate const *pck_cert =
@@ -201,16 +198,23 @@ StatusOr<MachineConfiguration> ExtractMachineConfiguration(
                   "PCK certificate is not an X.509 certificate");
   }
 
-  auto pck_extensions_result = pck_cert->GetOtherExtensions();
-  if (!pck_extensions_result.ok()) {
-    return pck_extensions_result.status().WithPrependedContext(
+  // Read the DER of the SGX extensions directly, without building an ASN.1
+  // tree of the extensions of the certificate.
+  auto sgx_extensions_der_result =
+      pck_cert->GetExtensionValue(GetSgxExtensionsOid());
+  if (!sgx_extensions_der_result.ok()) {
+    return sgx_extensions_der_result.status().WithPrependedContext(
         "PCK certificate does not contain extensions");
   }
-  std::vector<X509Extension> pck_extensions =
-      std::move(pck_extensions_result).ValueOrDie();
+  absl::optional<std::vector<uint8_t>> sgx_extensions_der =
+      std::move(sgx_extensions_der_result).ValueOrDie();
+  if (!sgx_extensions_der.has_value()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "PCK certificate does not contain SGX extensions");
+  }
   SgxExtensions sgx_extensions;
   ASYLO_ASSIGN_OR_RETURN(sgx_extensions,
-                         ExtractSgxExtensions(absl::MakeSpan(pck_extensions)));
+                         ReadSgxExtensionsFromDer(*sgx_extensions_der));
 
   sgx::MachineConfiguration machine_config;
 
@@ -295,7 +299,7 @@ Status VerifyRemoteAssertion(
   ASYLO_RETURN_IF_ERROR(
       verifying_key->Verify(assertion.payload(), assertion.signature()));
 
-  CertificateInterfaceVector intel_cert_chain;
+  SharedCertificateInterfaceVector intel_cert_chain;
   ASYLO_ASSIGN_OR_RETURN(intel_cert_chain,
                          VerifyCertificateChainsAndExtractIntelCertificateChain(
                              assertion.certificate_chains(), intel_root,
@@ -0,0 +1,334 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/compiled_identity_acl.h"
+
+#include <utility>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "asylo/crypto/sha256_hash.h"
+#include "asylo/identity/named_identity_expectation_matcher.h"
+#include "asylo/platform/common/static_map.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+// String used to separate individual explanations in an accumulation of
+// explanation strings. Matches the one used by EvaluateIdentityAcl().
+constexpr char kSeparator[] = "\n  ";
+
+// Returns true if |lhs| and |rhs| describe the same kind of identity.
+bool SameDescription(const EnclaveIdentityDescription &lhs,
+                     const EnclaveIdentityDescription &rhs) {
+  return lhs.identity_type() == rhs.identity_type() &&
+         lhs.authority_type() == rhs.authority_type();
+}
+
+}  // namespace
+
+constexpr size_t CompiledIdentityAcl::kDefaultMemoCapacity;
+
+StatusOr<std::unique_ptr<CompiledIdentityAcl>> CompiledIdentityAcl::Create(
+    const IdentityAclPredicate &acl, size_t memo_capacity) {
+  auto compiled = absl::WrapUnique(
+      new CompiledIdentityAcl(/*matcher=*/nullptr, memo_capacity));
+  ASYLO_RETURN_IF_ERROR(compiled->Compile(acl));
+  compiled->ResolveTypedMatchers();
+  return std::move(compiled);
+}
+
+StatusOr<std::unique_ptr<CompiledIdentityAcl>> CompiledIdentityAcl::Create(
+    const IdentityAclPredicate &acl, const IdentityExpectationMatcher &matcher,
+    size_t memo_capacity) {
+  auto compiled =
+      absl::WrapUnique(new CompiledIdentityAcl(&matcher, memo_capacity));
+  ASYLO_RETURN_IF_ERROR(compiled->Compile(acl));
+  return std::move(compiled);
+}
+
+CompiledIdentityAcl::CompiledIdentityAcl(
+    const IdentityExpectationMatcher *matcher, size_t memo_capacity)
+    : matcher_(matcher != nullptr ? matcher : &delegating_matcher_),
+      memo_capacity_(memo_capacity),
+      stats_{} {}
+
+StatusOr<bool> CompiledIdentityAcl::Evaluate(
+    const std::vector<EnclaveIdentity> &identities,
+    std::string *explanation) const {
+  std::string digest;
+  if (memo_capacity_ > 0) {
+    ASYLO_RETURN_IF_ERROR(HashIdentities(identities, &digest));
+
+    absl::MutexLock lock(&mu_);
+    auto it = memo_index_.find(digest);
+    if (it != memo_index_.end()) {
+      stats_.hits++;
+      memo_.splice(memo_.begin(), memo_, it->second);
+      const MemoEntry &entry = *it->second;
+      if (!entry.result && explanation != nullptr) {
+        *explanation = entry.explanation;
+      }
+      return entry.result;
+    }
+    stats_.misses++;
+  }
+
+  std::string local_explanation;
+  StatusOr<bool> result =
+      EvaluateNode(/*index=*/0, identities, &local_explanation);
+  if (!result.ok()) {
+    return result;
+  }
+  if (!local_explanation.empty()) {
+    local_explanation =
+        absl::StrCat("ACL failed to match:", kSeparator, local_explanation);
+  }
+  if (!result.ValueOrDie() && explanation != nullptr) {
+    *explanation = local_explanation;
+  }
+
+  if (memo_capacity_ > 0) {
+    absl::MutexLock lock(&mu_);
+    // Another thread may have memoized the same identities in the meantime.
+    if (memo_index_.find(digest) == memo_index_.end()) {
+      memo_.push_front(MemoEntry{digest, result.ValueOrDie(),
+                                 std::move(local_explanation)});
+      memo_index_.emplace(std::move(digest), memo_.begin());
+      while (memo_.size() > memo_capacity_) {
+        memo_index_.erase(memo_.back().digest);
+        memo_.pop_back();
+        stats_.evictions++;
+      }
+    }
+  }
+  return result;
+}
+
+void CompiledIdentityAcl::ClearMemo() {
+  absl::MutexLock lock(&mu_);
+  memo_index_.clear();
+  memo_.clear();
+}
+
+CompiledIdentityAcl::Stats CompiledIdentityAcl::GetStats() const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+Status CompiledIdentityAcl::Compile(const IdentityAclPredicate &acl) {
+  // |nodes_| may be reallocated while compiling the children, so the node is
+  // referred to by index.
+  size_t index = nodes_.size();
+  nodes_.push_back(Node{Node::kExpectation, /*end=*/0, {},
+                        /*typed_matcher=*/nullptr});
+
+  switch (acl.item_case()) {
+    case IdentityAclPredicate::kExpectation:
+      nodes_[index].expectation = acl.expectation();
+      break;
+    case IdentityAclPredicate::kAclGroup: {
+      const IdentityAclGroup &acl_group = acl.acl_group();
+      if (acl_group.predicates().empty()) {
+        return Status(error::GoogleError::INVALID_ARGUMENT,
+                      "ACL predicate groups cannot be empty");
+      }
+      switch (acl_group.type()) {
+        case IdentityAclGroup::OR:
+          nodes_[index].type = Node::kOr;
+          break;
+        case IdentityAclGroup::AND:
+          nodes_[index].type = Node::kAnd;
+          break;
+        case IdentityAclGroup::NOT:
+          if (acl_group.predicates_size() != 1) {
+            return Status(error::GoogleError::INVALID_ARGUMENT,
+                          "NOT predicate groups must have exactly one element");
+          }
+          nodes_[index].type = Node::kNot;
+          break;
+        default:
+          return Status(
+              error::GoogleError::INVALID_ARGUMENT,
+              absl::StrCat("Unknown acl_group type: ", acl_group.type()));
+      }
+      for (const IdentityAclPredicate &predicate : acl_group.predicates()) {
+        ASYLO_RETURN_IF_ERROR(Compile(predicate));
+      }
+      break;
+    }
+    case IdentityAclPredicate::ITEM_NOT_SET:
+      return Status(
+          error::GoogleError::INVALID_ARGUMENT,
+          "Invalid ACL predicate: must be either a group or an expectation.");
+    default:
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    absl::StrCat("Unknown acl item: ", acl.item_case()));
+  }
+
+  nodes_[index].end = nodes_.size();
+  return Status::OkStatus();
+}
+
+void CompiledIdentityAcl::ResolveTypedMatchers() {
+  for (Node &node : nodes_) {
+    if (node.type != Node::kExpectation) {
+      continue;
+    }
+    StatusOr<std::string> name_result =
+        NamedIdentityExpectationMatcher::GetMatcherName(
+            node.expectation.reference_identity().description());
+    if (!name_result.ok()) {
+      continue;
+    }
+    auto matcher_it =
+        IdentityExpectationMatcherMap::GetValue(name_result.ValueOrDie());
+    if (matcher_it != IdentityExpectationMatcherMap::value_end()) {
+      node.typed_matcher = &*matcher_it;
+    }
+  }
+}
+
+StatusOr<bool> CompiledIdentityAcl::EvaluateNode(
+    size_t index, const std::vector<EnclaveIdentity> &identities,
+    std::string *explanation) const {
+  const Node &node = nodes_[index];
+  if (node.type == Node::kExpectation) {
+    return EvaluateExpectation(node, identities, explanation);
+  }
+
+  if (node.type == Node::kNot) {
+    // Don't pass an explanation parameter to this call because the NOT group
+    // takes the inverse of the result.
+    StatusOr<bool> result =
+        EvaluateNode(index + 1, identities, /*explanation=*/nullptr);
+    if (!result.ok()) {
+      return result;
+    }
+    if (result.ValueOrDie() && explanation != nullptr) {
+      *explanation = "NOT predicate was satisfied when it should not have been";
+    }
+    return !result.ValueOrDie();
+  }
+
+  // An OR group is satisfied by its first satisfied predicate, while an AND
+  // group evaluates all of its predicates. Either way, the explanations of the
+  // unsatisfied predicates are accumulated.
+  std::vector<std::string> explanations;
+  bool match_result = node.type == Node::kAnd;
+  for (size_t child = index + 1; child < node.end; child = nodes_[child].end) {
+    std::string local_explanation;
+    StatusOr<bool> result =
+        EvaluateNode(child, identities, &local_explanation);
+    if (!result.ok()) {
+      return result;
+    }
+
+    if (node.type == Node::kOr && result.ValueOrDie()) {
+      return true;
+    }
+    match_result &= result.ValueOrDie();
+
+    if (!local_explanation.empty()) {
+      explanations.push_back(std::move(local_explanation));
+    }
+  }
+
+  if (match_result) {
+    return true;
+  }
+  if (explanation != nullptr) {
+    *explanation = absl::StrJoin(explanations, kSeparator);
+  }
+  return false;
+}
+
+StatusOr<bool> CompiledIdentityAcl::EvaluateExpectation(
+    const Node &node, const std::vector<EnclaveIdentity> &identities,
+    std::string *explanation) const {
+  const EnclaveIdentityDescription &expected_description =
+      node.expectation.reference_identity().description();
+  std::vector<std::string> explanations;
+  for (const EnclaveIdentity &identity : identities) {
+    // Identities of other descriptions go through |matcher_|, which knows how
+    // to report them.
+    const IdentityExpectationMatcher *matcher =
+        node.typed_matcher != nullptr &&
+                SameDescription(identity.description(), expected_description)
+            ? node.typed_matcher
+            : matcher_;
+
+    std::string local_explanation;
+    StatusOr<bool> result = matcher->MatchAndExplain(
+        identity, node.expectation, &local_explanation);
+    if (!result.ok()) {
+      return result;
+    }
+
+    if (result.ValueOrDie()) {
+      return true;
+    }
+
+    if (!local_explanation.empty()) {
+      explanations.push_back(std::move(local_explanation));
+    }
+  }
+
+  // No identities satisfied the expectation. Return an accumulation of the
+  // explanation strings.
+  if (explanation != nullptr) {
+    *explanation = absl::StrJoin(explanations, kSeparator);
+  }
+  return false;
+}
+
+Status CompiledIdentityAcl::HashIdentities(
+    const std::vector<EnclaveIdentity> &identities, std::string *digest) {
+  Sha256Hash hash;
+  for (const EnclaveIdentity &identity : identities) {
+    std::string serialized;
+    // The CodedOutputStream destructor can modify the string to contain
+    // garbage bytes.
+    {
+      google::protobuf::io::StringOutputStream string_stream(&serialized);
+      google::protobuf::io::CodedOutputStream coded_stream(&string_stream);
+      coded_stream.SetSerializationDeterministic(true);
+      if (!identity.SerializeToCodedStream(&coded_stream)) {
+        return Status(error::GoogleError::INVALID_ARGUMENT,
+                      "Failed to serialize identity");
+      }
+    }
+
+    // Prefix each identity with its length so that different lists of
+    // identities cannot hash the same.
+    uint64_t length = serialized.size();
+    hash.Update(ByteContainerView(&length, sizeof(length)));
+    hash.Update(serialized);
+  }
+
+  std::vector<uint8_t> digest_bytes;
+  ASYLO_RETURN_IF_ERROR(hash.CumulativeHash(&digest_bytes));
+  digest->assign(digest_bytes.begin(), digest_bytes.end());
+  return Status::OkStatus();
+}
+
+}  // namespace asylo
@@ -0,0 +1,186 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_IDENTITY_COMPILED_IDENTITY_ACL_H_
+#define ASYLO_IDENTITY_COMPILED_IDENTITY_ACL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/identity/delegating_identity_expectation_matcher.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/identity/identity_acl.pb.h"
+#include "asylo/identity/identity_expectation_matcher.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+/// An identity ACL that is validated and flattened once, and then evaluated
+/// repeatedly, such as on every RPC of a server.
+///
+/// A `CompiledIdentityAcl` produces the same results and explanations as
+/// `EvaluateIdentityAcl()`, with two differences:
+///
+///  * A malformed ACL is rejected by `Create()`, even if the malformed part of
+///    the ACL would never be reached during evaluation.
+///  * Results are memoized per set of identities. The identities are hashed
+///    with SHA-256 over their deterministic serialization, so that repeated
+///    evaluations against the same peer cost a hash lookup. Evaluations that
+///    fail with a non-OK status are not memoized.
+///
+/// Memoization assumes that the matcher is a pure function of the identity
+/// and the expectation, which holds for all matchers in Asylo.
+///
+/// This class is thread-safe.
+class CompiledIdentityAcl {
+ public:
+  /// Counters of the memo cache since the creation of the ACL.
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+  };
+
+  /// The default number of identity sets whose results are memoized.
+  static constexpr size_t kDefaultMemoCapacity = 64;
+
+  /// Compiles `acl` for evaluation with the matchers registered in the
+  /// `IdentityExpectationMatcherMap`, as `DelegatingIdentityExpectationMatcher`
+  /// does. The matcher for each expectation in `acl` is resolved once here,
+  /// rather than on every evaluation.
+  ///
+  /// \param acl The ACL to compile.
+  /// \param memo_capacity The number of identity sets whose results are
+  ///                      memoized. A capacity of zero disables memoization.
+  /// \return The compiled ACL, or an INVALID_ARGUMENT error if `acl` is
+  ///         malformed.
+  static StatusOr<std::unique_ptr<CompiledIdentityAcl>> Create(
+      const IdentityAclPredicate &acl,
+      size_t memo_capacity = kDefaultMemoCapacity);
+
+  /// Compiles `acl` for evaluation with `matcher`.
+  ///
+  /// \param acl The ACL to compile.
+  /// \param matcher The matcher to evaluate the expectations of `acl` with.
+  ///                Must outlive the returned object.
+  /// \param memo_capacity The number of identity sets whose results are
+  ///                      memoized. A capacity of zero disables memoization.
+  /// \return The compiled ACL, or an INVALID_ARGUMENT error if `acl` is
+  ///         malformed.
+  static StatusOr<std::unique_ptr<CompiledIdentityAcl>> Create(
+      const IdentityAclPredicate &acl,
+      const IdentityExpectationMatcher &matcher,
+      size_t memo_capacity = kDefaultMemoCapacity);
+
+  /// Evaluates whether `identities` satisfies the ACL.
+  ///
+  /// \param identities A list of identities to match against the ACL.
+  /// \param[out] explanation An explanation of why the match failed, if the
+  ///             result is false.
+  /// \return A bool indicating whether the ACL evaluated to true, or a non-OK
+  ///         Status if the matcher failed on any of `identities`.
+  StatusOr<bool> Evaluate(const std::vector<EnclaveIdentity> &identities,
+                          std::string *explanation = nullptr) const
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  /// Drops all memoized results.
+  void ClearMemo() ABSL_LOCKS_EXCLUDED(mu_);
+
+  /// Returns the counters of the memo cache.
+  Stats GetStats() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // A node of the flattened ACL. The nodes of a subtree are stored in
+  // pre-order, so the children of a group start right after the group node,
+  // and each node records where its subtree ends.
+  struct Node {
+    enum Type { kExpectation, kOr, kAnd, kNot };
+
+    Type type;
+
+    // Index one past the last node of the subtree rooted at this node.
+    size_t end;
+
+    // For kExpectation nodes, the expectation, and the registered matcher for
+    // the description of its reference identity, if resolved during
+    // compilation.
+    EnclaveIdentityExpectation expectation;
+    const IdentityExpectationMatcher *typed_matcher;
+  };
+
+  struct MemoEntry {
+    std::string digest;
+    bool result;
+    std::string explanation;
+  };
+
+  using MemoList = std::list<MemoEntry>;
+
+  CompiledIdentityAcl(const IdentityExpectationMatcher *matcher,
+                      size_t memo_capacity);
+
+  // Appends the nodes of |acl| to |nodes_|, validating it on the way.
+  Status Compile(const IdentityAclPredicate &acl);
+
+  // Resolves the registered matcher of each expectation node.
+  void ResolveTypedMatchers();
+
+  // Evaluates the subtree rooted at node |index|.
+  StatusOr<bool> EvaluateNode(size_t index,
+                              const std::vector<EnclaveIdentity> &identities,
+                              std::string *explanation) const;
+
+  // Evaluates the expectation node |node|.
+  StatusOr<bool> EvaluateExpectation(
+      const Node &node, const std::vector<EnclaveIdentity> &identities,
+      std::string *explanation) const;
+
+  // Sets |digest| to a hash of |identities|.
+  static Status HashIdentities(const std::vector<EnclaveIdentity> &identities,
+                               std::string *digest);
+
+  // Matcher used for expectations that have no typed matcher.
+  const IdentityExpectationMatcher *const matcher_;
+  const DelegatingIdentityExpectationMatcher delegating_matcher_;
+
+  std::vector<Node> nodes_;
+
+  const size_t memo_capacity_;
+
+  // Memoized results ordered from the most to the least recently used, and
+  // their index by digest.
+  mutable MemoList memo_ ABSL_GUARDED_BY(mu_);
+  mutable std::unordered_map<std::string, MemoList::iterator> memo_index_
+      ABSL_GUARDED_BY(mu_);
+  mutable Stats stats_ ABSL_GUARDED_BY(mu_);
+  mutable absl::Mutex mu_;
+
+  CompiledIdentityAcl(const CompiledIdentityAcl &) = delete;
+  CompiledIdentityAcl &operator=(const CompiledIdentityAcl &) = delete;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_IDENTITY_COMPILED_IDENTITY_ACL_H_
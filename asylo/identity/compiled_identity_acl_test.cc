@@ -0,0 +1,316 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/compiled_identity_acl.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/strings/str_format.h"
+#include "asylo/identity/delegating_identity_expectation_matcher.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/identity/identity_acl.pb.h"
+#include "asylo/identity/identity_acl_evaluator.h"
+#include "asylo/identity/named_identity_expectation_matcher.h"
+#include "asylo/platform/common/static_map.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Not;
+
+// Number of calls to TestMatcher::MatchAndExplain().
+std::atomic<int> match_calls(0);
+
+// Makes an identity description whose authority_type string is constructed
+// based on the template parameter |C|.
+template <char C>
+EnclaveIdentityDescription MakeDescription() {
+  EnclaveIdentityDescription description;
+  description.set_identity_type(UNKNOWN_IDENTITY);
+  description.set_authority_type(std::string(4, C));
+  return description;
+}
+
+template <char C>
+EnclaveIdentity MakeIdentity(std::string id) {
+  EnclaveIdentity identity;
+  *identity.mutable_description() = MakeDescription<C>();
+  identity.set_identity(std::move(id));
+  return identity;
+}
+
+template <char C>
+IdentityAclPredicate MakeExpectation(std::string id) {
+  IdentityAclPredicate predicate;
+  *predicate.mutable_expectation()->mutable_reference_identity() =
+      MakeIdentity<C>(std::move(id));
+  return predicate;
+}
+
+IdentityAclPredicate MakeGroup(IdentityAclGroup::GroupType type,
+                               std::vector<IdentityAclPredicate> predicates) {
+  IdentityAclPredicate group;
+  group.mutable_acl_group()->set_type(type);
+  for (IdentityAclPredicate &predicate : predicates) {
+    *group.mutable_acl_group()->add_predicates() = std::move(predicate);
+  }
+  return group;
+}
+
+// Matcher of identities of description MakeDescription<C>(), which considers
+// an identity to match an expectation if the identity equals the reference
+// identity of the expectation.
+template <char C>
+class TestMatcher final : public NamedIdentityExpectationMatcher {
+ public:
+  EnclaveIdentityDescription Description() const override {
+    return MakeDescription<C>();
+  }
+
+  StatusOr<bool> Match(
+      const EnclaveIdentity &identity,
+      const EnclaveIdentityExpectation &expectation) const override {
+    return MatchAndExplain(identity, expectation, /*explanation=*/nullptr);
+  }
+
+  StatusOr<bool> MatchAndExplain(const EnclaveIdentity &identity,
+                                 const EnclaveIdentityExpectation &expectation,
+                                 std::string *explanation) const override {
+    match_calls++;
+    const EnclaveIdentity &reference_identity =
+        expectation.reference_identity();
+    if (identity.identity() != reference_identity.identity()) {
+      if (explanation != nullptr) {
+        *explanation =
+            absl::StrFormat("Identity %s does not match expected identity %s",
+                            identity.identity(), reference_identity.identity());
+      }
+      return false;
+    }
+    return true;
+  }
+};
+
+using TestMatcherA = TestMatcher<'A'>;
+using TestMatcherB = TestMatcher<'B'>;
+
+SET_STATIC_MAP_VALUE_OF_DERIVED_TYPE(IdentityExpectationMatcherMap,
+                                     TestMatcherA);
+SET_STATIC_MAP_VALUE_OF_DERIVED_TYPE(IdentityExpectationMatcherMap,
+                                     TestMatcherB);
+
+class CompiledIdentityAclTest : public ::testing::Test {
+ protected:
+  void SetUp() override { match_calls = 0; }
+
+  // Verifies that |acl| compiled either way evaluates |identities| as
+  // EvaluateIdentityAcl() does.
+  void ExpectSameAsEvaluator(const IdentityAclPredicate &acl,
+                             const std::vector<EnclaveIdentity> &identities) {
+    std::string expected_explanation;
+    StatusOr<bool> expected_result = EvaluateIdentityAcl(
+        identities, acl, delegating_matcher_, &expected_explanation);
+    ASSERT_THAT(expected_result, IsOk());
+
+    std::unique_ptr<CompiledIdentityAcl> registered;
+    ASYLO_ASSERT_OK_AND_ASSIGN(registered, CompiledIdentityAcl::Create(acl));
+    std::unique_ptr<CompiledIdentityAcl> explicit_matcher;
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        explicit_matcher,
+        CompiledIdentityAcl::Create(acl, delegating_matcher_));
+
+    for (const CompiledIdentityAcl *compiled :
+         {registered.get(), explicit_matcher.get()}) {
+      // Evaluate twice to cover memoized results.
+      for (int i = 0; i < 2; i++) {
+        std::string explanation;
+        EXPECT_THAT(compiled->Evaluate(identities, &explanation),
+                    IsOkAndHolds(expected_result.ValueOrDie()));
+        EXPECT_THAT(explanation, Eq(expected_explanation));
+      }
+    }
+  }
+
+  DelegatingIdentityExpectationMatcher delegating_matcher_;
+};
+
+TEST_F(CompiledIdentityAclTest, MatchesEvaluateIdentityAcl) {
+  std::vector<IdentityAclPredicate> acls = {
+      MakeExpectation<'A'>("foo"),
+      MakeGroup(IdentityAclGroup::OR,
+                {MakeExpectation<'A'>("foo"), MakeExpectation<'B'>("bar")}),
+      MakeGroup(IdentityAclGroup::AND,
+                {MakeExpectation<'A'>("foo"), MakeExpectation<'B'>("bar")}),
+      MakeGroup(IdentityAclGroup::NOT, {MakeExpectation<'A'>("foo")}),
+      MakeGroup(IdentityAclGroup::AND,
+                {MakeGroup(IdentityAclGroup::OR, {MakeExpectation<'A'>("baz"),
+                                                  MakeExpectation<'A'>("foo")}),
+                 MakeGroup(IdentityAclGroup::NOT,
+                           {MakeExpectation<'B'>("baz")})}),
+  };
+  std::vector<std::vector<EnclaveIdentity>> identity_sets = {
+      {},
+      {MakeIdentity<'A'>("foo")},
+      {MakeIdentity<'A'>("baz")},
+      {MakeIdentity<'B'>("bar")},
+      {MakeIdentity<'A'>("foo"), MakeIdentity<'B'>("bar")},
+      {MakeIdentity<'B'>("baz"), MakeIdentity<'A'>("foo")},
+  };
+
+  for (const IdentityAclPredicate &acl : acls) {
+    for (const std::vector<EnclaveIdentity> &identities : identity_sets) {
+      SCOPED_TRACE(absl::StrFormat("ACL: %s, identities: %d",
+                                   acl.ShortDebugString(), identities.size()));
+      ExpectSameAsEvaluator(acl, identities);
+    }
+  }
+}
+
+TEST_F(CompiledIdentityAclTest, RejectsMalformedAcl) {
+  IdentityAclPredicate unset;
+  EXPECT_THAT(CompiledIdentityAcl::Create(unset),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  EXPECT_THAT(CompiledIdentityAcl::Create(MakeGroup(IdentityAclGroup::OR, {})),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  EXPECT_THAT(CompiledIdentityAcl::Create(MakeGroup(
+                  IdentityAclGroup::NOT, {MakeExpectation<'A'>("foo"),
+                                          MakeExpectation<'A'>("bar")})),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+
+  // The malformed predicate is rejected even though evaluation would never
+  // reach it.
+  EXPECT_THAT(CompiledIdentityAcl::Create(MakeGroup(
+                  IdentityAclGroup::OR, {MakeExpectation<'A'>("foo"), unset})),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST_F(CompiledIdentityAclTest, MemoizesResults) {
+  std::unique_ptr<CompiledIdentityAcl> compiled;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      compiled, CompiledIdentityAcl::Create(MakeGroup(
+                    IdentityAclGroup::AND, {MakeExpectation<'A'>("foo"),
+                                            MakeExpectation<'B'>("bar")})));
+
+  std::vector<EnclaveIdentity> peer = {MakeIdentity<'A'>("foo"),
+                                       MakeIdentity<'B'>("bar")};
+  EXPECT_THAT(compiled->Evaluate(peer), IsOkAndHolds(true));
+  int calls = match_calls;
+  EXPECT_GT(calls, 0);
+
+  for (int i = 0; i < 10; i++) {
+    EXPECT_THAT(compiled->Evaluate(peer), IsOkAndHolds(true));
+  }
+  EXPECT_THAT(match_calls, Eq(calls));
+
+  CompiledIdentityAcl::Stats stats = compiled->GetStats();
+  EXPECT_THAT(stats.hits, Eq(10));
+  EXPECT_THAT(stats.misses, Eq(1));
+
+  // A different peer, including one with the same identities in a different
+  // order, is evaluated afresh.
+  std::vector<EnclaveIdentity> reordered = {peer[1], peer[0]};
+  EXPECT_THAT(compiled->Evaluate(reordered), IsOkAndHolds(true));
+  EXPECT_THAT(match_calls, Not(Eq(calls)));
+
+  compiled->ClearMemo();
+  calls = match_calls;
+  EXPECT_THAT(compiled->Evaluate(peer), IsOkAndHolds(true));
+  EXPECT_THAT(match_calls, Not(Eq(calls)));
+}
+
+TEST_F(CompiledIdentityAclTest, MemoizesExplanations) {
+  std::unique_ptr<CompiledIdentityAcl> compiled =
+      CompiledIdentityAcl::Create(MakeExpectation<'A'>("foo")).ValueOrDie();
+  std::vector<EnclaveIdentity> peer = {MakeIdentity<'A'>("bar")};
+
+  std::string first_explanation;
+  EXPECT_THAT(compiled->Evaluate(peer, &first_explanation),
+              IsOkAndHolds(false));
+  EXPECT_THAT(first_explanation, Not(IsEmpty()));
+
+  std::string second_explanation;
+  EXPECT_THAT(compiled->Evaluate(peer, &second_explanation),
+              IsOkAndHolds(false));
+  EXPECT_THAT(second_explanation, Eq(first_explanation));
+  EXPECT_THAT(compiled->GetStats().hits, Eq(1));
+}
+
+TEST_F(CompiledIdentityAclTest, EvictsLeastRecentlyUsed) {
+  std::unique_ptr<CompiledIdentityAcl> compiled =
+      CompiledIdentityAcl::Create(MakeExpectation<'A'>("foo"),
+                                  /*memo_capacity=*/2)
+          .ValueOrDie();
+  std::vector<EnclaveIdentity> foo = {MakeIdentity<'A'>("foo")};
+  std::vector<EnclaveIdentity> bar = {MakeIdentity<'A'>("bar")};
+  std::vector<EnclaveIdentity> baz = {MakeIdentity<'A'>("baz")};
+
+  EXPECT_THAT(compiled->Evaluate(foo), IsOkAndHolds(true));
+  EXPECT_THAT(compiled->Evaluate(bar), IsOkAndHolds(false));
+  EXPECT_THAT(compiled->Evaluate(foo), IsOkAndHolds(true));
+
+  // Evicts |bar|, which is the least recently used.
+  EXPECT_THAT(compiled->Evaluate(baz), IsOkAndHolds(false));
+  EXPECT_THAT(compiled->GetStats().evictions, Eq(1));
+
+  int calls = match_calls;
+  EXPECT_THAT(compiled->Evaluate(foo), IsOkAndHolds(true));
+  EXPECT_THAT(match_calls, Eq(calls));
+  EXPECT_THAT(compiled->Evaluate(bar), IsOkAndHolds(false));
+  EXPECT_THAT(match_calls, Eq(calls + 1));
+}
+
+TEST_F(CompiledIdentityAclTest, ZeroCapacityDisablesMemo) {
+  std::unique_ptr<CompiledIdentityAcl> compiled =
+      CompiledIdentityAcl::Create(MakeExpectation<'A'>("foo"),
+                                  /*memo_capacity=*/0)
+          .ValueOrDie();
+  std::vector<EnclaveIdentity> peer = {MakeIdentity<'A'>("foo")};
+
+  for (int i = 1; i <= 3; i++) {
+    EXPECT_THAT(compiled->Evaluate(peer), IsOkAndHolds(true));
+    EXPECT_THAT(match_calls, Eq(i));
+  }
+  EXPECT_THAT(compiled->GetStats().hits, Eq(0));
+}
+
+TEST_F(CompiledIdentityAclTest, DoesNotMemoizeErrors) {
+  std::unique_ptr<CompiledIdentityAcl> compiled =
+      CompiledIdentityAcl::Create(MakeExpectation<'A'>("foo")).ValueOrDie();
+
+  // There is no matcher registered for identities of description 'C'.
+  std::vector<EnclaveIdentity> peer = {MakeIdentity<'C'>("foo")};
+  for (int i = 0; i < 2; i++) {
+    EXPECT_THAT(compiled->Evaluate(peer),
+                StatusIs(error::GoogleError::INTERNAL));
+  }
+  EXPECT_THAT(compiled->GetStats().hits, Eq(0));
+  EXPECT_THAT(compiled->GetStats().misses, Eq(2));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,488 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/provisioning/sgx/internal/caching_sgx_pcs_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <openssl/base.h>
+#include <openssl/bio.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/timestamp.pb.h"
+#include <google/protobuf/message.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "asylo/crypto/certificate.pb.h"
+#include "asylo/crypto/sha256_hash.h"
+#include "asylo/crypto/util/bssl_util.h"
+#include "asylo/crypto/x509_certificate.h"
+#include "asylo/identity/provisioning/sgx/internal/tcb.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/tcb_info_from_json.h"
+#include "asylo/util/fd_utils.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/path.h"
+#include "asylo/util/posix_error_space.h"
+#include "asylo/util/status_macros.h"
+#include "asylo/util/thread.h"
+#include "asylo/util/time_conversions.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+// Returns |message| serialized and prefixed with its length, for composing
+// unambiguous request keys.
+std::string KeyField(const google::protobuf::Message &message) {
+  std::string serialized = message.SerializeAsString();
+  return absl::StrCat(serialized.size(), ":", serialized);
+}
+
+// Reads the "issueDate" and "nextUpdate" of |tcb_info|.
+Status GetTcbInfoValidity(const SignedTcbInfo &tcb_info, absl::Time *issue_date,
+                          absl::Time *next_update) {
+  TcbInfo parsed_tcb_info;
+  ASYLO_ASSIGN_OR_RETURN(parsed_tcb_info,
+                         TcbInfoFromJson(tcb_info.tcb_info_json()));
+  ASYLO_ASSIGN_OR_RETURN(
+      *issue_date,
+      ConvertTime<absl::Time>(parsed_tcb_info.impl().issue_date()));
+  ASYLO_ASSIGN_OR_RETURN(
+      *next_update,
+      ConvertTime<absl::Time>(parsed_tcb_info.impl().next_update()));
+  return Status::OkStatus();
+}
+
+// Reads the "thisUpdate" and "nextUpdate" of |crl|. Sets |next_update| to
+// absl::InfiniteFuture() if |crl| does not have a "nextUpdate".
+Status GetCrlValidity(const CertificateRevocationList &crl,
+                      absl::Time *issue_date, absl::Time *next_update) {
+  bssl::UniquePtr<X509_CRL> x509_crl;
+  switch (crl.format()) {
+    case CertificateRevocationList::X509_DER: {
+      const uint8_t *data =
+          reinterpret_cast<const uint8_t *>(crl.data().data());
+      x509_crl.reset(d2i_X509_CRL(/*a=*/nullptr, &data, crl.data().size()));
+      break;
+    }
+    case CertificateRevocationList::X509_PEM: {
+      bssl::UniquePtr<BIO> crl_bio(
+          BIO_new_mem_buf(crl.data().data(), crl.data().size()));
+      x509_crl.reset(PEM_read_bio_X509_CRL(crl_bio.get(), /*x=*/nullptr,
+                                           /*cb=*/nullptr, /*u=*/nullptr));
+      break;
+    }
+    default:
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    "Unsupported certificate revocation list format");
+  }
+  if (x509_crl == nullptr) {
+    return Status(error::GoogleError::INVALID_ARGUMENT, BsslLastErrorString());
+  }
+
+  ASYLO_ASSIGN_OR_RETURN(
+      *issue_date,
+      AbslTimeFromAsn1Time(*X509_CRL_get0_lastUpdate(x509_crl.get())));
+  const ASN1_TIME *crl_next_update = X509_CRL_get0_nextUpdate(x509_crl.get());
+  if (crl_next_update == nullptr) {
+    *next_update = absl::InfiniteFuture();
+    return Status::OkStatus();
+  }
+  ASYLO_ASSIGN_OR_RETURN(*next_update, AbslTimeFromAsn1Time(*crl_next_update));
+  return Status::OkStatus();
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<CachingSgxPcsClient>> CachingSgxPcsClient::Create(
+    std::unique_ptr<SgxPcsClient> client, const Options &options) {
+  if (client == nullptr) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "The underlying SgxPcsClient must not be nullptr");
+  }
+  if (!(options.refresh_fraction >= 0.0 && options.refresh_fraction <= 1.0)) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "The refresh fraction must be in [0, 1]");
+  }
+  if (!options.cache_directory.empty() &&
+      mkdir(options.cache_directory.c_str(), 0700) != 0 && errno != EEXIST) {
+    return Status(static_cast<error::PosixError>(errno),
+                  absl::StrCat("Failed to create cache directory ",
+                               options.cache_directory));
+  }
+  return absl::WrapUnique(new CachingSgxPcsClient(std::move(client), options));
+}
+
+CachingSgxPcsClient::CachingSgxPcsClient(std::unique_ptr<SgxPcsClient> client,
+                                         const Options &options)
+    : client_(std::move(client)),
+      options_(options),
+      stats_{},
+      refreshes_running_(0) {}
+
+CachingSgxPcsClient::~CachingSgxPcsClient() {
+  absl::MutexLock lock(&mu_);
+  auto no_refreshes = [this]() { return refreshes_running_ == 0; };
+  mu_.Await(absl::Condition(&no_refreshes));
+}
+
+StatusOr<GetPckCertificateResult> CachingSgxPcsClient::GetPckCertificate(
+    const Ppid &ppid, const CpuSvn &cpu_svn, const PceSvn &pce_svn,
+    const PceId &pce_id) {
+  const std::string key =
+      absl::StrCat("pck_cert:", KeyField(ppid), KeyField(cpu_svn),
+                   KeyField(pce_svn), KeyField(pce_id));
+  SgxPcsCacheEntry cache_entry;
+  ASYLO_ASSIGN_OR_RETURN(
+      cache_entry,
+      Get(key, [this, ppid, cpu_svn, pce_svn,
+                pce_id]() -> StatusOr<SgxPcsCacheEntry> {
+        GetPckCertificateResult result;
+        ASYLO_ASSIGN_OR_RETURN(
+            result, client_->GetPckCertificate(ppid, cpu_svn, pce_svn, pce_id));
+        SgxPcsCacheEntry fetched;
+        *fetched.mutable_issuer_cert_chain() =
+            std::move(result.issuer_cert_chain);
+        *fetched.mutable_pck_cert()->mutable_pck_cert() =
+            std::move(result.pck_cert);
+        *fetched.mutable_pck_cert()->mutable_tcbm() = std::move(result.tcbm);
+        return fetched;
+      }));
+
+  GetPckCertificateResult result;
+  result.pck_cert = cache_entry.pck_cert().pck_cert();
+  result.issuer_cert_chain = cache_entry.issuer_cert_chain();
+  result.tcbm = cache_entry.pck_cert().tcbm();
+  return result;
+}
+
+StatusOr<GetPckCertificatesResult> CachingSgxPcsClient::GetPckCertificates(
+    const Ppid &ppid, const PceId &pce_id) {
+  const std::string key =
+      absl::StrCat("pck_certs:", KeyField(ppid), KeyField(pce_id));
+  SgxPcsCacheEntry cache_entry;
+  ASYLO_ASSIGN_OR_RETURN(
+      cache_entry,
+      Get(key, [this, ppid, pce_id]() -> StatusOr<SgxPcsCacheEntry> {
+        GetPckCertificatesResult result;
+        ASYLO_ASSIGN_OR_RETURN(result,
+                               client_->GetPckCertificates(ppid, pce_id));
+        SgxPcsCacheEntry fetched;
+        *fetched.mutable_issuer_cert_chain() =
+            std::move(result.issuer_cert_chain);
+        *fetched.mutable_pck_certs() = std::move(result.pck_certs);
+        return fetched;
+      }));
+
+  GetPckCertificatesResult result;
+  result.pck_certs = cache_entry.pck_certs();
+  result.issuer_cert_chain = cache_entry.issuer_cert_chain();
+  return result;
+}
+
+StatusOr<GetCrlResult> CachingSgxPcsClient::GetCrl(SgxCaType sgx_ca_type) {
+  const std::string key = absl::StrCat("crl:", sgx_ca_type);
+  SgxPcsCacheEntry cache_entry;
+  ASYLO_ASSIGN_OR_RETURN(
+      cache_entry,
+      Get(key, [this, sgx_ca_type]() -> StatusOr<SgxPcsCacheEntry> {
+        GetCrlResult result;
+        ASYLO_ASSIGN_OR_RETURN(result, client_->GetCrl(sgx_ca_type));
+        SgxPcsCacheEntry fetched;
+        *fetched.mutable_issuer_cert_chain() =
+            std::move(result.issuer_cert_chain);
+        *fetched.mutable_pck_crl() = std::move(result.pck_crl);
+        return fetched;
+      }));
+
+  GetCrlResult result;
+  result.pck_crl = cache_entry.pck_crl();
+  result.issuer_cert_chain = cache_entry.issuer_cert_chain();
+  return result;
+}
+
+StatusOr<GetTcbInfoResult> CachingSgxPcsClient::GetTcbInfo(
+    const Fmspc &fmspc) {
+  const std::string key = absl::StrCat("tcb_info:", KeyField(fmspc));
+  SgxPcsCacheEntry cache_entry;
+  ASYLO_ASSIGN_OR_RETURN(
+      cache_entry, Get(key, [this, fmspc]() -> StatusOr<SgxPcsCacheEntry> {
+        GetTcbInfoResult result;
+        ASYLO_ASSIGN_OR_RETURN(result, client_->GetTcbInfo(fmspc));
+        SgxPcsCacheEntry fetched;
+        *fetched.mutable_issuer_cert_chain() =
+            std::move(result.issuer_cert_chain);
+        *fetched.mutable_tcb_info() = std::move(result.tcb_info);
+        return fetched;
+      }));
+
+  GetTcbInfoResult result;
+  result.tcb_info = cache_entry.tcb_info();
+  result.issuer_cert_chain = cache_entry.issuer_cert_chain();
+  return result;
+}
+
+CachingSgxPcsClient::Stats CachingSgxPcsClient::GetStats() const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+StatusOr<SgxPcsCacheEntry> CachingSgxPcsClient::Get(const std::string &key,
+                                                    const Fetcher &fetch) {
+  std::shared_ptr<Flight> flight;
+  bool leader = false;
+  {
+    absl::MutexLock lock(&mu_);
+    const absl::Time now = absl::Now();
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      EntryList::iterator entry = it->second;
+      if (now < entry->expiry) {
+        stats_.hits++;
+        entries_.splice(entries_.begin(), entries_, entry);
+        if (now >= entry->refresh_time && !flights_.contains(key)) {
+          auto refresh = std::make_shared<Flight>();
+          flights_.emplace(key, refresh);
+          stats_.refreshes++;
+          refreshes_running_++;
+          Thread::StartDetached([this, key, fetch, refresh] {
+            Run(key, fetch, /*use_disk=*/false, refresh.get());
+            absl::MutexLock lock(&mu_);
+            refreshes_running_--;
+          });
+        }
+        return entry->cache_entry;
+      }
+      entries_.erase(entry);
+      index_.erase(it);
+    }
+
+    auto flight_it = flights_.find(key);
+    if (flight_it != flights_.end()) {
+      flight = flight_it->second;
+      stats_.coalesced++;
+    } else {
+      flight = std::make_shared<Flight>();
+      flights_.emplace(key, flight);
+      leader = true;
+    }
+  }
+
+  if (leader) {
+    Run(key, fetch, /*use_disk=*/true, flight.get());
+  } else {
+    flight->done.WaitForNotification();
+  }
+  return flight->result;
+}
+
+void CachingSgxPcsClient::Run(const std::string &key, const Fetcher &fetch,
+                              bool use_disk, Flight *flight) {
+  Entry entry;
+  bool from_disk = false;
+  if (use_disk && !options_.cache_directory.empty()) {
+    StatusOr<Entry> entry_result = ReadFile(key);
+    if (entry_result.ok()) {
+      entry = std::move(entry_result).ValueOrDie();
+      from_disk = true;
+    }
+  }
+
+  StatusOr<SgxPcsCacheEntry> result;
+  if (from_disk) {
+    result = entry.cache_entry;
+  } else {
+    {
+      absl::MutexLock lock(&mu_);
+      stats_.misses++;
+    }
+    result = fetch();
+    if (result.ok()) {
+      result.ValueOrDie().set_key(key);
+      entry = CreateEntry(result.ValueOrDie(), absl::Now());
+      if (absl::Now() < entry.expiry && !options_.cache_directory.empty()) {
+        Status write_status = WriteFile(result.ValueOrDie());
+        if (!write_status.ok()) {
+          LOG(WARNING) << "Failed to write to the SGX PCS cache: "
+                       << write_status;
+        }
+      }
+    }
+  }
+
+  {
+    absl::MutexLock lock(&mu_);
+    if (from_disk) {
+      stats_.disk_hits++;
+    }
+    if (result.ok() && absl::Now() < entry.expiry) {
+      Insert(std::move(entry));
+    }
+    flights_.erase(key);
+  }
+  flight->result = std::move(result);
+  flight->done.Notify();
+}
+
+void CachingSgxPcsClient::Insert(Entry entry) {
+  const std::string key = entry.cache_entry.key();
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+  if (options_.max_entries == 0) {
+    return;
+  }
+  while (entries_.size() >= options_.max_entries) {
+    index_.erase(entries_.back().cache_entry.key());
+    entries_.pop_back();
+  }
+  entries_.push_front(std::move(entry));
+  index_.emplace(key, entries_.begin());
+}
+
+CachingSgxPcsClient::Entry CachingSgxPcsClient::CreateEntry(
+    SgxPcsCacheEntry cache_entry, absl::Time fetch_time) const {
+  absl::Time issue_date = fetch_time;
+  absl::Time expiry = fetch_time + options_.default_lifetime;
+  Status validity_status;
+  switch (cache_entry.response_case()) {
+    case SgxPcsCacheEntry::kPckCrl:
+      validity_status =
+          GetCrlValidity(cache_entry.pck_crl(), &issue_date, &expiry);
+      if (validity_status.ok() && expiry == absl::InfiniteFuture()) {
+        expiry = fetch_time + options_.default_lifetime;
+      }
+      break;
+    case SgxPcsCacheEntry::kTcbInfo:
+      validity_status =
+          GetTcbInfoValidity(cache_entry.tcb_info(), &issue_date, &expiry);
+      break;
+    default:
+      break;
+  }
+  if (validity_status.ok() && expiry < issue_date) {
+    validity_status = Status(error::GoogleError::INVALID_ARGUMENT,
+                             "Response expires before it is issued");
+  }
+  if (!validity_status.ok()) {
+    // Do not cache the response.
+    LOG(WARNING) << "Failed to read the validity of an SGX PCS response: "
+                 << validity_status;
+    issue_date = expiry = fetch_time;
+  }
+
+  Entry entry;
+  entry.expiry = expiry;
+  entry.refresh_time =
+      issue_date + (expiry - issue_date) * options_.refresh_fraction;
+  entry.cache_entry = std::move(cache_entry);
+  return entry;
+}
+
+std::string CachingSgxPcsClient::GetFilePath(const std::string &key) const {
+  Sha256Hash hash;
+  hash.Update(key);
+  std::vector<uint8_t> digest;
+  ASYLO_CHECK_OK(hash.CumulativeHash(&digest));
+  return JoinPath(
+      options_.cache_directory,
+      absl::StrCat(absl::BytesToHexString(absl::string_view(
+                       reinterpret_cast<const char *>(digest.data()),
+                       digest.size())),
+                   ".pb"));
+}
+
+StatusOr<CachingSgxPcsClient::Entry> CachingSgxPcsClient::ReadFile(
+    const std::string &key) const {
+  const std::string path = GetFilePath(key);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return Status(error::GoogleError::NOT_FOUND,
+                  absl::StrCat("No cached response at ", path));
+  }
+  // The file was written when the response was fetched.
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    Status status(static_cast<error::PosixError>(errno),
+                  absl::StrCat("Failed to stat ", path));
+    close(fd);
+    return status;
+  }
+  StatusOr<std::string> contents_result = ReadAll(fd);
+  close(fd);
+  ASYLO_RETURN_IF_ERROR(contents_result.status());
+
+  SgxPcsCacheEntry cache_entry;
+  if (!cache_entry.ParseFromString(contents_result.ValueOrDie()) ||
+      cache_entry.key() != key) {
+    return Status(error::GoogleError::NOT_FOUND,
+                  absl::StrCat("Invalid cached response at ", path));
+  }
+  // The validity of the response is read from the response itself, rather than
+  // trusted from the file.
+  Entry entry = CreateEntry(std::move(cache_entry),
+                            absl::TimeFromTimespec(file_stat.st_mtim));
+  if (absl::Now() >= entry.expiry) {
+    return Status(error::GoogleError::NOT_FOUND,
+                  absl::StrCat("Expired cached response at ", path));
+  }
+  return entry;
+}
+
+Status CachingSgxPcsClient::WriteFile(
+    const SgxPcsCacheEntry &cache_entry) const {
+  // Write to a temporary file and rename it, so that readers never see a
+  // partially written file.
+  const std::string path = GetFilePath(cache_entry.key());
+  std::string temp_path = absl::StrCat(path, ".XXXXXX");
+  int fd = mkstemp(&temp_path[0]);
+  if (fd < 0) {
+    return Status(static_cast<error::PosixError>(errno),
+                  absl::StrCat("Failed to create ", temp_path));
+  }
+  Status status = WriteAll(fd, cache_entry.SerializeAsString());
+  if (close(fd) != 0 && status.ok()) {
+    status = Status(static_cast<error::PosixError>(errno),
+                    absl::StrCat("Failed to close ", temp_path));
+  }
+  if (status.ok() && rename(temp_path.c_str(), path.c_str()) != 0) {
+    status = Status(static_cast<error::PosixError>(errno),
+                    absl::StrCat("Failed to rename ", temp_path));
+  }
+  if (!status.ok()) {
+    unlink(temp_path.c_str());
+  }
+  return status;
+}
+
+}  // namespace sgx
+}  // namespace asylo
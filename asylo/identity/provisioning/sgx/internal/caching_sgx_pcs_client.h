@@ -0,0 +1,198 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_IDENTITY_PROVISIONING_SGX_INTERNAL_CACHING_SGX_PCS_CLIENT_H_
+#define ASYLO_IDENTITY_PROVISIONING_SGX_INTERNAL_CACHING_SGX_PCS_CLIENT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "asylo/identity/platform/sgx/machine_configuration.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/platform_provisioning.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_cache.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.pb.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace sgx {
+
+// An SgxPcsClient that caches the responses of another SgxPcsClient in memory
+// and, optionally, on disk.
+//
+// TCB infos and CRLs are cached until their "nextUpdate". Other responses, and
+// CRLs without a "nextUpdate", are cached for |Options::default_lifetime|.
+// Once |Options::refresh_fraction| of the period from the issue date of a
+// cached response to its expiry has passed, the next request for it returns
+// the cached response and fetches a new one in the background, so that
+// callers do not wait for responses that are about to expire. Concurrent
+// requests for a response that is not cached share a single request to the
+// underlying client. Errors are never cached.
+//
+// The on-disk cache holds one file per response in |Options::cache_directory|,
+// so that responses outlive the process and can be shared between processes.
+// Files that cannot be read are ignored.
+//
+// The least recently used responses are evicted from memory first. All
+// methods are thread-safe.
+class CachingSgxPcsClient : public SgxPcsClient {
+ public:
+  struct Options {
+    // Number of responses held in memory.
+    size_t max_entries = 1024;
+
+    // Directory of the on-disk cache, which is created if it does not exist.
+    // If empty, responses are only cached in memory.
+    std::string cache_directory;
+
+    // Lifetime of responses that do not say when they are next updated, such
+    // as PCK certificates.
+    absl::Duration default_lifetime = absl::Hours(24);
+
+    // Fraction of the validity period of a response after which it is
+    // refreshed in the background. Must be in [0, 1].
+    double refresh_fraction = 0.8;
+  };
+
+  // Counters of the client since its creation.
+  struct Stats {
+    // Requests answered from memory.
+    uint64_t hits;
+
+    // Requests answered from the on-disk cache.
+    uint64_t disk_hits;
+
+    // Requests forwarded to the underlying client.
+    uint64_t misses;
+
+    // Requests that waited for an identical request in flight.
+    uint64_t coalesced;
+
+    // Background refreshes started.
+    uint64_t refreshes;
+  };
+
+  // Creates a client that caches the responses of |client|, which must not be
+  // nullptr, according to |options|.
+  static StatusOr<std::unique_ptr<CachingSgxPcsClient>> Create(
+      std::unique_ptr<SgxPcsClient> client, const Options &options);
+
+  // Waits for the background refreshes to complete.
+  ~CachingSgxPcsClient() override;
+
+  // From SgxPcsClient.
+  StatusOr<GetPckCertificateResult> GetPckCertificate(
+      const Ppid &ppid, const CpuSvn &cpu_svn, const PceSvn &pce_svn,
+      const PceId &pce_id) override;
+  StatusOr<GetPckCertificatesResult> GetPckCertificates(
+      const Ppid &ppid, const PceId &pce_id) override;
+  StatusOr<GetCrlResult> GetCrl(SgxCaType sgx_ca_type) override;
+  StatusOr<GetTcbInfoResult> GetTcbInfo(const Fmspc &fmspc) override;
+
+  Stats GetStats() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Fetches a response from the underlying client as a cache entry, without
+  // its key.
+  using Fetcher = std::function<StatusOr<SgxPcsCacheEntry>()>;
+
+  // A request to the underlying client, shared by identical requests.
+  struct Flight {
+    absl::Notification done;
+    StatusOr<SgxPcsCacheEntry> result;
+  };
+
+  struct Entry {
+    SgxPcsCacheEntry cache_entry;
+    absl::Time expiry;
+    absl::Time refresh_time;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  CachingSgxPcsClient(std::unique_ptr<SgxPcsClient> client,
+                      const Options &options);
+
+  // Returns the cached response to the request |key|, using |fetch| to fetch
+  // it if needed.
+  StatusOr<SgxPcsCacheEntry> Get(const std::string &key, const Fetcher &fetch)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Answers |flight| for the request |key|, from the on-disk cache if
+  // |use_disk| is true and the response is cached there, and otherwise with
+  // |fetch|. Caches successful responses that have not expired.
+  void Run(const std::string &key, const Fetcher &fetch, bool use_disk,
+           Flight *flight) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Caches |entry| in memory, evicting the least recently used entries as
+  // needed.
+  void Insert(Entry entry) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the entry for |cache_entry|, whose response was fetched at
+  // |fetch_time|. The validity period of the response is read from the
+  // response if it has one, and is otherwise |Options::default_lifetime| from
+  // |fetch_time|. A response whose validity cannot be read expires at
+  // |fetch_time|.
+  Entry CreateEntry(SgxPcsCacheEntry cache_entry, absl::Time fetch_time) const;
+
+  // Returns the path of the file caching the response to the request |key|.
+  std::string GetFilePath(const std::string &key) const;
+
+  // Reads the response to the request |key| from the on-disk cache. Responses
+  // without a validity period of their own are deemed fetched when their file
+  // was last modified. Returns a NOT_FOUND error if the response is not cached
+  // there or it expired.
+  StatusOr<Entry> ReadFile(const std::string &key) const;
+
+  // Writes |cache_entry| to the on-disk cache.
+  Status WriteFile(const SgxPcsCacheEntry &cache_entry) const;
+
+  const std::unique_ptr<SgxPcsClient> client_;
+  const Options options_;
+
+  Stats stats_ ABSL_GUARDED_BY(mu_);
+
+  // Entries ordered from the most to the least recently used, and their index.
+  EntryList entries_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<std::string, EntryList::iterator> index_
+      ABSL_GUARDED_BY(mu_);
+
+  // Requests in flight, by key.
+  absl::flat_hash_map<std::string, std::shared_ptr<Flight>> flights_
+      ABSL_GUARDED_BY(mu_);
+
+  // Number of background refreshes running.
+  size_t refreshes_running_ ABSL_GUARDED_BY(mu_);
+
+  mutable absl::Mutex mu_;
+};
+
+}  // namespace sgx
+}  // namespace asylo
+
+#endif  // ASYLO_IDENTITY_PROVISIONING_SGX_INTERNAL_CACHING_SGX_PCS_CLIENT_H_
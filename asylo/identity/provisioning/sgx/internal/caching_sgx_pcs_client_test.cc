@@ -0,0 +1,484 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/provisioning/sgx/internal/caching_sgx_pcs_client.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "asylo/identity/platform/sgx/machine_configuration.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/fake_sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/mock_sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/platform_provisioning.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/tcb.pb.h"
+#include "asylo/test/util/proto_matchers.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/test/util/test_flags.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Return;
+
+GetPckCertificatesResult SomePckCertificates(const std::string &data) {
+  GetPckCertificatesResult result;
+  PckCertificates::PckCertificateInfo *cert_info =
+      result.pck_certs.add_certs();
+  cert_info->mutable_cert()->set_format(Certificate::X509_PEM);
+  cert_info->mutable_cert()->set_data(data);
+  Certificate *issuer = result.issuer_cert_chain.add_certificates();
+  issuer->set_format(Certificate::X509_PEM);
+  issuer->set_data("issuer");
+  return result;
+}
+
+Ppid SomePpid(const std::string &value) {
+  Ppid ppid;
+  ppid.set_value(value);
+  return ppid;
+}
+
+PceId SomePceId() {
+  PceId pce_id;
+  pce_id.set_value(0);
+  return pce_id;
+}
+
+// Returns a version 2 TCB info for |fmspc| and |pce_id|.
+TcbInfo SomeTcbInfo(const Fmspc &fmspc, const PceId &pce_id) {
+  TcbInfo tcb_info;
+  TcbInfoImpl *impl = tcb_info.mutable_impl();
+  impl->set_version(2);
+  impl->mutable_issue_date()->set_seconds(0);
+  impl->mutable_next_update()->set_seconds(1);
+  *impl->mutable_fmspc() = fmspc;
+  *impl->mutable_pce_id() = pce_id;
+  impl->set_tcb_type(TcbType::TCB_TYPE_0);
+  impl->set_tcb_evaluation_data_number(2);
+  TcbLevel *tcb_level = impl->add_tcb_levels();
+  tcb_level->mutable_tcb()->set_components("0123456789abcdef");
+  tcb_level->mutable_tcb()->mutable_pce_svn()->set_value(7);
+  tcb_level->mutable_status()->set_known_status(TcbStatus::UP_TO_DATE);
+  tcb_level->mutable_tcb_date()->set_seconds(1000);
+  return tcb_info;
+}
+
+// Returns a new empty directory for an on-disk cache.
+std::string CreateCacheDirectory() {
+  std::string cache_directory =
+      absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir), "/sgx_pcs_cache.XXXXXX");
+  CHECK_NE(mkdtemp(&cache_directory[0]), nullptr);
+  return cache_directory;
+}
+
+// Sets the modification time of all files in |directory| to |mtime|.
+void SetModificationTimes(const std::string &directory, absl::Time mtime) {
+  DIR *dir = opendir(directory.c_str());
+  ASSERT_NE(dir, nullptr);
+  const struct timeval times[2] = {absl::ToTimeval(mtime),
+                                   absl::ToTimeval(mtime)};
+  while (struct dirent *entry = readdir(dir)) {
+    if (entry->d_type == DT_REG) {
+      EXPECT_EQ(
+          utimes(absl::StrCat(directory, "/", entry->d_name).c_str(), times),
+          0);
+    }
+  }
+  closedir(dir);
+}
+
+class CachingSgxPcsClientTest : public ::testing::Test {
+ protected:
+  // Returns a caching client for a new mock client, which is stored in
+  // |mock_client_|.
+  std::unique_ptr<CachingSgxPcsClient> CreateClient(
+      const CachingSgxPcsClient::Options &options) {
+    auto mock_client = absl::make_unique<MockSgxPcsClient>();
+    mock_client_ = mock_client.get();
+    auto client_result =
+        CachingSgxPcsClient::Create(std::move(mock_client), options);
+    EXPECT_THAT(client_result, IsOk());
+    return std::move(client_result).ValueOrDie();
+  }
+
+  // Returns a caching client for a new fake client, which is stored in
+  // |fake_client_|.
+  std::unique_ptr<CachingSgxPcsClient> CreateFakeClient(
+      const CachingSgxPcsClient::Options &options) {
+    auto fake_client = absl::make_unique<FakeSgxPcsClient>();
+    fake_client_ = fake_client.get();
+    auto client_result =
+        CachingSgxPcsClient::Create(std::move(fake_client), options);
+    EXPECT_THAT(client_result, IsOk());
+    return std::move(client_result).ValueOrDie();
+  }
+
+  // Options under which only responses with a validity period of their own are
+  // cached, and are not refreshed before they expire.
+  static CachingSgxPcsClient::Options OwnValidityOnlyOptions() {
+    CachingSgxPcsClient::Options options;
+    options.default_lifetime = absl::ZeroDuration();
+    options.refresh_fraction = 1.0;
+    return options;
+  }
+
+  MockSgxPcsClient *mock_client_ = nullptr;
+  FakeSgxPcsClient *fake_client_ = nullptr;
+};
+
+TEST_F(CachingSgxPcsClientTest, CreateFailsWithoutClient) {
+  EXPECT_THAT(CachingSgxPcsClient::Create(nullptr, {}),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST_F(CachingSgxPcsClientTest, CreateFailsWithInvalidRefreshFraction) {
+  CachingSgxPcsClient::Options options;
+  options.refresh_fraction = 1.5;
+  EXPECT_THAT(CachingSgxPcsClient::Create(
+                  absl::make_unique<MockSgxPcsClient>(), options),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST_F(CachingSgxPcsClientTest, CachesResponses) {
+  auto client = CreateClient({});
+  GetPckCertificatesResult expected = SomePckCertificates("cert");
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Return(expected));
+
+  for (int i = 0; i < 3; i++) {
+    GetPckCertificatesResult result;
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        result, client->GetPckCertificates(SomePpid("ppid"), SomePceId()));
+    EXPECT_THAT(result.pck_certs, EqualsProto(expected.pck_certs));
+    EXPECT_THAT(result.issuer_cert_chain,
+                EqualsProto(expected.issuer_cert_chain));
+  }
+
+  CachingSgxPcsClient::Stats stats = client->GetStats();
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.hits, 2);
+}
+
+TEST_F(CachingSgxPcsClientTest, DistinguishesRequests) {
+  auto client = CreateClient({});
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Return(SomePckCertificates("first")))
+      .WillOnce(Return(SomePckCertificates("second")));
+
+  GetPckCertificatesResult result;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      result, client->GetPckCertificates(SomePpid("first"), SomePceId()));
+  EXPECT_EQ(result.pck_certs.certs(0).cert().data(), "first");
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      result, client->GetPckCertificates(SomePpid("second"), SomePceId()));
+  EXPECT_EQ(result.pck_certs.certs(0).cert().data(), "second");
+}
+
+TEST_F(CachingSgxPcsClientTest, DoesNotCacheErrors) {
+  auto client = CreateClient({});
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Return(Status(error::GoogleError::UNAVAILABLE, "Unavailable")))
+      .WillOnce(Return(SomePckCertificates("cert")));
+
+  EXPECT_THAT(client->GetPckCertificates(SomePpid("ppid"), SomePceId()),
+              StatusIs(error::GoogleError::UNAVAILABLE));
+  EXPECT_THAT(client->GetPckCertificates(SomePpid("ppid"), SomePceId()),
+              IsOk());
+}
+
+TEST_F(CachingSgxPcsClientTest, DoesNotCacheExpiredResponses) {
+  CachingSgxPcsClient::Options options;
+  options.default_lifetime = absl::ZeroDuration();
+  auto client = CreateClient(options);
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .Times(2)
+      .WillRepeatedly(Return(SomePckCertificates("cert")));
+
+  for (int i = 0; i < 2; i++) {
+    EXPECT_THAT(client->GetPckCertificates(SomePpid("ppid"), SomePceId()),
+                IsOk());
+  }
+}
+
+TEST_F(CachingSgxPcsClientTest, DoesNotCacheTcbInfoWithInvalidValidity) {
+  auto client = CreateClient({});
+  GetTcbInfoResult tcb_info;
+  tcb_info.tcb_info.set_tcb_info_json("not json");
+  EXPECT_CALL(*mock_client_, GetTcbInfo(_))
+      .Times(2)
+      .WillRepeatedly(Return(tcb_info));
+
+  Fmspc fmspc;
+  fmspc.set_value("fmspc!");
+  for (int i = 0; i < 2; i++) {
+    GetTcbInfoResult result;
+    ASYLO_ASSERT_OK_AND_ASSIGN(result, client->GetTcbInfo(fmspc));
+    EXPECT_THAT(result.tcb_info, EqualsProto(tcb_info.tcb_info));
+  }
+}
+
+TEST_F(CachingSgxPcsClientTest, EvictsLeastRecentlyUsedResponses) {
+  CachingSgxPcsClient::Options options;
+  options.max_entries = 1;
+  auto client = CreateClient(options);
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .Times(3)
+      .WillRepeatedly(Return(SomePckCertificates("cert")));
+
+  for (const char *ppid : {"first", "second", "second", "first"}) {
+    EXPECT_THAT(client->GetPckCertificates(SomePpid(ppid), SomePceId()),
+                IsOk());
+  }
+  EXPECT_EQ(client->GetStats().hits, 1);
+}
+
+TEST_F(CachingSgxPcsClientTest, CoalescesConcurrentRequests) {
+  constexpr int kNumThreads = 8;
+
+  auto client = CreateClient({});
+  absl::Notification fetching;
+  absl::Notification release;
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Invoke([&](const Ppid &ppid, const PceId &pce_id) {
+        fetching.Notify();
+        release.WaitForNotification();
+        return SomePckCertificates("cert");
+      }));
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back([&client] {
+      EXPECT_THAT(client->GetPckCertificates(SomePpid("ppid"), SomePceId()),
+                  IsOk());
+    });
+  }
+  fetching.WaitForNotification();
+  while (client->GetStats().coalesced + client->GetStats().hits <
+         kNumThreads - 1) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+  release.Notify();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(client->GetStats().misses, 1);
+}
+
+TEST_F(CachingSgxPcsClientTest, RefreshesResponsesInBackground) {
+  CachingSgxPcsClient::Options options;
+  options.refresh_fraction = 0.0;
+  auto client = CreateClient(options);
+  absl::Notification refreshed;
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Return(SomePckCertificates("first")))
+      .WillOnce(Invoke([&refreshed](const Ppid &ppid, const PceId &pce_id) {
+        refreshed.Notify();
+        return SomePckCertificates("second");
+      }))
+      .WillRepeatedly(Return(SomePckCertificates("second")));
+
+  GetPckCertificatesResult result;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      result, client->GetPckCertificates(SomePpid("ppid"), SomePceId()));
+  EXPECT_EQ(result.pck_certs.certs(0).cert().data(), "first");
+
+  // The stale response is returned while the new one is fetched.
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      result, client->GetPckCertificates(SomePpid("ppid"), SomePceId()));
+  EXPECT_EQ(result.pck_certs.certs(0).cert().data(), "first");
+  refreshed.WaitForNotification();
+  EXPECT_GE(client->GetStats().refreshes, 1);
+
+  // Wait for the refresh to complete.
+  client.reset();
+}
+
+TEST_F(CachingSgxPcsClientTest, PersistsResponsesOnDisk) {
+  CachingSgxPcsClient::Options options;
+  options.cache_directory = CreateCacheDirectory();
+  GetPckCertificatesResult expected = SomePckCertificates("cert");
+
+  auto client = CreateClient(options);
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Return(expected));
+  EXPECT_THAT(client->GetPckCertificates(SomePpid("ppid"), SomePceId()),
+              IsOk());
+
+  // A second client finds the response on disk.
+  auto other_client = CreateClient(options);
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _)).Times(0);
+  GetPckCertificatesResult result;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      result, other_client->GetPckCertificates(SomePpid("ppid"), SomePceId()));
+  EXPECT_THAT(result.pck_certs, EqualsProto(expected.pck_certs));
+  EXPECT_THAT(result.issuer_cert_chain,
+              EqualsProto(expected.issuer_cert_chain));
+  EXPECT_EQ(other_client->GetStats().disk_hits, 1);
+}
+
+TEST_F(CachingSgxPcsClientTest, ExpiresResponsesOnDiskFromModificationTime) {
+  CachingSgxPcsClient::Options options;
+  options.cache_directory = CreateCacheDirectory();
+  options.default_lifetime = absl::Hours(1);
+
+  auto client = CreateClient(options);
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Return(SomePckCertificates("cert")));
+  EXPECT_THAT(client->GetPckCertificates(SomePpid("ppid"), SomePceId()),
+              IsOk());
+
+  // The response was fetched longer than |default_lifetime| ago, whatever the
+  // file holds.
+  ASSERT_NO_FATAL_FAILURE(SetModificationTimes(
+      options.cache_directory, absl::Now() - absl::Hours(2)));
+  auto other_client = CreateClient(options);
+  EXPECT_CALL(*mock_client_, GetPckCertificates(_, _))
+      .WillOnce(Return(SomePckCertificates("cert")));
+  EXPECT_THAT(other_client->GetPckCertificates(SomePpid("ppid"), SomePceId()),
+              IsOk());
+  EXPECT_EQ(other_client->GetStats().disk_hits, 0);
+  EXPECT_EQ(other_client->GetStats().misses, 1);
+}
+
+TEST_F(CachingSgxPcsClientTest, DoesNotCacheTcbInfoPastNextUpdate) {
+  constexpr char kExpiredTcbInfoJson[] = R"json({
+        "version": 1,
+        "issueDate": "2020-02-20T20:20:20Z",
+        "nextUpdate": "2020-03-20T20:20:20Z",
+        "fmspc": "0123456789ab",
+        "pceId": "0000",
+        "tcbLevels": [{
+          "tcb": {
+            "sgxtcbcomp01svn": 0,
+            "sgxtcbcomp02svn": 1,
+            "sgxtcbcomp03svn": 2,
+            "sgxtcbcomp04svn": 3,
+            "sgxtcbcomp05svn": 4,
+            "sgxtcbcomp06svn": 5,
+            "sgxtcbcomp07svn": 6,
+            "sgxtcbcomp08svn": 7,
+            "sgxtcbcomp09svn": 8,
+            "sgxtcbcomp10svn": 9,
+            "sgxtcbcomp11svn": 10,
+            "sgxtcbcomp12svn": 11,
+            "sgxtcbcomp13svn": 12,
+            "sgxtcbcomp14svn": 13,
+            "sgxtcbcomp15svn": 14,
+            "sgxtcbcomp16svn": 15,
+            "pcesvn": 2
+          },
+          "status": "UpToDate"
+        }]
+      })json";
+
+  auto client = CreateClient({});
+  Fmspc fmspc;
+  fmspc.set_value("fmspc!");
+  GetTcbInfoResult tcb_info;
+  tcb_info.tcb_info.set_tcb_info_json(kExpiredTcbInfoJson);
+  EXPECT_CALL(*mock_client_, GetTcbInfo(_))
+      .Times(2)
+      .WillRepeatedly(Return(tcb_info));
+
+  for (int i = 0; i < 2; i++) {
+    EXPECT_THAT(client->GetTcbInfo(fmspc), IsOk());
+  }
+  EXPECT_EQ(client->GetStats().hits, 0);
+}
+
+TEST_F(CachingSgxPcsClientTest, CachesTcbInfoUntilNextUpdate) {
+  auto client = CreateFakeClient(OwnValidityOnlyOptions());
+  FakeSgxPcsClient::PlatformProperties platform;
+  platform.ca = SgxCaType::PLATFORM;
+  platform.pce_id = SomePceId();
+  Fmspc fmspc;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      fmspc, FakeSgxPcsClient::CreateFmspcWithProperties(platform));
+  ASSERT_THAT(
+      fake_client_->AddFmspc(fmspc, SomeTcbInfo(fmspc, platform.pce_id)),
+      IsOkAndHolds(true));
+
+  // The fake issues TCB infos with a "nextUpdate" a month after they are
+  // fetched, so they are cached although |default_lifetime| is zero.
+  GetTcbInfoResult first;
+  ASYLO_ASSERT_OK_AND_ASSIGN(first, client->GetTcbInfo(fmspc));
+  GetTcbInfoResult second;
+  ASYLO_ASSERT_OK_AND_ASSIGN(second, client->GetTcbInfo(fmspc));
+  EXPECT_THAT(second.tcb_info, EqualsProto(first.tcb_info));
+  EXPECT_EQ(client->GetStats().misses, 1);
+  EXPECT_EQ(client->GetStats().hits, 1);
+}
+
+TEST_F(CachingSgxPcsClientTest, CachesCrlUntilNextUpdate) {
+  auto client = CreateFakeClient(OwnValidityOnlyOptions());
+  for (SgxCaType ca_type : {SgxCaType::PLATFORM, SgxCaType::PROCESSOR}) {
+    GetCrlResult first;
+    ASYLO_ASSERT_OK_AND_ASSIGN(first, client->GetCrl(ca_type));
+    GetCrlResult second;
+    ASYLO_ASSERT_OK_AND_ASSIGN(second, client->GetCrl(ca_type));
+    EXPECT_THAT(second.pck_crl, EqualsProto(first.pck_crl));
+    EXPECT_THAT(second.issuer_cert_chain,
+                EqualsProto(first.issuer_cert_chain));
+  }
+  EXPECT_EQ(client->GetStats().misses, 2);
+  EXPECT_EQ(client->GetStats().hits, 2);
+}
+
+TEST_F(CachingSgxPcsClientTest, ReadsValidityOfCrlOnDiskFromCrl) {
+  CachingSgxPcsClient::Options options = OwnValidityOnlyOptions();
+  options.cache_directory = CreateCacheDirectory();
+  GetCrlResult expected;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      expected, CreateFakeClient(options)->GetCrl(SgxCaType::PLATFORM));
+
+  // The CRL is still valid, however long ago its file was written.
+  ASSERT_NO_FATAL_FAILURE(SetModificationTimes(
+      options.cache_directory, absl::Now() - absl::Hours(24)));
+  auto other_client = CreateFakeClient(options);
+  GetCrlResult result;
+  ASYLO_ASSERT_OK_AND_ASSIGN(result,
+                             other_client->GetCrl(SgxCaType::PLATFORM));
+  EXPECT_THAT(result.pck_crl, EqualsProto(expected.pck_crl));
+  EXPECT_EQ(other_client->GetStats().disk_hits, 1);
+  EXPECT_EQ(other_client->GetStats().misses, 0);
+}
+
+}  // namespace
+}  // namespace sgx
+}  // namespace asylo
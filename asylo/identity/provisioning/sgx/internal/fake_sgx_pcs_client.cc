@@ -19,6 +19,11 @@
 #include "asylo/identity/provisioning/sgx/internal/fake_sgx_pcs_client.h"
 
 #include <endian.h>
+#include <openssl/base.h>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
 
 #include <algorithm>
 #include <cstdint>
@@ -56,6 +61,7 @@
 #include "asylo/crypto/certificate_interface.h"
 #include "asylo/crypto/ecdsa_p256_sha256_signing_key.h"
 #include "asylo/crypto/signing_key.h"
+#include "asylo/crypto/util/bssl_util.h"
 #include "asylo/crypto/util/bytes.h"
 #include "asylo/crypto/util/trivial_object_util.h"
 #include "asylo/crypto/x509_certificate.h"
@@ -400,8 +406,13 @@ StatusOr<GetPckCertificatesResult> FakeSgxPcsClient::GetPckCertificates(
 }
 
 StatusOr<GetCrlResult> FakeSgxPcsClient::GetCrl(SgxCaType sgx_ca_type) {
-  return Status(error::GoogleError::UNIMPLEMENTED,
-                "FakeSgxPcsClient::GetCrl() is not implemented");
+  const CaInfo *ca_info;
+  ASYLO_ASSIGN_OR_RETURN(ca_info, GetCaInfo(sgx_ca_type));
+
+  GetCrlResult result;
+  ASYLO_ASSIGN_OR_RETURN(result.pck_crl, CreateFakeCrl(*ca_info));
+  result.issuer_cert_chain = ca_info->issuer_chain;
+  return result;
 }
 
 StatusOr<GetTcbInfoResult> FakeSgxPcsClient::GetTcbInfo(const Fmspc &fmspc) {
@@ -493,6 +504,62 @@ StatusOr<const FakeSgxPcsClient::CaInfo *> FakeSgxPcsClient::GetCaInfo(
   }
 }
 
+StatusOr<CertificateRevocationList> FakeSgxPcsClient::CreateFakeCrl(
+    const CaInfo &ca_info) const {
+  const std::string &ca_certificate_pem =
+      ca_info.issuer_chain.certificates(0).data();
+  bssl::UniquePtr<BIO> ca_certificate_bio(
+      BIO_new_mem_buf(ca_certificate_pem.data(), ca_certificate_pem.size()));
+  bssl::UniquePtr<X509> ca_certificate(
+      PEM_read_bio_X509(ca_certificate_bio.get(), /*x=*/nullptr,
+                        /*cb=*/nullptr, /*u=*/nullptr));
+  if (ca_certificate == nullptr) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+
+  CleansingVector<uint8_t> signing_key_der;
+  ASYLO_ASSIGN_OR_RETURN(signing_key_der,
+                         ca_info.signing_key->SerializeToDer());
+  const uint8_t *signing_key_data = signing_key_der.data();
+  bssl::UniquePtr<EVP_PKEY> signing_key(d2i_AutoPrivateKey(
+      /*out=*/nullptr, &signing_key_data, signing_key_der.size()));
+  if (signing_key == nullptr) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+
+  absl::Time this_update = absl::Now();
+  absl::Time next_update = this_update + absl::Hours(24 * 30);
+  bssl::UniquePtr<ASN1_TIME> this_update_asn1(
+      ASN1_TIME_set(/*s=*/nullptr, absl::ToTimeT(this_update)));
+  bssl::UniquePtr<ASN1_TIME> next_update_asn1(
+      ASN1_TIME_set(/*s=*/nullptr, absl::ToTimeT(next_update)));
+  bssl::UniquePtr<X509_CRL> crl(X509_CRL_new());
+  if (this_update_asn1 == nullptr || next_update_asn1 == nullptr ||
+      crl == nullptr ||
+      X509_CRL_set_version(crl.get(), /*version=*/1) != 1 ||
+      X509_CRL_set_issuer_name(
+          crl.get(), X509_get_subject_name(ca_certificate.get())) != 1 ||
+      X509_CRL_set1_lastUpdate(crl.get(), this_update_asn1.get()) != 1 ||
+      X509_CRL_set1_nextUpdate(crl.get(), next_update_asn1.get()) != 1 ||
+      X509_CRL_sign(crl.get(), signing_key.get(), EVP_sha256()) == 0) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+
+  bssl::UniquePtr<BIO> crl_bio(BIO_new(BIO_s_mem()));
+  if (PEM_write_bio_X509_CRL(crl_bio.get(), crl.get()) != 1) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+  const uint8_t *crl_pem;
+  size_t crl_pem_size;
+  if (BIO_mem_contents(crl_bio.get(), &crl_pem, &crl_pem_size) != 1) {
+    return Status(error::GoogleError::INTERNAL, BsslLastErrorString());
+  }
+  CertificateRevocationList crl_proto;
+  crl_proto.set_format(CertificateRevocationList::X509_PEM);
+  crl_proto.set_data(crl_pem, crl_pem_size);
+  return crl_proto;
+}
+
 StatusOr<PckCertificates::PckCertificateInfo>
 FakeSgxPcsClient::CreateFakePckCertificateInfo(
     const CaInfo &ca_info, const SgxExtensions &extension_data) const {
@@ -124,7 +124,11 @@ class FakeSgxPcsClient : public SgxPcsClient {
   StatusOr<GetPckCertificatesResult> GetPckCertificates(
       const Ppid &ppid, const PceId &pce_id) override;
 
-  // From SgxPcsClient. Currently unimplemented.
+  // From SgxPcsClient. Returns an empty PEM-encoded CRL signed by the fake CA
+  // for |sgx_ca_type|, with a "thisUpdate" corresponding to the current time
+  // and a "nextUpdate" one month later.
+  //
+  // GetCrl() returns an error if |sgx_ca_type| is not supported.
   StatusOr<GetCrlResult> GetCrl(SgxCaType sgx_ca_type) override;
 
   // From SgxPcsClient. Returns the TCB info associated with |fmspc|, but
@@ -186,6 +190,10 @@ class FakeSgxPcsClient : public SgxPcsClient {
   StatusOr<PckCertificates::PckCertificateInfo> CreateFakePckCertificateInfo(
       const CaInfo &ca_info, const SgxExtensions &extension_data) const;
 
+  // Creates an empty fake CRL in PEM format signed by the given |ca_info|.
+  StatusOr<CertificateRevocationList> CreateFakeCrl(
+      const CaInfo &ca_info) const;
+
   // Creates a fake PCK certificate in PEM format for the given |ca_info| and
   // with the given |extension_data|. All the |extension_data| must be valid and
   // consistent, and it all must match the internal provisioning type layouts.
@@ -18,6 +18,12 @@
 
 #include "asylo/identity/provisioning/sgx/internal/fake_sgx_pcs_client.h"
 
+#include <openssl/base.h>
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
 #include <algorithm>
 #include <cstdint>
 #include <memory>
@@ -471,9 +477,55 @@ TEST_P(FakeSgxPcsClientTest,
   }
 }
 
-TEST_P(FakeSgxPcsClientTest, GetCrlIsUnimplemented) {
-  EXPECT_THAT(fake_client_->GetCrl(SgxCaType::PLATFORM),
-              StatusIs(error::GoogleError::UNIMPLEMENTED));
+TEST_P(FakeSgxPcsClientTest, GetCrlFailsOnUnsupportedCaType) {
+  EXPECT_THAT(fake_client_->GetCrl(SgxCaType::SGX_CA_TYPE_UNKNOWN),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST_P(FakeSgxPcsClientTest, GetCrlReturnsCrlSignedByCa) {
+  for (SgxCaType ca_type : {SgxCaType::PLATFORM, SgxCaType::PROCESSOR}) {
+    const CertificateChain &issuer_chain = ca_type == SgxCaType::PLATFORM
+                                               ? platform_ca_issuer_chain_
+                                               : processor_ca_issuer_chain_;
+    absl::Time before = absl::Now();
+    GetCrlResult result;
+    ASYLO_ASSERT_OK_AND_ASSIGN(result, fake_client_->GetCrl(ca_type));
+    EXPECT_THAT(result.issuer_cert_chain, EqualsProto(issuer_chain));
+    ASSERT_THAT(result.pck_crl.format(),
+                Eq(CertificateRevocationList::X509_PEM));
+
+    bssl::UniquePtr<BIO> crl_bio(BIO_new_mem_buf(
+        result.pck_crl.data().data(), result.pck_crl.data().size()));
+    bssl::UniquePtr<X509_CRL> crl(PEM_read_bio_X509_CRL(
+        crl_bio.get(), /*x=*/nullptr, /*cb=*/nullptr, /*u=*/nullptr));
+    ASSERT_THAT(crl, Ne(nullptr));
+    EXPECT_THAT(sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crl.get())), Eq(0));
+
+    const std::string &ca_certificate_pem =
+        issuer_chain.certificates(0).data();
+    bssl::UniquePtr<BIO> ca_certificate_bio(
+        BIO_new_mem_buf(ca_certificate_pem.data(), ca_certificate_pem.size()));
+    bssl::UniquePtr<X509> ca_certificate(
+        PEM_read_bio_X509(ca_certificate_bio.get(), /*x=*/nullptr,
+                          /*cb=*/nullptr, /*u=*/nullptr));
+    ASSERT_THAT(ca_certificate, Ne(nullptr));
+    EXPECT_THAT(X509_NAME_cmp(X509_CRL_get_issuer(crl.get()),
+                              X509_get_subject_name(ca_certificate.get())),
+                Eq(0));
+    bssl::UniquePtr<EVP_PKEY> ca_public_key(
+        X509_get_pubkey(ca_certificate.get()));
+    EXPECT_THAT(X509_CRL_verify(crl.get(), ca_public_key.get()), Eq(1));
+
+    absl::Time this_update;
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        this_update,
+        AbslTimeFromAsn1Time(*X509_CRL_get0_lastUpdate(crl.get())));
+    EXPECT_THAT(this_update, Ge(absl::FromTimeT(absl::ToTimeT(before))));
+    EXPECT_THAT(this_update, Le(absl::Now()));
+    ASSERT_THAT(X509_CRL_get0_nextUpdate(crl.get()), Ne(nullptr));
+    EXPECT_THAT(AbslTimeFromAsn1Time(*X509_CRL_get0_nextUpdate(crl.get())),
+                IsOkAndHolds(this_update + absl::Hours(24 * 30)));
+  }
 }
 
 TEST_P(FakeSgxPcsClientTest, GetTcbInfoFailsOnInvalidFmspc) {
@@ -154,7 +154,8 @@ uint16_t ConvertMatchSpecToKeypolicy(const SgxIdentityMatchSpec &spec) {
 
 Status GenerateCryptorKey(AeadScheme aead_scheme, const std::string &key_id,
                           const SgxIdentityExpectation &sgx_expectation,
-                          size_t key_size, CleansingVector<uint8_t> *key) {
+                          size_t key_size, CleansingVector<uint8_t> *key,
+                          SealKeyCache *cache) {
   // The function generates the |key_size| number of bytes by concatenating
   // bytes from one or more hardware-generated "subkeys." Each of the subkeys
   // is obtained by calling the GetKey() function. Except for the last subkey,
@@ -215,8 +216,13 @@ Status GenerateCryptorKey(AeadScheme aead_scheme, const std::string &key_id,
     req->keyid.assign(digest);
 
     HardwareKey hardware_key;
-    ASYLO_ASSIGN_OR_RETURN(hardware_key,
-                           HardwareInterface::CreateDefault()->GetKey(*req));
+    if (cache == nullptr || !cache->Lookup(*req, &hardware_key)) {
+      ASYLO_ASSIGN_OR_RETURN(hardware_key,
+                             HardwareInterface::CreateDefault()->GetKey(*req));
+      if (cache != nullptr) {
+        cache->Insert(*req, hardware_key);
+      }
+    }
     size_t copy_size = std::min(hardware_key.size(), remaining_key_bytes);
     remaining_key_bytes -= copy_size;
     std::copy(hardware_key.cbegin(), hardware_key.cbegin() + copy_size,
@@ -265,6 +271,70 @@ Status Open(AeadCryptor *cryptor, const SealedSecret &sealed_secret,
   return Status::OkStatus();
 }
 
+Status SealBatch(AeadCryptor *cryptor,
+                 absl::Span<const ByteContainerView> secrets,
+                 absl::Span<const ByteContainerView> additional_data,
+                 absl::Span<SealedSecret> sealed_secrets) {
+  size_t total_secrets_size = 0;
+  for (const ByteContainerView &secret : secrets) {
+    total_secrets_size += secret.size();
+  }
+  std::vector<uint8_t> ciphertexts(total_secrets_size +
+                                   secrets.size() * cryptor->MaxSealOverhead());
+  std::vector<uint8_t> ivs(secrets.size() * cryptor->NonceSize());
+  std::vector<size_t> ciphertext_sizes(secrets.size());
+  ASYLO_RETURN_IF_ERROR(cryptor->SealBatch(
+      secrets, additional_data, absl::MakeSpan(ivs),
+      absl::MakeSpan(ciphertexts), absl::MakeSpan(ciphertext_sizes)));
+
+  size_t ciphertext_offset = 0;
+  for (size_t i = 0; i < secrets.size(); ++i) {
+    sealed_secrets[i].set_secret_ciphertext(
+        ciphertexts.data() + ciphertext_offset, ciphertext_sizes[i]);
+    sealed_secrets[i].set_iv(ivs.data() + i * cryptor->NonceSize(),
+                             cryptor->NonceSize());
+    ciphertext_offset += ciphertext_sizes[i];
+  }
+  return Status::OkStatus();
+}
+
+Status OpenBatch(AeadCryptor *cryptor,
+                 absl::Span<const SealedSecret *const> sealed_secrets,
+                 absl::Span<const ByteContainerView> additional_data,
+                 absl::Span<CleansingVector<uint8_t> *const> secrets) {
+  std::vector<ByteContainerView> ciphertexts;
+  ciphertexts.reserve(sealed_secrets.size());
+  std::vector<uint8_t> ivs;
+  ivs.reserve(sealed_secrets.size() * cryptor->NonceSize());
+  size_t total_ciphertexts_size = 0;
+  for (const SealedSecret *sealed_secret : sealed_secrets) {
+    if (sealed_secret->iv().size() != cryptor->NonceSize()) {
+      return Status(
+          error::GoogleError::INVALID_ARGUMENT,
+          absl::StrCat("Invalid IV size: ", sealed_secret->iv().size(),
+                       " (must be ", cryptor->NonceSize(), ")"));
+    }
+    ciphertexts.emplace_back(sealed_secret->secret_ciphertext());
+    ivs.insert(ivs.end(), sealed_secret->iv().cbegin(),
+               sealed_secret->iv().cend());
+    total_ciphertexts_size += sealed_secret->secret_ciphertext().size();
+  }
+
+  CleansingVector<uint8_t> plaintexts(total_ciphertexts_size);
+  std::vector<size_t> plaintext_sizes(sealed_secrets.size());
+  ASYLO_RETURN_IF_ERROR(cryptor->OpenBatch(ciphertexts, additional_data, ivs,
+                                           absl::MakeSpan(plaintexts),
+                                           absl::MakeSpan(plaintext_sizes)));
+
+  size_t plaintext_offset = 0;
+  for (size_t i = 0; i < sealed_secrets.size(); ++i) {
+    const uint8_t *plaintext = plaintexts.data() + plaintext_offset;
+    secrets[i]->assign(plaintext, plaintext + plaintext_sizes[i]);
+    plaintext_offset += plaintext_sizes[i];
+  }
+  return Status::OkStatus();
+}
+
 StatusOr<AeadScheme> ParseAeadSchemeFromSealedSecretHeader(
     const SealedSecretHeader &header) {
   AeadScheme aead_scheme;
@@ -19,6 +19,7 @@
 #ifndef ASYLO_IDENTITY_SEALING_SGX_INTERNAL_LOCAL_SECRET_SEALER_HELPERS_H_
 #define ASYLO_IDENTITY_SEALING_SGX_INTERNAL_LOCAL_SECRET_SEALER_HELPERS_H_
 
+#include "absl/types/span.h"
 #include "asylo/crypto/aead_cryptor.h"
 #include "asylo/crypto/algorithms.pb.h"
 #include "asylo/crypto/util/byte_container_view.h"
@@ -27,6 +28,7 @@
 #include "asylo/identity/platform/sgx/sgx_identity.pb.h"
 #include "asylo/identity/sealing/sealed_secret.pb.h"
 #include "asylo/identity/sealing/sgx/internal/local_sealed_secret.pb.h"
+#include "asylo/identity/sealing/sgx/internal/seal_key_cache.h"
 #include "asylo/identity/sgx/identity_key_management_structs.h"
 #include "asylo/util/cleansing_types.h"
 #include "asylo/util/status.h"
@@ -47,10 +49,12 @@ Status ParseKeyGenerationParamsFromSealedSecretHeader(
 uint16_t ConvertMatchSpecToKeypolicy(const SgxIdentityMatchSpec &spec);
 
 // Generates the key used by the AEAD Cryptor to perform the Seal or the Open
-// operation.
+// operation. If |cache| is not nullptr, the hardware keys the key is made of
+// are looked up in and added to |cache|.
 Status GenerateCryptorKey(AeadScheme aead_scheme, const std::string &key_id,
                           const SgxIdentityExpectation &sgx_expectation,
-                          size_t key_size, CleansingVector<uint8_t> *key);
+                          size_t key_size, CleansingVector<uint8_t> *key,
+                          SealKeyCache *cache = nullptr);
 
 // Creates a cryptor that uses |key| and the algorithm denoted by
 // |aead_scheme|. Returns a non-OK status if a cryptor cannot be generated.
@@ -66,6 +70,22 @@ Status Open(AeadCryptor *cryptor, const SealedSecret &sealed_secret,
             ByteContainerView additional_data,
             CleansingVector<uint8_t> *secret);
 
+// Seals |secrets| into |sealed_secrets|, using |cryptor|. Secret i is sealed
+// with |additional_data|[i], or with |additional_data|[0] if it holds a single
+// entry. |sealed_secrets| must hold an entry per secret.
+Status SealBatch(AeadCryptor *cryptor,
+                 absl::Span<const ByteContainerView> secrets,
+                 absl::Span<const ByteContainerView> additional_data,
+                 absl::Span<SealedSecret> sealed_secrets);
+
+// Opens the sealed secrets |sealed_secrets| into |secrets|, using |cryptor|.
+// Secret i is opened with |additional_data|[i]. |secrets| must hold an entry
+// per sealed secret.
+Status OpenBatch(AeadCryptor *cryptor,
+                 absl::Span<const SealedSecret *const> sealed_secrets,
+                 absl::Span<const ByteContainerView> additional_data,
+                 absl::Span<CleansingVector<uint8_t> *const> secrets);
+
 // Parses and returns the AEAD scheme associated with |header|. Returns a non-OK
 // status if |header| cannot be parsed.
 StatusOr<AeadScheme> ParseAeadSchemeFromSealedSecretHeader(
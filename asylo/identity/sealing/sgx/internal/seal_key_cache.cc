@@ -0,0 +1,51 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/sealing/sgx/internal/seal_key_cache.h"
+
+#include <cstring>
+
+namespace asylo {
+namespace sgx {
+namespace internal {
+
+bool SealKeyCache::KeyrequestEqual::operator()(const Keyrequest &lhs,
+                                               const Keyrequest &rhs) const {
+  return memcmp(&lhs, &rhs, sizeof(Keyrequest)) == 0;
+}
+
+SealKeyCache::SealKeyCache(size_t capacity, absl::Duration lifetime)
+    : cache_(capacity, lifetime) {}
+
+bool SealKeyCache::Lookup(const Keyrequest &request, HardwareKey *key) {
+  return cache_.Lookup(request, key);
+}
+
+void SealKeyCache::Insert(const Keyrequest &request, const HardwareKey &key) {
+  cache_.Insert(request, key);
+}
+
+void SealKeyCache::Clear() { cache_.Clear(); }
+
+SealKeyCache::Stats SealKeyCache::GetStats() const {
+  return cache_.GetStats();
+}
+
+}  // namespace internal
+}  // namespace sgx
+}  // namespace asylo
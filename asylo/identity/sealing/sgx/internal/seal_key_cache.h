@@ -0,0 +1,77 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_IDENTITY_SEALING_SGX_INTERNAL_SEAL_KEY_CACHE_H_
+#define ASYLO_IDENTITY_SEALING_SGX_INTERNAL_SEAL_KEY_CACHE_H_
+
+#include <cstddef>
+
+#include "absl/time/time.h"
+#include "asylo/identity/sgx/derived_key_cache.h"
+#include "asylo/identity/sgx/identity_key_management_structs.h"
+
+namespace asylo {
+namespace sgx {
+namespace internal {
+
+// A short-lived cache of SEAL keys, keyed by the KEYREQUEST they were derived
+// from. Keys expire a fixed time after they are cached, and the least recently
+// used keys are evicted first when the cache is full; see DerivedKeyCache.
+//
+// A SEAL key also depends on the identity of the enclave that gets it, hence a
+// cache must only be used by the enclave that filled it. All methods are
+// thread-safe.
+class SealKeyCache {
+ public:
+  // Compares KEYREQUESTs bytewise.
+  struct KeyrequestEqual {
+    bool operator()(const Keyrequest &lhs, const Keyrequest &rhs) const;
+  };
+
+  using Stats =
+      DerivedKeyCache<Keyrequest, HardwareKey, KeyrequestEqual>::Stats;
+
+  // Creates a cache of at most |capacity| keys, each of which expires
+  // |lifetime| after it is cached. A cache of zero capacity or lifetime caches
+  // nothing.
+  SealKeyCache(size_t capacity, absl::Duration lifetime);
+
+  SealKeyCache(const SealKeyCache &other) = delete;
+  SealKeyCache &operator=(const SealKeyCache &other) = delete;
+
+  // Copies the unexpired key cached for |request| to |key|, and returns true,
+  // if there is one.
+  bool Lookup(const Keyrequest &request, HardwareKey *key);
+
+  // Caches |key| for |request|, replacing the cached key if any.
+  void Insert(const Keyrequest &request, const HardwareKey &key);
+
+  // Drops all cached keys.
+  void Clear();
+
+  Stats GetStats() const;
+
+ private:
+  DerivedKeyCache<Keyrequest, HardwareKey, KeyrequestEqual> cache_;
+};
+
+}  // namespace internal
+}  // namespace sgx
+}  // namespace asylo
+
+#endif  // ASYLO_IDENTITY_SEALING_SGX_INTERNAL_SEAL_KEY_CACHE_H_
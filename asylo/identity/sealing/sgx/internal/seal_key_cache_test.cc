@@ -0,0 +1,75 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/sealing/sgx/internal/seal_key_cache.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/crypto/util/trivial_object_util.h"
+#include "asylo/identity/sgx/identity_key_management_structs.h"
+
+namespace asylo {
+namespace sgx {
+namespace internal {
+namespace {
+
+// Returns a KEYREQUEST for a SEAL key with a random KEYID.
+Keyrequest RandomKeyrequest() {
+  Keyrequest request = TrivialZeroObject<Keyrequest>();
+  request.keyname = KeyrequestKeyname::SEAL_KEY;
+  request.keypolicy = kKeypolicyMrenclaveBitMask;
+  request.keyid = TrivialRandomObject<UnsafeBytes<kKeyrequestKeyidSize>>();
+  return request;
+}
+
+TEST(SealKeyCacheTest, LookupReturnsInsertedKey) {
+  SealKeyCache cache(/*capacity=*/4, absl::Minutes(1));
+  Keyrequest request = RandomKeyrequest();
+  HardwareKey inserted_key = TrivialRandomObject<HardwareKey>();
+
+  HardwareKey key;
+  EXPECT_FALSE(cache.Lookup(request, &key));
+  cache.Insert(request, inserted_key);
+  ASSERT_TRUE(cache.Lookup(request, &key));
+  EXPECT_EQ(key, inserted_key);
+
+  // Any field of the KEYREQUEST distinguishes keys.
+  request.isvsvn++;
+  EXPECT_FALSE(cache.Lookup(request, &key));
+
+  SealKeyCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 2);
+}
+
+TEST(SealKeyCacheTest, KeysExpire) {
+  SealKeyCache cache(/*capacity=*/4, absl::Milliseconds(10));
+  Keyrequest request = RandomKeyrequest();
+  HardwareKey key = TrivialRandomObject<HardwareKey>();
+  cache.Insert(request, key);
+
+  absl::SleepFor(absl::Milliseconds(50));
+  EXPECT_FALSE(cache.Lookup(request, &key));
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace sgx
+}  // namespace asylo
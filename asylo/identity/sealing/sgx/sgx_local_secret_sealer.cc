@@ -18,7 +18,9 @@
 
 #include "asylo/identity/sealing/sgx/sgx_local_secret_sealer.h"
 
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "absl/memory/memory.h"
@@ -126,11 +128,8 @@ Status SgxLocalSecretSealer::Seal(
     const SealedSecretHeader &header,
     ByteContainerView additional_authenticated_data, ByteContainerView secret,
     SealedSecret *sealed_secret) {
-  AeadScheme aead_scheme;
-  SgxIdentityExpectation sgx_expectation;
-  ASYLO_RETURN_IF_ERROR(
-      sgx::internal::ParseKeyGenerationParamsFromSealedSecretHeader(
-          header, &aead_scheme, &sgx_expectation));
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSIGN_OR_RETURN(cryptor, CreateCryptor(header));
 
   if (!header.SerializeToString(
           sealed_secret->mutable_sealed_secret_header())) {
@@ -146,13 +145,6 @@ Status SgxLocalSecretSealer::Seal(
                           sealed_secret->sealed_secret_header(),
                           additional_authenticated_data);
 
-  CleansingVector<uint8_t> key;
-  ASYLO_RETURN_IF_ERROR(sgx::internal::GenerateCryptorKey(
-      aead_scheme, "default_key_id", sgx_expectation, kAes256GcmSivKeySize,
-      &key));
-
-  std::unique_ptr<AeadCryptor> cryptor;
-  ASYLO_ASSIGN_OR_RETURN(cryptor, sgx::internal::MakeCryptor(aead_scheme, key));
   return sgx::internal::Seal(cryptor.get(), secret, final_additional_data,
                              sealed_secret);
 }
@@ -165,26 +157,143 @@ Status SgxLocalSecretSealer::Unseal(const SealedSecret &sealed_secret,
                   "Could not parse the sealed secret header");
   }
 
-  AeadScheme aead_scheme;
-  SgxIdentityExpectation sgx_expectation;
-  ASYLO_RETURN_IF_ERROR(
-      sgx::internal::ParseKeyGenerationParamsFromSealedSecretHeader(
-          header, &aead_scheme, &sgx_expectation));
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSIGN_OR_RETURN(cryptor, CreateCryptor(header));
 
   std::string final_additional_data;
   SerializeByteContainers(&final_additional_data,
                           sealed_secret.sealed_secret_header(),
                           sealed_secret.additional_authenticated_data());
 
+  return sgx::internal::Open(cryptor.get(), sealed_secret,
+                             final_additional_data, secret);
+}
+
+Status SgxLocalSecretSealer::SealBatch(
+    const SealedSecretHeader &header,
+    absl::Span<const ByteContainerView> additional_authenticated_data,
+    absl::Span<const ByteContainerView> secrets,
+    std::vector<SealedSecret> *sealed_secrets) {
+  if (additional_authenticated_data.size() != 1 &&
+      additional_authenticated_data.size() != secrets.size()) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  "Expected a single additional authenticated data entry or "
+                  "one entry per secret");
+  }
+
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSIGN_OR_RETURN(cryptor, CreateCryptor(header));
+
+  std::string serialized_header;
+  if (!header.SerializeToString(&serialized_header)) {
+    return Status(error::GoogleError::INTERNAL,
+                  "Header serialization to string failed");
+  }
+
+  sealed_secrets->clear();
+  sealed_secrets->resize(secrets.size());
+  std::vector<std::string> final_additional_data(secrets.size());
+  std::vector<ByteContainerView> final_additional_data_views;
+  final_additional_data_views.reserve(secrets.size());
+  for (size_t i = 0; i < secrets.size(); ++i) {
+    ByteContainerView additional_data =
+        additional_authenticated_data.size() == 1
+            ? additional_authenticated_data[0]
+            : additional_authenticated_data[i];
+    SealedSecret &sealed_secret = (*sealed_secrets)[i];
+    sealed_secret.set_sealed_secret_header(serialized_header);
+    sealed_secret.set_additional_authenticated_data(
+        reinterpret_cast<const char *>(additional_data.data()),
+        additional_data.size());
+    SerializeByteContainers(&final_additional_data[i], serialized_header,
+                            additional_data);
+    final_additional_data_views.emplace_back(final_additional_data[i]);
+  }
+
+  return sgx::internal::SealBatch(cryptor.get(), secrets,
+                                  final_additional_data_views,
+                                  absl::MakeSpan(*sealed_secrets));
+}
+
+Status SgxLocalSecretSealer::UnsealBatch(
+    absl::Span<const SealedSecret> sealed_secrets,
+    std::vector<CleansingVector<uint8_t>> *secrets) {
+  secrets->clear();
+  secrets->resize(sealed_secrets.size());
+
+  // Group the secrets by header, preserving their order within each group.
+  std::vector<std::string> headers;
+  std::vector<std::vector<size_t>> groups;
+  for (size_t i = 0; i < sealed_secrets.size(); ++i) {
+    const std::string &header = sealed_secrets[i].sealed_secret_header();
+    auto it = std::find(headers.begin(), headers.end(), header);
+    if (it == headers.end()) {
+      headers.push_back(header);
+      groups.emplace_back();
+      it = headers.end() - 1;
+    }
+    groups[it - headers.begin()].push_back(i);
+  }
+
+  for (size_t group = 0; group < groups.size(); ++group) {
+    SealedSecretHeader header;
+    if (!header.ParseFromString(headers[group])) {
+      return Status(error::GoogleError::INVALID_ARGUMENT,
+                    "Could not parse the sealed secret header");
+    }
+
+    std::unique_ptr<AeadCryptor> cryptor;
+    ASYLO_ASSIGN_OR_RETURN(cryptor, CreateCryptor(header));
+
+    std::vector<const SealedSecret *> group_sealed_secrets;
+    std::vector<std::string> final_additional_data(groups[group].size());
+    std::vector<ByteContainerView> final_additional_data_views;
+    std::vector<CleansingVector<uint8_t> *> group_secrets;
+    for (size_t j = 0; j < groups[group].size(); ++j) {
+      const SealedSecret &sealed_secret = sealed_secrets[groups[group][j]];
+      group_sealed_secrets.push_back(&sealed_secret);
+      SerializeByteContainers(&final_additional_data[j], headers[group],
+                              sealed_secret.additional_authenticated_data());
+      final_additional_data_views.emplace_back(final_additional_data[j]);
+      group_secrets.push_back(&(*secrets)[groups[group][j]]);
+    }
+
+    ASYLO_RETURN_IF_ERROR(sgx::internal::OpenBatch(
+        cryptor.get(), group_sealed_secrets, final_additional_data_views,
+        absl::MakeSpan(group_secrets)));
+  }
+  return Status::OkStatus();
+}
+
+void SgxLocalSecretSealer::EnableKeyCache(size_t capacity,
+                                          absl::Duration lifetime) {
+  std::shared_ptr<sgx::internal::SealKeyCache> key_cache;
+  if (capacity != 0 && lifetime > absl::ZeroDuration()) {
+    key_cache =
+        std::make_shared<sgx::internal::SealKeyCache>(capacity, lifetime);
+  }
+  absl::MutexLock lock(&key_cache_mu_);
+  key_cache_.swap(key_cache);
+}
+
+StatusOr<std::unique_ptr<AeadCryptor>> SgxLocalSecretSealer::CreateCryptor(
+    const SealedSecretHeader &header) {
+  AeadScheme aead_scheme;
+  SgxIdentityExpectation sgx_expectation;
+  ASYLO_RETURN_IF_ERROR(
+      sgx::internal::ParseKeyGenerationParamsFromSealedSecretHeader(
+          header, &aead_scheme, &sgx_expectation));
+
+  std::shared_ptr<sgx::internal::SealKeyCache> key_cache;
+  {
+    absl::MutexLock lock(&key_cache_mu_);
+    key_cache = key_cache_;
+  }
   CleansingVector<uint8_t> key;
   ASYLO_RETURN_IF_ERROR(sgx::internal::GenerateCryptorKey(
       aead_scheme, "default_key_id", sgx_expectation, kAes256GcmSivKeySize,
-      &key));
-
-  std::unique_ptr<AeadCryptor> cryptor;
-  ASYLO_ASSIGN_OR_RETURN(cryptor, sgx::internal::MakeCryptor(aead_scheme, key));
-  return sgx::internal::Open(cryptor.get(), sealed_secret,
-                             final_additional_data, secret);
+      &key, key_cache.get()));
+  return sgx::internal::MakeCryptor(aead_scheme, key);
 }
 
 }  // namespace asylo
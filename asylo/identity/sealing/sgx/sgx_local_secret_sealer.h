@@ -20,15 +20,23 @@
 #define ASYLO_IDENTITY_SEALING_SGX_SGX_LOCAL_SECRET_SEALER_H_
 
 #include <memory>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "asylo/crypto/aead_cryptor.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/identity/platform/sgx/code_identity.pb.h"
 #include "asylo/identity/platform/sgx/sgx_identity.pb.h"
 #include "asylo/identity/sealing/sealed_secret.pb.h"
 #include "asylo/identity/sealing/secret_sealer.h"
+#include "asylo/identity/sealing/sgx/internal/seal_key_cache.h"
 #include "asylo/util/cleansing_types.h"
 #include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
 
 namespace asylo {
 
@@ -139,13 +147,74 @@ class SgxLocalSecretSealer : public SecretSealer {
   Status Unseal(const SealedSecret &sealed_secret,
                 CleansingVector<uint8_t> *secret) override;
 
+  /// Seals a batch of secrets per the same header.
+  ///
+  /// The result is the same as calling Seal() on each secret, but the header
+  /// is validated and serialized, the sealing key is derived, and the cryptor
+  /// is set up once for the whole batch.
+  ///
+  /// \param header The metadata to guide the sealing.
+  /// \param additional_authenticated_data Unencrypted data that is bundled with
+  ///        each secret, or a single entry bundled with all of them.
+  /// \param secrets The data to encrypt and seal.
+  /// \param[out] sealed_secrets The output sealed secrets, one per secret.
+  /// \return A non-OK status if sealing fails.
+  Status SealBatch(
+      const SealedSecretHeader &header,
+      absl::Span<const ByteContainerView> additional_authenticated_data,
+      absl::Span<const ByteContainerView> secrets,
+      std::vector<SealedSecret> *sealed_secrets);
+
+  /// Unseals a batch of sealed secrets.
+  ///
+  /// The result is the same as calling Unseal() on each sealed secret, but the
+  /// sealing key is derived and the cryptor is set up once per distinct
+  /// header. Fails if any of the secrets fails to unseal.
+  ///
+  /// \param sealed_secrets The input secrets to unseal.
+  /// \param[out] secrets The destination for the unsealed secrets, one per
+  ///             sealed secret.
+  /// \return A non-OK Status if unsealing fails.
+  Status UnsealBatch(absl::Span<const SealedSecret> sealed_secrets,
+                     std::vector<CleansingVector<uint8_t>> *secrets);
+
+  /// Enables caching of the hardware keys that sealing keys are derived from.
+  ///
+  /// Keys are cached for at most `lifetime`, and at most `capacity` keys are
+  /// cached, the least recently used of which are evicted first. Cached keys
+  /// are cleansed when they are evicted, when they are found to have expired
+  /// on a later use of the cache, or when the cache is disabled or replaced
+  /// and no sealing operation still uses it. A zero `capacity` or `lifetime`
+  /// disables the cache. The cache assumes that the identity of the enclave
+  /// does not change while keys are cached.
+  ///
+  /// This method is thread-safe, and may be called while other threads seal or
+  /// unseal secrets. Operations already in progress keep using the previous
+  /// cache, if any.
+  ///
+  /// \param capacity The maximum number of cached keys.
+  /// \param lifetime How long a key is cached for.
+  void EnableKeyCache(size_t capacity, absl::Duration lifetime);
+
  private:
   // Instantiates LocalSecretSealer that sets client_acl in the default sealed
   // secret header per |default_client_acl|.
   SgxLocalSecretSealer(const SgxIdentityExpectation &default_client_acl);
 
+  // Validates |header| and creates a cryptor using the sealing key it
+  // describes.
+  StatusOr<std::unique_ptr<AeadCryptor>> CreateCryptor(
+      const SealedSecretHeader &header);
+
   // The default client ACL for this SecretSealer.
   SgxIdentityExpectation default_client_acl_;
+
+  // Cache of the hardware keys sealing keys are derived from, if enabled.
+  // Shared with the operations using it, so that replacing it does not destroy
+  // it under them.
+  std::shared_ptr<sgx::internal::SealKeyCache> key_cache_
+      ABSL_GUARDED_BY(key_cache_mu_);
+  absl::Mutex key_cache_mu_;
 };
 
 }  // namespace asylo
@@ -22,13 +22,18 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/memory/memory.h"
+#include "absl/time/time.h"
 #include "asylo/crypto/algorithms.pb.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/crypto/util/bytes.h"
@@ -812,5 +817,156 @@ TEST_F(SgxLocalSecretSealerTest, BackwardCompatibility) {
   }
 }
 
+// Verify that secrets sealed by SealBatch() can be unsealed one by one and by
+// UnsealBatch().
+TEST_F(SgxLocalSecretSealerTest, SealBatchUnsealBatchSuccess) {
+  std::unique_ptr<SgxLocalSecretSealer> sealer =
+      SgxLocalSecretSealer::CreateMrenclaveSecretSealer();
+  SealedSecretHeader header;
+  PrepareSealedSecretHeader(*sealer, &header);
+
+  std::vector<std::string> input_secrets = {kTestSecret, "", kTestString};
+  std::vector<std::string> input_aads = {kTestAad, kTestString, ""};
+  std::vector<ByteContainerView> secret_views(input_secrets.begin(),
+                                              input_secrets.end());
+  std::vector<ByteContainerView> aad_views(input_aads.begin(),
+                                           input_aads.end());
+
+  std::vector<SealedSecret> sealed_secrets;
+  ASYLO_ASSERT_OK(
+      sealer->SealBatch(header, aad_views, secret_views, &sealed_secrets));
+  ASSERT_EQ(sealed_secrets.size(), input_secrets.size());
+
+  std::unique_ptr<SgxLocalSecretSealer> sealer2 =
+      SgxLocalSecretSealer::CreateMrenclaveSecretSealer();
+  for (size_t i = 0; i < sealed_secrets.size(); ++i) {
+    EXPECT_EQ(sealed_secrets[i].additional_authenticated_data(),
+              input_aads[i]);
+    CleansingVector<uint8_t> output_secret;
+    ASYLO_ASSERT_OK(sealer2->Unseal(sealed_secrets[i], &output_secret));
+    EXPECT_EQ(std::string(output_secret.begin(), output_secret.end()),
+              input_secrets[i]);
+  }
+
+  std::vector<CleansingVector<uint8_t>> output_secrets;
+  ASYLO_ASSERT_OK(sealer2->UnsealBatch(sealed_secrets, &output_secrets));
+  ASSERT_EQ(output_secrets.size(), input_secrets.size());
+  for (size_t i = 0; i < output_secrets.size(); ++i) {
+    EXPECT_EQ(std::string(output_secrets[i].begin(), output_secrets[i].end()),
+              input_secrets[i]);
+  }
+}
+
+// Verify that SealBatch() binds a single additional authenticated data entry
+// to all secrets, and rejects a mismatched number of entries.
+TEST_F(SgxLocalSecretSealerTest, SealBatchSharedAdditionalData) {
+  std::unique_ptr<SgxLocalSecretSealer> sealer =
+      SgxLocalSecretSealer::CreateMrsignerSecretSealer();
+  SealedSecretHeader header;
+  PrepareSealedSecretHeader(*sealer, &header);
+
+  std::vector<ByteContainerView> secret_views = {kTestSecret, kTestString,
+                                                 kTestAad};
+  std::vector<ByteContainerView> aad_views = {kTestAad};
+  std::vector<SealedSecret> sealed_secrets;
+  ASYLO_ASSERT_OK(
+      sealer->SealBatch(header, aad_views, secret_views, &sealed_secrets));
+  for (const SealedSecret &sealed_secret : sealed_secrets) {
+    EXPECT_EQ(sealed_secret.additional_authenticated_data(), kTestAad);
+  }
+
+  aad_views.emplace_back(kTestAad);
+  EXPECT_THAT(
+      sealer->SealBatch(header, aad_views, secret_views, &sealed_secrets),
+      StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+// Verify that UnsealBatch() unseals secrets sealed to different headers, and
+// fails if any of the secrets fails to unseal.
+TEST_F(SgxLocalSecretSealerTest, UnsealBatchMixedHeaders) {
+  std::unique_ptr<SgxLocalSecretSealer> mrenclave_sealer =
+      SgxLocalSecretSealer::CreateMrenclaveSecretSealer();
+  std::unique_ptr<SgxLocalSecretSealer> mrsigner_sealer =
+      SgxLocalSecretSealer::CreateMrsignerSecretSealer();
+  SealedSecretHeader mrenclave_header;
+  PrepareSealedSecretHeader(*mrenclave_sealer, &mrenclave_header);
+  SealedSecretHeader mrsigner_header;
+  PrepareSealedSecretHeader(*mrsigner_sealer, &mrsigner_header);
+
+  std::vector<std::string> input_secrets = {kTestSecret, kTestString, kTestAad};
+  std::vector<SealedSecret> sealed_secrets(input_secrets.size());
+  for (size_t i = 0; i < input_secrets.size(); ++i) {
+    ASYLO_ASSERT_OK(mrenclave_sealer->Seal(
+        i % 2 == 0 ? mrenclave_header : mrsigner_header, kTestAad,
+        input_secrets[i], &sealed_secrets[i]));
+  }
+
+  std::vector<CleansingVector<uint8_t>> output_secrets;
+  ASYLO_ASSERT_OK(
+      mrenclave_sealer->UnsealBatch(sealed_secrets, &output_secrets));
+  ASSERT_EQ(output_secrets.size(), input_secrets.size());
+  for (size_t i = 0; i < output_secrets.size(); ++i) {
+    EXPECT_EQ(std::string(output_secrets[i].begin(), output_secrets[i].end()),
+              input_secrets[i]);
+  }
+
+  sealed_secrets[1].set_additional_authenticated_data(kTestString);
+  EXPECT_THAT(mrenclave_sealer->UnsealBatch(sealed_secrets, &output_secrets),
+              Not(IsOk()));
+}
+
+// Verify that a sealer with a key cache seals and unseals secrets compatibly
+// with a sealer without one.
+TEST_F(SgxLocalSecretSealerTest, SealUnsealWithKeyCache) {
+  std::unique_ptr<SgxLocalSecretSealer> sealer =
+      SgxLocalSecretSealer::CreateMrenclaveSecretSealer();
+  sealer->EnableKeyCache(/*capacity=*/4, absl::Minutes(1));
+  SealedSecretHeader header;
+  PrepareSealedSecretHeader(*sealer, &header);
+
+  std::unique_ptr<SgxLocalSecretSealer> uncached_sealer =
+      SgxLocalSecretSealer::CreateMrenclaveSecretSealer();
+  for (int i = 0; i < 3; ++i) {
+    SealedSecret sealed_secret;
+    ASYLO_ASSERT_OK(sealer->Seal(header, kTestAad, kTestSecret,
+                                 &sealed_secret));
+
+    CleansingVector<uint8_t> output_secret;
+    ASYLO_ASSERT_OK(uncached_sealer->Unseal(sealed_secret, &output_secret));
+    EXPECT_EQ(std::string(output_secret.begin(), output_secret.end()),
+              kTestSecret);
+    ASYLO_ASSERT_OK(sealer->Unseal(sealed_secret, &output_secret));
+    EXPECT_EQ(std::string(output_secret.begin(), output_secret.end()),
+              kTestSecret);
+  }
+}
+
+// Verify that the key cache can be replaced and disabled while secrets are
+// being sealed and unsealed.
+TEST_F(SgxLocalSecretSealerTest, EnableKeyCacheWhileSealing) {
+  std::unique_ptr<SgxLocalSecretSealer> sealer =
+      SgxLocalSecretSealer::CreateMrenclaveSecretSealer();
+  SealedSecretHeader header;
+  PrepareSealedSecretHeader(*sealer, &header);
+
+  std::atomic<bool> done(false);
+  std::thread toggler([&sealer, &done] {
+    for (size_t capacity = 0; !done; capacity = (capacity + 1) % 3) {
+      sealer->EnableKeyCache(capacity, absl::Minutes(1));
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    SealedSecret sealed_secret;
+    ASYLO_ASSERT_OK(sealer->Seal(header, kTestAad, kTestSecret,
+                                 &sealed_secret));
+    CleansingVector<uint8_t> output_secret;
+    ASYLO_ASSERT_OK(sealer->Unseal(sealed_secret, &output_secret));
+    EXPECT_EQ(std::string(output_secret.begin(), output_secret.end()),
+              kTestSecret);
+  }
+  done = true;
+  toggler.join();
+}
+
 }  // namespace
 }  // namespace asylo
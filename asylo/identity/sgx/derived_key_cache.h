@@ -0,0 +1,208 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_IDENTITY_SGX_DERIVED_KEY_CACHE_H_
+#define ASYLO_IDENTITY_SGX_DERIVED_KEY_CACHE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace asylo {
+namespace sgx {
+
+// A small cache of keys derived by the hardware, such as REPORT and SEAL keys,
+// by an |IdT| that identifies their derivation. Ids are compared with
+// |IdEqualT|. The least recently used keys are evicted first when the cache is
+// full, and keys may expire a fixed time after they are cached. Expired keys
+// are never returned, but they are only dropped on the next Lookup() or
+// Insert(); there is no timer.
+//
+// |KeyT| must cleanse its memory when it is overwritten or destroyed, as
+// SafeBytes does, so that keys are cleansed when they are evicted, invalidated
+// or expired, and when the cache is cleared or destroyed. All methods are
+// thread-safe.
+template <typename IdT, typename KeyT, typename IdEqualT = std::equal_to<IdT>>
+class DerivedKeyCache {
+ public:
+  // Counters of the cache since its creation.
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+  };
+
+  // Creates a cache of at most |capacity| keys, each of which expires
+  // |lifetime| after it is cached. A cache of zero capacity or lifetime caches
+  // nothing.
+  explicit DerivedKeyCache(size_t capacity,
+                           absl::Duration lifetime = absl::InfiniteDuration())
+      : capacity_(lifetime > absl::ZeroDuration() ? capacity : 0),
+        lifetime_(lifetime),
+        stats_{0, 0, 0},
+        clock_(0) {
+    entries_.reserve(capacity_);
+  }
+
+  DerivedKeyCache(const DerivedKeyCache &other) = delete;
+  DerivedKeyCache &operator=(const DerivedKeyCache &other) = delete;
+
+  ~DerivedKeyCache() { Clear(); }
+
+  // Copies the unexpired key cached for |id| to |key|, and returns true, if
+  // there is one.
+  bool Lookup(const IdT &id, KeyT *key) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    if (Expires()) {
+      DropExpired(absl::Now());
+    }
+    Entry *entry = Find(id);
+    if (entry == nullptr) {
+      stats_.misses++;
+      return false;
+    }
+    stats_.hits++;
+    entry->last_use = ++clock_;
+    *key = entry->key;
+    return true;
+  }
+
+  // Caches |key| for |id|, replacing the cached key if any.
+  void Insert(const IdT &id, const KeyT &key) ABSL_LOCKS_EXCLUDED(mu_) {
+    if (capacity_ == 0) {
+      return;
+    }
+
+    absl::Time expiration = absl::InfiniteFuture();
+    absl::Time now;
+    if (Expires()) {
+      now = absl::Now();
+      expiration = now + lifetime_;
+    }
+    absl::MutexLock lock(&mu_);
+    if (Expires()) {
+      DropExpired(now);
+    }
+    Entry *entry = Find(id);
+    if (entry == nullptr) {
+      if (entries_.size() == capacity_) {
+        auto least_recently_used = std::min_element(
+            entries_.begin(), entries_.end(),
+            [](const Entry &lhs, const Entry &rhs) {
+              return lhs.last_use < rhs.last_use;
+            });
+        Erase(least_recently_used - entries_.begin());
+        stats_.evictions++;
+      }
+      entries_.emplace_back();
+      entry = &entries_.back();
+      entry->id = id;
+    }
+    entry->key = key;
+    entry->expiration = expiration;
+    entry->last_use = ++clock_;
+  }
+
+  // Drops the key cached for |id|, if any.
+  void Invalidate(const IdT &id) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    Entry *entry = Find(id);
+    if (entry != nullptr) {
+      Erase(entry - entries_.data());
+    }
+  }
+
+  // Drops all cached keys.
+  void Clear() ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    while (!entries_.empty()) {
+      Erase(entries_.size() - 1);
+    }
+  }
+
+  Stats GetStats() const ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    return stats_;
+  }
+
+ private:
+  struct Entry {
+    IdT id;
+    KeyT key;
+    absl::Time expiration;
+
+    // Value of |clock_| when the entry was last used.
+    uint64_t last_use;
+  };
+
+  // Returns whether keys expire. Caches of keys that never expire do not read
+  // the clock.
+  bool Expires() const { return lifetime_ != absl::InfiniteDuration(); }
+
+  // Drops the entries that expired by |now|.
+  void DropExpired(absl::Time now) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    size_t index = 0;
+    while (index < entries_.size()) {
+      if (entries_[index].expiration <= now) {
+        Erase(index);
+      } else {
+        index++;
+      }
+    }
+  }
+
+  // Returns the entry for |id|, or nullptr if there is none. The cache holds
+  // few entries, which are searched linearly.
+  Entry *Find(const IdT &id) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    IdEqualT equal;
+    for (Entry &entry : entries_) {
+      if (equal(entry.id, id)) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  // Removes the entry at |index|. Moving the last entry over the erased one
+  // overwrites its key, and popping the last entry cleanses its copy.
+  void Erase(size_t index) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (index != entries_.size() - 1) {
+      entries_[index] = entries_.back();
+    }
+    entries_.pop_back();
+  }
+
+  const size_t capacity_;
+  const absl::Duration lifetime_;
+  Stats stats_ ABSL_GUARDED_BY(mu_);
+  uint64_t clock_ ABSL_GUARDED_BY(mu_);
+  std::vector<Entry> entries_ ABSL_GUARDED_BY(mu_);
+  mutable absl::Mutex mu_;
+};
+
+}  // namespace sgx
+}  // namespace asylo
+
+#endif  // ASYLO_IDENTITY_SGX_DERIVED_KEY_CACHE_H_
@@ -0,0 +1,125 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/sgx/derived_key_cache.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/crypto/util/trivial_object_util.h"
+#include "asylo/identity/sgx/identity_key_management_structs.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+using IntKeyCache = DerivedKeyCache<int, HardwareKey>;
+
+class DerivedKeyCacheTest : public ::testing::Test {
+ protected:
+  DerivedKeyCacheTest() : key_(TrivialRandomObject<HardwareKey>()) {}
+
+  HardwareKey key_;
+};
+
+TEST_F(DerivedKeyCacheTest, LookupReturnsInsertedKey) {
+  IntKeyCache cache(/*capacity=*/4);
+  HardwareKey key;
+  EXPECT_FALSE(cache.Lookup(1, &key));
+
+  cache.Insert(1, key_);
+  ASSERT_TRUE(cache.Lookup(1, &key));
+  EXPECT_EQ(key, key_);
+  EXPECT_FALSE(cache.Lookup(2, &key));
+
+  IntKeyCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 2);
+  EXPECT_EQ(stats.evictions, 0);
+}
+
+TEST_F(DerivedKeyCacheTest, InsertReplacesKey) {
+  IntKeyCache cache(/*capacity=*/4);
+  cache.Insert(1, key_);
+  HardwareKey other_key = TrivialRandomObject<HardwareKey>();
+  cache.Insert(1, other_key);
+
+  HardwareKey key;
+  ASSERT_TRUE(cache.Lookup(1, &key));
+  EXPECT_EQ(key, other_key);
+  EXPECT_EQ(cache.GetStats().evictions, 0);
+}
+
+TEST_F(DerivedKeyCacheTest, EvictsLeastRecentlyUsedKey) {
+  IntKeyCache cache(/*capacity=*/2);
+  cache.Insert(0, key_);
+  cache.Insert(1, key_);
+
+  // Use the first key, so that the second one is evicted.
+  HardwareKey key;
+  ASSERT_TRUE(cache.Lookup(0, &key));
+  cache.Insert(2, key_);
+
+  EXPECT_TRUE(cache.Lookup(0, &key));
+  EXPECT_FALSE(cache.Lookup(1, &key));
+  EXPECT_TRUE(cache.Lookup(2, &key));
+  EXPECT_EQ(cache.GetStats().evictions, 1);
+}
+
+TEST_F(DerivedKeyCacheTest, InvalidateAndClearDropKeys) {
+  IntKeyCache cache(/*capacity=*/4);
+  cache.Insert(0, key_);
+  cache.Insert(1, key_);
+  cache.Insert(2, key_);
+
+  // Dropping an entry other than the last keeps the others.
+  cache.Invalidate(0);
+  HardwareKey key;
+  EXPECT_FALSE(cache.Lookup(0, &key));
+  EXPECT_TRUE(cache.Lookup(1, &key));
+  EXPECT_TRUE(cache.Lookup(2, &key));
+
+  cache.Clear();
+  EXPECT_FALSE(cache.Lookup(1, &key));
+  EXPECT_FALSE(cache.Lookup(2, &key));
+}
+
+TEST_F(DerivedKeyCacheTest, KeysExpire) {
+  IntKeyCache cache(/*capacity=*/4, absl::Milliseconds(10));
+  cache.Insert(1, key_);
+
+  absl::SleepFor(absl::Milliseconds(50));
+  HardwareKey key;
+  EXPECT_FALSE(cache.Lookup(1, &key));
+}
+
+TEST_F(DerivedKeyCacheTest, ZeroCapacityOrLifetimeCachesNothing) {
+  HardwareKey key;
+  IntKeyCache zero_capacity_cache(/*capacity=*/0);
+  zero_capacity_cache.Insert(1, key_);
+  EXPECT_FALSE(zero_capacity_cache.Lookup(1, &key));
+
+  IntKeyCache zero_lifetime_cache(/*capacity=*/4, absl::ZeroDuration());
+  zero_lifetime_cache.Insert(1, key_);
+  EXPECT_FALSE(zero_lifetime_cache.Lookup(1, &key));
+}
+
+}  // namespace
+}  // namespace sgx
+}  // namespace asylo
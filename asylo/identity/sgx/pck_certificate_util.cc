@@ -23,7 +23,7 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
-#include <functional>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -38,11 +38,12 @@
 #include "absl/hash/hash.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
-#include "absl/strings/str_join.h"
+#include "absl/types/span.h"
 #include "asylo/crypto/asn1.h"
 #include "asylo/crypto/asn1_schema.h"
 #include "asylo/crypto/certificate.pb.h"
 #include "asylo/crypto/certificate_util.h"
+#include "asylo/crypto/der_reader.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/util/logging.h"
 #include "asylo/identity/platform/sgx/machine_configuration.pb.h"
@@ -65,18 +66,6 @@ enum class SgxTypeRaw : uint8_t {
   kStandard = 0,
 };
 
-// Whether an extension is required or optional.
-enum class Optionality { REQUIRED, OPTIONAL };
-
-// Information needed to read a particular extension.
-struct ReadInfo {
-  // The function used to read the ASN.1 value.
-  std::function<Status(const Asn1Value &)> read_function;
-
-  // Whether the extension is required or optional.
-  Optionality optionality;
-};
-
 // Returns an OBJECT IDENTIFIER for |oid_string|. Crashes the program on
 // failure.
 ObjectId CreateOidOrDie(const std::string &oid_string);
@@ -144,19 +133,142 @@ const SgxOidsStruct &GetSgxOids() {
   return *oids;
 }
 
-// If |asn1| is an OCTET STRING with size |expected_size|, returns its octets.
-// Otherwise, returns an error.
-StatusOr<std::vector<uint8_t>> ReadOctetStringWithSize(const Asn1Value &asn1,
-                                                       size_t expected_size) {
-  std::vector<uint8_t> bytes;
-  ASYLO_ASSIGN_OR_RETURN(bytes, asn1.GetOctetString());
-  if (bytes.size() != expected_size) {
+// Returns the contents octets of the DER encoding of |oid|, for matching the
+// OBJECT IDENTIFIERs read by a DerReader. Crashes the program on failure.
+std::vector<uint8_t> OidContentsOrDie(const ObjectId &oid) {
+  std::vector<uint8_t> der = Asn1Value::CreateObjectId(oid)
+                                 .ValueOrDie()
+                                 .SerializeToDer()
+                                 .ValueOrDie();
+  DerReader reader(der);
+  DerElement element;
+  ASYLO_CHECK_OK(reader.ReadElement(DerTag::kObjectId, &element));
+  return std::vector<uint8_t>(element.contents.begin(), element.contents.end());
+}
+
+// A field of the SGX extensions, read from a DerReader into an SgxExtensions.
+using SgxExtensionField = DerOidField<SgxExtensions>;
+
+// Reads |value| as an OCTET STRING with size |expected_size|.
+Status ReadOctetStringWithSize(DerReader *value, size_t expected_size,
+                               ByteContainerView *bytes) {
+  DerElement element;
+  ASYLO_RETURN_IF_ERROR(value->ReadElement(DerTag::kOctetString, &element));
+  if (element.contents.size() != expected_size) {
     return Status(
         error::GoogleError::INVALID_ARGUMENT,
         absl::StrFormat("Expected a container of size %d, found size %d",
-                        expected_size, bytes.size()));
+                        expected_size, element.contents.size()));
   }
-  return bytes;
+  *bytes = element.contents;
+  return Status::OkStatus();
+}
+
+Status ReadPpid(DerReader *value, int /*index*/, SgxExtensions *extensions) {
+  ByteContainerView bytes(nullptr, 0);
+  ASYLO_RETURN_IF_ERROR(ReadOctetStringWithSize(value, kPpidSize, &bytes));
+  extensions->ppid.set_value(bytes.data(), bytes.size());
+  return Status::OkStatus();
+}
+
+Status ReadTcbComponent(DerReader *value, int index,
+                        SgxExtensions *extensions) {
+  // Read as a uint8_t and cast to disallow negative values.
+  uint8_t component;
+  ASYLO_RETURN_IF_ERROR(value->ReadInteger(&component));
+  (*extensions->tcb.mutable_components())[index] =
+      *reinterpret_cast<char *>(&component);
+  return Status::OkStatus();
+}
+
+Status ReadPceSvn(DerReader *value, int /*index*/, SgxExtensions *extensions) {
+  uint16_t pce_svn;
+  ASYLO_RETURN_IF_ERROR(value->ReadInteger(&pce_svn));
+  extensions->tcb.mutable_pce_svn()->set_value(pce_svn);
+  return Status::OkStatus();
+}
+
+Status ReadCpuSvn(DerReader *value, int /*index*/, SgxExtensions *extensions) {
+  ByteContainerView bytes(nullptr, 0);
+  ASYLO_RETURN_IF_ERROR(ReadOctetStringWithSize(value, kCpusvnSize, &bytes));
+  extensions->cpu_svn.set_value(bytes.data(), bytes.size());
+  return Status::OkStatus();
+}
+
+Status ReadTcb(DerReader *value, int index, SgxExtensions *extensions);
+
+Status ReadPceId(DerReader *value, int /*index*/, SgxExtensions *extensions) {
+  ByteContainerView bytes(nullptr, 0);
+  ASYLO_RETURN_IF_ERROR(
+      ReadOctetStringWithSize(value, sizeof(uint16_t), &bytes));
+  uint16_t pce_id;
+  memcpy(&pce_id, bytes.data(), sizeof(pce_id));
+  extensions->pce_id.set_value(le16toh(pce_id));
+  return Status::OkStatus();
+}
+
+Status ReadFmspc(DerReader *value, int /*index*/, SgxExtensions *extensions) {
+  ByteContainerView bytes(nullptr, 0);
+  ASYLO_RETURN_IF_ERROR(ReadOctetStringWithSize(value, kFmspcSize, &bytes));
+  extensions->fmspc.set_value(bytes.data(), bytes.size());
+  return Status::OkStatus();
+}
+
+Status ReadSgxType(DerReader *value, int /*index*/,
+                   SgxExtensions *extensions) {
+  std::underlying_type<SgxTypeRaw>::type raw;
+  ASYLO_RETURN_IF_ERROR(value->ReadEnumerated(&raw));
+  ASYLO_ASSIGN_OR_RETURN(extensions->sgx_type, FromRawSgxType(raw));
+  return Status::OkStatus();
+}
+
+// The fields of the SGX extensions and of the TCB extension within them. The
+// fields refer to the contents octets of their OBJECT IDENTIFIERs, which are
+// stored alongside.
+struct SgxExtensionFieldsStruct {
+  SgxExtensionFieldsStruct() {
+    const SgxOidsStruct &oids = GetSgxOids();
+    for (int i = 0; i < kTcbComponentsSize; ++i) {
+      oid_contents.push_back(OidContentsOrDie(oids.sgx_tcb_comp_svns[i]));
+    }
+    oid_contents.push_back(OidContentsOrDie(oids.pce_svn));
+    oid_contents.push_back(OidContentsOrDie(oids.cpu_svn));
+    oid_contents.push_back(OidContentsOrDie(oids.ppid));
+    oid_contents.push_back(OidContentsOrDie(oids.tcb));
+    oid_contents.push_back(OidContentsOrDie(oids.pce_id));
+    oid_contents.push_back(OidContentsOrDie(oids.fmspc));
+    oid_contents.push_back(OidContentsOrDie(oids.sgx_type));
+
+    auto oid = oid_contents.cbegin();
+    for (int i = 0; i < kTcbComponentsSize; ++i) {
+      tcb_fields.push_back({*oid++, ReadTcbComponent, i});
+    }
+    tcb_fields.push_back({*oid++, ReadPceSvn, 0});
+    tcb_fields.push_back({*oid++, ReadCpuSvn, 0});
+    extension_fields.push_back({*oid++, ReadPpid, 0});
+    extension_fields.push_back({*oid++, ReadTcb, 0});
+    extension_fields.push_back({*oid++, ReadPceId, 0});
+    extension_fields.push_back({*oid++, ReadFmspc, 0});
+    extension_fields.push_back({*oid++, ReadSgxType, 0});
+  }
+
+  std::vector<std::vector<uint8_t>> oid_contents;
+  std::vector<SgxExtensionField> tcb_fields;
+  std::vector<SgxExtensionField> extension_fields;
+};
+
+// Returns a singleton instance of SgxExtensionFieldsStruct.
+const SgxExtensionFieldsStruct &GetSgxExtensionFields() {
+  static const SgxExtensionFieldsStruct *fields = new SgxExtensionFieldsStruct;
+  return *fields;
+}
+
+Status ReadTcb(DerReader *value, int /*index*/, SgxExtensions *extensions) {
+  // Ensure that tcb.components has a slot for each TCB component.
+  extensions->tcb.mutable_components()->resize(kTcbComponentsSize);
+  return ReadDerOidSequence(
+      value, absl::MakeConstSpan(GetSgxExtensionFields().tcb_fields),
+      extensions);
 }
 
 // Returns a schema for a sequence of (OID, ANY) pairs with a minimum length of
@@ -170,69 +282,6 @@ const Asn1Schema<std::vector<std::tuple<ObjectId, Asn1Value>>>
   return *kSchema;
 }
 
-// For each (OID, ASN.1 value) pair in |sequence|, ReadOidAnySequence() calls
-// the function in |read_infos| corresponding to the OID on the ASN.1 value.
-// ReadOidAnySequence() fails if:
-//
-//   * Any OID appears more than once in |sequence|.
-//   * Any OID in |sequence| is not a key in |read_infos|.
-//   * Any of the calls to the functions in |read_infos| returns a non-OK
-//     status.
-//   * An OID in |read_infos| is marked as REQUIRED but is not found in
-//     |sequence|.
-Status ReadOidAnySequence(
-    absl::flat_hash_map<ObjectId, ReadInfo> read_infos,
-    const std::vector<std::tuple<ObjectId, Asn1Value>> &sequence) {
-  absl::flat_hash_set<ObjectId> found_oids;
-  std::vector<std::string> errors;
-  for (auto pair : sequence) {
-    ObjectId oid;
-    Asn1Value asn1;
-    std::tie(oid, asn1) = std::move(pair);
-    auto oid_string_result = oid.GetOidString();
-    std::string oid_string = oid_string_result.ok()
-                                 ? oid_string_result.ValueOrDie()
-                                 : "<could not print OID>";
-    if (!found_oids.insert(oid).second) {
-      errors.push_back(absl::StrCat("Found repeated OID: ", oid_string));
-      continue;
-    }
-    const auto it = read_infos.find(oid);
-    if (it == read_infos.end()) {
-      auto oid_string_result = oid.GetOidString();
-      errors.push_back(absl::StrCat("Unexpected OID: ", oid_string));
-      continue;
-    }
-    Status read_status = it->second.read_function(asn1).WithPrependedContext(
-        absl::StrFormat("Error reading value for OID %s: ", oid_string));
-    if (!read_status.ok()) {
-      if (read_status.CanonicalCode() == error::GoogleError::INVALID_ARGUMENT) {
-        errors.push_back(std::string(read_status.error_message()));
-      } else {
-        return read_status;
-      }
-    }
-  }
-  for (auto pair : read_infos) {
-    ObjectId oid;
-    ReadInfo read_info;
-    std::tie(oid, read_info) = std::move(pair);
-    if (read_info.optionality == Optionality::REQUIRED &&
-        !found_oids.contains(oid)) {
-      auto oid_string_result = oid.GetOidString();
-      errors.push_back(oid_string_result.ok()
-                           ? absl::StrCat("Missing extension with OID ",
-                                          oid_string_result.ValueOrDie())
-                           : "Missing extension");
-    }
-  }
-  return errors.empty()
-             ? Status::OkStatus()
-             : Status(error::GoogleError::INVALID_ARGUMENT,
-                      absl::StrCat("Encountered the following errors:\n  ",
-                                   absl::StrJoin(errors, "\n  ")));
-}
-
 // Validates an SgxExtensions object.
 Status ValidateSgxExtensions(const SgxExtensions &extensions) {
   ASYLO_RETURN_IF_ERROR(ValidatePpid(extensions.ppid));
@@ -248,49 +297,6 @@ Status ValidateSgxExtensions(const SgxExtensions &extensions) {
   return Status::OkStatus();
 }
 
-// Reads |asn1| as a TCB ASN.1 value into |tcb| and |cpu_svn|.
-Status ReadTcb(const Asn1Value &asn1, Tcb *tcb, CpuSvn *cpu_svn) {
-  absl::flat_hash_map<ObjectId, ReadInfo> read_functions(
-      {{GetSgxOids().pce_svn,
-        {[tcb](const Asn1Value &asn1) {
-           uint16_t pce_svn;
-           ASYLO_ASSIGN_OR_RETURN(pce_svn, asn1.GetIntegerAsInt<uint16_t>());
-           tcb->mutable_pce_svn()->set_value(pce_svn);
-           return Status::OkStatus();
-         },
-         Optionality::REQUIRED}},
-       {GetSgxOids().cpu_svn,
-        {[cpu_svn](const Asn1Value &asn1) {
-           std::vector<uint8_t> cpu_svn_bytes;
-           ASYLO_ASSIGN_OR_RETURN(cpu_svn_bytes,
-                                  ReadOctetStringWithSize(asn1, kCpusvnSize));
-           cpu_svn->set_value(cpu_svn_bytes.data(), cpu_svn_bytes.size());
-           return Status::OkStatus();
-         },
-         Optionality::REQUIRED}}});
-  ObjectId oid;
-  for (int i = 0; i < kTcbComponentsSize; ++i) {
-    read_functions.insert({GetSgxOids().sgx_tcb_comp_svns[i],
-                           {[tcb, i](const Asn1Value &asn1) {
-                              // Read as a uint8_t and cast to disallow negative
-                              // values.
-                              uint8_t component;
-                              ASYLO_ASSIGN_OR_RETURN(
-                                  component, asn1.GetIntegerAsInt<uint8_t>());
-                              (*tcb->mutable_components())[i] =
-                                  *reinterpret_cast<char *>(&component);
-                              return Status::OkStatus();
-                            },
-                            Optionality::REQUIRED}});
-  }
-
-  std::vector<std::tuple<ObjectId, Asn1Value>> sequence;
-  ASYLO_ASSIGN_OR_RETURN(sequence, OidAnySequenceSchema().Read(asn1));
-  // Ensure that tcb.components has a slot for each TCB component.
-  tcb->mutable_components()->resize(kTcbComponentsSize);
-  return ReadOidAnySequence(read_functions, sequence);
-}
-
 // Writes |tcb| and |cpu_svn| to a TCB ASN.1 value.
 StatusOr<Asn1Value> WriteTcb(const Tcb &tcb, const CpuSvn &cpu_svn) {
   std::vector<std::tuple<ObjectId, Asn1Value>> sequence;
@@ -344,56 +350,19 @@ Status ValidatePckCertificateInfo(
 const ObjectId &GetSgxExtensionsOid() { return GetSgxOids().sgx_extensions; }
 
 StatusOr<SgxExtensions> ReadSgxExtensions(const Asn1Value &extensions_asn1) {
-  std::vector<std::tuple<ObjectId, Asn1Value>> sequence;
-  ASYLO_ASSIGN_OR_RETURN(sequence,
-                         OidAnySequenceSchema().Read(extensions_asn1));
+  std::vector<uint8_t> extensions_der;
+  ASYLO_ASSIGN_OR_RETURN(extensions_der, extensions_asn1.SerializeToDer());
+  return ReadSgxExtensionsFromDer(extensions_der);
+}
+
+StatusOr<SgxExtensions> ReadSgxExtensionsFromDer(
+    ByteContainerView extensions_der) {
+  DerReader reader(extensions_der);
   SgxExtensions extensions;
-  absl::flat_hash_set<ObjectId> sequence_oids;
-  ASYLO_RETURN_IF_ERROR(ReadOidAnySequence(
-      {{GetSgxOids().ppid,
-        {[&extensions](const Asn1Value &asn1) {
-           std::vector<uint8_t> ppid_bytes;
-           ASYLO_ASSIGN_OR_RETURN(ppid_bytes,
-                                  ReadOctetStringWithSize(asn1, kPpidSize));
-           extensions.ppid.set_value(ppid_bytes.data(), ppid_bytes.size());
-           return Status::OkStatus();
-         },
-         Optionality::REQUIRED}},
-       {GetSgxOids().tcb,
-        {[&extensions](const Asn1Value &asn1) {
-           return ReadTcb(asn1, &extensions.tcb, &extensions.cpu_svn);
-         },
-         Optionality::REQUIRED}},
-       {GetSgxOids().pce_id,
-        {[&extensions](const Asn1Value &asn1) {
-           std::vector<uint8_t> pce_id_bytes;
-           ASYLO_ASSIGN_OR_RETURN(
-               pce_id_bytes, ReadOctetStringWithSize(asn1, sizeof(uint16_t)));
-           extensions.pce_id.set_value(
-               le16toh(*reinterpret_cast<uint16_t *>(pce_id_bytes.data())));
-           return Status::OkStatus();
-         },
-         Optionality::REQUIRED}},
-       {GetSgxOids().fmspc,
-        {[&extensions](const Asn1Value &asn1) {
-           std::vector<uint8_t> fmspc_bytes;
-           ASYLO_ASSIGN_OR_RETURN(fmspc_bytes,
-                                  ReadOctetStringWithSize(asn1, kFmspcSize));
-           extensions.fmspc.set_value(fmspc_bytes.data(), fmspc_bytes.size());
-           return Status::OkStatus();
-         },
-         Optionality::REQUIRED}},
-       {GetSgxOids().sgx_type,
-        {[&extensions](const Asn1Value &asn1) {
-           using UnderlyingType = std::underlying_type<SgxTypeRaw>::type;
-           UnderlyingType raw;
-           ASYLO_ASSIGN_OR_RETURN(raw,
-                                  asn1.GetEnumeratedAsInt<UnderlyingType>());
-           ASYLO_ASSIGN_OR_RETURN(extensions.sgx_type, FromRawSgxType(raw));
-           return Status::OkStatus();
-         },
-      Optionality::REQUIRED}}},
-      sequence));
+  ASYLO_RETURN_IF_ERROR(ReadDerOidSequence(
+      &reader, absl::MakeConstSpan(GetSgxExtensionFields().extension_fields),
+      &extensions));
+  ASYLO_RETURN_IF_ERROR(reader.ExpectEnd());
   return extensions;
 }
 
@@ -21,6 +21,7 @@
 
 #include "absl/types/optional.h"
 #include "asylo/crypto/asn1.h"
+#include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/identity/platform/sgx/machine_configuration.pb.h"
 #include "asylo/identity/provisioning/sgx/internal/platform_provisioning.pb.h"
 #include "asylo/identity/provisioning/sgx/internal/tcb.pb.h"
@@ -59,6 +60,12 @@ const ObjectId &GetSgxExtensionsOid();
 // Reads the SGX-specific extension data in |extensions_asn1|.
 StatusOr<SgxExtensions> ReadSgxExtensions(const Asn1Value &extensions_asn1);
 
+// Reads the SGX-specific extension data in the DER encoding |extensions_der|.
+// Unlike ReadSgxExtensions(), ReadSgxExtensionsFromDer() does not build an
+// ASN.1 tree of the extensions, and only allocates for the output.
+StatusOr<SgxExtensions> ReadSgxExtensionsFromDer(
+    ByteContainerView extensions_der);
+
 // Writes the SGX-specific extension data in |extensions| to an Asn1Value. This
 // is only intended to be used for testing.
 StatusOr<Asn1Value> WriteSgxExtensions(const SgxExtensions &extensions);
@@ -0,0 +1,148 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of reading the SGX extensions of PCK certificates, comparing a
+// walk of the BoringSSL ASN.1 tree of the extensions with the DER reader. Run
+// with --benchmarks=all.
+
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "asylo/crypto/asn1.h"
+#include "asylo/crypto/asn1_schema.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/identity/provisioning/sgx/internal/tcb.h"
+#include "asylo/identity/sgx/pck_certificate_util.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+using OidAnySequence = std::vector<std::tuple<ObjectId, Asn1Value>>;
+
+// Returns the DER encoding of valid SGX extensions.
+const std::vector<uint8_t> &GetSgxExtensionsDer() {
+  static const std::vector<uint8_t> *der = [] {
+    SgxExtensions extensions;
+    extensions.ppid.set_value("PPIDPPIDPPIDPPID");
+    extensions.tcb.set_components("0123456789abcdef");
+    extensions.tcb.mutable_pce_svn()->set_value(7);
+    extensions.cpu_svn.set_value("fedcba9876543210");
+    extensions.pce_id.set_value(1);
+    extensions.fmspc.set_value("FMSPC!");
+    extensions.sgx_type = SgxType::STANDARD;
+    return new std::vector<uint8_t>(WriteSgxExtensions(extensions)
+                                        .ValueOrDie()
+                                        .SerializeToDer()
+                                        .ValueOrDie());
+  }();
+  return *der;
+}
+
+const Asn1Schema<OidAnySequence> &OidAnySequenceSchema() {
+  static const auto *kSchema =
+      CHECK_NOTNULL(Asn1SequenceOf(Asn1Sequence(Asn1ObjectId(), Asn1Any()),
+                                   /*min_size=*/1))
+          .release();
+  return *kSchema;
+}
+
+// Decodes every value of the SGX extensions in |extensions_der| by parsing
+// them into an ASN.1 tree and reading it with Asn1Schema, the way the SGX
+// extensions used to be read. Unlike ReadSgxExtensions(), does not check the
+// OBJECT IDENTIFIERs, so this is a lower bound of the cost of that approach.
+Status DecodeSgxExtensionsWithAsn1Schema(ByteContainerView extensions_der) {
+  static const ObjectId *tcb_oid = new ObjectId(
+      ObjectId::CreateFromOidString("1.2.840.113741.1.13.1.2").ValueOrDie());
+  static const ObjectId *sgx_type_oid = new ObjectId(
+      ObjectId::CreateFromOidString("1.2.840.113741.1.13.1.5").ValueOrDie());
+
+  Asn1Value extensions_asn1;
+  ASYLO_ASSIGN_OR_RETURN(extensions_asn1,
+                         Asn1Value::CreateFromDer(extensions_der));
+  OidAnySequence extensions;
+  ASYLO_ASSIGN_OR_RETURN(extensions,
+                         OidAnySequenceSchema().Read(extensions_asn1));
+  for (const auto &extension : extensions) {
+    const ObjectId &oid = std::get<0>(extension);
+    const Asn1Value &value = std::get<1>(extension);
+    if (oid == *tcb_oid) {
+      OidAnySequence tcb;
+      ASYLO_ASSIGN_OR_RETURN(tcb, OidAnySequenceSchema().Read(value));
+      for (int i = 0; i < kTcbComponentsSize; ++i) {
+        benchmark::DoNotOptimize(
+            std::get<1>(tcb[i]).GetIntegerAsInt<uint8_t>());
+      }
+      benchmark::DoNotOptimize(
+          std::get<1>(tcb[kTcbComponentsSize]).GetIntegerAsInt<uint16_t>());
+      benchmark::DoNotOptimize(
+          std::get<1>(tcb[kTcbComponentsSize + 1]).GetOctetString());
+    } else if (oid == *sgx_type_oid) {
+      benchmark::DoNotOptimize(value.GetEnumeratedAsInt<uint8_t>());
+    } else {
+      benchmark::DoNotOptimize(value.GetOctetString());
+    }
+  }
+  return Status::OkStatus();
+}
+
+// Decodes the SGX extensions with an ASN.1 tree and Asn1Schema.
+void BM_DecodeSgxExtensionsWithAsn1Schema(benchmark::State &state) {
+  const std::vector<uint8_t> &extensions_der = GetSgxExtensionsDer();
+  for (auto _ : state) {
+    CHECK(DecodeSgxExtensionsWithAsn1Schema(extensions_der).ok());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecodeSgxExtensionsWithAsn1Schema);
+
+// Reads the SGX extensions from their DER encoding with the DER reader.
+void BM_ReadSgxExtensionsFromDer(benchmark::State &state) {
+  const std::vector<uint8_t> &extensions_der = GetSgxExtensionsDer();
+  for (auto _ : state) {
+    auto extensions_result = ReadSgxExtensionsFromDer(extensions_der);
+    CHECK(extensions_result.ok()) << extensions_result.status();
+    benchmark::DoNotOptimize(extensions_result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadSgxExtensionsFromDer);
+
+// Reads the SGX extensions from an Asn1Value, as callers holding an X.509
+// extension do, which serializes the value before reading it.
+void BM_ReadSgxExtensionsFromAsn1Value(benchmark::State &state) {
+  const Asn1Value extensions_asn1 =
+      Asn1Value::CreateFromDer(GetSgxExtensionsDer()).ValueOrDie();
+  for (auto _ : state) {
+    auto extensions_result = ReadSgxExtensions(extensions_asn1);
+    CHECK(extensions_result.ok()) << extensions_result.status();
+    benchmark::DoNotOptimize(extensions_result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadSgxExtensionsFromAsn1Value);
+
+}  // namespace
+}  // namespace sgx
+}  // namespace asylo
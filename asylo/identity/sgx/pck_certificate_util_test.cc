@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include <bitset>
+#include <cstdint>
 #include <limits>
 #include <ostream>
 #include <string>
@@ -591,6 +592,27 @@ TEST(PckCertificateUtilTest, SgxExtensionsRoundtrip) {
               IsOkAndHolds(SgxExtensionsEquals(extensions)));
 }
 
+TEST(PckCertificateUtilTest, SgxExtensionsRoundtripThroughDer) {
+  SgxExtensions extensions = CreateValidSgxExtensions();
+  Asn1Value extensions_asn1;
+  ASYLO_ASSERT_OK_AND_ASSIGN(extensions_asn1, WriteSgxExtensions(extensions));
+  std::vector<uint8_t> extensions_der;
+  ASYLO_ASSERT_OK_AND_ASSIGN(extensions_der, extensions_asn1.SerializeToDer());
+  EXPECT_THAT(ReadSgxExtensionsFromDer(extensions_der),
+              IsOkAndHolds(SgxExtensionsEquals(extensions)));
+}
+
+TEST(PckCertificateUtilTest, SgxExtensionsWithTrailingDataCannotBeRead) {
+  Asn1Value extensions_asn1;
+  ASYLO_ASSERT_OK_AND_ASSIGN(extensions_asn1,
+                             WriteSgxExtensions(CreateValidSgxExtensions()));
+  std::vector<uint8_t> extensions_der;
+  ASYLO_ASSERT_OK_AND_ASSIGN(extensions_der, extensions_asn1.SerializeToDer());
+  extensions_der.push_back(0);
+  EXPECT_THAT(ReadSgxExtensionsFromDer(extensions_der),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
 TEST(PckCertificateUtilTest, SgxExtensionsElementsCanBeInAnyOrder) {
   SgxExtensions extensions = CreateValidSgxExtensions();
   Asn1Value extensions_asn1;
@@ -0,0 +1,57 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/sgx/report_key_cache.h"
+
+namespace asylo {
+namespace sgx {
+
+constexpr size_t ReportKeyCache::kDefaultCapacity;
+
+ReportKeyCache::ReportKeyCache(size_t capacity) : cache_(capacity) {}
+
+ReportKeyCache *ReportKeyCache::GetInstance() {
+  static ReportKeyCache *instance = new ReportKeyCache;
+  return instance;
+}
+
+bool ReportKeyCache::Lookup(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+                            const UnsafeBytes<kCpusvnSize> &cpusvn,
+                            HardwareKey *key) {
+  return cache_.Lookup(KeyId(keyid, cpusvn), key);
+}
+
+void ReportKeyCache::Insert(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+                            const UnsafeBytes<kCpusvnSize> &cpusvn,
+                            const HardwareKey &key) {
+  cache_.Insert(KeyId(keyid, cpusvn), key);
+}
+
+void ReportKeyCache::Invalidate(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+                                const UnsafeBytes<kCpusvnSize> &cpusvn) {
+  cache_.Invalidate(KeyId(keyid, cpusvn));
+}
+
+void ReportKeyCache::Clear() { cache_.Clear(); }
+
+ReportKeyCache::Stats ReportKeyCache::GetStats() const {
+  return cache_.GetStats();
+}
+
+}  // namespace sgx
+}  // namespace asylo
@@ -0,0 +1,86 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_IDENTITY_SGX_REPORT_KEY_CACHE_H_
+#define ASYLO_IDENTITY_SGX_REPORT_KEY_CACHE_H_
+
+#include <cstddef>
+#include <utility>
+
+#include "asylo/crypto/util/bytes.h"
+#include "asylo/identity/sgx/derived_key_cache.h"
+#include "asylo/identity/sgx/identity_key_management_structs.h"
+
+namespace asylo {
+namespace sgx {
+
+// A small cache of REPORT keys, keyed by the KEYID and CPUSVN of the reports
+// they verify. The least recently used keys are evicted first. Cached keys are
+// cleansed when they are evicted or invalidated.
+//
+// A REPORT key also depends on the identity of the enclave that gets it, hence
+// a cache must only be shared by verifications performed by the same enclave.
+// Callers should only insert keys that verified a report, and should
+// invalidate a cached key that fails to verify one. All methods are
+// thread-safe.
+class ReportKeyCache {
+ public:
+  // Number of keys cached by default. Reports of a platform share a KEYID
+  // until the platform is reset, so a handful of entries is plenty.
+  static constexpr size_t kDefaultCapacity = 8;
+
+  // Identifies a REPORT key by the KEYID and CPUSVN of the reports it
+  // verifies.
+  using KeyId = std::pair<UnsafeBytes<kKeyrequestKeyidSize>,
+                          UnsafeBytes<kCpusvnSize>>;
+
+  using Stats = DerivedKeyCache<KeyId, HardwareKey>::Stats;
+
+  // Creates a cache of at most |capacity| keys. A cache of zero capacity
+  // caches nothing.
+  explicit ReportKeyCache(size_t capacity = kDefaultCapacity);
+
+  // Returns the cache shared by report verifications in this enclave.
+  static ReportKeyCache *GetInstance();
+
+  // Copies the key cached for |keyid| and |cpusvn| to |key|, and returns true,
+  // if there is one.
+  bool Lookup(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+              const UnsafeBytes<kCpusvnSize> &cpusvn, HardwareKey *key);
+
+  // Caches |key| for |keyid| and |cpusvn|, replacing the cached key if any.
+  void Insert(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+              const UnsafeBytes<kCpusvnSize> &cpusvn, const HardwareKey &key);
+
+  // Drops the key cached for |keyid| and |cpusvn|, if any.
+  void Invalidate(const UnsafeBytes<kKeyrequestKeyidSize> &keyid,
+                  const UnsafeBytes<kCpusvnSize> &cpusvn);
+
+  // Drops all cached keys.
+  void Clear();
+
+  Stats GetStats() const;
+
+ private:
+  DerivedKeyCache<KeyId, HardwareKey> cache_;
+};
+
+}  // namespace sgx
+}  // namespace asylo
+
+#endif  // ASYLO_IDENTITY_SGX_REPORT_KEY_CACHE_H_
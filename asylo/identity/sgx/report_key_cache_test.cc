@@ -0,0 +1,86 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/identity/sgx/report_key_cache.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/crypto/util/bytes.h"
+#include "asylo/crypto/util/trivial_object_util.h"
+#include "asylo/identity/sgx/identity_key_management_structs.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+using Keyid = UnsafeBytes<kKeyrequestKeyidSize>;
+using Cpusvn = UnsafeBytes<kCpusvnSize>;
+
+class ReportKeyCacheTest : public ::testing::Test {
+ protected:
+  ReportKeyCacheTest()
+      : keyid_(TrivialRandomObject<Keyid>()),
+        cpusvn_(TrivialRandomObject<Cpusvn>()),
+        key_(TrivialRandomObject<HardwareKey>()) {}
+
+  Keyid keyid_;
+  Cpusvn cpusvn_;
+  HardwareKey key_;
+};
+
+TEST_F(ReportKeyCacheTest, LookupReturnsInsertedKey) {
+  ReportKeyCache cache;
+  HardwareKey key;
+  EXPECT_FALSE(cache.Lookup(keyid_, cpusvn_, &key));
+
+  cache.Insert(keyid_, cpusvn_, key_);
+  ASSERT_TRUE(cache.Lookup(keyid_, cpusvn_, &key));
+  EXPECT_EQ(key, key_);
+
+  ReportKeyCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+}
+
+TEST_F(ReportKeyCacheTest, KeysDependOnKeyidAndCpusvn) {
+  ReportKeyCache cache;
+  cache.Insert(keyid_, cpusvn_, key_);
+
+  HardwareKey key;
+  EXPECT_FALSE(cache.Lookup(TrivialRandomObject<Keyid>(), cpusvn_, &key));
+  EXPECT_FALSE(cache.Lookup(keyid_, TrivialRandomObject<Cpusvn>(), &key));
+}
+
+TEST_F(ReportKeyCacheTest, InvalidateDropsKey) {
+  ReportKeyCache cache;
+  Keyid other_keyid = TrivialRandomObject<Keyid>();
+  cache.Insert(keyid_, cpusvn_, key_);
+  cache.Insert(other_keyid, cpusvn_, key_);
+
+  cache.Invalidate(keyid_, cpusvn_);
+  HardwareKey key;
+  EXPECT_FALSE(cache.Lookup(keyid_, cpusvn_, &key));
+  EXPECT_TRUE(cache.Lookup(other_keyid, cpusvn_, &key));
+
+  cache.Clear();
+  EXPECT_FALSE(cache.Lookup(other_keyid, cpusvn_, &key));
+}
+
+}  // namespace
+}  // namespace sgx
+}  // namespace asylo
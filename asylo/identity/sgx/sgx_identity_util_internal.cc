@@ -97,6 +97,32 @@ StatusOr<HardwareKey> GetReportKey(
   return HardwareInterface::CreateDefault()->GetKey(*request);
 }
 
+// Verifies the MAC of |report| with the report key |report_key|.
+Status VerifyReportMac(const Report &report, const HardwareKey &report_key) {
+  // Compute the report MAC. SGX uses CMAC to MAC the contents of the report.
+  // The last two fields (KEYID and MAC) from the REPORT struct are not
+  // included in the MAC computation.
+  constexpr size_t kReportMacSize = sizeof(report.mac);
+  static_assert(kReportMacSize == AES_BLOCK_SIZE,
+                "Size of the mac field in the REPORT structure is incorrect.");
+  SafeBytes<kReportMacSize> actual_mac;
+  if (AES_CMAC(/*out=*/actual_mac.data(), /*key=*/report_key.data(),
+               /*key_len=*/report_key.size(),
+               /*in=*/reinterpret_cast<const uint8_t *>(&report.body),
+               /*in_len=*/sizeof(report.body)) != 1) {
+    return Status(
+        error::GoogleError::INTERNAL,
+        absl::StrCat("CMAC computation failed: ", BsslLastErrorString()));
+  }
+
+  // Inequality operator on a SafeBytes object performs a constant-time
+  // comparison, which is required for MAC verification.
+  if (actual_mac != report.mac) {
+    return Status(error::GoogleError::INTERNAL, "MAC verification failed");
+  }
+  return Status::OkStatus();
+}
+
 StatusOr<bool> MatchIdentityToExpectation(const CodeIdentity &identity,
                                           const CodeIdentity &expected,
                                           const CodeIdentityMatchSpec &spec,
@@ -700,30 +726,33 @@ void SetTargetinfoFromSelfIdentity(Targetinfo *tinfo) {
 }
 
 Status VerifyHardwareReport(const Report &report) {
+#ifdef __ASYLO__
+  // REPORT keys depend on the identity of the enclave, which does not change
+  // during its lifetime, hence the keys are cached for the whole enclave.
+  return VerifyHardwareReport(report, ReportKeyCache::GetInstance());
+#else
+  // Outside an SGX enclave, enclave identity is simulated by the FakeEnclave
+  // object, and it can change from one call to this function to the next.
+  // Consequently, REPORT keys are not cached.
   HardwareKey report_key;
   ASYLO_ASSIGN_OR_RETURN(report_key, GetReportKey(report.keyid));
+  return VerifyReportMac(report, report_key);
+#endif  // __ASYLO__
+}
 
-  // Compute the report MAC. SGX uses CMAC to MAC the contents of the report.
-  // The last two fields (KEYID and MAC) from the REPORT struct are not
-  // included in the MAC computation.
-  constexpr size_t kReportMacSize = sizeof(report.mac);
-  static_assert(kReportMacSize == AES_BLOCK_SIZE,
-                "Size of the mac field in the REPORT structure is incorrect.");
-  SafeBytes<kReportMacSize> actual_mac;
-  if (AES_CMAC(/*out=*/actual_mac.data(), /*key=*/report_key.data(),
-               /*key_len=*/report_key.size(),
-               /*in=*/reinterpret_cast<const uint8_t *>(&report.body),
-               /*in_len=*/sizeof(report.body)) != 1) {
-    return Status(
-        error::GoogleError::INTERNAL,
-        absl::StrCat("CMAC computation failed: ", BsslLastErrorString()));
+Status VerifyHardwareReport(const Report &report, ReportKeyCache *cache) {
+  HardwareKey report_key;
+  if (cache->Lookup(report.keyid, report.body.cpusvn, &report_key) &&
+      VerifyReportMac(report, report_key).ok()) {
+    return Status::OkStatus();
   }
 
-  // Inequality operator on a SafeBytes object performs a constant-time
-  // comparison, which is required for MAC verification.
-  if (actual_mac != report.mac) {
-    return Status(error::GoogleError::INTERNAL, "MAC verification failed");
-  }
+  // Verify the report with a freshly derived key if there is no cached key, or
+  // if the cached key failed to verify it. Only keys that verified a report are
+  // cached, so that forged reports cannot fill the cache.
+  ASYLO_ASSIGN_OR_RETURN(report_key, GetReportKey(report.keyid));
+  ASYLO_RETURN_IF_ERROR(VerifyReportMac(report, report_key));
+  cache->Insert(report.keyid, report.body.cpusvn, report_key);
   return Status::OkStatus();
 }
 
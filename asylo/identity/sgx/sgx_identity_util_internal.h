@@ -26,6 +26,7 @@
 #include "asylo/identity/platform/sgx/sgx_identity.pb.h"
 #include "asylo/identity/sgx/code_identity_constants.h"
 #include "asylo/identity/sgx/identity_key_management_structs.h"
+#include "asylo/identity/sgx/report_key_cache.h"
 #include "asylo/util/status.h"
 #include "asylo/util/statusor.h"
 
@@ -157,9 +158,15 @@ Status SerializeSgxExpectation(const SgxIdentityExpectation &sgx_expectation,
 // this TARGETINFO are targeted at this enclave.
 void SetTargetinfoFromSelfIdentity(Targetinfo *tinfo);
 
-// Verifies the hardware report |report|.
+// Verifies the hardware report |report|. Inside an enclave, the REPORT keys
+// used are cached in ReportKeyCache::GetInstance().
 Status VerifyHardwareReport(const Report &report);
 
+// Verifies the hardware report |report|, using the REPORT key cached in |cache|
+// if any, and caching the key that verified |report|. |cache| must only be
+// used to verify reports in the current enclave.
+Status VerifyHardwareReport(const Report &report, ReportKeyCache *cache);
+
 }  // namespace sgx
 }  // namespace asylo
 
@@ -0,0 +1,95 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of the verification of hardware reports against the fake
+// hardware interface, with and without caching REPORT keys. Run with
+// --benchmarks=all.
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "asylo/crypto/util/trivial_object_util.h"
+#include "asylo/identity/sgx/fake_enclave.h"
+#include "asylo/identity/sgx/hardware_interface.h"
+#include "asylo/identity/sgx/identity_key_management_structs.h"
+#include "asylo/identity/sgx/report_key_cache.h"
+#include "asylo/identity/sgx/sgx_identity_util_internal.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+// Number of distinct reports verified in round robin.
+constexpr int kNumReports = 64;
+
+// Enters a fake enclave of random identity, and returns reports of that
+// enclave targeted at itself.
+std::vector<Report> *CreateReports() {
+  FakeEnclave enclave;
+  enclave.SetRandomIdentity();
+  FakeEnclave::EnterEnclave(enclave);
+
+  AlignedTargetinfoPtr targetinfo;
+  SetTargetinfoFromSelfIdentity(targetinfo.get());
+  AlignedReportdataPtr reportdata;
+  auto hardware = HardwareInterface::CreateDefault();
+  auto reports = new std::vector<Report>;
+  for (int i = 0; i < kNumReports; ++i) {
+    reportdata->data = TrivialRandomObject<UnsafeBytes<kReportdataSize>>();
+    auto report_result = hardware->GetReport(*targetinfo, *reportdata);
+    CHECK(report_result.ok()) << report_result.status();
+    reports->push_back(report_result.ValueOrDie());
+  }
+  return reports;
+}
+
+// Returns the reports verified by all benchmark threads.
+const std::vector<Report> &GetReports() {
+  static const std::vector<Report> *reports = CreateReports();
+  return *reports;
+}
+
+// Verifies reports deriving a REPORT key for each of them.
+void BM_VerifyHardwareReport(benchmark::State &state) {
+  const std::vector<Report> &reports = GetReports();
+  size_t index = 0;
+  for (auto _ : state) {
+    CHECK(VerifyHardwareReport(reports[index]).ok());
+    index = (index + 1) % reports.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VerifyHardwareReport)->ThreadRange(1, 8)->UseRealTime();
+
+// Verifies reports with a REPORT key cache shared by all benchmark threads.
+void BM_VerifyHardwareReportCached(benchmark::State &state) {
+  static ReportKeyCache *cache = new ReportKeyCache;
+  const std::vector<Report> &reports = GetReports();
+  size_t index = 0;
+  for (auto _ : state) {
+    CHECK(VerifyHardwareReport(reports[index], cache).ok());
+    index = (index + 1) % reports.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VerifyHardwareReportCached)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace
+}  // namespace sgx
+}  // namespace asylo
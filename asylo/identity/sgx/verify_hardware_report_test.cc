@@ -21,8 +21,10 @@
 #include "asylo/crypto/util/trivial_object_util.h"
 #include "asylo/identity/sgx/hardware_interface.h"
 #include "asylo/identity/sgx/identity_key_management_structs.h"
+#include "asylo/identity/sgx/report_key_cache.h"
 #include "asylo/identity/sgx/sgx_identity_util_internal.h"
 #include "asylo/test/util/status_matchers.h"
+#include "asylo/util/statusor.h"
 
 namespace asylo {
 namespace sgx {
@@ -30,6 +32,17 @@ namespace {
 
 using ::testing::Not;
 
+// Returns a hardware report of this enclave targeted at |targetinfo|.
+StatusOr<Report> GetReport(const Targetinfo &targetinfo) {
+  AlignedTargetinfoPtr aligned_targetinfo;
+  *aligned_targetinfo = targetinfo;
+
+  AlignedReportdataPtr reportdata;
+  reportdata->data = TrivialRandomObject<UnsafeBytes<kReportdataSize>>();
+  return HardwareInterface::CreateDefault()->GetReport(*aligned_targetinfo,
+                                                       *reportdata);
+}
+
 // Verify that VerifyHardwareReport() can verify a hardware report that is
 // targeted at the verifying enclave.
 TEST(VerifyHardwareReportTest, VerifyHardwareReportSucceedsWhenTargetIsSelf) {
@@ -62,6 +75,63 @@ TEST(VerifyHardwareReportTest, VerifyHardwareReportFailsWhenTargetIsNotSelf) {
   ASSERT_THAT(VerifyHardwareReport(report), Not(IsOk()));
 }
 
+// Verify that VerifyHardwareReport() caches the report key that verified a
+// report, and uses it to verify later reports.
+TEST(VerifyHardwareReportTest, VerifyHardwareReportCachesReportKey) {
+  Targetinfo targetinfo;
+  SetTargetinfoFromSelfIdentity(&targetinfo);
+  ReportKeyCache cache;
+
+  for (int i = 0; i < 3; ++i) {
+    Report report;
+    ASYLO_ASSERT_OK_AND_ASSIGN(report, GetReport(targetinfo));
+    ASYLO_ASSERT_OK(VerifyHardwareReport(report, &cache));
+  }
+
+  ReportKeyCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.hits, 2);
+}
+
+// Verify that a cached report key does not verify a hardware report that is
+// not targeted at the verifying enclave.
+TEST(VerifyHardwareReportTest,
+     VerifyHardwareReportWithCachedKeyFailsWhenTargetIsNotSelf) {
+  Targetinfo targetinfo;
+  SetTargetinfoFromSelfIdentity(&targetinfo);
+  ReportKeyCache cache;
+
+  Report report;
+  ASYLO_ASSERT_OK_AND_ASSIGN(report, GetReport(targetinfo));
+  ASYLO_ASSERT_OK(VerifyHardwareReport(report, &cache));
+
+  ASYLO_ASSERT_OK_AND_ASSIGN(report,
+                             GetReport(TrivialZeroObject<Targetinfo>()));
+  EXPECT_THAT(VerifyHardwareReport(report, &cache), Not(IsOk()));
+
+  // A report targeted at the verifying enclave still verifies.
+  ASYLO_ASSERT_OK_AND_ASSIGN(report, GetReport(targetinfo));
+  ASYLO_EXPECT_OK(VerifyHardwareReport(report, &cache));
+}
+
+// Verify that a report whose MAC was tampered with does not verify, whether or
+// not its report key is cached.
+TEST(VerifyHardwareReportTest, VerifyHardwareReportFailsWhenMacIsTampered) {
+  Targetinfo targetinfo;
+  SetTargetinfoFromSelfIdentity(&targetinfo);
+  ReportKeyCache cache;
+
+  Report report;
+  ASYLO_ASSERT_OK_AND_ASSIGN(report, GetReport(targetinfo));
+  report.mac[0] ^= 1;
+  EXPECT_THAT(VerifyHardwareReport(report, &cache), Not(IsOk()));
+
+  report.mac[0] ^= 1;
+  ASYLO_ASSERT_OK(VerifyHardwareReport(report, &cache));
+  report.mac[0] ^= 1;
+  EXPECT_THAT(VerifyHardwareReport(report, &cache), Not(IsOk()));
+}
+
 }  // namespace
 }  // namespace sgx
 }  // namespace asylo
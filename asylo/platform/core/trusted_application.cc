@@ -40,6 +40,7 @@
 #include "asylo/platform/posix/io/io_manager.h"
 #include "asylo/platform/posix/io/native_paths.h"
 #include "asylo/platform/posix/io/random_devices.h"
+#include "asylo/platform/posix/io/tmpfs_paths.h"
 #include "asylo/platform/posix/threading/thread_manager.h"
 #include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/primitive_status.h"
@@ -281,6 +282,20 @@ void InitializeIO(const EnclaveConfig &config) {
       RandomPathHandler::kURandomPath,
       ::absl::make_unique<RandomPathHandler>());
 
+  // Register the in-enclave tmpfs, if configured, so scratch files can be
+  // written without exiting the enclave.
+  if (config.has_tmpfs_config()) {
+    const TmpfsConfig &tmpfs_config = config.tmpfs_config();
+    if (tmpfs_config.mount_path().empty() ||
+        !io_manager.RegisterVirtualPathHandler(
+            tmpfs_config.mount_path(),
+            ::absl::make_unique<io::TmpfsPathHandler>(
+                tmpfs_config.mount_path(), tmpfs_config.max_resident_bytes(),
+                tmpfs_config.enable_spill()))) {
+      LOG(ERROR) << "Failed to mount tmpfs at " << tmpfs_config.mount_path();
+    }
+  }
+
   // Set the current working directory so that relative paths can be handled.
   io_manager.SetCurrentWorkingDirectory(config.current_working_directory());
 }
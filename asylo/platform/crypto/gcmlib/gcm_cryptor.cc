@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <utility>
 
 #include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
@@ -87,12 +88,26 @@ bool GenerateDerivedKey(const GcmCryptorKey &wrapping_key,
 
 }  // namespace
 
+GcmCryptor::AeadContext::~AeadContext() {
+  EVP_AEAD_CTX_cleanup(&context_);
+  OPENSSL_cleanse(&context_, sizeof(context_));
+}
+
+std::unique_ptr<GcmCryptor::AeadContext> GcmCryptor::AeadContext::Create(
+    const GcmCryptorKey &key) {
+  std::unique_ptr<AeadContext> context(new AeadContext);
+  if (!EVP_AEAD_CTX_init(&context->context_, EVP_aead_aes_256_gcm(),
+                         reinterpret_cast<const uint8_t *>(key.data()),
+                         kKeyLength, kTagLength, nullptr)) {
+    LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
+    return nullptr;
+  }
+  return context;
+}
+
 GcmCryptor::GcmCryptor(size_t block_length, const GcmCryptorKey &gcm_key,
                        const GcmCryptorKey &cmac_key)
-    : kBlockLength(block_length),
-      kGcmKey(gcm_key),
-      kCmacKey(cmac_key),
-      key_id_counter_(0) {}
+    : kBlockLength(block_length), kGcmKey(gcm_key), kCmacKey(cmac_key) {}
 
 std::unique_ptr<GcmCryptor> GcmCryptor::Create(
     size_t block_length, const GcmCryptorKey &master_key) {
@@ -150,52 +165,27 @@ bool GcmCryptor::EncryptBlock(const uint8_t *plaintext_data, uint8_t *token,
     return false;
   }
 
-  absl::MutexLock lock(&mu_);
+  std::shared_ptr<EncryptionKey> key = GetEncryptionKey();
+  if (!key) {
+    return false;
+  }
 
-  if (1 != RAND_bytes(next_token_.nonce, kNonceLength)) {
+  Token *tok = reinterpret_cast<Token *>(token);
+  if (1 != RAND_bytes(tok->nonce, kNonceLength)) {
     LOG(ERROR)
         << "Failed to generate random nonce for GcmCryptor::EncryptBlock: "
         << BsslLastErrorString();
     return false;
   }
-
-  if (key_id_counter_ % kKeyIdCycle == 0) {
-    key_id_counter_ = 0;
-
-    if (1 != RAND_bytes(next_token_.key_id, kKeyIdLength)) {
-      LOG(ERROR)
-          << "Failed to generate random token for GcmCryptor::EncryptBlock: "
-          << BsslLastErrorString();
-      return false;
-    }
-
-    if (!GenerateDerivedGcmKey(next_token_.key_id, &next_derived_key_)) {
-      LOG(ERROR) << "Failed to derive key for GcmCryptor::EncryptBlock: "
-                 << BsslLastErrorString();
-      return false;
-    }
-  }
-
-  // Increment the key reuse counter only if the key was successfully generated.
-  key_id_counter_++;
-
-  EVP_AEAD_CTX context;
-  if (!EVP_AEAD_CTX_init(
-          &context, EVP_aead_aes_256_gcm(),
-          reinterpret_cast<const uint8_t *>(next_derived_key_.data()),
-          kKeyLength, kTagLength, nullptr)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
-    return false;
-  }
+  memcpy(tok->key_id, key->key_id, kKeyIdLength);
 
   size_t ciphertext_length;
   size_t max_ciphertext_length = kBlockLength + kTagLength;
-  if (!EVP_AEAD_CTX_seal(&context, ciphertext_data, &ciphertext_length,
-                         max_ciphertext_length, next_token_.nonce, kNonceLength,
-                         plaintext_data, kBlockLength, nullptr, 0)) {
+  if (!EVP_AEAD_CTX_seal(key->context->get(), ciphertext_data,
+                         &ciphertext_length, max_ciphertext_length, tok->nonce,
+                         kNonceLength, plaintext_data, kBlockLength, nullptr,
+                         0)) {
     LOG(ERROR) << "EVP_AEAD_CTX_seal failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
     return false;
   }
 
@@ -203,13 +193,9 @@ bool GcmCryptor::EncryptBlock(const uint8_t *plaintext_data, uint8_t *token,
     LOG(ERROR) << "EVP_AEAD_CTX_seal failed to encrypt complete plaintext, "
                << "expected ciphertext_length = " << max_ciphertext_length
                << ", encountered ciphertext_length = " << ciphertext_length;
-    EVP_AEAD_CTX_cleanup(&context);
     return false;
   }
 
-  memcpy(token, next_token_.data(), kTokenLength);
-
-  EVP_AEAD_CTX_cleanup(&context);
   return true;
 }
 
@@ -223,29 +209,17 @@ bool GcmCryptor::DecryptBlock(const uint8_t *ciphertext_data,
 
   const Token *tok = reinterpret_cast<const Token *>(token);
 
-  GcmCryptorKey derived_key;
-  if (!GenerateDerivedGcmKey(tok->key_id, &derived_key)) {
-    LOG(ERROR) << "Failed to derive key for GcmCryptor::DecryptBlock: "
-               << BsslLastErrorString();
-    return false;
-  }
-
-  EVP_AEAD_CTX context;
-  if (!EVP_AEAD_CTX_init(&context, EVP_aead_aes_256_gcm(),
-                         reinterpret_cast<const uint8_t *>(derived_key.data()),
-                         kKeyLength, kTagLength, nullptr)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
+  std::shared_ptr<const AeadContext> context = GetContext(tok->key_id);
+  if (!context) {
     return false;
   }
 
   size_t plaintext_length;
-  if (!EVP_AEAD_CTX_open(&context, plaintext_data, &plaintext_length,
+  if (!EVP_AEAD_CTX_open(context->get(), plaintext_data, &plaintext_length,
                          kBlockLength, tok->nonce, kNonceLength,
                          ciphertext_data, kBlockLength + kTagLength, nullptr,
                          0)) {
     LOG(ERROR) << "EVP_AEAD_CTX_open failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
     return false;
   }
 
@@ -253,14 +227,106 @@ bool GcmCryptor::DecryptBlock(const uint8_t *ciphertext_data,
     LOG(ERROR) << "EVP_AEAD_CTX_open failed to decrypt complete ciphertext, "
                << "expected plaintext_length = " << kBlockLength
                << ", encountered plaintext_length = " << plaintext_length;
-    EVP_AEAD_CTX_cleanup(&context);
     return false;
   }
 
-  EVP_AEAD_CTX_cleanup(&context);
   return true;
 }
 
+size_t GcmCryptor::CachedContextCount() {
+  absl::MutexLock lock(&cache_mu_);
+  return contexts_.size();
+}
+
+std::shared_ptr<GcmCryptor::EncryptionKey> GcmCryptor::GetEncryptionKey() {
+  std::shared_ptr<EncryptionKey> key;
+  while (true) {
+    {
+      absl::ReaderMutexLock lock(&mu_);
+      key = encryption_key_;
+    }
+
+    // Each use of the key is accounted for exactly once, so that no key is
+    // used for more than kKeyIdCycle blocks.
+    if (key && key->uses.fetch_add(1) < kKeyIdCycle) {
+      return key;
+    }
+
+    absl::MutexLock lock(&mu_);
+    // Another thread may have rotated the key in the meantime.
+    if (encryption_key_ != key) {
+      continue;
+    }
+
+    auto new_key = std::make_shared<EncryptionKey>();
+    if (1 != RAND_bytes(new_key->key_id, kKeyIdLength)) {
+      LOG(ERROR)
+          << "Failed to generate random token for GcmCryptor::EncryptBlock: "
+          << BsslLastErrorString();
+      return nullptr;
+    }
+
+    new_key->context = GetContext(new_key->key_id);
+    if (!new_key->context) {
+      LOG(ERROR) << "Failed to derive key for GcmCryptor::EncryptBlock: "
+                 << BsslLastErrorString();
+      return nullptr;
+    }
+
+    new_key->uses = 1;
+    encryption_key_ = new_key;
+    return new_key;
+  }
+}
+
+std::shared_ptr<const GcmCryptor::AeadContext> GcmCryptor::GetContext(
+    const uint8_t *key_id) {
+  std::string id(reinterpret_cast<const char *>(key_id), kKeyIdLength);
+  {
+    absl::MutexLock lock(&cache_mu_);
+    auto it = contexts_.find(id);
+    if (it != contexts_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+      return it->second.context;
+    }
+  }
+
+  // Derive the key outside of the lock - derivation is the costly part.
+  GcmCryptorKey derived_key;
+  if (!GenerateDerivedGcmKey(key_id, &derived_key)) {
+    LOG(ERROR) << "Failed to derive key for GcmCryptor: "
+               << BsslLastErrorString();
+    return nullptr;
+  }
+
+  std::shared_ptr<const AeadContext> context =
+      AeadContext::Create(derived_key);
+  if (!context) {
+    return nullptr;
+  }
+
+  return CacheContext(id, std::move(context));
+}
+
+std::shared_ptr<const GcmCryptor::AeadContext> GcmCryptor::CacheContext(
+    const std::string &key_id, std::shared_ptr<const AeadContext> context) {
+  absl::MutexLock lock(&cache_mu_);
+  auto it = contexts_.find(key_id);
+  if (it != contexts_.end()) {
+    return it->second.context;
+  }
+
+  // Contexts in use by other threads stay alive until they are done.
+  if (contexts_.size() >= kMaxCachedContexts) {
+    contexts_.erase(lru_.back());
+    lru_.pop_back();
+  }
+
+  lru_.push_front(key_id);
+  contexts_.emplace(key_id, CacheEntry{context, lru_.begin()});
+  return context;
+}
+
 bool GcmCryptor::GenerateDerivedGcmKey(const uint8_t *key_id,
                                        GcmCryptorKey *dk) {
   return GenerateDerivedKey(kGcmKey, key_id, dk);
@@ -287,13 +353,14 @@ GcmCryptor *GcmCryptorRegistry::GetGcmCryptor(size_t block_length,
                                               const GcmCryptorKey &key) {
   absl::MutexLock lock(&mu_);
 
-  auto it = cryptor_registry_.find(key);
+  CryptorId id{block_length, key};
+  auto it = cryptor_registry_.find(id);
   if (it != cryptor_registry_.end()) {
     return it->second.get();
   }
 
-  auto result =
-      cryptor_registry_.emplace(key, GcmCryptor::Create(block_length, key));
+  auto result = cryptor_registry_.emplace(
+      std::move(id), GcmCryptor::Create(block_length, key));
   return result.first->second.get();
 }
 
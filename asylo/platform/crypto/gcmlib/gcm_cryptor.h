@@ -21,6 +21,8 @@
 
 #include <openssl/evp.h>
 
+#include <atomic>
+#include <list>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -48,7 +50,16 @@ constexpr size_t kKeyIdLength = 32;
 
 using GcmCryptorKey = SafeBytes<kKeyLength>;
 
+// Maximum number of AES-GCM contexts a cryptor keeps initialized for reuse.
+constexpr size_t kMaxCachedContexts = 256;
+
 // GcmCryptor implements AES-GCM encryption and decryption.
+//
+// Every block is encrypted with a key derived from the master key and a key id
+// carried in the token of the block. The cryptor keeps a bounded cache of
+// AES-GCM contexts initialized with derived keys, keyed by key id, so that key
+// derivation and context initialization are not repeated for every block. The
+// cryptor is safe to use from multiple threads.
 class GcmCryptor {
  public:
   // Initializes the cryptor with the specified 32 byte key.
@@ -72,6 +83,9 @@ class GcmCryptor {
   // true on success, false on failure.
   bool GetAuthTag(uint8_t out[16], const uint8_t *in, size_t in_len) const;
 
+  // Returns the number of AES-GCM contexts currently cached.
+  size_t CachedContextCount() ABSL_LOCKS_EXCLUDED(cache_mu_);
+
  private:
   static constexpr size_t kNonceLength = 12;
   static constexpr size_t kKeyIdCycle = 256;
@@ -84,18 +98,77 @@ class GcmCryptor {
     uint8_t *data() { return nonce; }
   };
 
+  // An AES-GCM context initialized with a derived key. The context is not
+  // modified by sealing and opening, hence may be used by several threads at
+  // once.
+  class AeadContext {
+   public:
+    // Returns a context initialized with |key|, or nullptr on failure.
+    static std::unique_ptr<AeadContext> Create(const GcmCryptorKey &key);
+    ~AeadContext();
+
+    const EVP_AEAD_CTX *get() const { return &context_; }
+
+   private:
+    AeadContext() = default;
+    AeadContext(const AeadContext &) = delete;
+    AeadContext &operator=(const AeadContext &) = delete;
+
+    EVP_AEAD_CTX context_;
+  };
+
+  // Key used to encrypt blocks until it has encrypted kKeyIdCycle blocks.
+  struct EncryptionKey {
+    uint8_t key_id[kKeyIdLength];
+    std::shared_ptr<const AeadContext> context;
+
+    // Number of blocks the key has been handed out for.
+    std::atomic<size_t> uses{0};
+  };
+
+  // A cached context and its position in the LRU order.
+  struct CacheEntry {
+    std::shared_ptr<const AeadContext> context;
+    std::list<std::string>::iterator lru_position;
+  };
+
   GcmCryptor(size_t block_length, const GcmCryptorKey &gcm_key,
              const GcmCryptorKey &cmac_key);
   bool GenerateDerivedGcmKey(const uint8_t *key_id, GcmCryptorKey *dk);
 
+  // Returns the key to encrypt the next block with, rotating to a new key id
+  // once the current key has been used for kKeyIdCycle blocks. Returns nullptr
+  // on failure.
+  std::shared_ptr<EncryptionKey> GetEncryptionKey() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns a context initialized with the key derived for |key_id|, from the
+  // cache if present. Returns nullptr on failure.
+  std::shared_ptr<const AeadContext> GetContext(const uint8_t *key_id)
+      ABSL_LOCKS_EXCLUDED(cache_mu_);
+
+  // Adds |context| for |key_id| to the cache, evicting the least recently used
+  // context if the cache is full. Returns the cached context for |key_id|,
+  // which is |context| unless another thread has cached one first.
+  std::shared_ptr<const AeadContext> CacheContext(
+      const std::string &key_id, std::shared_ptr<const AeadContext> context)
+      ABSL_LOCKS_EXCLUDED(cache_mu_);
+
   const size_t kBlockLength;
   const GcmCryptorKey kGcmKey;
   const GcmCryptorKey kCmacKey;
-  Token next_token_ ABSL_GUARDED_BY(mu_);
-  uint64_t key_id_counter_;
-  GcmCryptorKey next_derived_key_ ABSL_GUARDED_BY(mu_);
+
+  // The current encryption key. Encryption takes |mu_| shared to fetch the key,
+  // and exclusively only to rotate it.
+  std::shared_ptr<EncryptionKey> encryption_key_ ABSL_GUARDED_BY(mu_);
   absl::Mutex mu_;
 
+  // Cache of contexts keyed by key id, and the key ids from the most to the
+  // least recently used.
+  std::unordered_map<std::string, CacheEntry> contexts_
+      ABSL_GUARDED_BY(cache_mu_);
+  std::list<std::string> lru_ ABSL_GUARDED_BY(cache_mu_);
+  absl::Mutex cache_mu_;
+
   GcmCryptor(const GcmCryptor &) = delete;
   GcmCryptor &operator=(const GcmCryptor &) = delete;
 };
@@ -109,7 +182,8 @@ class GcmCryptorRegistry {
     return *instance;
   }
 
-  // Accessor to the instance of GCM cryptor associated with a given key.
+  // Accessor to the instance of GCM cryptor associated with a given block
+  // length and key.
   GcmCryptor *GetGcmCryptor(size_t block_length, const GcmCryptorKey &key)
       ABSL_LOCKS_EXCLUDED(mu_);
 
@@ -132,6 +206,24 @@ class GcmCryptorRegistry {
   };
 
  private:
+  // Identifies a cryptor - cryptors operate on blocks of a fixed length, so a
+  // key used with several block lengths maps to several cryptors.
+  struct CryptorId {
+    size_t block_length;
+    GcmCryptorKey key;
+
+    bool operator==(const CryptorId &other) const {
+      return block_length == other.block_length && key == other.key;
+    }
+  };
+
+  class CryptorIdHasher {
+   public:
+    size_t operator()(const CryptorId &id) const {
+      return SafeBytesHasher()(id.key) ^ std::hash<size_t>()(id.block_length);
+    }
+  };
+
   GcmCryptorRegistry() = default;
   GcmCryptorRegistry(GcmCryptorRegistry const &) = delete;
   void operator=(GcmCryptorRegistry const &) = delete;
@@ -140,8 +232,7 @@ class GcmCryptorRegistry {
   // primitives interface where system calls might not be available, so we use
   // std::unordered_map instead of absl::flat_hash_map to prevent unsafe system
   // calls made by absl based containers.
-  std::unordered_map<GcmCryptorKey, std::unique_ptr<GcmCryptor>,
-                     SafeBytesHasher>
+  std::unordered_map<CryptorId, std::unique_ptr<GcmCryptor>, CryptorIdHasher>
       cryptor_registry_ ABSL_GUARDED_BY(mu_);
   absl::Mutex mu_;
 };
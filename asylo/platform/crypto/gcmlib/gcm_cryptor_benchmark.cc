@@ -0,0 +1,133 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of the per-block cost of GcmCryptor. Decryption is measured both
+// with contexts served from the cache and with every block missing the cache,
+// which is the cost of deriving a key and initializing a context per block. Run
+// with --benchmarks=all.
+
+#include <openssl/rand.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace {
+
+using platform::crypto::gcmlib::GcmCryptor;
+using platform::crypto::gcmlib::GcmCryptorKey;
+using platform::crypto::gcmlib::kMaxCachedContexts;
+using platform::crypto::gcmlib::kTagLength;
+using platform::crypto::gcmlib::kTokenLength;
+
+// Number of blocks encrypted with a single key id.
+constexpr size_t kKeyIdCycle = 256;
+
+// Length of blocks of the cryptor shared by benchmark threads.
+constexpr size_t kSharedBlockLength = 128;
+
+std::unique_ptr<GcmCryptor> CreateCryptor(size_t block_length) {
+  GcmCryptorKey key;
+  CHECK_EQ(RAND_bytes(key.data(), key.size()), 1);
+  return GcmCryptor::Create(block_length, key);
+}
+
+// Encrypted blocks along with their tokens.
+struct EncryptedBlocks {
+  std::vector<std::vector<uint8_t>> ciphertexts;
+  std::vector<std::vector<uint8_t>> tokens;
+};
+
+// Encrypts |key_ids| * kKeyIdCycle blocks with |cryptor|, keeping the first
+// block encrypted with each key id.
+EncryptedBlocks EncryptWithKeyIds(GcmCryptor *cryptor, size_t block_length,
+                                  size_t key_ids) {
+  EncryptedBlocks blocks;
+  std::vector<uint8_t> plaintext(block_length, 'a');
+  std::vector<uint8_t> ciphertext(block_length + kTagLength);
+  std::vector<uint8_t> token(kTokenLength);
+  for (size_t i = 0; i < key_ids * kKeyIdCycle; ++i) {
+    CHECK(cryptor->EncryptBlock(plaintext.data(), token.data(),
+                                ciphertext.data()));
+    if (i % kKeyIdCycle == 0) {
+      blocks.ciphertexts.push_back(ciphertext);
+      blocks.tokens.push_back(token);
+    }
+  }
+  return blocks;
+}
+
+void BlockLengthArguments(benchmark::internal::Benchmark *benchmark) {
+  benchmark->Arg(128)->Arg(4096);
+}
+
+// Encrypts blocks with a cryptor shared by all benchmark threads.
+void BM_EncryptBlock(benchmark::State &state) {
+  static GcmCryptor *cryptor = CreateCryptor(kSharedBlockLength).release();
+  std::vector<uint8_t> plaintext(kSharedBlockLength, 'a');
+  std::vector<uint8_t> ciphertext(kSharedBlockLength + kTagLength);
+  std::vector<uint8_t> token(kTokenLength);
+  for (auto _ : state) {
+    CHECK(cryptor->EncryptBlock(plaintext.data(), token.data(),
+                                ciphertext.data()));
+  }
+  state.SetBytesProcessed(state.iterations() * plaintext.size());
+}
+BENCHMARK(BM_EncryptBlock)->ThreadRange(1, 8)->UseRealTime();
+
+// Decrypts blocks of a few key ids, all of which stay cached.
+void BM_DecryptBlockCached(benchmark::State &state) {
+  auto cryptor = CreateCryptor(state.range(0));
+  EncryptedBlocks blocks = EncryptWithKeyIds(cryptor.get(), state.range(0), 4);
+  std::vector<uint8_t> plaintext(state.range(0) + kTagLength);
+  size_t block = 0;
+  for (auto _ : state) {
+    CHECK(cryptor->DecryptBlock(blocks.ciphertexts[block].data(),
+                                blocks.tokens[block].data(),
+                                plaintext.data()));
+    block = (block + 1) % blocks.ciphertexts.size();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DecryptBlockCached)->Apply(BlockLengthArguments);
+
+// Decrypts blocks of more key ids than are cached, in round robin, so that
+// every block misses the cache.
+void BM_DecryptBlockUncached(benchmark::State &state) {
+  auto cryptor = CreateCryptor(state.range(0));
+  EncryptedBlocks blocks = EncryptWithKeyIds(cryptor.get(), state.range(0),
+                                             kMaxCachedContexts + 1);
+  std::vector<uint8_t> plaintext(state.range(0) + kTagLength);
+  size_t block = 0;
+  for (auto _ : state) {
+    CHECK(cryptor->DecryptBlock(blocks.ciphertexts[block].data(),
+                                blocks.tokens[block].data(),
+                                plaintext.data()));
+    block = (block + 1) % blocks.ciphertexts.size();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DecryptBlockUncached)->Apply(BlockLengthArguments);
+
+}  // namespace
+}  // namespace asylo
@@ -20,8 +20,14 @@
 
 #include <openssl/rand.h>
 
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include "absl/synchronization/mutex.h"
 #include "asylo/crypto/util/bytes.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
@@ -33,6 +39,7 @@ using platform::crypto::gcmlib::GcmCryptor;
 using platform::crypto::gcmlib::GcmCryptorKey;
 using platform::crypto::gcmlib::GcmCryptorRegistry;
 using platform::crypto::gcmlib::kKeyLength;
+using platform::crypto::gcmlib::kMaxCachedContexts;
 using platform::crypto::gcmlib::kTagLength;
 using platform::crypto::gcmlib::kTokenLength;
 
@@ -195,6 +202,82 @@ TEST(GcmCryptorTest, DecryptWithAlteredCiphertextFails) {
       decryptor->DecryptBlock(encryptor_buffer, token, decryptor_buffer));
 }
 
+// Tests decryption of blocks encrypted with more key ids than the cryptor keeps
+// contexts for.
+TEST(GcmCryptorTest, DecryptBeyondContextCacheCapacity) {
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  auto encryptor = GcmCryptor::Create(kBlockLength, key);
+  auto decryptor = GcmCryptor::Create(kBlockLength, key);
+
+  // Keep the first block encrypted with each key id.
+  constexpr size_t kKeyIds = kMaxCachedContexts + 2;
+  std::vector<uint8_t> plaintext(kBlockLength, 'a');
+  std::vector<std::vector<uint8_t>> ciphertexts;
+  std::vector<std::vector<uint8_t>> tokens;
+  std::vector<uint8_t> ciphertext(kBlockLength + kTagLength);
+  std::vector<uint8_t> token(kTokenLength);
+  for (size_t i = 0; i < kKeyIds * kKeyIdCycle; ++i) {
+    ASSERT_TRUE(encryptor->EncryptBlock(plaintext.data(), token.data(),
+                                        ciphertext.data()));
+    if (i % kKeyIdCycle == 0) {
+      ciphertexts.push_back(ciphertext);
+      tokens.push_back(token);
+    }
+  }
+  EXPECT_LE(encryptor->CachedContextCount(), kMaxCachedContexts);
+
+  // Decrypt twice, the second time after the first contexts were evicted.
+  std::vector<uint8_t> decrypted(kBlockLength + kTagLength);
+  for (int round = 0; round < 2; ++round) {
+    for (size_t i = 0; i < kKeyIds; ++i) {
+      ASSERT_TRUE(decryptor->DecryptBlock(ciphertexts[i].data(),
+                                          tokens[i].data(), decrypted.data()));
+      EXPECT_EQ(memcmp(plaintext.data(), decrypted.data(), kBlockLength), 0);
+    }
+    EXPECT_EQ(decryptor->CachedContextCount(), kMaxCachedContexts);
+  }
+}
+
+// Tests encryption and decryption from several threads with a shared cryptor,
+// and that no key id is used for more than kKeyIdCycle blocks.
+TEST(GcmCryptorTest, ConcurrentEncryptDecrypt) {
+  constexpr int kThreads = 4;
+  constexpr int kNumMessages = 1000;
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  auto cryptor = GcmCryptor::Create(kBlockLength, key);
+
+  absl::Mutex mu;
+  std::map<std::string, int> key_id_uses;
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < kThreads; ++thread) {
+    threads.emplace_back([&cryptor, &mu, &key_id_uses]() {
+      uint8_t plaintext[kBlockLength];
+      uint8_t ciphertext[kBlockLength + kTagLength];
+      uint8_t decrypted[kBlockLength + kTagLength];
+      uint8_t token[kTokenLength];
+      for (int i = 0; i < kNumMessages; ++i) {
+        ASSERT_EQ(RAND_bytes(plaintext, kBlockLength), 1);
+        ASSERT_TRUE(cryptor->EncryptBlock(plaintext, token, ciphertext));
+        ASSERT_TRUE(cryptor->DecryptBlock(ciphertext, token, decrypted));
+        EXPECT_EQ(memcmp(plaintext, decrypted, kBlockLength), 0);
+
+        absl::MutexLock lock(&mu);
+        key_id_uses[std::string(
+            reinterpret_cast<char *>(token + kNonceLength), kKeyIdLength)]++;
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (const auto &entry : key_id_uses) {
+    EXPECT_LE(entry.second, kKeyIdCycle);
+  }
+}
+
 // Tests GCM cryptor registry returns consistent instance of GCM cryptor.
 TEST(GcmCryptorTest, GetGcmCryptorIsConsistent) {
   GcmCryptorKey key;
@@ -144,6 +144,11 @@ class IOManager {
       return -1;
     }
 
+    virtual ssize_t PWrite(const void *buf, size_t count, off_t offset) {
+      errno = ENOSYS;
+      return -1;
+    }
+
     virtual int SetSockOpt(int level, int option_name, const void *option_value,
                            socklen_t option_len) {
       errno = ENOSYS;
@@ -601,6 +606,9 @@ class IOManager {
   // Implements pread(2).
   virtual ssize_t PRead(int fd, void *buf, size_t count, off_t offset);
 
+  // Implements pwrite(2).
+  virtual ssize_t PWrite(int fd, const void *buf, size_t count, off_t offset);
+
   // Implements umask(2).
   virtual mode_t Umask(mode_t mask);
 
@@ -132,6 +132,10 @@ ssize_t IOContextNative::PRead(void *buf, size_t count, off_t offset) {
   return enc_untrusted_pread64(host_fd_, buf, count, offset);
 }
 
+ssize_t IOContextNative::PWrite(const void *buf, size_t count, off_t offset) {
+  return enc_untrusted_pwrite64(host_fd_, buf, count, offset);
+}
+
 int IOContextNative::SetSockOpt(int level, int option_name,
                                 const void *option_value,
                                 socklen_t option_len) {
@@ -21,6 +21,7 @@
 #include <cerrno>
 #include <cstdint>
 
+#include "absl/time/time.h"
 #include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
 #include "asylo/platform/posix/io/io_manager.h"
@@ -46,11 +47,21 @@ ssize_t IOContextSecure::Write(const void *buf, size_t count) {
   return platform::storage::secure_write(host_fd_, buf, count);
 }
 
+ssize_t IOContextSecure::PRead(void *buf, size_t count, off_t offset) {
+  return platform::storage::secure_pread(host_fd_, buf, count, offset);
+}
+
+ssize_t IOContextSecure::PWrite(const void *buf, size_t count, off_t offset) {
+  return platform::storage::secure_pwrite(host_fd_, buf, count, offset);
+}
+
 int IOContextSecure::LSeek(off_t offset, int whence) {
   return platform::storage::secure_lseek(host_fd_, offset, whence);
 }
 
-int IOContextSecure::FSync() { return enc_untrusted_fsync(host_fd_); }
+int IOContextSecure::FSync() {
+  return platform::storage::secure_fsync(host_fd_);
+}
 
 int IOContextSecure::FStat(struct stat *st) {
   return platform::storage::secure_fstat(host_fd_, st);
@@ -65,6 +76,31 @@ int IOContextSecure::Ioctl(int request, void *argp) {
       return AeadHandler::GetInstance().SetMasterKey(
           host_fd_, ioctl_param->data, ioctl_param->length);
     }
+    case ENCLAVE_STORAGE_SET_BLOCK_LENGTH: {
+      if (argp == nullptr) {
+        errno = EINVAL;
+        return -1;
+      }
+      return AeadHandler::GetInstance().SetBlockLength(
+          host_fd_, *reinterpret_cast<uint32_t *>(argp));
+    }
+    case ENCLAVE_STORAGE_SET_WRITE_BACK: {
+      if (argp == nullptr) {
+        errno = EINVAL;
+        return -1;
+      }
+      return AeadHandler::GetInstance().SetWriteBack(
+          host_fd_, absl::Milliseconds(*reinterpret_cast<uint32_t *>(argp)));
+    }
+    case ENCLAVE_STORAGE_SET_MAX_WORKERS: {
+      if (argp == nullptr) {
+        errno = EINVAL;
+        return -1;
+      }
+      AeadHandler::GetInstance().SetMaxWorkers(
+          *reinterpret_cast<uint32_t *>(argp));
+      return 0;
+    }
     default:
       if (argp != nullptr) {
         errno = ENOSYS;
@@ -40,6 +40,8 @@ class IOContextSecure : public IOManager::IOContext {
  protected:
   ssize_t Read(void *buf, size_t count) override;
   ssize_t Write(const void *buf, size_t count) override;
+  ssize_t PRead(void *buf, size_t count, off_t offset) override;
+  ssize_t PWrite(const void *buf, size_t count, off_t offset) override;
   int Close() override;
   int LSeek(off_t offset, int whence) override;
   int FSync() override;
@@ -0,0 +1,812 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/posix/io/tmpfs_paths.h"
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "asylo/platform/primitives/trusted_primitives.h"
+
+namespace asylo {
+namespace io {
+namespace {
+
+using primitives::TrustedPrimitives;
+
+// Size of the ephemeral AES-GCM key used to seal spilled pages.
+constexpr size_t kSpillKeySize = 32;
+
+// Size of the nonce prepended to every sealed page.
+constexpr size_t kSpillNonceSize = 12;
+
+// Associated data bound to a sealed page.
+struct SpilledPageAad {
+  uint64_t inode_id;
+  uint64_t index;
+  uint64_t generation;
+};
+
+// Returns the parent directory of the canonical path |path|.
+std::string ParentOf(const std::string &path) {
+  size_t pos = path.rfind('/');
+  if (pos == std::string::npos || pos == 0) {
+    return "";
+  }
+  return path.substr(0, pos);
+}
+
+// Returns true if |path| lies strictly under directory |dir|.
+bool IsUnder(const std::string &path, const std::string &dir) {
+  return path.size() > dir.size() + 1 && absl::StartsWith(path, dir) &&
+         path[dir.size()] == '/';
+}
+
+void FillDirectoryStat(struct stat *stat_buffer) {
+  memset(stat_buffer, 0, sizeof(*stat_buffer));
+  stat_buffer->st_mode = S_IFDIR | S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH |
+                         S_IXOTH;
+  stat_buffer->st_nlink = 2;
+  stat_buffer->st_blksize = TmpfsFileSystem::kPageSize;
+}
+
+}  // namespace
+
+constexpr size_t TmpfsFileSystem::kPageSize;
+constexpr size_t TmpfsPathHandler::kDefaultMaxResidentBytes;
+
+TmpfsFileSystem::TmpfsFileSystem(std::string mount_path,
+                                 size_t max_resident_bytes, bool enable_spill)
+    : mount_path_(std::move(mount_path)),
+      max_resident_pages_(std::max<size_t>(1, max_resident_bytes / kPageSize)),
+      enable_spill_(enable_spill) {}
+
+TmpfsFileSystem::~TmpfsFileSystem() {
+  // Drop the file table outside of the lock, since releasing the last
+  // reference to an inode acquires |mu_|.
+  std::map<std::string, std::shared_ptr<Inode>> files;
+  {
+    absl::MutexLock lock(&mu_);
+    files.swap(files_);
+  }
+}
+
+std::shared_ptr<TmpfsFileSystem::Inode> TmpfsFileSystem::Open(
+    const std::string &path, int flags, mode_t mode) {
+  absl::MutexLock lock(&mu_);
+  if (path == mount_path_ || directories_.count(path) > 0) {
+    errno = EISDIR;
+    return nullptr;
+  }
+
+  auto it = files_.find(path);
+  if (it != files_.end()) {
+    if ((flags & O_CREAT) && (flags & O_EXCL)) {
+      errno = EEXIST;
+      return nullptr;
+    }
+    if ((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY &&
+        !ResizeInode(it->second.get(), 0)) {
+      return nullptr;
+    }
+    return it->second;
+  }
+
+  if (!(flags & O_CREAT)) {
+    errno = ENOENT;
+    return nullptr;
+  }
+  if (!ParentExists(path)) {
+    errno = ENOENT;
+    return nullptr;
+  }
+
+  auto inode = std::shared_ptr<Inode>(
+      new Inode, [this](Inode *inode) { ReleaseInode(inode); });
+  inode->id = next_inode_id_++;
+  inode->mode = mode & 07777;
+  files_.emplace(path, inode);
+  return inode;
+}
+
+ssize_t TmpfsFileSystem::Read(Inode *inode, void *buf, size_t count,
+                              off_t offset) {
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  absl::MutexLock lock(&mu_);
+  if (offset >= inode->size) {
+    return 0;
+  }
+  count = std::min<size_t>(count, inode->size - offset);
+
+  uint8_t *dest = static_cast<uint8_t *>(buf);
+  size_t done = 0;
+  while (done < count) {
+    size_t index = (offset + done) / kPageSize;
+    size_t page_offset = (offset + done) % kPageSize;
+    size_t chunk = std::min(count - done, kPageSize - page_offset);
+
+    if (index >= inode->pages.size() || !inode->pages[index]) {
+      // Holes read as zeros.
+      memset(dest + done, 0, chunk);
+    } else {
+      Page *page = GetResidentPage(inode, index, /*allocate=*/false);
+      if (!page) {
+        return done > 0 ? done : -1;
+      }
+      memcpy(dest + done, page->plaintext.data() + page_offset, chunk);
+    }
+    done += chunk;
+  }
+  return done;
+}
+
+ssize_t TmpfsFileSystem::Write(Inode *inode, const void *buf, size_t count,
+                               off_t offset) {
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  absl::MutexLock lock(&mu_);
+  const uint8_t *src = static_cast<const uint8_t *>(buf);
+  size_t done = 0;
+  while (done < count) {
+    size_t index = (offset + done) / kPageSize;
+    size_t page_offset = (offset + done) % kPageSize;
+    size_t chunk = std::min(count - done, kPageSize - page_offset);
+
+    Page *page = GetResidentPage(inode, index, /*allocate=*/true);
+    if (!page) {
+      break;
+    }
+    memcpy(page->plaintext.data() + page_offset, src + done, chunk);
+    done += chunk;
+  }
+
+  inode->size = std::max<off_t>(inode->size, offset + done);
+  return (done > 0 || count == 0) ? done : -1;
+}
+
+int TmpfsFileSystem::Truncate(Inode *inode, off_t length) {
+  if (length < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  absl::MutexLock lock(&mu_);
+  return ResizeInode(inode, length) ? 0 : -1;
+}
+
+off_t TmpfsFileSystem::Size(Inode *inode) {
+  absl::MutexLock lock(&mu_);
+  return inode->size;
+}
+
+int TmpfsFileSystem::Stat(const std::string &path, struct stat *stat_buffer) {
+  std::shared_ptr<Inode> inode;
+  {
+    absl::MutexLock lock(&mu_);
+    if (path == mount_path_ || directories_.count(path) > 0) {
+      FillDirectoryStat(stat_buffer);
+      return 0;
+    }
+    auto it = files_.find(path);
+    if (it == files_.end()) {
+      errno = ENOENT;
+      return -1;
+    }
+    inode = it->second;
+  }
+  FillStat(*inode, stat_buffer);
+  return 0;
+}
+
+int TmpfsFileSystem::Truncate(const std::string &path, off_t length) {
+  if (length < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  absl::MutexLock lock(&mu_);
+  if (path == mount_path_ || directories_.count(path) > 0) {
+    errno = EISDIR;
+    return -1;
+  }
+  auto it = files_.find(path);
+  if (it == files_.end()) {
+    errno = ENOENT;
+    return -1;
+  }
+  return ResizeInode(it->second.get(), length) ? 0 : -1;
+}
+
+int TmpfsFileSystem::Unlink(const std::string &path) {
+  // Keep the inode alive until |mu_| is released so that its pages are
+  // released outside of the lock.
+  std::shared_ptr<Inode> unlinked;
+  absl::MutexLock lock(&mu_);
+  if (path == mount_path_ || directories_.count(path) > 0) {
+    errno = EISDIR;
+    return -1;
+  }
+  auto it = files_.find(path);
+  if (it == files_.end()) {
+    errno = ENOENT;
+    return -1;
+  }
+  unlinked = std::move(it->second);
+  files_.erase(it);
+  return 0;
+}
+
+int TmpfsFileSystem::Rename(const std::string &oldpath,
+                            const std::string &newpath) {
+  std::shared_ptr<Inode> replaced;
+  absl::MutexLock lock(&mu_);
+  if (oldpath == newpath) {
+    return 0;
+  }
+  if (oldpath == mount_path_ || newpath == mount_path_) {
+    errno = EBUSY;
+    return -1;
+  }
+  if (!ParentExists(newpath)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  auto file = files_.find(oldpath);
+  if (file != files_.end()) {
+    if (directories_.count(newpath) > 0) {
+      errno = EISDIR;
+      return -1;
+    }
+    std::shared_ptr<Inode> inode = std::move(file->second);
+    files_.erase(file);
+    std::shared_ptr<Inode> &target = files_[newpath];
+    replaced = std::move(target);
+    target = std::move(inode);
+    return 0;
+  }
+
+  if (directories_.count(oldpath) == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+  if (IsUnder(newpath, oldpath)) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (files_.count(newpath) > 0) {
+    errno = ENOTDIR;
+    return -1;
+  }
+  if (directories_.count(newpath) > 0) {
+    std::string children = absl::StrCat(newpath, "/");
+    auto child_file = files_.lower_bound(children);
+    auto child_dir = directories_.lower_bound(children);
+    if ((child_file != files_.end() && IsUnder(child_file->first, newpath)) ||
+        (child_dir != directories_.end() &&
+         IsUnder(*child_dir, newpath))) {
+      errno = ENOTEMPTY;
+      return -1;
+    }
+    directories_.erase(newpath);
+  }
+
+  // Move the directory and everything under it.
+  std::string children = absl::StrCat(oldpath, "/");
+  for (auto it = files_.lower_bound(children);
+       it != files_.end() && IsUnder(it->first, oldpath);) {
+    std::string moved = absl::StrCat(newpath, it->first.substr(oldpath.size()));
+    std::shared_ptr<Inode> inode = std::move(it->second);
+    it = files_.erase(it);
+    files_.emplace(std::move(moved), std::move(inode));
+  }
+  std::vector<std::string> moved_directories;
+  for (auto it = directories_.lower_bound(children);
+       it != directories_.end() && IsUnder(*it, oldpath);) {
+    moved_directories.push_back(
+        absl::StrCat(newpath, it->substr(oldpath.size())));
+    it = directories_.erase(it);
+  }
+  directories_.erase(oldpath);
+  directories_.insert(newpath);
+  directories_.insert(moved_directories.begin(), moved_directories.end());
+  return 0;
+}
+
+int TmpfsFileSystem::Mkdir(const std::string &path, mode_t mode) {
+  absl::MutexLock lock(&mu_);
+  if (path == mount_path_ || directories_.count(path) > 0 ||
+      files_.count(path) > 0) {
+    errno = EEXIST;
+    return -1;
+  }
+  if (!ParentExists(path)) {
+    errno = ENOENT;
+    return -1;
+  }
+  directories_.insert(path);
+  return 0;
+}
+
+int TmpfsFileSystem::RmDir(const std::string &path) {
+  absl::MutexLock lock(&mu_);
+  if (path == mount_path_) {
+    errno = EBUSY;
+    return -1;
+  }
+  if (files_.count(path) > 0) {
+    errno = ENOTDIR;
+    return -1;
+  }
+  if (directories_.count(path) == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+  std::string children = absl::StrCat(path, "/");
+  auto child_file = files_.lower_bound(children);
+  auto child_dir = directories_.lower_bound(children);
+  if ((child_file != files_.end() && IsUnder(child_file->first, path)) ||
+      (child_dir != directories_.end() && IsUnder(*child_dir, path))) {
+    errno = ENOTEMPTY;
+    return -1;
+  }
+  directories_.erase(path);
+  return 0;
+}
+
+int TmpfsFileSystem::Access(const std::string &path, int mode) {
+  absl::MutexLock lock(&mu_);
+  if (path == mount_path_ || directories_.count(path) > 0 ||
+      files_.count(path) > 0) {
+    return 0;
+  }
+  errno = ENOENT;
+  return -1;
+}
+
+void TmpfsFileSystem::FillStat(const Inode &inode, struct stat *stat_buffer) {
+  absl::MutexLock lock(&mu_);
+  size_t allocated_pages = 0;
+  for (const auto &page : inode.pages) {
+    if (page) {
+      ++allocated_pages;
+    }
+  }
+
+  memset(stat_buffer, 0, sizeof(*stat_buffer));
+  stat_buffer->st_ino = inode.id;
+  stat_buffer->st_mode = S_IFREG | inode.mode;
+  stat_buffer->st_nlink = 1;
+  stat_buffer->st_size = inode.size;
+  stat_buffer->st_blksize = kPageSize;
+  // st_blocks is expressed in 512-byte units.
+  stat_buffer->st_blocks = allocated_pages * (kPageSize / 512);
+}
+
+size_t TmpfsFileSystem::ResidentPages() {
+  absl::MutexLock lock(&mu_);
+  return lru_.size();
+}
+
+size_t TmpfsFileSystem::SpilledPages() {
+  absl::MutexLock lock(&mu_);
+  return spilled_pages_;
+}
+
+bool TmpfsFileSystem::ParentExists(const std::string &path) {
+  std::string parent = ParentOf(path);
+  return parent == mount_path_ || directories_.count(parent) > 0;
+}
+
+TmpfsFileSystem::Page *TmpfsFileSystem::GetResidentPage(Inode *inode,
+                                                        size_t index,
+                                                        bool allocate) {
+  if (index >= inode->pages.size()) {
+    if (!allocate) {
+      errno = EINVAL;
+      return nullptr;
+    }
+    inode->pages.resize(index + 1);
+  }
+
+  std::unique_ptr<Page> &page = inode->pages[index];
+  if (!page) {
+    if (!allocate) {
+      errno = EINVAL;
+      return nullptr;
+    }
+    if (!ReserveResidentPage()) {
+      return nullptr;
+    }
+    page = absl::make_unique<Page>();
+    page->inode_id = inode->id;
+    page->index = index;
+    page->plaintext.resize(kPageSize, 0);
+    lru_.push_front(page.get());
+    page->lru_position = lru_.begin();
+    return page.get();
+  }
+
+  if (page->plaintext.empty()) {
+    if (!ReserveResidentPage() || !RestorePage(page.get())) {
+      return nullptr;
+    }
+    return page.get();
+  }
+
+  TouchPage(page.get());
+  return page.get();
+}
+
+bool TmpfsFileSystem::ReserveResidentPage() {
+  if (lru_.size() < max_resident_pages_) {
+    return true;
+  }
+  if (!enable_spill_) {
+    errno = ENOSPC;
+    return false;
+  }
+  return SpillPage(lru_.back());
+}
+
+bool TmpfsFileSystem::SpillPage(Page *page) {
+  if (!cryptor_) {
+    CleansingVector<uint8_t> key(kSpillKeySize);
+    if (RAND_bytes(key.data(), key.size()) != 1) {
+      errno = EIO;
+      return false;
+    }
+    auto cryptor_result = AeadCryptor::CreateAesGcmCryptor(key);
+    if (!cryptor_result.ok()) {
+      errno = EIO;
+      return false;
+    }
+    cryptor_ = std::move(cryptor_result).ValueOrDie();
+  }
+
+  const size_t sealed_size = kSpillNonceSize + kPageSize +
+                             cryptor_->MaxSealOverhead();
+  if (!page->sealed) {
+    page->sealed = static_cast<uint8_t *>(
+        TrustedPrimitives::UntrustedLocalAlloc(sealed_size));
+    if (!page->sealed) {
+      errno = ENOMEM;
+      return false;
+    }
+  }
+
+  SpilledPageAad aad = {page->inode_id, page->index, page->generation + 1};
+
+  // Seal into enclave memory first so that the host only ever observes the
+  // finished ciphertext.
+  std::vector<uint8_t> sealed(sealed_size);
+  size_t ciphertext_size = 0;
+  Status status = cryptor_->Seal(
+      page->plaintext, ByteContainerView(&aad, sizeof(aad)),
+      absl::MakeSpan(sealed.data(), kSpillNonceSize),
+      absl::MakeSpan(sealed.data() + kSpillNonceSize,
+                     sealed.size() - kSpillNonceSize),
+      &ciphertext_size);
+  if (!status.ok()) {
+    errno = EIO;
+    return false;
+  }
+  page->sealed_size = kSpillNonceSize + ciphertext_size;
+  memcpy(page->sealed, sealed.data(), page->sealed_size);
+
+  ++page->generation;
+  lru_.erase(page->lru_position);
+  CleansingVector<uint8_t>().swap(page->plaintext);
+  ++spilled_pages_;
+  return true;
+}
+
+bool TmpfsFileSystem::RestorePage(Page *page) {
+  // Copy the sealed page into enclave memory before authenticating it so the
+  // host cannot modify it while it is being decrypted.
+  std::vector<uint8_t> sealed(page->sealed, page->sealed + page->sealed_size);
+  SpilledPageAad aad = {page->inode_id, page->index, page->generation};
+
+  CleansingVector<uint8_t> plaintext(sealed.size());
+  size_t plaintext_size = 0;
+  Status status = cryptor_->Open(
+      ByteContainerView(sealed.data() + kSpillNonceSize,
+                        sealed.size() - kSpillNonceSize),
+      ByteContainerView(&aad, sizeof(aad)),
+      ByteContainerView(sealed.data(), kSpillNonceSize),
+      absl::MakeSpan(plaintext), &plaintext_size);
+  if (!status.ok() || plaintext_size != kPageSize) {
+    errno = EIO;
+    return false;
+  }
+  plaintext.resize(plaintext_size);
+
+  page->plaintext = std::move(plaintext);
+  lru_.push_front(page);
+  page->lru_position = lru_.begin();
+  --spilled_pages_;
+  return true;
+}
+
+void TmpfsFileSystem::ReleasePage(Page *page) {
+  if (page->plaintext.empty()) {
+    --spilled_pages_;
+  } else {
+    lru_.erase(page->lru_position);
+    CleansingVector<uint8_t>().swap(page->plaintext);
+  }
+  if (page->sealed) {
+    TrustedPrimitives::UntrustedLocalFree(page->sealed);
+    page->sealed = nullptr;
+  }
+}
+
+void TmpfsFileSystem::TouchPage(Page *page) {
+  lru_.splice(lru_.begin(), lru_, page->lru_position);
+}
+
+bool TmpfsFileSystem::ResizeInode(Inode *inode, off_t length) {
+  if (length < inode->size) {
+    // Zero the tail of the last partial page so a later extension of the file
+    // reads back zeros.
+    size_t last_index = length / kPageSize;
+    size_t tail_offset = length % kPageSize;
+    if (tail_offset != 0 && last_index < inode->pages.size() &&
+        inode->pages[last_index]) {
+      Page *page = GetResidentPage(inode, last_index, /*allocate=*/false);
+      if (!page) {
+        return false;
+      }
+      memset(page->plaintext.data() + tail_offset, 0,
+             kPageSize - tail_offset);
+    }
+
+    size_t page_count = (length + kPageSize - 1) / kPageSize;
+    for (size_t i = page_count; i < inode->pages.size(); ++i) {
+      if (inode->pages[i]) {
+        ReleasePage(inode->pages[i].get());
+      }
+    }
+    if (page_count < inode->pages.size()) {
+      inode->pages.resize(page_count);
+    }
+  }
+  inode->size = length;
+  return true;
+}
+
+void TmpfsFileSystem::ReleaseInode(Inode *inode) {
+  {
+    absl::MutexLock lock(&mu_);
+    for (auto &page : inode->pages) {
+      if (page) {
+        ReleasePage(page.get());
+      }
+    }
+  }
+  delete inode;
+}
+
+IOContextTmpfs::IOContextTmpfs(TmpfsFileSystem *fs,
+                               std::shared_ptr<TmpfsFileSystem::Inode> inode,
+                               int flags)
+    : fs_(fs), inode_(std::move(inode)), flags_(flags) {}
+
+ssize_t IOContextTmpfs::Read(void *buf, size_t count) {
+  if ((flags_ & O_ACCMODE) == O_WRONLY) {
+    errno = EBADF;
+    return -1;
+  }
+  absl::MutexLock lock(&offset_mu_);
+  ssize_t result = fs_->Read(inode_.get(), buf, count, offset_);
+  if (result > 0) {
+    offset_ += result;
+  }
+  return result;
+}
+
+ssize_t IOContextTmpfs::Write(const void *buf, size_t count) {
+  if ((flags_ & O_ACCMODE) == O_RDONLY) {
+    errno = EBADF;
+    return -1;
+  }
+  absl::MutexLock lock(&offset_mu_);
+  if (flags_ & O_APPEND) {
+    offset_ = fs_->Size(inode_.get());
+  }
+  ssize_t result = fs_->Write(inode_.get(), buf, count, offset_);
+  if (result > 0) {
+    offset_ += result;
+  }
+  return result;
+}
+
+int IOContextTmpfs::Close() { return 0; }
+
+int IOContextTmpfs::LSeek(off_t offset, int whence) {
+  absl::MutexLock lock(&offset_mu_);
+  off_t base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = offset_;
+      break;
+    case SEEK_END:
+      base = fs_->Size(inode_.get());
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+  if (base + offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  offset_ = base + offset;
+  return offset_;
+}
+
+int IOContextTmpfs::FCntl(int cmd, int64_t arg) {
+  switch (cmd) {
+    case F_GETFL:
+      return flags_;
+    case F_SETFL:
+      // Only the file status flags that affect this context may be changed.
+      flags_ = (flags_ & ~(O_APPEND | O_NONBLOCK)) |
+               (arg & (O_APPEND | O_NONBLOCK));
+      return 0;
+    case F_GETFD:
+    case F_SETFD:
+      return 0;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+}
+
+int IOContextTmpfs::FSync() {
+  // Nothing to do.
+  return 0;
+}
+
+int IOContextTmpfs::FStat(struct stat *stat_buffer) {
+  fs_->FillStat(*inode_, stat_buffer);
+  return 0;
+}
+
+int IOContextTmpfs::Isatty() {
+  // Returns 0 as tmpfs files are not terminals.
+  return 0;
+}
+
+int IOContextTmpfs::FTruncate(off_t length) {
+  if ((flags_ & O_ACCMODE) == O_RDONLY) {
+    errno = EINVAL;
+    return -1;
+  }
+  return fs_->Truncate(inode_.get(), length);
+}
+
+ssize_t IOContextTmpfs::Writev(const struct iovec *iov, int iovcnt) {
+  ssize_t total = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    ssize_t result = Write(iov[i].iov_base, iov[i].iov_len);
+    if (result < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += result;
+    if (static_cast<size_t>(result) < iov[i].iov_len) {
+      break;
+    }
+  }
+  return total;
+}
+
+ssize_t IOContextTmpfs::Readv(const struct iovec *iov, int iovcnt) {
+  ssize_t total = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    ssize_t result = Read(iov[i].iov_base, iov[i].iov_len);
+    if (result < 0) {
+      return total > 0 ? total : -1;
+    }
+    total += result;
+    if (static_cast<size_t>(result) < iov[i].iov_len) {
+      break;
+    }
+  }
+  return total;
+}
+
+ssize_t IOContextTmpfs::PRead(void *buf, size_t count, off_t offset) {
+  if ((flags_ & O_ACCMODE) == O_WRONLY) {
+    errno = EBADF;
+    return -1;
+  }
+  return fs_->Read(inode_.get(), buf, count, offset);
+}
+
+ssize_t IOContextTmpfs::PWrite(const void *buf, size_t count, off_t offset) {
+  if ((flags_ & O_ACCMODE) == O_RDONLY) {
+    errno = EBADF;
+    return -1;
+  }
+  return fs_->Write(inode_.get(), buf, count, offset);
+}
+
+std::unique_ptr<IOManager::IOContext> TmpfsPathHandler::Open(const char *path,
+                                                             int flags,
+                                                             mode_t mode) {
+  std::shared_ptr<TmpfsFileSystem::Inode> inode = fs_.Open(path, flags, mode);
+  if (!inode) {
+    return nullptr;
+  }
+  return ::absl::make_unique<IOContextTmpfs>(&fs_, std::move(inode), flags);
+}
+
+int TmpfsPathHandler::Stat(const char *pathname, struct stat *stat_buffer) {
+  return fs_.Stat(pathname, stat_buffer);
+}
+
+int TmpfsPathHandler::LStat(const char *pathname, struct stat *stat_buffer) {
+  // The tmpfs does not support symbolic links.
+  return fs_.Stat(pathname, stat_buffer);
+}
+
+int TmpfsPathHandler::Mkdir(const char *path, mode_t mode) {
+  return fs_.Mkdir(path, mode);
+}
+
+int TmpfsPathHandler::RmDir(const char *pathname) {
+  return fs_.RmDir(pathname);
+}
+
+int TmpfsPathHandler::Rename(const char *oldpath, const char *newpath) {
+  return fs_.Rename(oldpath, newpath);
+}
+
+int TmpfsPathHandler::Unlink(const char *pathname) {
+  return fs_.Unlink(pathname);
+}
+
+int TmpfsPathHandler::Access(const char *path, int mode) {
+  return fs_.Access(path, mode);
+}
+
+int TmpfsPathHandler::Truncate(const char *path, off_t length) {
+  return fs_.Truncate(path, length);
+}
+
+}  // namespace io
+}  // namespace asylo
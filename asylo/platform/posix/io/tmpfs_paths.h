@@ -0,0 +1,260 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_POSIX_IO_TMPFS_PATHS_H_
+#define ASYLO_PLATFORM_POSIX_IO_TMPFS_PATHS_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/crypto/aead_cryptor.h"
+#include "asylo/platform/posix/io/io_manager.h"
+#include "asylo/util/cleansing_types.h"
+
+namespace asylo {
+namespace io {
+
+// In-enclave storage backing a tmpfs mount. File contents are held as
+// fixed-size pages in enclave memory. When the number of resident pages exceeds
+// the configured budget, the least recently used pages are sealed with AES-GCM
+// under an ephemeral key and moved to untrusted memory. Spilled pages are
+// authenticated against their file, page index and spill generation when they
+// are brought back, so the host can neither read, reorder nor replay them.
+//
+// Contents never reach the host file system and do not survive the enclave.
+// The file system must outlive every file opened on it. This class is
+// thread-safe.
+class TmpfsFileSystem {
+ public:
+  // Size of a single tmpfs page.
+  static constexpr size_t kPageSize = 4096;
+
+  // A single page of file data. A page is either resident, in which case
+  // |plaintext| holds kPageSize bytes, or spilled, in which case |plaintext| is
+  // empty and |sealed| points to untrusted memory holding the sealed page.
+  struct Page {
+    CleansingVector<uint8_t> plaintext;
+    uint8_t *sealed = nullptr;
+    size_t sealed_size = 0;
+
+    // Owning file and position of the page within it. Together with
+    // |generation| these are bound into the associated data of the sealed
+    // page.
+    uint64_t inode_id = 0;
+    size_t index = 0;
+
+    // Incremented every time the page is spilled.
+    uint64_t generation = 0;
+
+    // Position of the page in the resident LRU list, valid while resident.
+    std::list<Page *>::iterator lru_position;
+  };
+
+  // A regular file in the tmpfs.
+  struct Inode {
+    uint64_t id;
+    mode_t mode;
+    off_t size = 0;
+    std::vector<std::unique_ptr<Page>> pages;
+  };
+
+  // Creates a file system mounted at |mount_path| which keeps at most
+  // |max_resident_bytes| of file data resident in enclave memory. If
+  // |enable_spill| is false, writes that would exceed the budget fail with
+  // ENOSPC instead of spilling.
+  TmpfsFileSystem(std::string mount_path, size_t max_resident_bytes,
+                  bool enable_spill);
+  ~TmpfsFileSystem();
+
+  TmpfsFileSystem(const TmpfsFileSystem &) = delete;
+  TmpfsFileSystem &operator=(const TmpfsFileSystem &) = delete;
+
+  // Looks up the file at |path|, creating it according to |flags| and |mode|.
+  // Returns nullptr and sets errno on failure.
+  std::shared_ptr<Inode> Open(const std::string &path, int flags, mode_t mode)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Reads up to |count| bytes at |offset| of |inode| into |buf|.
+  ssize_t Read(Inode *inode, void *buf, size_t count, off_t offset)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes |count| bytes from |buf| at |offset| of |inode|, extending the file
+  // as needed.
+  ssize_t Write(Inode *inode, const void *buf, size_t count, off_t offset)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Sets the size of |inode| to |length|.
+  int Truncate(Inode *inode, off_t length) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the current size of |inode|.
+  off_t Size(Inode *inode) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Path based operations. These return 0 on success, otherwise set errno and
+  // return -1.
+  int Stat(const std::string &path, struct stat *stat_buffer)
+      ABSL_LOCKS_EXCLUDED(mu_);
+  int Truncate(const std::string &path, off_t length) ABSL_LOCKS_EXCLUDED(mu_);
+  int Unlink(const std::string &path) ABSL_LOCKS_EXCLUDED(mu_);
+  int Rename(const std::string &oldpath, const std::string &newpath)
+      ABSL_LOCKS_EXCLUDED(mu_);
+  int Mkdir(const std::string &path, mode_t mode) ABSL_LOCKS_EXCLUDED(mu_);
+  int RmDir(const std::string &path) ABSL_LOCKS_EXCLUDED(mu_);
+  int Access(const std::string &path, int mode) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Fills |stat_buffer| with the attributes of |inode|.
+  void FillStat(const Inode &inode, struct stat *stat_buffer)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the number of pages currently resident in enclave memory.
+  size_t ResidentPages() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the number of pages currently spilled to untrusted memory.
+  size_t SpilledPages() ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Returns true if the parent of |path| is the mount point or an existing
+  // directory.
+  bool ParentExists(const std::string &path) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns page |index| of |inode| resident in enclave memory, allocating or
+  // restoring it as needed. Returns nullptr and sets errno on failure.
+  Page *GetResidentPage(Inode *inode, size_t index, bool allocate)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Makes room for one more resident page, spilling the least recently used
+  // page if the budget is exhausted. Returns false and sets errno on failure.
+  bool ReserveResidentPage() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Seals |page| into untrusted memory and releases its plaintext.
+  bool SpillPage(Page *page) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Authenticates and decrypts spilled |page| back into enclave memory.
+  bool RestorePage(Page *page) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Releases all memory held by |page|.
+  void ReleasePage(Page *page) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Marks |page| as the most recently used resident page.
+  void TouchPage(Page *page) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Resizes |inode| to |length|, releasing pages past the new end of file.
+  // Returns false and sets errno on failure.
+  bool ResizeInode(Inode *inode, off_t length)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Releases the pages of |inode| once the last reference to it is dropped.
+  void ReleaseInode(Inode *inode) ABSL_LOCKS_EXCLUDED(mu_);
+
+  const std::string mount_path_;
+  const size_t max_resident_pages_;
+  const bool enable_spill_;
+
+  absl::Mutex mu_;
+
+  // Cryptor used to seal spilled pages. Created lazily on the first spill.
+  std::unique_ptr<AeadCryptor> cryptor_ ABSL_GUARDED_BY(mu_);
+
+  std::map<std::string, std::shared_ptr<Inode>> files_ ABSL_GUARDED_BY(mu_);
+  std::set<std::string> directories_ ABSL_GUARDED_BY(mu_);
+
+  // Resident pages, most recently used first.
+  std::list<Page *> lru_ ABSL_GUARDED_BY(mu_);
+
+  size_t spilled_pages_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t next_inode_id_ ABSL_GUARDED_BY(mu_) = 1;
+};
+
+// IOContext implementation for an open tmpfs file.
+class IOContextTmpfs : public IOManager::IOContext {
+ public:
+  IOContextTmpfs(TmpfsFileSystem *fs,
+                 std::shared_ptr<TmpfsFileSystem::Inode> inode, int flags);
+
+ protected:
+  ssize_t Read(void *buf, size_t count) override;
+  ssize_t Write(const void *buf, size_t count) override;
+  int Close() override;
+  int LSeek(off_t offset, int whence) override;
+  int FCntl(int cmd, int64_t arg) override;
+  int FSync() override;
+  int FStat(struct stat *stat_buffer) override;
+  int Isatty() override;
+  int FTruncate(off_t length) override;
+  ssize_t Writev(const struct iovec *iov, int iovcnt) override;
+  ssize_t Readv(const struct iovec *iov, int iovcnt) override;
+  ssize_t PRead(void *buf, size_t count, off_t offset) override;
+  ssize_t PWrite(const void *buf, size_t count, off_t offset) override;
+
+ private:
+  TmpfsFileSystem *const fs_;
+  const std::shared_ptr<TmpfsFileSystem::Inode> inode_;
+  int flags_;
+
+  absl::Mutex offset_mu_;
+  off_t offset_ ABSL_GUARDED_BY(offset_mu_) = 0;
+};
+
+// VirtualPathHandler implementation serving an in-enclave tmpfs. Scratch files
+// opened under the handler's prefix are kept entirely inside the enclave (or
+// sealed in untrusted memory under memory pressure) and never cause host calls
+// for I/O.
+class TmpfsPathHandler : public IOManager::VirtualPathHandler {
+ public:
+  // Default budget of resident file data.
+  static constexpr size_t kDefaultMaxResidentBytes = 16 * 1024 * 1024;
+
+  explicit TmpfsPathHandler(
+      std::string mount_path,
+      size_t max_resident_bytes = kDefaultMaxResidentBytes,
+      bool enable_spill = true)
+      : fs_(std::move(mount_path), max_resident_bytes, enable_spill) {}
+
+  TmpfsFileSystem *file_system() { return &fs_; }
+
+ protected:
+  std::unique_ptr<IOManager::IOContext> Open(const char *path, int flags,
+                                             mode_t mode) override;
+
+  int Stat(const char *pathname, struct stat *stat_buffer) override;
+  int LStat(const char *pathname, struct stat *stat_buffer) override;
+  int Mkdir(const char *path, mode_t mode) override;
+  int RmDir(const char *pathname) override;
+  int Rename(const char *oldpath, const char *newpath) override;
+  int Unlink(const char *pathname) override;
+  int Access(const char *path, int mode) override;
+  int Truncate(const char *path, off_t length) override;
+
+ private:
+  TmpfsFileSystem fs_;
+};
+
+}  // namespace io
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_POSIX_IO_TMPFS_PATHS_H_
@@ -0,0 +1,195 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/posix/io/io_manager.h"
+#include "asylo/platform/posix/io/tmpfs_paths.h"
+
+namespace asylo {
+namespace {
+
+constexpr char kMountPath[] = "/tmpfs_test";
+
+// Number of pages the test file system keeps resident before spilling.
+constexpr size_t kResidentPages = 4;
+
+class TmpfsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto handler = ::absl::make_unique<io::TmpfsPathHandler>(
+        kMountPath, kResidentPages * io::TmpfsFileSystem::kPageSize);
+    fs_ = handler->file_system();
+    ASSERT_TRUE(io::IOManager::GetInstance().RegisterVirtualPathHandler(
+        kMountPath, std::move(handler)));
+  }
+
+  void TearDown() override {
+    io::IOManager::GetInstance().DeregisterVirtualPathHandler(kMountPath);
+  }
+
+  std::string PathFor(const std::string &name) {
+    return absl::StrCat(kMountPath, "/", name);
+  }
+
+  io::TmpfsFileSystem *fs_;
+};
+
+TEST_F(TmpfsTest, WriteAndReadBack) {
+  const std::string path = PathFor("write_and_read_back");
+  const std::string data = "tmpfs contents";
+
+  int fd = open(path.c_str(), O_CREAT | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(write(fd, data.data(), data.size()), data.size());
+  EXPECT_EQ(lseek(fd, 0, SEEK_SET), 0);
+
+  std::vector<char> buf(data.size());
+  EXPECT_EQ(read(fd, buf.data(), buf.size()), data.size());
+  EXPECT_EQ(std::string(buf.begin(), buf.end()), data);
+  EXPECT_EQ(read(fd, buf.data(), buf.size()), 0);
+
+  struct stat st;
+  EXPECT_EQ(fstat(fd, &st), 0);
+  EXPECT_EQ(st.st_size, data.size());
+  EXPECT_TRUE(S_ISREG(st.st_mode));
+  EXPECT_EQ(close(fd), 0);
+
+  EXPECT_EQ(unlink(path.c_str()), 0);
+  EXPECT_LT(open(path.c_str(), O_RDONLY), 0);
+  EXPECT_EQ(errno, ENOENT);
+}
+
+TEST_F(TmpfsTest, HolesReadAsZeros) {
+  const std::string path = PathFor("holes");
+  int fd = open(path.c_str(), O_CREAT | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+
+  const off_t offset = 3 * io::TmpfsFileSystem::kPageSize + 7;
+  EXPECT_EQ(lseek(fd, offset, SEEK_SET), offset);
+  EXPECT_EQ(write(fd, "x", 1), 1);
+
+  std::vector<char> buf(offset + 1, 'a');
+  EXPECT_EQ(pread(fd, buf.data(), buf.size(), 0), buf.size());
+  EXPECT_EQ(buf.back(), 'x');
+  buf.pop_back();
+  EXPECT_EQ(buf, std::vector<char>(offset, '\0'));
+
+  EXPECT_EQ(ftruncate(fd, 1), 0);
+  EXPECT_EQ(ftruncate(fd, offset + 1), 0);
+  EXPECT_EQ(pread(fd, buf.data(), 1, offset), 1);
+  EXPECT_EQ(buf[0], '\0');
+
+  EXPECT_EQ(close(fd), 0);
+  EXPECT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(TmpfsTest, PositionalWritesKeepOffset) {
+  const std::string path = PathFor("pwrite");
+  int fd = open(path.c_str(), O_CREAT | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+
+  EXPECT_EQ(write(fd, "abcdef", 6), 6);
+  EXPECT_EQ(pwrite(fd, "XY", 2, 2), 2);
+  EXPECT_EQ(lseek(fd, 0, SEEK_CUR), 6);
+
+  const off_t offset = io::TmpfsFileSystem::kPageSize + 1;
+  EXPECT_EQ(pwrite(fd, "z", 1, offset), 1);
+  EXPECT_EQ(lseek(fd, 0, SEEK_CUR), 6);
+
+  char buf[6];
+  EXPECT_EQ(pread(fd, buf, sizeof(buf), 0), sizeof(buf));
+  EXPECT_EQ(std::string(buf, sizeof(buf)), "abXYef");
+  EXPECT_EQ(pread(fd, buf, 1, offset), 1);
+  EXPECT_EQ(buf[0], 'z');
+  EXPECT_EQ(close(fd), 0);
+
+  fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(pwrite(fd, "x", 1, 0), -1);
+  EXPECT_EQ(errno, EBADF);
+  EXPECT_EQ(close(fd), 0);
+  EXPECT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(TmpfsTest, SpillsAndRestoresPages) {
+  const std::string path = PathFor("spill");
+  constexpr size_t kPages = 4 * kResidentPages;
+
+  int fd = open(path.c_str(), O_CREAT | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+
+  std::vector<uint8_t> page(io::TmpfsFileSystem::kPageSize);
+  for (size_t i = 0; i < kPages; ++i) {
+    std::fill(page.begin(), page.end(), static_cast<uint8_t>(i));
+    ASSERT_EQ(write(fd, page.data(), page.size()), page.size());
+  }
+  EXPECT_LE(fs_->ResidentPages(), kResidentPages);
+  EXPECT_GE(fs_->SpilledPages(), kPages - kResidentPages);
+
+  EXPECT_EQ(lseek(fd, 0, SEEK_SET), 0);
+  for (size_t i = 0; i < kPages; ++i) {
+    ASSERT_EQ(read(fd, page.data(), page.size()), page.size());
+    EXPECT_EQ(page, std::vector<uint8_t>(page.size(), static_cast<uint8_t>(i)));
+  }
+
+  EXPECT_EQ(close(fd), 0);
+  EXPECT_EQ(unlink(path.c_str()), 0);
+  EXPECT_EQ(fs_->ResidentPages(), 0);
+  EXPECT_EQ(fs_->SpilledPages(), 0);
+}
+
+TEST_F(TmpfsTest, Directories) {
+  const std::string dir = PathFor("dir");
+  const std::string moved_dir = PathFor("moved_dir");
+  const std::string file = absl::StrCat(dir, "/file");
+
+  EXPECT_LT(open(file.c_str(), O_CREAT | O_RDWR, 0600), 0);
+  EXPECT_EQ(errno, ENOENT);
+
+  ASSERT_EQ(mkdir(dir.c_str(), 0700), 0);
+  int fd = open(file.c_str(), O_CREAT | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(close(fd), 0);
+
+  EXPECT_EQ(rmdir(dir.c_str()), -1);
+  EXPECT_EQ(errno, ENOTEMPTY);
+
+  ASSERT_EQ(rename(dir.c_str(), moved_dir.c_str()), 0);
+  struct stat st;
+  EXPECT_EQ(stat(absl::StrCat(moved_dir, "/file").c_str(), &st), 0);
+  EXPECT_TRUE(S_ISREG(st.st_mode));
+  EXPECT_EQ(stat(moved_dir.c_str(), &st), 0);
+  EXPECT_TRUE(S_ISDIR(st.st_mode));
+
+  EXPECT_EQ(unlink(absl::StrCat(moved_dir, "/file").c_str()), 0);
+  EXPECT_EQ(rmdir(moved_dir.c_str()), 0);
+}
+
+}  // namespace
+}  // namespace asylo
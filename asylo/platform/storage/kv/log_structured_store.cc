@@ -0,0 +1,738 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/kv/log_structured_store.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/crypto/sha256_hash.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+// Layout of the storage: two header slots, followed by the log.
+constexpr uint64_t kHeaderSlotLength = 256;
+constexpr uint64_t kLogBegin = 2 * kHeaderSlotLength;
+
+constexpr uint32_t kHeaderMagic = 0x4c4b5641;  // "AVKL"
+constexpr char kHeaderAssociatedData[] = "asylo log-structured store header";
+constexpr size_t kNonceLength = 12;
+constexpr size_t kTagLength = 16;
+
+// A header slot holds the magic, the length of the sealed header, the nonce
+// and the sealed header.
+constexpr size_t kHeaderPrefixLength = 2 * sizeof(uint32_t) + kNonceLength;
+
+// A record of the log holds the length of its sealed update and the epoch it
+// was sealed in, then the nonce and the sealed update. An update holds a
+// deletion flag and the length of the key, then the key and the value.
+constexpr size_t kRecordPrefixLength = 2 * sizeof(uint32_t) + kNonceLength;
+constexpr size_t kUpdatePrefixLength = 1 + sizeof(uint32_t);
+
+// Length of the reads and writes of the log during replay and compaction.
+constexpr size_t kScanLength = 1024 * 1024;
+
+template <typename T>
+void Append(T value, std::vector<uint8_t> *bytes) {
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(&value);
+  bytes->insert(bytes->end(), data, data + sizeof(T));
+}
+
+template <typename T>
+T Load(const uint8_t *data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+// Returns the associated data of a record at |offset| of the log of storage
+// |storage| sealed in |epoch|, which binds the record to its position.
+std::vector<uint8_t> RecordAssociatedData(int storage, uint32_t epoch,
+                                          uint64_t offset) {
+  std::vector<uint8_t> associated_data;
+  Append<uint8_t>(storage, &associated_data);
+  Append(epoch, &associated_data);
+  Append(offset, &associated_data);
+  return associated_data;
+}
+
+// Replaces |chain| with the hash of |chain| followed by |record|.
+Status ExtendChain(ByteContainerView record, uint8_t chain[32]) {
+  Sha256Hash hash;
+  hash.Update(ByteContainerView(chain, 32));
+  hash.Update(record);
+  std::vector<uint8_t> digest;
+  ASYLO_RETURN_IF_ERROR(hash.CumulativeHash(&digest));
+  memcpy(chain, digest.data(), 32);
+  return Status::OkStatus();
+}
+
+Status DataLoss(absl::string_view message) {
+  return Status(error::GoogleError::DATA_LOSS, message);
+}
+
+}  // namespace
+
+constexpr size_t LogStructuredStore::kKeyLength;
+
+void LogStructuredStore::WriteBatch::Put(absl::string_view key,
+                                         absl::string_view value) {
+  updates_.push_back(Update{std::string(key), std::string(value), false});
+}
+
+void LogStructuredStore::WriteBatch::Delete(absl::string_view key) {
+  updates_.push_back(Update{std::string(key), std::string(), true});
+}
+
+StatusOr<std::unique_ptr<LogStructuredStore>> LogStructuredStore::Open(
+    ByteContainerView key, RandomAccessStorage *primary,
+    RandomAccessStorage *secondary, const Options &options) {
+  if (key.size() != kKeyLength) {
+    return Status(error::GoogleError::INVALID_ARGUMENT,
+                  absl::StrCat("Key must be ", kKeyLength, " bytes long"));
+  }
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSIGN_OR_RETURN(cryptor, AeadCryptor::CreateAesGcmSivCryptor(key));
+  std::unique_ptr<AeadCryptor> compaction_cryptor;
+  ASYLO_ASSIGN_OR_RETURN(compaction_cryptor,
+                         AeadCryptor::CreateAesGcmSivCryptor(key));
+
+  auto store = absl::WrapUnique(
+      new LogStructuredStore(std::move(cryptor), std::move(compaction_cryptor),
+                             primary, secondary, options));
+  {
+    absl::MutexLock lock(&store->mu_);
+    absl::MutexLock io_lock(&store->io_mu_);
+
+    // Open the storage with the most recent header.
+    bool found = false;
+    for (int storage = 0; storage < 2; storage++) {
+      Header header;
+      if (store->ReadHeader(storage, &header) &&
+          (!found || header.version > store->header_.version)) {
+        found = true;
+        store->active_ = storage;
+        store->header_ = header;
+      }
+    }
+    if (!found) {
+      for (RandomAccessStorage *storage : store->storage_) {
+        size_t size;
+        ASYLO_ASSIGN_OR_RETURN(size, storage->Size());
+        if (size > 0) {
+          return DataLoss("No valid header found in a non-empty store");
+        }
+      }
+    }
+    if (store->header_.version < options.min_version) {
+      return Status(error::GoogleError::FAILED_PRECONDITION,
+                    absl::StrCat("Store is at version ",
+                                 store->header_.version, ", expected ",
+                                 options.min_version, " or later"));
+    }
+    ASYLO_RETURN_IF_ERROR(store->Replay());
+
+    // Start a new epoch, so that records left beyond the end of the log by an
+    // earlier session cannot be mistaken for the records that replace them.
+    store->header_.version++;
+    store->header_.epoch++;
+    ASYLO_RETURN_IF_ERROR(
+        store->WriteHeader(store->active_, store->header_));
+  }
+
+  if (options.compaction_ratio > 0 && options.compaction_ratio <= 1) {
+    LogStructuredStore *raw_store = store.get();
+    store->compaction_thread_ = absl::make_unique<Thread>(
+        [raw_store] { raw_store->CompactionLoop(); });
+  }
+  return std::move(store);
+}
+
+LogStructuredStore::LogStructuredStore(
+    std::unique_ptr<AeadCryptor> cryptor,
+    std::unique_ptr<AeadCryptor> compaction_cryptor,
+    RandomAccessStorage *primary, RandomAccessStorage *secondary,
+    const Options &options)
+    : cryptor_(std::move(cryptor)),
+      compaction_cryptor_(std::move(compaction_cryptor)),
+      storage_{primary, secondary},
+      options_(options),
+      active_(0),
+      header_{0, kLogBegin, 0, {}},
+      live_length_(0),
+      compaction_requested_(false),
+      shutting_down_(false) {}
+
+LogStructuredStore::~LogStructuredStore() {
+  if (compaction_thread_) {
+    {
+      absl::MutexLock lock(&mu_);
+      shutting_down_ = true;
+    }
+    compaction_thread_->Join();
+  }
+}
+
+StatusOr<std::string> LogStructuredStore::Get(absl::string_view key) const {
+  absl::ReaderMutexLock lock(&mu_);
+  auto it = index_.find(std::string(key));
+  if (it == index_.end()) {
+    return Status(error::GoogleError::NOT_FOUND, "Key not found");
+  }
+
+  std::string record_key;
+  std::string value;
+  bool deleted;
+  {
+    absl::MutexLock io_lock(&io_mu_);
+    ASYLO_RETURN_IF_ERROR(
+        ReadRecord(active_, it->second, &record_key, &value, &deleted));
+  }
+  if (deleted || record_key != key) {
+    return DataLoss("Record does not match the index");
+  }
+  return value;
+}
+
+Status LogStructuredStore::Put(absl::string_view key,
+                               absl::string_view value) {
+  WriteBatch batch;
+  batch.Put(key, value);
+  return Write(batch);
+}
+
+Status LogStructuredStore::Delete(absl::string_view key) {
+  WriteBatch batch;
+  batch.Delete(key);
+  return Write(batch);
+}
+
+Status LogStructuredStore::Write(const WriteBatch &batch) {
+  if (batch.updates_.empty()) {
+    return Status::OkStatus();
+  }
+
+  absl::MutexLock lock(&mu_);
+  Header header = header_;
+  header.version++;
+  std::vector<uint8_t> log;
+  std::vector<RecordLocation> locations;
+  locations.reserve(batch.updates_.size());
+  for (const WriteBatch::Update &update : batch.updates_) {
+    RecordLocation location;
+    ASYLO_ASSIGN_OR_RETURN(
+        location, AppendRecord(cryptor_.get(), active_, header.epoch,
+                               header_.log_end, update.key, update.value,
+                               update.deleted, &log, &header));
+    locations.push_back(location);
+  }
+
+  {
+    absl::MutexLock io_lock(&io_mu_);
+    RandomAccessStorage *storage = storage_[active_];
+    Status status = storage->Write(log.data(), header_.log_end, log.size());
+    if (status.ok()) {
+      status = WriteHeader(active_, header);
+    }
+    if (status.ok() && options_.sync) {
+      status = storage->Sync();
+    }
+    if (!status.ok()) {
+      // The records written may be left beyond the end of the log. Seal later
+      // records in a new epoch, so that they cannot be substituted.
+      header_.epoch++;
+      return status;
+    }
+  }
+
+  header_ = header;
+  for (size_t i = 0; i < locations.size(); i++) {
+    const WriteBatch::Update &update = batch.updates_[i];
+    auto it = index_.find(update.key);
+    if (it != index_.end()) {
+      live_length_ -= it->second.length;
+    }
+    if (update.deleted) {
+      if (it != index_.end()) {
+        index_.erase(it);
+      }
+    } else if (it != index_.end()) {
+      it->second = locations[i];
+      live_length_ += locations[i].length;
+    } else {
+      index_.emplace(update.key, locations[i]);
+      live_length_ += locations[i].length;
+    }
+  }
+
+  if (compaction_thread_ && !compaction_requested_ && ShouldCompact()) {
+    compaction_requested_ = true;
+  }
+  return Status::OkStatus();
+}
+
+Status LogStructuredStore::Compact() {
+  absl::MutexLock lock(&compaction_mu_);
+  return CompactInternal();
+}
+
+Status LogStructuredStore::Sync() {
+  absl::ReaderMutexLock lock(&mu_);
+  absl::MutexLock io_lock(&io_mu_);
+  return storage_[active_]->Sync();
+}
+
+uint64_t LogStructuredStore::version() const {
+  absl::ReaderMutexLock lock(&mu_);
+  return header_.version;
+}
+
+size_t LogStructuredStore::size() const {
+  absl::ReaderMutexLock lock(&mu_);
+  return index_.size();
+}
+
+uint64_t LogStructuredStore::log_length() const {
+  absl::ReaderMutexLock lock(&mu_);
+  return header_.log_end - kLogBegin;
+}
+
+bool LogStructuredStore::ReadHeader(int storage, Header *header) const {
+  bool found = false;
+  for (uint64_t slot = 0; slot < 2; slot++) {
+    uint8_t bytes[kHeaderSlotLength];
+    if (!storage_[storage]
+             ->Read(bytes, slot * kHeaderSlotLength, sizeof(bytes))
+             .ok() ||
+        Load<uint32_t>(bytes) != kHeaderMagic) {
+      continue;
+    }
+    const uint32_t sealed_length = Load<uint32_t>(bytes + sizeof(uint32_t));
+    if (sealed_length != sizeof(Header) + kTagLength) {
+      continue;
+    }
+
+    CleansingVector<uint8_t> plaintext(sealed_length);
+    size_t plaintext_length;
+    std::vector<uint8_t> associated_data(
+        kHeaderAssociatedData,
+        kHeaderAssociatedData + sizeof(kHeaderAssociatedData));
+    associated_data.push_back(storage);
+    Header slot_header;
+    if (!cryptor_
+             ->Open(ByteContainerView(bytes + kHeaderPrefixLength,
+                                      sealed_length),
+                    associated_data,
+                    ByteContainerView(bytes + 2 * sizeof(uint32_t),
+                                      kNonceLength),
+                    absl::MakeSpan(plaintext), &plaintext_length)
+             .ok() ||
+        plaintext_length != sizeof(Header)) {
+      continue;
+    }
+    memcpy(&slot_header, plaintext.data(), sizeof(Header));
+
+    // A header is only valid in the slot of its version.
+    if (slot_header.version % 2 != slot ||
+        (found && slot_header.version <= header->version)) {
+      continue;
+    }
+    found = true;
+    *header = slot_header;
+  }
+  return found;
+}
+
+Status LogStructuredStore::WriteHeader(int storage, const Header &header) {
+  std::vector<uint8_t> associated_data(
+      kHeaderAssociatedData,
+      kHeaderAssociatedData + sizeof(kHeaderAssociatedData));
+  associated_data.push_back(storage);
+
+  std::vector<uint8_t> bytes(kHeaderSlotLength);
+  size_t sealed_length;
+  ASYLO_RETURN_IF_ERROR(cryptor_->Seal(
+      ByteContainerView(&header, sizeof(header)), associated_data,
+      absl::MakeSpan(bytes.data() + 2 * sizeof(uint32_t), kNonceLength),
+      absl::MakeSpan(bytes.data() + kHeaderPrefixLength,
+                     kHeaderSlotLength - kHeaderPrefixLength),
+      &sealed_length));
+  memcpy(bytes.data(), &kHeaderMagic, sizeof(uint32_t));
+  const uint32_t length = sealed_length;
+  memcpy(bytes.data() + sizeof(uint32_t), &length, sizeof(uint32_t));
+
+  // Alternate between the slots, so that a torn write of a header leaves the
+  // previous one intact.
+  return storage_[storage]->Write(
+      bytes.data(), (header.version % 2) * kHeaderSlotLength, bytes.size());
+}
+
+Status LogStructuredStore::Replay() {
+  index_.clear();
+  live_length_ = 0;
+  Header replayed = header_;
+  memset(replayed.chain, 0, sizeof(replayed.chain));
+  ASYLO_RETURN_IF_ERROR(ScanLog(
+      active_, kLogBegin, header_.log_end,
+      [this, &replayed](const RecordLocation &location,
+                        ByteContainerView record) -> Status {
+        std::string key;
+        std::string value;
+        bool deleted;
+        ASYLO_RETURN_IF_ERROR(
+            OpenRecord(active_, location, record, &key, &value, &deleted));
+        ASYLO_RETURN_IF_ERROR(ExtendChain(record, replayed.chain));
+
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+          live_length_ -= it->second.length;
+          if (deleted) {
+            index_.erase(it);
+            return Status::OkStatus();
+          }
+          it->second = location;
+        } else if (!deleted) {
+          index_.emplace(std::move(key), location);
+        }
+        if (!deleted) {
+          live_length_ += location.length;
+        }
+        return Status::OkStatus();
+      }));
+
+  if (memcmp(replayed.chain, header_.chain, sizeof(header_.chain)) != 0) {
+    index_.clear();
+    live_length_ = 0;
+    return DataLoss("Log does not match its header");
+  }
+  return Status::OkStatus();
+}
+
+Status LogStructuredStore::ScanLog(
+    int storage, uint64_t begin, uint64_t end,
+    const std::function<Status(const RecordLocation &location,
+                               ByteContainerView record)> &visit) const {
+  // |buffer| holds the log from |buffer_begin|, of which the records before
+  // |offset| have been visited.
+  std::vector<uint8_t> buffer;
+  uint64_t buffer_begin = begin;
+  uint64_t offset = begin;
+  while (offset < end) {
+    // Reads the log until the buffer holds |length| bytes from |offset|.
+    auto fill = [&](uint64_t length) -> Status {
+      if (offset + length > end) {
+        return DataLoss("Truncated record in log");
+      }
+      if (offset + length <= buffer_begin + buffer.size()) {
+        return Status::OkStatus();
+      }
+      buffer.erase(buffer.begin(), buffer.begin() + (offset - buffer_begin));
+      buffer_begin = offset;
+      size_t read_length =
+          std::min<uint64_t>(std::max<uint64_t>(kScanLength, length),
+                             end - buffer_begin) -
+          buffer.size();
+      size_t old_size = buffer.size();
+      buffer.resize(old_size + read_length);
+      ASYLO_RETURN_IF_ERROR(storage_[storage]->Read(
+          buffer.data() + old_size, buffer_begin + old_size, read_length));
+      return Status::OkStatus();
+    };
+
+    ASYLO_RETURN_IF_ERROR(fill(kRecordPrefixLength));
+    const uint8_t *prefix = buffer.data() + (offset - buffer_begin);
+    RecordLocation location;
+    location.offset = offset;
+    location.length = kRecordPrefixLength + Load<uint32_t>(prefix);
+    location.epoch = Load<uint32_t>(prefix + sizeof(uint32_t));
+    ASYLO_RETURN_IF_ERROR(fill(location.length));
+    const uint8_t *record = buffer.data() + (offset - buffer_begin);
+    ASYLO_RETURN_IF_ERROR(
+        visit(location, ByteContainerView(record, location.length)));
+    offset += location.length;
+  }
+  return Status::OkStatus();
+}
+
+StatusOr<LogStructuredStore::RecordLocation> LogStructuredStore::AppendRecord(
+    AeadCryptor *cryptor, int storage, uint32_t epoch, uint64_t log_begin,
+    absl::string_view key, absl::string_view value, bool deleted,
+    std::vector<uint8_t> *log, Header *header) const {
+  CleansingVector<uint8_t> update;
+  update.reserve(kUpdatePrefixLength + key.size() + value.size());
+  update.push_back(deleted ? 1 : 0);
+  const uint32_t key_length = key.size();
+  const uint8_t *key_length_bytes =
+      reinterpret_cast<const uint8_t *>(&key_length);
+  update.insert(update.end(), key_length_bytes,
+                key_length_bytes + sizeof(key_length));
+  update.insert(update.end(), key.begin(), key.end());
+  update.insert(update.end(), value.begin(), value.end());
+
+  RecordLocation location;
+  location.offset = log_begin + log->size();
+  location.epoch = epoch;
+
+  const size_t record_begin = log->size();
+  log->resize(record_begin + kRecordPrefixLength + update.size() +
+              cryptor->MaxSealOverhead());
+  uint8_t *record = log->data() + record_begin;
+  size_t sealed_length;
+  ASYLO_RETURN_IF_ERROR(cryptor->Seal(
+      update, RecordAssociatedData(storage, epoch, location.offset),
+      absl::MakeSpan(record + 2 * sizeof(uint32_t), kNonceLength),
+      absl::MakeSpan(record + kRecordPrefixLength,
+                     log->size() - record_begin - kRecordPrefixLength),
+      &sealed_length));
+  const uint32_t length = sealed_length;
+  memcpy(record, &length, sizeof(length));
+  memcpy(record + sizeof(length), &epoch, sizeof(epoch));
+  location.length = kRecordPrefixLength + sealed_length;
+  log->resize(record_begin + location.length);
+
+  ASYLO_RETURN_IF_ERROR(ExtendChain(
+      ByteContainerView(log->data() + record_begin, location.length),
+      header->chain));
+  header->log_end = location.offset + location.length;
+  return location;
+}
+
+Status LogStructuredStore::OpenRecord(int storage,
+                                      const RecordLocation &location,
+                                      ByteContainerView record,
+                                      std::string *key, std::string *value,
+                                      bool *deleted) const {
+  if (record.size() != location.length ||
+      location.length < kRecordPrefixLength + kTagLength ||
+      Load<uint32_t>(record.data()) + kRecordPrefixLength != location.length ||
+      Load<uint32_t>(record.data() + sizeof(uint32_t)) != location.epoch) {
+    return DataLoss("Malformed record in log");
+  }
+
+  const size_t sealed_length = location.length - kRecordPrefixLength;
+  CleansingVector<uint8_t> update(sealed_length);
+  size_t update_length;
+  Status status = cryptor_->Open(
+      ByteContainerView(record.data() + kRecordPrefixLength, sealed_length),
+      RecordAssociatedData(storage, location.epoch, location.offset),
+      ByteContainerView(record.data() + 2 * sizeof(uint32_t), kNonceLength),
+      absl::MakeSpan(update), &update_length);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to open record at offset " << location.offset
+               << ": " << status;
+    return DataLoss("Record in log failed authentication");
+  }
+  if (update_length < kUpdatePrefixLength) {
+    return DataLoss("Malformed update in log");
+  }
+  const uint32_t key_length = Load<uint32_t>(update.data() + 1);
+  if (key_length > update_length - kUpdatePrefixLength) {
+    return DataLoss("Malformed update in log");
+  }
+
+  const char *data = reinterpret_cast<const char *>(update.data());
+  *deleted = update[0] != 0;
+  key->assign(data + kUpdatePrefixLength, key_length);
+  value->assign(data + kUpdatePrefixLength + key_length,
+                update_length - kUpdatePrefixLength - key_length);
+  return Status::OkStatus();
+}
+
+Status LogStructuredStore::ReadRecord(int storage,
+                                      const RecordLocation &location,
+                                      std::string *key, std::string *value,
+                                      bool *deleted) const {
+  std::vector<uint8_t> record(location.length);
+  ASYLO_RETURN_IF_ERROR(
+      storage_[storage]->Read(record.data(), location.offset, record.size()));
+  return OpenRecord(storage, location, record, key, value, deleted);
+}
+
+Status LogStructuredStore::CompactInternal() {
+  // Snapshot the index, and reserve an epoch for the records resealed into the
+  // other storage, ahead of the epoch of later updates.
+  int source;
+  uint64_t snapshot_end;
+  uint32_t epoch;
+  std::vector<std::pair<std::string, RecordLocation>> live;
+  {
+    absl::MutexLock lock(&mu_);
+    source = active_;
+    snapshot_end = header_.log_end;
+    live.assign(index_.begin(), index_.end());
+
+    Header header = header_;
+    header.version++;
+    epoch = header.epoch + 1;
+    header.epoch = epoch + 1;
+    absl::MutexLock io_lock(&io_mu_);
+    ASYLO_RETURN_IF_ERROR(WriteHeader(source, header));
+    header_ = header;
+  }
+  const int target = 1 - source;
+
+  // Copy the live records in the order of the log, so that they are read
+  // sequentially.
+  std::sort(live.begin(), live.end(),
+            [](const std::pair<std::string, RecordLocation> &lhs,
+               const std::pair<std::string, RecordLocation> &rhs) {
+              return lhs.second.offset < rhs.second.offset;
+            });
+  {
+    absl::MutexLock io_lock(&io_mu_);
+    ASYLO_RETURN_IF_ERROR(storage_[target]->Truncate(0));
+  }
+
+  Header compacted = {0, kLogBegin, 0, {}};
+  Index index;
+  uint64_t live_length = 0;
+  std::vector<uint8_t> log;
+  uint64_t log_begin = kLogBegin;
+  auto flush = [&]() -> Status {
+    absl::MutexLock io_lock(&io_mu_);
+    ASYLO_RETURN_IF_ERROR(
+        storage_[target]->Write(log.data(), log_begin, log.size()));
+    log_begin += log.size();
+    log.clear();
+    return Status::OkStatus();
+  };
+  auto copy = [&](const std::string &key, const std::string &value,
+                  bool deleted) -> Status {
+    RecordLocation location;
+    ASYLO_ASSIGN_OR_RETURN(
+        location,
+        AppendRecord(compaction_cryptor_.get(), target, epoch, log_begin, key,
+                     value, deleted, &log, &compacted));
+    auto it = index.find(key);
+    if (it != index.end()) {
+      live_length -= it->second.length;
+      index.erase(it);
+    }
+    if (!deleted) {
+      index.emplace(key, location);
+      live_length += location.length;
+    }
+    if (log.size() >= kScanLength) {
+      return flush();
+    }
+    return Status::OkStatus();
+  };
+
+  for (const auto &entry : live) {
+    std::string key;
+    std::string value;
+    bool deleted;
+    {
+      absl::MutexLock io_lock(&io_mu_);
+      ASYLO_RETURN_IF_ERROR(
+          ReadRecord(source, entry.second, &key, &value, &deleted));
+    }
+    if (deleted || key != entry.first) {
+      return DataLoss("Record does not match the index");
+    }
+    ASYLO_RETURN_IF_ERROR(copy(key, value, /*deleted=*/false));
+  }
+  live.clear();
+
+  // Copy the updates made since the snapshot, then switch over to the other
+  // storage.
+  absl::MutexLock lock(&mu_);
+  {
+    absl::MutexLock io_lock(&io_mu_);
+    ASYLO_RETURN_IF_ERROR(ScanLog(
+        source, snapshot_end, header_.log_end,
+        [&](const RecordLocation &location, ByteContainerView record) {
+          std::string key;
+          std::string value;
+          bool deleted;
+          ASYLO_RETURN_IF_ERROR(
+              OpenRecord(source, location, record, &key, &value, &deleted));
+          // A deletion of a key not copied has nothing to hide.
+          if (deleted && index.find(key) == index.end()) {
+            return Status::OkStatus();
+          }
+          RecordLocation copied;
+          ASYLO_ASSIGN_OR_RETURN(
+              copied,
+              AppendRecord(compaction_cryptor_.get(), target, epoch, log_begin,
+                           key, value, deleted, &log, &compacted));
+          auto it = index.find(key);
+          if (it != index.end()) {
+            live_length -= it->second.length;
+            index.erase(it);
+          }
+          if (!deleted) {
+            index.emplace(key, copied);
+            live_length += copied.length;
+          }
+          return Status::OkStatus();
+        }));
+  }
+  ASYLO_RETURN_IF_ERROR(flush());
+
+  compacted.version = header_.version + 1;
+  compacted.epoch = header_.epoch;
+  {
+    absl::MutexLock io_lock(&io_mu_);
+    ASYLO_RETURN_IF_ERROR(storage_[target]->Sync());
+    ASYLO_RETURN_IF_ERROR(WriteHeader(target, compacted));
+    ASYLO_RETURN_IF_ERROR(storage_[target]->Sync());
+  }
+  active_ = target;
+  header_ = compacted;
+  index_ = std::move(index);
+  live_length_ = live_length;
+  return Status::OkStatus();
+}
+
+void LogStructuredStore::CompactionLoop() {
+  while (true) {
+    {
+      absl::MutexLock lock(&mu_);
+      auto requested_or_shutting_down = [this]() {
+        mu_.AssertReaderHeld();
+        return compaction_requested_ || shutting_down_;
+      };
+      mu_.Await(absl::Condition(&requested_or_shutting_down));
+      if (shutting_down_) {
+        return;
+      }
+    }
+
+    absl::MutexLock lock(&compaction_mu_);
+    Status status = CompactInternal();
+    LOG_IF(ERROR, !status.ok()) << "Compaction failed: " << status;
+    absl::MutexLock state_lock(&mu_);
+    compaction_requested_ = false;
+  }
+}
+
+bool LogStructuredStore::ShouldCompact() const {
+  const uint64_t log_length = header_.log_end - kLogBegin;
+  return log_length >= options_.min_compaction_length &&
+         log_length - live_length_ >= options_.compaction_ratio * log_length;
+}
+
+}  // namespace asylo
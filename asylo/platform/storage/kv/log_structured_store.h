@@ -0,0 +1,261 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_KV_LOG_STRUCTURED_STORE_H_
+#define ASYLO_PLATFORM_STORAGE_KV_LOG_STRUCTURED_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/crypto/aead_cryptor.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/platform/storage/utils/random_access_storage.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+
+// An encrypted key-value store kept in untrusted storage as an append-only log.
+//
+// Every update is sealed into a record of the log with AES-GCM-SIV, bound to
+// its position in the log, and the keys of the store are indexed in enclave
+// memory. A header at the start of the storage seals the length of the log, a
+// hash chained over all of its records and a version which increases with
+// every update. Opening a store replays its log against the header, and fails
+// if the version is lower than expected, which detects the rollback of the
+// storage to an earlier state as long as the caller keeps track of the latest
+// version, for instance in a monotonic counter.
+//
+// Updates are applied in batches: the records of a batch are appended with a
+// single write, followed by the header. Updates not covered by the header when
+// the store is opened are discarded, hence batches are atomic.
+//
+// Overwritten and deleted records are reclaimed by compaction, which copies the
+// live records to a second storage resource and then switches over to it. The
+// store alternates between the two resources, and is opened from the one with
+// the most recent header. Compaction runs on an enclave thread once dead
+// records take up enough of the log, without blocking other operations for
+// longer than it takes to copy the records appended meanwhile.
+//
+// All methods are thread-safe.
+class LogStructuredStore {
+ public:
+  struct Options {
+    // Minimum version accepted when opening the store. The version of the store
+    // after an update is returned by version().
+    uint64_t min_version = 0;
+
+    // Compaction is started in the background once dead records take up this
+    // fraction of a log of at least |min_compaction_length| bytes. A ratio of 0
+    // or more than 1 disables background compaction.
+    double compaction_ratio = 0.5;
+    size_t min_compaction_length = 1024 * 1024;
+
+    // Whether the storage resource is synchronized after every batch.
+    bool sync = false;
+  };
+
+  // A sequence of updates applied atomically by Write().
+  class WriteBatch {
+   public:
+    void Put(absl::string_view key, absl::string_view value);
+    void Delete(absl::string_view key);
+
+    size_t size() const { return updates_.size(); }
+    void Clear() { updates_.clear(); }
+
+   private:
+    friend class LogStructuredStore;
+
+    struct Update {
+      std::string key;
+      std::string value;
+      bool deleted;
+    };
+
+    std::vector<Update> updates_;
+  };
+
+  // Length of the key of the store.
+  static constexpr size_t kKeyLength = 32;
+
+  // Opens the store kept in |primary| and |secondary|, which may be empty, with
+  // the encryption |key|. The store does not take ownership of the storage
+  // resources, which must outlive it. Returns an error if the storage does not
+  // hold a valid store, or if the version of the store is lower than
+  // |options.min_version|.
+  static StatusOr<std::unique_ptr<LogStructuredStore>> Open(
+      ByteContainerView key, RandomAccessStorage *primary,
+      RandomAccessStorage *secondary, const Options &options);
+
+  // Waits for background compaction to finish.
+  ~LogStructuredStore();
+
+  // Returns the value of |key|, or a NOT_FOUND error if the store does not hold
+  // |key|.
+  StatusOr<std::string> Get(absl::string_view key) const
+      ABSL_LOCKS_EXCLUDED(mu_, io_mu_);
+
+  Status Put(absl::string_view key, absl::string_view value)
+      ABSL_LOCKS_EXCLUDED(mu_, io_mu_);
+
+  Status Delete(absl::string_view key) ABSL_LOCKS_EXCLUDED(mu_, io_mu_);
+
+  // Applies the updates of |batch| in order, atomically.
+  Status Write(const WriteBatch &batch) ABSL_LOCKS_EXCLUDED(mu_, io_mu_);
+
+  // Reclaims the dead records of the log. Returns once compaction completes,
+  // including one started in the background.
+  Status Compact() ABSL_LOCKS_EXCLUDED(mu_, io_mu_, compaction_mu_);
+
+  // Synchronizes the storage resource holding the log.
+  Status Sync() ABSL_LOCKS_EXCLUDED(mu_, io_mu_);
+
+  // Returns the version of the store, which increases with every update.
+  uint64_t version() const ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the number of keys in the store.
+  size_t size() const ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the length of the log, including dead records.
+  uint64_t log_length() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Location of the latest record of a key.
+  struct RecordLocation {
+    uint64_t offset;
+    uint32_t length;
+
+    // Epoch the record was sealed in, which is part of its associated data.
+    uint32_t epoch;
+  };
+
+  // State sealed in the header.
+  struct Header {
+    uint64_t version;
+    uint64_t log_end;
+    uint32_t epoch;
+    uint8_t chain[32];
+  };
+
+  using Index = std::unordered_map<std::string, RecordLocation>;
+
+  LogStructuredStore(std::unique_ptr<AeadCryptor> cryptor,
+                     std::unique_ptr<AeadCryptor> compaction_cryptor,
+                     RandomAccessStorage *primary,
+                     RandomAccessStorage *secondary, const Options &options);
+
+  // Reads the most recent valid header of storage |storage| into |header|.
+  // Returns false if there is none.
+  bool ReadHeader(int storage, Header *header) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(io_mu_);
+
+  // Seals |header| into the header slot of its version in storage |storage|.
+  Status WriteHeader(int storage, const Header &header)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(io_mu_);
+
+  // Rebuilds the index by replaying the log of the active storage against the
+  // header.
+  Status Replay() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_, io_mu_);
+
+  // Calls |visit| with the location and the bytes of every record in
+  // [|begin|, |end|) of the log of storage |storage|, in order.
+  Status ScanLog(int storage, uint64_t begin, uint64_t end,
+                 const std::function<Status(const RecordLocation &location,
+                                            ByteContainerView record)> &visit)
+      const ABSL_EXCLUSIVE_LOCKS_REQUIRED(io_mu_);
+
+  // Seals the record of an update of |key| at the end of |log|, which starts at
+  // |log_begin| of the log of storage |storage|, and extends the hash chain of
+  // |header| over it. Returns the location of the record.
+  StatusOr<RecordLocation> AppendRecord(AeadCryptor *cryptor, int storage,
+                                        uint32_t epoch, uint64_t log_begin,
+                                        absl::string_view key,
+                                        absl::string_view value, bool deleted,
+                                        std::vector<uint8_t> *log,
+                                        Header *header) const;
+
+  // Opens the bytes of the |record| at |location| of the log of storage
+  // |storage|, returning its key in |key|, its value in |value| and true in
+  // |deleted| for deletions.
+  Status OpenRecord(int storage, const RecordLocation &location,
+                    ByteContainerView record, std::string *key,
+                    std::string *value, bool *deleted) const;
+
+  // Reads and opens the record at |location| of the log of storage |storage|.
+  Status ReadRecord(int storage, const RecordLocation &location,
+                    std::string *key, std::string *value, bool *deleted) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(io_mu_);
+
+  // Copies the live records to the inactive storage and switches over to it.
+  Status CompactInternal() ABSL_EXCLUSIVE_LOCKS_REQUIRED(compaction_mu_)
+      ABSL_LOCKS_EXCLUDED(mu_, io_mu_);
+
+  // Body of the compaction thread.
+  void CompactionLoop() ABSL_LOCKS_EXCLUDED(mu_, compaction_mu_);
+
+  // Returns true if dead records take up enough of the log to compact it.
+  bool ShouldCompact() const ABSL_SHARED_LOCKS_REQUIRED(mu_);
+
+  const std::unique_ptr<AeadCryptor> cryptor_ ABSL_PT_GUARDED_BY(mu_);
+
+  // Cryptor used to reseal records during compaction, concurrently with
+  // updates.
+  const std::unique_ptr<AeadCryptor> compaction_cryptor_
+      ABSL_PT_GUARDED_BY(compaction_mu_);
+
+  RandomAccessStorage *const storage_[2];
+  const Options options_;
+
+  // Index of the storage holding the log.
+  int active_ ABSL_GUARDED_BY(mu_);
+  Header header_ ABSL_GUARDED_BY(mu_);
+  Index index_ ABSL_GUARDED_BY(mu_);
+
+  // Length of the live records of the log.
+  uint64_t live_length_ ABSL_GUARDED_BY(mu_);
+
+  bool compaction_requested_ ABSL_GUARDED_BY(mu_);
+  bool shutting_down_ ABSL_GUARDED_BY(mu_);
+  mutable absl::Mutex mu_;
+
+  // Serializes accesses to the storage resources, which are not required to
+  // be thread-safe. Acquired after |mu_|.
+  mutable absl::Mutex io_mu_;
+
+  // Held for the duration of a compaction. Acquired before |mu_|.
+  absl::Mutex compaction_mu_;
+
+  std::unique_ptr<Thread> compaction_thread_;
+
+  LogStructuredStore(const LogStructuredStore &) = delete;
+  LogStructuredStore &operator=(const LogStructuredStore &) = delete;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_KV_LOG_STRUCTURED_STORE_H_
@@ -0,0 +1,116 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of LogStructuredStore over UntrustedFiles, holding a million keys.
+// Run with --benchmarks=all.
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/storage/kv/log_structured_store.h"
+#include "asylo/platform/storage/utils/test_utils.h"
+#include "asylo/platform/storage/utils/untrusted_file.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace {
+
+constexpr size_t kKeyCount = 1000 * 1000;
+constexpr size_t kValueLength = 100;
+constexpr size_t kPrefillBatchSize = 1000;
+constexpr char kKey[] = "0123456789abcdef0123456789abcdef";
+
+std::string KeyOf(size_t index) { return absl::StrCat("key", index); }
+
+// Returns a store of kKeyCount keys shared by all benchmarks.
+LogStructuredStore *GetStore() {
+  static LogStructuredStore *store = [] {
+    auto *primary =
+        new UntrustedFile(CreateEmptyTempFileOrDie("kv_bench_primary.tmp"));
+    auto *secondary =
+        new UntrustedFile(CreateEmptyTempFileOrDie("kv_bench_secondary.tmp"));
+    auto store_result = LogStructuredStore::Open(
+        ByteContainerView(kKey, LogStructuredStore::kKeyLength), primary,
+        secondary, LogStructuredStore::Options());
+    CHECK(store_result.ok()) << store_result.status();
+    LogStructuredStore *store = store_result.ValueOrDie().release();
+
+    const std::string value(kValueLength, 'v');
+    LogStructuredStore::WriteBatch batch;
+    for (size_t i = 0; i < kKeyCount; i++) {
+      batch.Put(KeyOf(i), value);
+      if (batch.size() == kPrefillBatchSize) {
+        CHECK(store->Write(batch).ok());
+        batch.Clear();
+      }
+    }
+    CHECK(store->Write(batch).ok());
+    return store;
+  }();
+  return store;
+}
+
+// Reads random keys, concurrently on multiple threads.
+void BM_Get(benchmark::State &state) {
+  LogStructuredStore *store = GetStore();
+  std::mt19937 random(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::uniform_int_distribution<size_t> indices(0, kKeyCount - 1);
+  for (auto _ : state) {
+    CHECK(store->Get(KeyOf(indices(random))).ok());
+  }
+}
+BENCHMARK(BM_Get)->ThreadRange(1, 4)->UseRealTime();
+
+// Overwrites random keys in batches of the size given by the argument, which
+// lets background compaction run as the log grows.
+void BM_Put(benchmark::State &state) {
+  LogStructuredStore *store = GetStore();
+  std::mt19937 random(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::uniform_int_distribution<size_t> indices(0, kKeyCount - 1);
+  const std::string value(kValueLength, 'w');
+  LogStructuredStore::WriteBatch batch;
+  for (auto _ : state) {
+    batch.Clear();
+    for (int i = 0; i < state.range(0); i++) {
+      batch.Put(KeyOf(indices(random)), value);
+    }
+    CHECK(store->Write(batch).ok());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Put)->Arg(1)->Arg(16)->Arg(256)->UseRealTime();
+
+// Compacts the log, which holds a single version of every key after the first
+// iteration.
+void BM_Compact(benchmark::State &state) {
+  LogStructuredStore *store = GetStore();
+  for (auto _ : state) {
+    CHECK(store->Compact().ok());
+  }
+  state.SetItemsProcessed(state.iterations() * store->size());
+}
+BENCHMARK(BM_Compact)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,311 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/kv/log_structured_store.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/platform/storage/utils/test_utils.h"
+#include "asylo/platform/storage/utils/untrusted_file.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Gt;
+using ::testing::Lt;
+
+constexpr char kKey[] = "0123456789abcdef0123456789abcdef";
+
+class LogStructuredStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    primary_ = absl::make_unique<UntrustedFile>(
+        CreateEmptyTempFileOrDie("log_structured_store_primary.tmp"));
+    secondary_ = absl::make_unique<UntrustedFile>(
+        CreateEmptyTempFileOrDie("log_structured_store_secondary.tmp"));
+  }
+
+  // Opens the store without background compaction, unless |options| says
+  // otherwise.
+  StatusOr<std::unique_ptr<LogStructuredStore>> OpenStore(
+      LogStructuredStore::Options options = ForegroundOptions()) {
+    return LogStructuredStore::Open(
+        ByteContainerView(kKey, LogStructuredStore::kKeyLength),
+        primary_.get(), secondary_.get(), options);
+  }
+
+  static LogStructuredStore::Options ForegroundOptions() {
+    LogStructuredStore::Options options;
+    options.compaction_ratio = 0;
+    return options;
+  }
+
+  std::unique_ptr<UntrustedFile> primary_;
+  std::unique_ptr<UntrustedFile> secondary_;
+};
+
+TEST_F(LogStructuredStoreTest, PutGetDelete) {
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+
+  EXPECT_THAT(store->Get("key").status(),
+              StatusIs(error::GoogleError::NOT_FOUND));
+  ASYLO_ASSERT_OK(store->Put("key", "value"));
+  EXPECT_THAT(store->Get("key"), IsOkAndHolds("value"));
+  ASYLO_ASSERT_OK(store->Put("key", "other value"));
+  EXPECT_THAT(store->Get("key"), IsOkAndHolds("other value"));
+  ASYLO_ASSERT_OK(store->Put("empty", ""));
+  EXPECT_THAT(store->Get("empty"), IsOkAndHolds(""));
+  EXPECT_THAT(store->size(), Eq(2));
+
+  ASYLO_ASSERT_OK(store->Delete("key"));
+  EXPECT_THAT(store->Get("key").status(),
+              StatusIs(error::GoogleError::NOT_FOUND));
+  EXPECT_THAT(store->size(), Eq(1));
+}
+
+TEST_F(LogStructuredStoreTest, RejectsBadKey) {
+  EXPECT_THAT(LogStructuredStore::Open("short key", primary_.get(),
+                                       secondary_.get(), ForegroundOptions())
+                  .status(),
+              StatusIs(error::GoogleError::INVALID_ARGUMENT));
+}
+
+TEST_F(LogStructuredStoreTest, PersistsAcrossReopen) {
+  uint64_t version;
+  {
+    std::unique_ptr<LogStructuredStore> store;
+    ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+    for (int i = 0; i < 100; i++) {
+      ASYLO_ASSERT_OK(store->Put(absl::StrCat("key", i), absl::StrCat(i)));
+    }
+    ASYLO_ASSERT_OK(store->Delete("key7"));
+    version = store->version();
+  }
+
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  EXPECT_THAT(store->version(), Gt(version));
+  EXPECT_THAT(store->size(), Eq(99));
+  EXPECT_THAT(store->Get("key42"), IsOkAndHolds("42"));
+  EXPECT_THAT(store->Get("key7").status(),
+              StatusIs(error::GoogleError::NOT_FOUND));
+}
+
+TEST_F(LogStructuredStoreTest, WritesBatches) {
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  ASYLO_ASSERT_OK(store->Put("deleted", "value"));
+  const uint64_t version = store->version();
+
+  LogStructuredStore::WriteBatch batch;
+  batch.Put("a", "1");
+  batch.Put("b", "2");
+  batch.Put("a", "3");
+  batch.Delete("deleted");
+  EXPECT_THAT(batch.size(), Eq(4));
+  ASYLO_ASSERT_OK(store->Write(batch));
+
+  // A batch is a single update of the store.
+  EXPECT_THAT(store->version(), Eq(version + 1));
+  EXPECT_THAT(store->Get("a"), IsOkAndHolds("3"));
+  EXPECT_THAT(store->Get("b"), IsOkAndHolds("2"));
+  EXPECT_THAT(store->Get("deleted").status(),
+              StatusIs(error::GoogleError::NOT_FOUND));
+}
+
+// Verifies that records appended without a header covering them, as after a
+// crash in the middle of a batch, are discarded.
+TEST_F(LogStructuredStoreTest, DiscardsUncommittedRecords) {
+  std::vector<uint8_t> committed;
+  {
+    std::unique_ptr<LogStructuredStore> store;
+    ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+    ASYLO_ASSERT_OK(store->Put("a", "1"));
+    size_t size;
+    ASYLO_ASSERT_OK_AND_ASSIGN(size, primary_->Size());
+    committed.resize(size);
+    ASYLO_ASSERT_OK(primary_->Read(committed.data(), 0, size));
+
+    LogStructuredStore::WriteBatch batch;
+    batch.Put("a", "2");
+    batch.Put("b", "3");
+    ASYLO_ASSERT_OK(store->Write(batch));
+  }
+
+  // Restore the header slots of the committed state.
+  ASYLO_ASSERT_OK(primary_->Write(committed.data(), 0, 512));
+
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  EXPECT_THAT(store->Get("a"), IsOkAndHolds("1"));
+  EXPECT_THAT(store->Get("b").status(),
+              StatusIs(error::GoogleError::NOT_FOUND));
+}
+
+TEST_F(LogStructuredStoreTest, DetectsRollback) {
+  std::vector<uint8_t> old_state;
+  uint64_t version;
+  {
+    std::unique_ptr<LogStructuredStore> store;
+    ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+    ASYLO_ASSERT_OK(store->Put("balance", "100"));
+    size_t size;
+    ASYLO_ASSERT_OK_AND_ASSIGN(size, primary_->Size());
+    old_state.resize(size);
+    ASYLO_ASSERT_OK(primary_->Read(old_state.data(), 0, size));
+
+    ASYLO_ASSERT_OK(store->Put("balance", "0"));
+    version = store->version();
+  }
+
+  // Roll the storage back to its earlier state.
+  ASYLO_ASSERT_OK(primary_->Truncate(0));
+  ASYLO_ASSERT_OK(primary_->Write(old_state.data(), 0, old_state.size()));
+
+  LogStructuredStore::Options options = ForegroundOptions();
+  options.min_version = version;
+  EXPECT_THAT(OpenStore(options).status(),
+              StatusIs(error::GoogleError::FAILED_PRECONDITION));
+
+  // The earlier state is otherwise valid.
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  EXPECT_THAT(store->version(), Lt(version + 1));
+  EXPECT_THAT(store->Get("balance"), IsOkAndHolds("100"));
+}
+
+TEST_F(LogStructuredStoreTest, DetectsTampering) {
+  {
+    std::unique_ptr<LogStructuredStore> store;
+    ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+    ASYLO_ASSERT_OK(store->Put("key", "value"));
+  }
+
+  // Flip a bit of the sealed update of the first record of the log.
+  uint8_t byte;
+  ASYLO_ASSERT_OK(primary_->Read(&byte, 512 + 24, 1));
+  byte ^= 1;
+  ASYLO_ASSERT_OK(primary_->Write(&byte, 512 + 24, 1));
+
+  EXPECT_THAT(OpenStore().status(), StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+TEST_F(LogStructuredStoreTest, RejectsGarbage) {
+  std::vector<uint8_t> garbage(1024, 0x5a);
+  ASYLO_ASSERT_OK(primary_->Write(garbage.data(), 0, garbage.size()));
+  EXPECT_THAT(OpenStore().status(), StatusIs(error::GoogleError::DATA_LOSS));
+}
+
+TEST_F(LogStructuredStoreTest, CompactionReclaimsDeadRecords) {
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 50; i++) {
+      ASYLO_ASSERT_OK(
+          store->Put(absl::StrCat("key", i), absl::StrCat(round, "-", i)));
+    }
+  }
+  ASYLO_ASSERT_OK(store->Delete("key0"));
+  const uint64_t log_length = store->log_length();
+
+  ASYLO_ASSERT_OK(store->Compact());
+  EXPECT_THAT(store->log_length(), Lt(log_length / 5));
+  EXPECT_THAT(store->size(), Eq(49));
+  EXPECT_THAT(store->Get("key1"), IsOkAndHolds("9-1"));
+
+  // Updates go to the compacted log, which survives a reopen, as does a
+  // second compaction back to the first storage.
+  ASYLO_ASSERT_OK(store->Put("key1", "new"));
+  ASYLO_ASSERT_OK(store->Delete("key2"));
+  store.reset();
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  EXPECT_THAT(store->Get("key1"), IsOkAndHolds("new"));
+  EXPECT_THAT(store->Get("key2").status(),
+              StatusIs(error::GoogleError::NOT_FOUND));
+  ASYLO_ASSERT_OK(store->Compact());
+  store.reset();
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  EXPECT_THAT(store->size(), Eq(48));
+  EXPECT_THAT(store->Get("key3"), IsOkAndHolds("9-3"));
+  EXPECT_THAT(store->Get("key0").status(),
+              StatusIs(error::GoogleError::NOT_FOUND));
+}
+
+TEST_F(LogStructuredStoreTest, CompactsInBackground) {
+  LogStructuredStore::Options options;
+  options.min_compaction_length = 16 * 1024;
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore(options));
+
+  const std::string value(100, 'v');
+  uint64_t max_log_length = 0;
+  for (int i = 0; i < 5000; i++) {
+    ASYLO_ASSERT_OK(store->Put(absl::StrCat("key", i % 10), value));
+    max_log_length = std::max(max_log_length, store->log_length());
+  }
+
+  // Compact() waits for a compaction in progress.
+  ASYLO_ASSERT_OK(store->Compact());
+  EXPECT_THAT(store->log_length(), Lt(5000 * value.size() / 2));
+  EXPECT_THAT(store->size(), Eq(10));
+  EXPECT_THAT(store->Get("key3"), IsOkAndHolds(value));
+}
+
+TEST_F(LogStructuredStoreTest, ConcurrentAccess) {
+  LogStructuredStore::Options options;
+  options.min_compaction_length = 8 * 1024;
+  std::unique_ptr<LogStructuredStore> store;
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore(options));
+
+  constexpr int kThreads = 4;
+  constexpr int kUpdates = 500;
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < kThreads; thread++) {
+    threads.emplace_back([&store, thread] {
+      for (int i = 0; i < kUpdates; i++) {
+        const std::string key = absl::StrCat(thread, "-", i % 20);
+        const std::string value = absl::StrCat(i);
+        ASYLO_EXPECT_OK(store->Put(key, value));
+        EXPECT_THAT(store->Get(key), IsOkAndHolds(value));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  store.reset();
+  ASYLO_ASSERT_OK_AND_ASSIGN(store, OpenStore());
+  EXPECT_THAT(store->size(), Eq(kThreads * 20));
+  EXPECT_THAT(store->Get("2-19"), IsOkAndHolds(absl::StrCat(kUpdates - 1)));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -23,11 +23,16 @@
 // IO syscall interface constants.
 #include <fcntl.h>
 
+#include <algorithm>
+#include <functional>
 #include <iomanip>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "absl/strings/escaping.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/crypto/util/bytes.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
@@ -101,49 +106,207 @@ ssize_t write_all(int fd, const void *buf, size_t len) {
   return offset;
 }
 
+// Reads at |file_offset| without moving the cursor of |fd|. Returns -1 on
+// failure, or min(|len|, bytes to EOF) on success.
+ssize_t pread_all(int fd, void *buf, size_t len, off_t file_offset) {
+  size_t bytes_to_read = len;
+  size_t offset = 0;
+
+  while (bytes_to_read > 0) {
+    ssize_t bytes_read;
+    do {
+      bytes_read = enc_untrusted_pread64(
+          fd, static_cast<uint8_t *>(buf) + offset, bytes_to_read,
+          file_offset + offset);
+    } while ((bytes_read == -1) && is_transient_error(errno));
+    if (bytes_read == -1) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      return offset;
+    }
+
+    bytes_to_read -= bytes_read;
+    offset += bytes_read;
+  }
+
+  return offset;
+}
+
+// Writes at |file_offset| without moving the cursor of |fd|. Returns -1 on
+// failure, or |len| on success.
+ssize_t pwrite_all(int fd, const void *buf, size_t len, off_t file_offset) {
+  size_t bytes_to_write = len;
+  size_t offset = 0;
+
+  while (bytes_to_write > 0) {
+    ssize_t bytes_written;
+    do {
+      bytes_written = enc_untrusted_pwrite64(
+          fd, static_cast<const uint8_t *>(buf) + offset, bytes_to_write,
+          file_offset + offset);
+    } while ((bytes_written == -1) && is_transient_error(errno));
+    if (bytes_written == -1) {
+      return -1;
+    }
+
+    bytes_to_write -= bytes_written;
+    offset += bytes_written;
+  }
+
+  return offset;
+}
+
+// Length of file data read at once when collecting integrity metadata of a
+// file.
+constexpr size_t kMetadataReadLength = 1024 * 1024;
+
+// Length of file data read or written at once by the pipeline that overlaps
+// host I/O with the cryptographic processing of blocks.
+constexpr size_t kPipelineChunkLength = 1024 * 1024;
+
+// Minimum length of plaintext processed by a worker pool task, below which
+// spreading blocks across threads costs more than it saves.
+constexpr size_t kMinParallelLength = 64 * 1024;
+
+// Reads of more blocks bypass the block cache, so that scans of large files do
+// not evict the hot blocks of short reads.
+constexpr int64_t kMaxCachedReadBlocks = 16;
+
+// Magic value identifying the versioned layout of the file header.
+constexpr uint64_t kFileHeaderMagic = 0x314b4c4241534541;  // "AESABLK1"
+
 // Returns offset to the plaintext buffer associated with the |block_index| of
-// a full block.
+// a full block, given the length of file blocks |block_length|.
 const uint8_t *GetPlaintextBuffer(size_t first_partial_block_bytes_count,
-                                  int64_t block_index, const void *buf) {
+                                  int64_t block_index, size_t block_length,
+                                  const void *buf) {
   const uint8_t *plaintext_data = reinterpret_cast<const uint8_t *>(buf);
   if (first_partial_block_bytes_count > 0) {
     if (block_index > 0) {
       plaintext_data += first_partial_block_bytes_count;
     }
     if (block_index > 1) {
-      plaintext_data += (block_index - 1) * kBlockLength;
+      plaintext_data += (block_index - 1) * block_length;
     }
   } else {
-    plaintext_data += block_index * kBlockLength;
+    plaintext_data += block_index * block_length;
   }
 
   return plaintext_data;
 }
 
 uint8_t *GetPlaintextBuffer(size_t first_partial_block_bytes_count,
-                            int64_t block_index, void *buf) {
+                            int64_t block_index, size_t block_length,
+                            void *buf) {
   return const_cast<uint8_t *>(
       GetPlaintextBuffer(first_partial_block_bytes_count, block_index,
-                         const_cast<const void *>(buf)));
+                         block_length, const_cast<const void *>(buf)));
 }
 
 }  // namespace
 
 using Tag = UnsafeBytes<kTagLength>;
-using Token = UnsafeBytes<kTokenLength>;
-using Block = UnsafeBytes<kBlockLength>;
-using Ciphertext = UnsafeBytes<kCipherBlockLength>;
-using SecureBlock = UnsafeBytes<kSecureBlockLength>;
 
 using TagView = ByteContainerView;
 using TokenView = ByteContainerView;
-using BlockView = ByteContainerView;
 using CiphertextView = ByteContainerView;
-using SecureBlockView = ByteContainerView;
 
 AeadHandler::AeadHandler()
-    : offset_translator_(OffsetTranslator::Create(
-          sizeof(FileHeader), kBlockLength, kSecureBlockLength)) {}
+    : next_file_id_(0), block_cache_(kDefaultBlockCacheCapacity) {
+  static_assert(sizeof(FileHeader) == kFileHeaderLength,
+                "FileHeader contains unexpected padding.");
+}
+
+bool AeadHandler::IsValidBlockLength(size_t block_length) {
+  return block_length >= kMinBlockLength && block_length <= kMaxBlockLength &&
+         (block_length & (block_length - 1)) == 0;
+}
+
+bool AeadHandler::ReadLayout(const char *path_name, size_t *header_length,
+                             size_t *block_length) {
+  int fd = enc_untrusted_open(path_name, O_RDONLY);
+  if (fd == -1) {
+    LOG(ERROR) << "Failed to open file for reading its layout, path="
+               << path_name << ", errno = " << errno;
+    return false;
+  }
+
+  FdCloser fd_closer(fd, &enc_untrusted_close);
+
+  FileHeader file_header;
+  ssize_t bytes_read = read_all(fd, file_header.data(), sizeof(FileHeader));
+  if (bytes_read == -1) {
+    LOG(ERROR) << "Failed to read the file header, path=" << path_name;
+    return false;
+  }
+
+  // Files without the magic value predate the versioned layout. Note that the
+  // layout read here is not trusted until the file hash, which covers the
+  // layout, is validated on deserialization.
+  if (bytes_read < sizeof(FileHeader) ||
+      file_header.magic != kFileHeaderMagic) {
+    *header_length = kLegacyFileHeaderLength;
+    *block_length = kLegacyBlockLength;
+    return true;
+  }
+
+  if (!IsValidBlockLength(file_header.block_length) ||
+      file_header.reserved != 0) {
+    LOG(ERROR) << "Invalid layout in the file header, path=" << path_name
+               << ", block_length = " << file_header.block_length;
+    errno = EINVAL;
+    return false;
+  }
+
+  *header_length = kFileHeaderLength;
+  *block_length = file_header.block_length;
+  return true;
+}
+
+bool AeadHandler::ComputeFileHash(const FileControl &file_ctrl,
+                                  const GcmCryptor &cryptor,
+                                  const std::string &root, size_t file_size,
+                                  FileHash *file_hash) const {
+  file_ctrl.mu.AssertReaderHeld();
+  if (root.size() != kRootHashLength) {
+    LOG(ERROR) << "Unexpected size of root hash encountered, size="
+               << root.size();
+    return false;
+  }
+
+  DataDigest data_digest;
+  std::copy_n(reinterpret_cast<const uint8_t *>(root.data()), kRootHashLength,
+              data_digest.data());
+  data_digest.file_size = file_size;
+  data_digest.block_length = file_ctrl.block_length;
+
+  // The digest of legacy files does not cover the block length, which is fixed
+  // for the legacy layout.
+  const size_t digest_length = file_ctrl.is_legacy()
+                                   ? kRootHashLength + sizeof(size_t)
+                                   : sizeof(DataDigest);
+  if (!cryptor.GetAuthTag(file_hash->data(), data_digest.data(),
+                          digest_length)) {
+    LOG(ERROR) << "Failed to generate CMAC, root = "
+               << absl::BytesToHexString(root);
+    return false;
+  }
+
+  return true;
+}
+
+std::shared_ptr<AeadHandler::FileControl> AeadHandler::GetFileControl(int fd) {
+  absl::ReaderMutexLock global_lock(&mu_);
+
+  auto entry = fmap_.find(fd);
+  if (entry == fmap_.end()) {
+    errno = ENOENT;
+    return nullptr;
+  }
+
+  return entry->second;
+}
 
 bool AeadHandler::Deserialize(FileControl *file_ctrl) {
   if (!file_ctrl) {
@@ -182,8 +345,9 @@ bool AeadHandler::Deserialize(FileControl *file_ctrl) {
 
   // Read the header with digest.
   FileHeader file_header;
-  ssize_t bytes_read = read_all(fd, file_header.data(), sizeof(FileHeader));
-  if (bytes_read != sizeof(FileHeader)) {
+  ssize_t bytes_read =
+      read_all(fd, file_header.data(), file_ctrl->header_length);
+  if (bytes_read != file_ctrl->header_length) {
     LOG(ERROR) << "Failed to read the file header, bytes read = " << bytes_read;
     return false;
   }
@@ -192,52 +356,52 @@ bool AeadHandler::Deserialize(FileControl *file_ctrl) {
   // collect integrity metadata across the file using the initially untrusted
   // value of the file size - then validation of the hash of the file digest
   // confirms validity of both the file size and the integrity metadata.
+  //
+  // The tags are interlaced with file data, so secure blocks are read in bulk
+  // and the tags are picked out of them in enclave memory - the number of host
+  // calls is proportional to the file size divided by kMetadataReadLength
+  // rather than to the number of blocks.
+  const size_t block_length = file_ctrl->block_length;
+  const size_t secure_block_length = file_ctrl->secure_block_length();
   const int64_t blocks_count =
-      (file_header.file_size + kBlockLength - 1) / kBlockLength;
-  Tag tag;
-  for (int64_t block_index = 0; block_index < blocks_count; block_index++) {
-    off_t offset = enc_untrusted_lseek(fd, kBlockLength, SEEK_CUR);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek past block when collecting integrity metadata.";
-      return false;
-    }
-
-    bytes_read = read_all(fd, tag.data(), kTagLength);
-    if (bytes_read != kTagLength) {
+      (file_header.file_size + block_length - 1) / block_length;
+  const int64_t blocks_per_read =
+      std::max<int64_t>(1, kMetadataReadLength / secure_block_length);
+  std::vector<uint8_t> buffer(std::min(blocks_count, blocks_per_read) *
+                              secure_block_length);
+  for (int64_t first_block_index = 0; first_block_index < blocks_count;
+       first_block_index += blocks_per_read) {
+    const int64_t blocks_to_read =
+        std::min(blocks_per_read, blocks_count - first_block_index);
+    const size_t bytes_to_read = blocks_to_read * secure_block_length;
+    bytes_read = read_all(fd, buffer.data(), bytes_to_read);
+    if (bytes_read != bytes_to_read) {
       LOG(ERROR) << "Failed to read integrity metadata, bytes_read="
-                 << bytes_read;
+                 << bytes_read << ", expected = " << bytes_to_read;
       return false;
     }
 
-    std::string tag_string(reinterpret_cast<char *>(tag.data()), kTagLength);
-    VLOG(2) << "Adding auth tag as leaf to rebuild Merkle tree: "
-            << absl::BytesToHexString(tag_string);
-    file_ctrl->ad->AddLeaf(tag_string);
-
-    offset = enc_untrusted_lseek(fd, kTokenLength, SEEK_CUR);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek past token when collecting integrity metadata.";
-      return false;
+    for (int64_t block_index = 0; block_index < blocks_to_read;
+         block_index++) {
+      std::string tag_string(
+          reinterpret_cast<char *>(buffer.data() +
+                                   block_index * secure_block_length +
+                                   block_length),
+          kTagLength);
+      VLOG(2) << "Adding auth tag as leaf to rebuild Merkle tree: "
+              << absl::BytesToHexString(tag_string);
+      file_ctrl->ad->AddLeaf(tag_string);
     }
   }
 
   VLOG(2) << "Pushed block auth tags on initialization.";
 
-  // Prepare file data digest.
-  DataDigest data_digest;
-  std::copy_n(
-      reinterpret_cast<const uint8_t *>(file_ctrl->ad->CurrentRoot().data()),
-      kRootHashLength, data_digest.data());
-  data_digest.file_size = file_header.file_size;
-
-  // Validate AD root and the file size.
+  // Validate AD root, the file size and the file layout.
   FileHash new_hash;
-  if (!cryptor->GetAuthTag(new_hash.data(), data_digest.data(),
-                           sizeof(DataDigest))) {
-    LOG(ERROR) << "Failed to generate CMAC for integrity verification, root="
-               << file_ctrl->ad->CurrentRoot();
+  if (!ComputeFileHash(*file_ctrl, *cryptor, file_ctrl->ad->CurrentRoot(),
+                       file_header.file_size, &new_hash)) {
+    LOG(ERROR) << "Failed to generate CMAC for integrity verification, path="
+               << file_ctrl->path;
     return false;
   }
 
@@ -274,18 +438,31 @@ bool AeadHandler::InitializeFile(int fd, const char *path_name,
 
   VLOG(2) << "Initializing secure file, fd = " << fd
           << ", path_name = " << path_name;
+  std::shared_ptr<FileControl> file_ctrl;
   auto path_it = opened_files_.find(path_name);
-  std::shared_ptr<FileControl> file_ctrl =
-      (path_it == opened_files_.end())
-          ? std::make_shared<FileControl>(path_name, is_new_file)
-          : path_it->second;
+  if (path_it != opened_files_.end()) {
+    file_ctrl = path_it->second.file_ctrl;
+    path_it->second.descriptor_count++;
+  } else {
+    // New files are created in the versioned layout with the default block
+    // length, the layout of existing files is recorded in their header.
+    size_t header_length = kFileHeaderLength;
+    size_t block_length = kDefaultBlockLength;
+    if (!is_new_file && !ReadLayout(path_name, &header_length, &block_length)) {
+      return false;
+    }
+    file_ctrl = std::make_shared<FileControl>(
+        next_file_id_++, path_name, is_new_file, header_length, block_length);
+    opened_files_.emplace(path_name, OpenedFile{file_ctrl, 1});
+  }
   fmap_.emplace(fd, file_ctrl);
-  opened_files_.emplace(path_name, file_ctrl);
 
   return true;
 }
 
-bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
+bool AeadHandler::RetrieveLogicalOffset(int fd, const FileControl &file_ctrl,
+                                        off_t *logical_offset) const {
+  file_ctrl.mu.AssertReaderHeld();
   if (fd < 0) {
     errno = EINVAL;
     return false;
@@ -297,7 +474,8 @@ bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
     return false;
   }
 
-  *logical_offset = offset_translator_->PhysicalToLogical(physical_offset);
+  *logical_offset =
+      file_ctrl.offset_translator->PhysicalToLogical(physical_offset);
   if (*logical_offset == OffsetTranslator::kInvalidOffset) {
     LOG(ERROR) << "The file is corrupted, fd = " << fd;
     return false;
@@ -306,15 +484,27 @@ bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
   return true;
 }
 
+bool AeadHandler::MoveCursor(int fd, const FileControl &file_ctrl,
+                             off_t logical_offset) const {
+  file_ctrl.mu.AssertReaderHeld();
+  const off_t physical_offset =
+      file_ctrl.offset_translator->LogicalToPhysical(logical_offset);
+  if (enc_untrusted_lseek(fd, physical_offset, SEEK_SET) == -1) {
+    LOG(ERROR) << "Failed lseek to the end of the accessed range, fd = " << fd;
+    return false;
+  }
+  return true;
+}
+
 GcmCryptor *AeadHandler::GetGcmCryptor(const FileControl &file_ctrl) const {
-  file_ctrl.mu.AssertHeld();
+  file_ctrl.mu.AssertReaderHeld();
   if (!file_ctrl.master_key) {
     LOG(ERROR) << "Master key has not been set, path = " << file_ctrl.path;
     return nullptr;
   }
 
   GcmCryptor *cryptor = GcmCryptorRegistry::GetInstance().GetGcmCryptor(
-      kBlockLength, *file_ctrl.master_key);
+      file_ctrl.block_length, *file_ctrl.master_key);
   if (!cryptor) {
     LOG(ERROR) << "Unable to instantiate GCM cryptor.";
   }
@@ -328,33 +518,69 @@ ssize_t AeadHandler::DecryptAndVerify(int fd, void *buf, size_t count) {
     return -1;
   }
 
-  off_t logical_offset;
-  if (!RetrieveLogicalOffset(fd, &logical_offset)) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to read from an unopened file, fd = " << fd;
     return -1;
   }
 
-  std::shared_ptr<FileControl> file_ctrl;
-  {
-    absl::MutexLock global_lock(&mu_);
+  // Other descriptors of the file may buffer writes between the buffered data
+  // being written out and the lock being taken, so check again under the lock.
+  while (true) {
+    if (!FlushPendingWritesForRead(file_ctrl.get())) {
+      return -1;
+    }
 
-    auto entry = fmap_.find(fd);
-    if (entry == fmap_.end()) {
-      LOG(ERROR) << "Attempt made to read from an unopened file, fd = " << fd;
-      errno = ENOENT;
+    absl::ReaderMutexLock lock(&file_ctrl->mu);
+    if (!file_ctrl->pending.empty()) {
+      continue;
+    }
+
+    off_t logical_offset;
+    if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
+      return -1;
+    }
+
+    ssize_t read_count =
+        DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, logical_offset);
+    if (read_count > 0 &&
+        !MoveCursor(fd, *file_ctrl, logical_offset + read_count)) {
       return -1;
     }
+    return read_count;
+  }
+}
 
-    file_ctrl = entry->second;
+ssize_t AeadHandler::DecryptAndVerify(int fd, void *buf, size_t count,
+                                      off_t offset) {
+  if (!buf || offset < 0) {
+    errno = EINVAL;
+    return -1;
   }
 
-  absl::MutexLock lock(&file_ctrl->mu);
-  return DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, logical_offset);
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to read from an unopened file, fd = " << fd;
+    return -1;
+  }
+
+  // As above, buffered writes may be made before the lock is taken.
+  while (true) {
+    if (!FlushPendingWritesForRead(file_ctrl.get())) {
+      return -1;
+    }
+
+    absl::ReaderMutexLock lock(&file_ctrl->mu);
+    if (file_ctrl->pending.empty()) {
+      return DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, offset);
+    }
+  }
 }
 
 ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
                                               const FileControl &file_ctrl,
                                               off_t logical_offset) const {
-  file_ctrl.mu.AssertHeld();
+  file_ctrl.mu.AssertReaderHeld();
   if (count == 0) {
     return 0;
   }
@@ -369,72 +595,62 @@ ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
     count = file_ctrl.logical_size - logical_offset;
   }
 
+  const OffsetTranslator &offset_translator = *file_ctrl.offset_translator;
+  const size_t block_length = file_ctrl.block_length;
+  const size_t cipher_block_length = file_ctrl.cipher_block_length();
+  const size_t secure_block_length = file_ctrl.secure_block_length();
+
   // Determine data breakdown into logical blocks.
   size_t first_partial_block_bytes_count;
   size_t last_partial_block_bytes_count;
   size_t full_inclusive_blocks_bytes_count;
-  offset_translator_->ReduceLogicalRangeToFullLogicalBlocks(
+  offset_translator.ReduceLogicalRangeToFullLogicalBlocks(
       logical_offset, count, &first_partial_block_bytes_count,
       &last_partial_block_bytes_count, &full_inclusive_blocks_bytes_count);
 
-  // Use single read buffer to minimize the number of read calls to the host.
-  std::vector<uint8_t> buffer;
-  const size_t physical_bytes_count =
-      (full_inclusive_blocks_bytes_count / kBlockLength) * kSecureBlockLength;
-  buffer.resize(physical_bytes_count);
-
-  // Move cursor to the first full block to read.
-  const off_t first_logical_block_offset =
-      (first_partial_block_bytes_count > 0)
-          ? (logical_offset + first_partial_block_bytes_count - kBlockLength)
-          : logical_offset;
-  const off_t first_physical_block_offset =
-      offset_translator_->LogicalToPhysical(first_logical_block_offset);
-  if (first_partial_block_bytes_count > 0) {
-    off_t offset =
-        enc_untrusted_lseek(fd, first_physical_block_offset, SEEK_SET);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek to the fist block offset when reading file data.";
-      return -1;
-    }
-  }
+  const int64_t blocks_read_max =
+      full_inclusive_blocks_bytes_count / block_length;
+  const size_t physical_bytes_count = blocks_read_max * secure_block_length;
 
-  // Perform the read. Read may have been requested beyond EOF - cannot require
-  // that bytes_read is equal to physical_bytes_count. The read was not
-  // requested at EOF - checked this above.
-  ssize_t bytes_read =
-      enc_untrusted_read(fd, buffer.data(), physical_bytes_count);
-  if (bytes_read <= 0) {
-    LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
-    return -1;
-  }
+  // Reading starts at the first full block of the range. The range may start
+  // and end within the same block.
+  const size_t in_block_offset = logical_offset % block_length;
+  const off_t first_logical_block_offset = logical_offset - in_block_offset;
+  const off_t first_physical_block_offset =
+      offset_translator.LogicalToPhysical(first_logical_block_offset);
 
-  // Process only complete blocks read, since need per-block metadata to decrypt
-  // the block.
-  bytes_read = (bytes_read / kSecureBlockLength) * kSecureBlockLength;
-  if (bytes_read == 0) {
-    LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
-    return -1;
-  }
+  const off_t first_block_index =
+      (first_physical_block_offset - file_ctrl.header_length) /
+      secure_block_length;
 
-  // Move cursor to the position of the end of the read range.
-  off_t new_cur_logical_offset = logical_offset + count;
-  if (bytes_read != physical_bytes_count) {
-    int64_t blocks_not_read =
-        (physical_bytes_count - bytes_read) / kSecureBlockLength;
-    if (last_partial_block_bytes_count > 0) {
-      new_cur_logical_offset -= last_partial_block_bytes_count;
-      blocks_not_read--;
+  // Returns the number of plaintext bytes of block |block_index| of the range
+  // that are returned to the caller.
+  auto plaintext_length = [&](int64_t block_index) -> size_t {
+    if (block_index == 0 && first_partial_block_bytes_count > 0) {
+      return first_partial_block_bytes_count;
+    }
+    if (block_index == blocks_read_max - 1 &&
+        last_partial_block_bytes_count > 0) {
+      return last_partial_block_bytes_count;
+    }
+    return block_length;
+  };
+
+  // Serve the range from the block cache if all of its blocks are cached.
+  const bool use_cache = blocks_read_max <= kMaxCachedReadBlocks;
+  if (use_cache) {
+    bool cached = true;
+    for (int64_t block_index = 0; cached && block_index < blocks_read_max;
+         block_index++) {
+      cached = block_cache_.Lookup(
+          file_ctrl.id, first_block_index + block_index,
+          block_index == 0 ? in_block_offset : 0, plaintext_length(block_index),
+          GetPlaintextBuffer(first_partial_block_bytes_count, block_index,
+                             block_length, buf));
+    }
+    if (cached) {
+      return count;
     }
-    new_cur_logical_offset -= blocks_not_read * kBlockLength;
-  }
-  const off_t new_cur_physical_offset =
-      offset_translator_->LogicalToPhysical(new_cur_logical_offset);
-  off_t offset = enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET);
-  if (offset == -1) {
-    LOG(ERROR) << "Failed lseek to the end of read range.";
-    return -1;
   }
 
   GcmCryptor *cryptor = GetGcmCryptor(file_ctrl);
@@ -442,97 +658,159 @@ ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
     return -1;
   }
 
-  // Cycle through blocks.
-  const int64_t blocks_read = bytes_read / kSecureBlockLength;
-  const int64_t blocks_read_max = physical_bytes_count / kSecureBlockLength;
-  const off_t first_block_index =
-      (first_physical_block_offset - sizeof(FileHeader)) / kSecureBlockLength;
-  size_t read_count = 0;
-  for (int64_t block_index = 0; block_index < blocks_read; block_index++) {
+  // Verifies and decrypts block |block_index| of the range from |secure_block|
+  // into |buf|, via |bounce_block| if only part of the block is returned.
+  auto decrypt_block = [&](int64_t block_index, const uint8_t *secure_block,
+                           std::vector<uint8_t> *bounce_block) -> bool {
     const size_t merkle_block_idx = first_block_index + block_index + 1;
 
-    uint8_t *plaintext_data =
-        GetPlaintextBuffer(first_partial_block_bytes_count, block_index, buf);
+    uint8_t *plaintext_data = GetPlaintextBuffer(
+        first_partial_block_bytes_count, block_index, block_length, buf);
+
+    // Target for decryption - bounce block or the supplied buffer.
+    uint8_t *decrypt_target = plaintext_data;
+    if (plaintext_length(block_index) != block_length) {
+      bounce_block->resize(block_length);
+      decrypt_target = bounce_block->data();
+    }
 
     // Detect full blocks that belong to sparse regions in the file - no need to
     // decrypt.
-    if (file_ctrl.ad->LeafHash(merkle_block_idx) == file_ctrl.zero_hash) {
+    std::string leaf_hash = file_ctrl.ad->LeafHash(merkle_block_idx);
+    if (leaf_hash == file_ctrl.zero_hash) {
       VLOG(2) << "A sparse region block detected.";
-      memset(plaintext_data, 0, kBlockLength);
-      read_count += kBlockLength;
-      continue;
+      memset(decrypt_target, 0, block_length);
+    } else {
+      CiphertextView ciphertext(secure_block, cipher_block_length);
+      VLOG(2) << "Ciphertext read: "
+              << absl::BytesToHexString(absl::string_view(
+                     reinterpret_cast<const char *>(ciphertext.data()),
+                     cipher_block_length));
+
+      TagView tag(secure_block + block_length, kTagLength);
+      VLOG(2) << "Auth tag read: "
+              << absl::BytesToHexString(absl::string_view(
+                     reinterpret_cast<const char *>(tag.data()), kTagLength));
+
+      TokenView token(secure_block + cipher_block_length, kTokenLength);
+      VLOG(2) << "Token read: "
+              << absl::BytesToHexString(absl::string_view(
+                     reinterpret_cast<const char *>(token.data()),
+                     kTokenLength));
+
+      // Note: Verifying integrity tag will be replaced with integrity
+      // verification against AD root if/when AD tree will be stored in a file
+      // (i.e. if/when optimizing integrity assurance for large files).
+      if (leaf_hash !=
+          file_ctrl.ad->LeafHash(std::string(
+              reinterpret_cast<const char *>(tag.data()), kTagLength))) {
+        LOG(ERROR) << "Integrity verification failed, fd = " << fd;
+        return false;
+      }
+
+      if (!cryptor->DecryptBlock(ciphertext.data(), token.data(),
+                                 decrypt_target)) {
+        LOG(ERROR) << "Decryption failed, fd = " << fd;
+        return false;
+      }
     }
 
-    CiphertextView ciphertext(buffer.data() + block_index * kSecureBlockLength,
-                              kCipherBlockLength);
-    VLOG(2) << "Ciphertext read: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(ciphertext.data()),
-                   kCipherBlockLength));
-
-    TagView tag(buffer.data() + block_index * kSecureBlockLength + kBlockLength,
-                kTagLength);
-    VLOG(2) << "Auth tag read: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(tag.data()), kTagLength));
+    if (use_cache) {
+      block_cache_.Insert(file_ctrl.id, first_block_index + block_index,
+                          decrypt_target, block_length);
+    }
 
-    TokenView token(
-        buffer.data() + block_index * kSecureBlockLength + kCipherBlockLength,
-        kTokenLength);
-    VLOG(2) << "Token read: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(token.data()), kTokenLength));
-
-    // Note: Verifying integrity tag will be replaced with integrity
-    // verification against AD root if/when AD tree will be stored in a file
-    // (i.e. if/when optimizing integrity assurance for large files).
-    if (file_ctrl.ad->LeafHash(merkle_block_idx) !=
-        file_ctrl.ad->LeafHash(std::string(
-            reinterpret_cast<const char *>(tag.data()), kTagLength))) {
-      LOG(ERROR) << "Integrity verification failed, fd = " << fd;
+    // Copy content from the bounce buffer, if used.
+    if (block_index == 0 && first_partial_block_bytes_count > 0) {
+      std::copy_n(bounce_block->begin() + in_block_offset,
+                  first_partial_block_bytes_count, plaintext_data);
+    } else if (decrypt_target != plaintext_data) {
+      std::copy_n(bounce_block->begin(), last_partial_block_bytes_count,
+                  plaintext_data);
+    }
+    return true;
+  };
+
+  // The range is read in chunks, which are decrypted by the worker pool while
+  // the next chunk is read from the host. Read may have been requested beyond
+  // EOF - a chunk shorter than requested ends the read.
+  const int64_t chunk_blocks = std::min<int64_t>(
+      blocks_read_max,
+      std::max<size_t>(1, kPipelineChunkLength / secure_block_length));
+  const size_t min_parallel_blocks =
+      std::max<size_t>(1, kMinParallelLength / block_length);
+  std::vector<uint8_t> chunks[2];
+  chunks[0].resize(chunk_blocks * secure_block_length);
+  if (chunk_blocks < blocks_read_max) {
+    chunks[1].resize(chunk_blocks * secure_block_length);
+  }
+
+  // Reads the chunk starting at block |chunk_first| of the range into |chunk|.
+  // Returns the number of complete blocks read, since per-block metadata is
+  // needed to decrypt a block, or -1 on error.
+  auto read_chunk = [&](int64_t chunk_first, uint8_t *chunk) -> int64_t {
+    const size_t length =
+        std::min(chunk_blocks, blocks_read_max - chunk_first) *
+        secure_block_length;
+    ssize_t bytes_read =
+        pread_all(fd, chunk, length,
+                  first_physical_block_offset +
+                      chunk_first * secure_block_length);
+    if (bytes_read < 0) {
+      LOG(ERROR) << "Failed to read file data, fd = " << fd;
       return -1;
     }
+    return bytes_read / secure_block_length;
+  };
 
-    // Bounce block for reading partial blocks at the ends of the full range.
-    Block bounce_block;
-    // Target for decryption - bounce block or the supplied buffer.
-    uint8_t *decrypt_target;
-    // Determine the target depending on whether the read block is at the end of
-    // the full range.
-    if ((block_index == 0 && first_partial_block_bytes_count > 0) ||
-        (block_index == blocks_read_max - 1 &&
-         last_partial_block_bytes_count > 0)) {
-      decrypt_target = bounce_block.data();
-    } else {
-      decrypt_target = plaintext_data;
+  WorkerPool &pool = worker_pool_;
+  int64_t blocks_read = 0;
+  int64_t chunk_blocks_read = read_chunk(0, chunks[0].data());
+  if (chunk_blocks_read <= 0) {
+    LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
+    return -1;
+  }
+  for (int current = 0; chunk_blocks_read > 0; current = 1 - current) {
+    const int64_t chunk_first = blocks_read;
+    const uint8_t *chunk = chunks[current].data();
+    blocks_read += chunk_blocks_read;
+
+    std::function<bool(size_t, size_t)> decrypt_range =
+        [&](size_t begin, size_t end) {
+          std::vector<uint8_t> bounce_block;
+          for (size_t block = begin; block < end; block++) {
+            if (!decrypt_block(chunk_first + block,
+                               chunk + block * secure_block_length,
+                               &bounce_block)) {
+              return false;
+            }
+          }
+          return true;
+        };
+    std::vector<WorkerPool::Task> tasks =
+        pool.SplitRange(chunk_blocks_read, min_parallel_blocks, decrypt_range);
+
+    int64_t next_chunk_blocks_read = 0;
+    if (chunk_blocks_read == chunk_blocks && blocks_read < blocks_read_max) {
+      uint8_t *next_chunk = chunks[1 - current].data();
+      tasks.emplace_back([&, next_chunk] {
+        next_chunk_blocks_read = read_chunk(blocks_read, next_chunk);
+        return next_chunk_blocks_read >= 0;
+      });
     }
-
-    // Decrypt the block.
-    if (!cryptor->DecryptBlock(ciphertext.data(), token.data(),
-                               decrypt_target)) {
-      LOG(ERROR) << "Decryption failed, fd = " << fd;
+    if (!pool.Run(std::move(tasks))) {
       return -1;
     }
+    chunk_blocks_read = next_chunk_blocks_read;
+  }
 
-    // Copy content from the bounce buffer, if used. Increment the count of read
-    // bytes.
-    if (block_index == 0 && first_partial_block_bytes_count > 0) {
-      std::copy_n(
-          bounce_block.begin() + kBlockLength - first_partial_block_bytes_count,
-          first_partial_block_bytes_count, plaintext_data);
-      read_count += first_partial_block_bytes_count;
-    } else if (block_index == blocks_read_max - 1 &&
-               last_partial_block_bytes_count > 0) {
-      std::copy_n(bounce_block.begin(), last_partial_block_bytes_count,
-                  plaintext_data);
-      read_count += last_partial_block_bytes_count;
-    } else {
-      read_count += kBlockLength;
-    }
+  size_t read_count = 0;
+  for (int64_t block_index = 0; block_index < blocks_read; block_index++) {
+    read_count += plaintext_length(block_index);
   }
 
   VLOG(2) << "Verified read blocks, blocks_read = " << blocks_read
-          << ", bytes_read = " << bytes_read;
+          << ", bytes_read = " << blocks_read * secure_block_length;
   return read_count;
 }
 
@@ -554,30 +832,23 @@ bool AeadHandler::UpdateDigest(FileControl *file_ctrl,
   FdCloser fd_closer(fd, &enc_untrusted_close);
 
   std::string root = file_ctrl->ad->CurrentRoot();
-  if (root.size() != kRootHashLength) {
-    LOG(ERROR) << "Unexpected size of root hash encountered, size="
-               << root.size();
-    return false;
-  }
-
-  // Prepare file data digest.
-  DataDigest data_digest;
-  std::copy_n(reinterpret_cast<const uint8_t *>(root.data()), kRootHashLength,
-              data_digest.data());
-  data_digest.file_size = file_ctrl->logical_size;
-
   FileHeader header;
-  if (!cryptor.GetAuthTag(header.data(), data_digest.data(),
-                          sizeof(DataDigest))) {
-    LOG(ERROR) << "Failed to generate CMAC, root = " << root;
+  if (!ComputeFileHash(*file_ctrl, cryptor, root, file_ctrl->logical_size,
+                       &header.file_hash)) {
     return false;
   }
   header.file_size = file_ctrl->logical_size;
+  header.magic = kFileHeaderMagic;
+  header.block_length = file_ctrl->block_length;
+  header.reserved = 0;
 
+  // Legacy files keep their layout - only the legacy part of the header is
+  // written.
   VLOG(2) << "Updating the digest for file: " << file_ctrl->path
           << ", root hash: " << absl::BytesToHexString(root);
-  ssize_t bytes_written = write_all(fd, header.data(), sizeof(FileHeader));
-  if (bytes_written != sizeof(FileHeader)) {
+  ssize_t bytes_written =
+      write_all(fd, header.data(), file_ctrl->header_length);
+  if (bytes_written != file_ctrl->header_length) {
     LOG(ERROR) << "Failed to write full digest to file, path="
                << file_ctrl->path << ", bytes written = " << bytes_written;
     return false;
@@ -593,13 +864,21 @@ bool AeadHandler::UpdateDigest(FileControl *file_ctrl,
 }
 
 bool AeadHandler::ReadFullBlock(const FileControl &file_ctrl,
-                                off_t logical_offset, Block *block) const {
-  file_ctrl.mu.AssertHeld();
-  if (logical_offset < 0 || logical_offset % kBlockLength != 0) {
+                                off_t logical_offset, uint8_t *block) const {
+  file_ctrl.mu.AssertReaderHeld();
+  const size_t block_length = file_ctrl.block_length;
+  if (logical_offset < 0 || logical_offset % block_length != 0) {
     errno = EINVAL;
     return false;
   }
 
+  // Blocks beyond the end of the file on the host have not been written yet.
+  if (file_ctrl.offset_translator->LogicalToPhysical(logical_offset) >=
+      file_ctrl.physical_size()) {
+    memset(block, 0, block_length);
+    return true;
+  }
+
   int fd = enc_untrusted_open(file_ctrl.path.c_str(), O_RDONLY);
   if (fd == -1) {
     LOG(ERROR) << "Failed to open file to read a block, path=" << file_ctrl.path
@@ -609,21 +888,14 @@ bool AeadHandler::ReadFullBlock(const FileControl &file_ctrl,
 
   FdCloser fd_closer(fd, &enc_untrusted_close);
 
-  off_t physical_offset = offset_translator_->LogicalToPhysical(logical_offset);
-  off_t offset = enc_untrusted_lseek(fd, physical_offset, SEEK_SET);
-  if (offset == -1) {
-    LOG(ERROR) << "Failed lseek when reading a full block.";
-    return false;
-  }
-
-  ssize_t bytes_read = DecryptAndVerifyInternal(fd, block->data(), kBlockLength,
+  ssize_t bytes_read = DecryptAndVerifyInternal(fd, block, block_length,
                                                 file_ctrl, logical_offset);
   if (bytes_read == -1) {
-    return -1;
+    return false;
   }
 
-  if (bytes_read < kBlockLength) {
-    memset(block->data() + bytes_read, 0, kBlockLength - bytes_read);
+  if (bytes_read < block_length) {
+    memset(block + bytes_read, 0, block_length - bytes_read);
   }
 
   return true;
@@ -635,23 +907,43 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
     return -1;
   }
 
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to write to an unopened file, fd = " << fd;
+    return -1;
+  }
+
+  if (count == 0) {
+    return 0;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+
   off_t logical_offset;
-  if (!RetrieveLogicalOffset(fd, &logical_offset)) {
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
     return -1;
   }
 
-  std::shared_ptr<FileControl> file_ctrl;
-  {
-    absl::MutexLock global_lock(&mu_);
+  ssize_t write_count =
+      Write(fd, buf, count, file_ctrl.get(), logical_offset);
+  if (write_count > 0 &&
+      !MoveCursor(fd, *file_ctrl, logical_offset + write_count)) {
+    return -1;
+  }
+  return write_count;
+}
 
-    auto entry = fmap_.find(fd);
-    if (entry == fmap_.end()) {
-      LOG(ERROR) << "Attempt made to write to an unopened file, fd = " << fd;
-      errno = ENOENT;
-      return -1;
-    }
+ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count,
+                                       off_t offset) {
+  if (!buf || offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
 
-    file_ctrl = entry->second;
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to write to an unopened file, fd = " << fd;
+    return -1;
   }
 
   if (count == 0) {
@@ -659,39 +951,56 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   }
 
   absl::MutexLock lock(&file_ctrl->mu);
+  return Write(fd, buf, count, file_ctrl.get(), offset);
+}
+
+ssize_t AeadHandler::EncryptAndPersistInternal(int fd, const void *buf,
+                                               size_t count,
+                                               FileControl *file_ctrl,
+                                               off_t logical_offset) {
+  file_ctrl->mu.AssertHeld();
+  const OffsetTranslator &offset_translator = *file_ctrl->offset_translator;
+  const size_t block_length = file_ctrl->block_length;
+  const size_t cipher_block_length = file_ctrl->cipher_block_length();
+  const size_t secure_block_length = file_ctrl->secure_block_length();
 
   // Determine data breakdown into logical blocks.
   size_t first_partial_block_bytes_count;
   size_t last_partial_block_bytes_count;
   size_t full_inclusive_blocks_bytes_count;
-  offset_translator_->ReduceLogicalRangeToFullLogicalBlocks(
+  offset_translator.ReduceLogicalRangeToFullLogicalBlocks(
       logical_offset, count, &first_partial_block_bytes_count,
       &last_partial_block_bytes_count, &full_inclusive_blocks_bytes_count);
 
+  // Note: the range may start and end within the same block - the first block
+  // of the range starts at the block boundary preceding |logical_offset|.
+  const size_t in_block_offset = logical_offset % block_length;
+  const off_t first_logical_block_offset = logical_offset - in_block_offset;
+
   // Bounce block for writing the first partial block in the range, if any.
-  Block first_block;
+  std::vector<uint8_t> first_block;
   if (first_partial_block_bytes_count > 0) {
-    if (!ReadFullBlock(
-            *file_ctrl,
-            logical_offset + first_partial_block_bytes_count - kBlockLength,
-            &first_block)) {
+    first_block.resize(block_length);
+    if (!ReadFullBlock(*file_ctrl, first_logical_block_offset,
+                       first_block.data())) {
       LOG(ERROR)
           << "failed to read the first misaligned block when writing, fd = "
           << fd;
       return -1;
     }
 
-    std::copy_n(
-        reinterpret_cast<const uint8_t *>(buf), first_partial_block_bytes_count,
-        first_block.data() + kBlockLength - first_partial_block_bytes_count);
+    std::copy_n(reinterpret_cast<const uint8_t *>(buf),
+                first_partial_block_bytes_count,
+                first_block.data() + in_block_offset);
   }
 
   // Bounce block for writing the last partial block in the range, if any.
-  Block last_block;
+  std::vector<uint8_t> last_block;
   if (last_partial_block_bytes_count > 0) {
+    last_block.resize(block_length);
     if (!ReadFullBlock(*file_ctrl,
                        logical_offset + count - last_partial_block_bytes_count,
-                       &last_block)) {
+                       last_block.data())) {
       LOG(ERROR)
           << "failed to read the last misaligned block when writing, fd = "
           << fd;
@@ -703,19 +1012,15 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
                 last_partial_block_bytes_count, last_block.data());
   }
 
-  const off_t first_logical_block_offset =
-      (first_partial_block_bytes_count > 0)
-          ? (logical_offset + first_partial_block_bytes_count - kBlockLength)
-          : logical_offset;
   const off_t first_physical_block_offset =
-      offset_translator_->LogicalToPhysical(first_logical_block_offset);
+      offset_translator.LogicalToPhysical(first_logical_block_offset);
   const int64_t eof_block_index = file_ctrl->ad->LeafCount();
   int64_t start_block_to_write = 0;
   if (first_physical_block_offset > file_ctrl->physical_size()) {
     // Append leafs to the Merkle Tree to account for sparse region blocks.
     int64_t sparse_blocks_count =
         (first_physical_block_offset - file_ctrl->physical_size()) /
-        kSecureBlockLength;
+        secure_block_length;
     for (int64_t idx = 0; idx < sparse_blocks_count; idx++) {
       VLOG(2) << "Adding an empty auth tag to AD for a block "
                  "from a sparse region: "
@@ -726,7 +1031,7 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   } else {
     int64_t blocks_to_eof =
         (file_ctrl->physical_size() - first_physical_block_offset) /
-        kSecureBlockLength;
+        secure_block_length;
     start_block_to_write = eof_block_index - blocks_to_eof;
   }
 
@@ -737,18 +1042,17 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
 
   VLOG(2) << "Writing data to file, count = " << count << ", fd = " << fd;
 
-  // Use single write buffer to minimize the number of write calls to the host.
-  std::vector<uint8_t> buffer;
   const int64_t blocks_to_write =
-      full_inclusive_blocks_bytes_count / kBlockLength;
-  const size_t physical_bytes_count = blocks_to_write * kSecureBlockLength;
-  buffer.resize(physical_bytes_count);
+      full_inclusive_blocks_bytes_count / block_length;
+  block_cache_.Invalidate(file_ctrl->id, start_block_to_write,
+                          start_block_to_write + blocks_to_write);
 
-  // Cycle through blocks.
-  std::vector<Tag> tags;
-  for (int64_t block_index = 0; block_index < blocks_to_write; block_index++) {
-    const uint8_t *plaintext_data =
-        GetPlaintextBuffer(first_partial_block_bytes_count, block_index, buf);
+  // Encrypts block |block_index| of the range into |secure_block|, and saves
+  // its auth tag in |tags|.
+  std::vector<Tag> tags(blocks_to_write);
+  auto encrypt_block = [&](int64_t block_index, uint8_t *secure_block) {
+    const uint8_t *plaintext_data = GetPlaintextBuffer(
+        first_partial_block_bytes_count, block_index, block_length, buf);
 
     // Source for encryption - bounce block or the supplied buffer.
     const uint8_t *encrypt_source;
@@ -763,43 +1067,30 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
       encrypt_source = plaintext_data;
     }
 
-    Ciphertext *ciphertext =
-        Ciphertext::Place(&buffer, block_index * kSecureBlockLength);
-    Token *token = Token::Place(
-        &buffer, block_index * kSecureBlockLength + kCipherBlockLength);
+    uint8_t *ciphertext = secure_block;
+    uint8_t *token = ciphertext + cipher_block_length;
 
     // Encrypt the block.
-    if (!cryptor->EncryptBlock(encrypt_source, token->data(),
-                               ciphertext->data())) {
+    if (!cryptor->EncryptBlock(encrypt_source, token, ciphertext)) {
       LOG(ERROR) << "Encryption failed, fd = " << fd;
-      return -1;
+      return false;
     }
     VLOG(2) << "Ciphertext generated: "
             << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(ciphertext->data()),
-                   kBlockLength));
+                   reinterpret_cast<const char *>(ciphertext),
+                   block_length));
     VLOG(2) << "Token generated: "
             << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(token->data()),
+                   reinterpret_cast<const char *>(token),
                    kTokenLength));
 
-    TagView tag(ciphertext->data() + kBlockLength, kTagLength);
-    tags.push_back(tag);
+    TagView tag(ciphertext + block_length, kTagLength);
+    tags[block_index] = Tag(tag);
     VLOG(2) << "Auth tag generated: "
             << absl::BytesToHexString(absl::string_view(
                    reinterpret_cast<const char *>(tag.data()), kTagLength));
-  }
-
-  // Move cursor to the first full block to write.
-  if (first_partial_block_bytes_count > 0) {
-    off_t offset =
-        enc_untrusted_lseek(fd, first_physical_block_offset, SEEK_SET);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek to the fist block offset when writing file data.";
-      return -1;
-    }
-  }
+    return true;
+  };
 
   // Note: with block alignment constraint in place, partial block writes are
   // not permissible - complete blocks must be written. Thus, the options are:
@@ -809,24 +1100,66 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   //    on error or when all data has been written, following the POSIX model -
   //    this may lead to "long" writes when "large" amount of data is written.
   // In this code optimize operation for full writes - i.e. the option #2.
-  ssize_t bytes_written = write_all(fd, buffer.data(), physical_bytes_count);
-  if (bytes_written != physical_bytes_count) {
-    LOG(ERROR) << "Failed to write encrypted data to file, path="
-               << file_ctrl->path << ", bytes written = " << bytes_written;
-    return -1;
-  }
-
-  // Move cursor to the position of the end of the write range.
-  if (last_partial_block_bytes_count > 0) {
-    off_t new_cur_logical_offset = logical_offset + count;
-    off_t new_cur_physical_offset =
-        offset_translator_->LogicalToPhysical(new_cur_logical_offset);
-    off_t offset = enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek to the last block offset when reading file data.";
+  ssize_t bytes_written = 0;
+  auto write_chunk = [&](const uint8_t *chunk, size_t length) {
+    ssize_t chunk_bytes_written = pwrite_all(
+        fd, chunk, length, first_physical_block_offset + bytes_written);
+    if (chunk_bytes_written != length) {
+      LOG(ERROR) << "Failed to write encrypted data to file, path="
+                 << file_ctrl->path
+                 << ", bytes written = " << bytes_written + chunk_bytes_written;
+      return false;
+    }
+    bytes_written += chunk_bytes_written;
+    return true;
+  };
+
+  // The range is encrypted in chunks by the worker pool, and each chunk is
+  // written to the host while the next one is encrypted.
+  const int64_t chunk_blocks = std::min<int64_t>(
+      blocks_to_write,
+      std::max<size_t>(1, kPipelineChunkLength / secure_block_length));
+  const size_t min_parallel_blocks =
+      std::max<size_t>(1, kMinParallelLength / block_length);
+  std::vector<uint8_t> chunks[2];
+  chunks[0].resize(chunk_blocks * secure_block_length);
+  if (chunk_blocks < blocks_to_write) {
+    chunks[1].resize(chunk_blocks * secure_block_length);
+  }
+
+  WorkerPool &pool = worker_pool_;
+  size_t pending_write_length = 0;
+  for (int64_t chunk_first = 0, current = 0;
+       chunk_first < blocks_to_write || pending_write_length > 0;
+       chunk_first += chunk_blocks, current = 1 - current) {
+    const int64_t chunk_length =
+        std::max<int64_t>(0, std::min(chunk_blocks,
+                                      blocks_to_write - chunk_first));
+    uint8_t *chunk = chunks[current].data();
+    std::function<bool(size_t, size_t)> encrypt_range =
+        [&](size_t begin, size_t end) {
+          for (size_t block = begin; block < end; block++) {
+            if (!encrypt_block(chunk_first + block,
+                               chunk + block * secure_block_length)) {
+              return false;
+            }
+          }
+          return true;
+        };
+    std::vector<WorkerPool::Task> tasks =
+        pool.SplitRange(chunk_length, min_parallel_blocks, encrypt_range);
+
+    if (pending_write_length > 0) {
+      const uint8_t *previous_chunk = chunks[1 - current].data();
+      const size_t previous_chunk_length = pending_write_length;
+      tasks.emplace_back([&write_chunk, previous_chunk, previous_chunk_length] {
+        return write_chunk(previous_chunk, previous_chunk_length);
+      });
+    }
+    if (!pool.Run(std::move(tasks))) {
       return -1;
     }
+    pending_write_length = chunk_length * secure_block_length;
   }
 
   for (int64_t idx = 0; idx < tags.size(); idx++) {
@@ -844,25 +1177,157 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
     }
   }
 
-  file_ctrl->logical_size = logical_offset + count;
+  // Overwriting data within the file does not change its size.
+  file_ctrl->logical_size =
+      std::max<size_t>(file_ctrl->logical_size, logical_offset + count);
 
-  if (!UpdateDigest(file_ctrl.get(), *cryptor)) {
-    return -1;
+  VLOG(2) << "Wrote data to file, bytes_written = " << bytes_written;
+
+  return count;
+}
+
+ssize_t AeadHandler::Write(int fd, const void *buf, size_t count,
+                           FileControl *file_ctrl, off_t logical_offset) {
+  file_ctrl->mu.AssertHeld();
+  if (!file_ctrl->write_back()) {
+    ssize_t write_count =
+        EncryptAndPersistInternal(fd, buf, count, file_ctrl, logical_offset);
+    if (write_count == -1) {
+      return -1;
+    }
+    GcmCryptor *cryptor = GetGcmCryptor(*file_ctrl);
+    if (!cryptor || !UpdateDigest(file_ctrl, *cryptor)) {
+      return -1;
+    }
+    return write_count;
   }
 
-  VLOG(2) << "Wrote data to file, bytes_written = " << bytes_written;
+  // Only writes that extend the buffered range contiguously are buffered.
+  const off_t pending_end =
+      file_ctrl->pending_offset + file_ctrl->pending.size();
+  if (!file_ctrl->pending.empty() &&
+      (logical_offset != pending_end || count >= kWriteBackBufferLength)) {
+    if (!FlushPendingWrites(file_ctrl, /*full_blocks_only=*/false)) {
+      return -1;
+    }
+  }
+
+  file_ctrl->digest_dirty = true;
+  if (count >= kWriteBackBufferLength) {
+    if (EncryptAndPersistInternal(fd, buf, count, file_ctrl, logical_offset) ==
+        -1) {
+      return -1;
+    }
+  } else {
+    if (file_ctrl->pending.empty()) {
+      file_ctrl->pending_offset = logical_offset;
+      file_ctrl->pending_fd = fd;
+      file_ctrl->unbuffered_size = file_ctrl->logical_size;
+    }
+    const uint8_t *data = static_cast<const uint8_t *>(buf);
+    file_ctrl->pending.insert(file_ctrl->pending.end(), data, data + count);
+    file_ctrl->logical_size =
+        std::max<size_t>(file_ctrl->logical_size, logical_offset + count);
+    if (file_ctrl->pending.size() >= kWriteBackBufferLength &&
+        !FlushPendingWrites(file_ctrl, /*full_blocks_only=*/true)) {
+      return -1;
+    }
+  }
 
+  if (absl::Now() - file_ctrl->digest_time >= file_ctrl->digest_interval &&
+      !SyncInternal(file_ctrl)) {
+    return -1;
+  }
   return count;
 }
 
-bool AeadHandler::FinalizeFile(int fd) {
-  absl::MutexLock global_lock(&mu_);
+bool AeadHandler::FlushPendingWrites(FileControl *file_ctrl,
+                                     bool full_blocks_only) {
+  file_ctrl->mu.AssertHeld();
+  size_t flush_length = file_ctrl->pending.size();
+  if (full_blocks_only) {
+    const off_t pending_end = file_ctrl->pending_offset + flush_length;
+    const off_t flush_end = pending_end - pending_end % file_ctrl->block_length;
+    flush_length = std::max<off_t>(0, flush_end - file_ctrl->pending_offset);
+  }
+  if (flush_length == 0) {
+    return true;
+  }
 
+  ssize_t write_count = EncryptAndPersistInternal(
+      file_ctrl->pending_fd, file_ctrl->pending.data(), flush_length, file_ctrl,
+      file_ctrl->pending_offset);
+  if (write_count == -1) {
+    LOG(ERROR) << "Failed to write out buffered data of file, path="
+               << file_ctrl->path;
+    return false;
+  }
+
+  file_ctrl->pending.erase(file_ctrl->pending.begin(),
+                           file_ctrl->pending.begin() + flush_length);
+  file_ctrl->pending_offset += flush_length;
+  file_ctrl->unbuffered_size = std::max<size_t>(file_ctrl->unbuffered_size,
+                                                file_ctrl->pending_offset);
+  return true;
+}
+
+bool AeadHandler::FlushPendingWritesForRead(FileControl *file_ctrl) {
+  {
+    absl::ReaderMutexLock lock(&file_ctrl->mu);
+    if (file_ctrl->pending.empty()) {
+      return true;
+    }
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+  return FlushPendingWrites(file_ctrl, /*full_blocks_only=*/false);
+}
+
+bool AeadHandler::SyncInternal(FileControl *file_ctrl) {
+  file_ctrl->mu.AssertHeld();
+  if (!FlushPendingWrites(file_ctrl, /*full_blocks_only=*/false)) {
+    return false;
+  }
+  if (!file_ctrl->digest_dirty) {
+    return true;
+  }
+
+  GcmCryptor *cryptor = GetGcmCryptor(*file_ctrl);
+  if (!cryptor || !UpdateDigest(file_ctrl, *cryptor)) {
+    return false;
+  }
+  file_ctrl->digest_dirty = false;
+  file_ctrl->digest_time = absl::Now();
+  return true;
+}
+
+bool AeadHandler::FinalizeFile(int fd) {
   if (fd < 0) {
     errno = EINVAL;
     return false;
   }
 
+  // Buffered data and the digest of a write-back file are written out on every
+  // close, while the descriptor buffered writes were made through is still
+  // open. Data that cannot be written out is dropped along with the
+  // descriptor, and the failure is reported.
+  bool synced = true;
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (file_ctrl) {
+    absl::MutexLock lock(&file_ctrl->mu);
+    if (file_ctrl->write_back()) {
+      synced = SyncInternal(file_ctrl.get());
+      if (!synced && file_ctrl->pending_fd == fd) {
+        if (!file_ctrl->pending.empty()) {
+          file_ctrl->logical_size = file_ctrl->unbuffered_size;
+        }
+        file_ctrl->pending.clear();
+      }
+    }
+  }
+
+  absl::MutexLock global_lock(&mu_);
+
   auto entry = fmap_.find(fd);
   if (entry == fmap_.end()) {
     LOG(ERROR) << "Attempt made to finalize uninitialized file, fd = " << fd;
@@ -877,10 +1342,16 @@ bool AeadHandler::FinalizeFile(int fd) {
 
   VLOG(2) << "Finalizing secure file, fd = " << fd
           << ", pathname = " << entry->second->path;
-  opened_files_.erase(entry->second->path);
+  // Other descriptors of the same file keep sharing its control structure.
+  auto path_it = opened_files_.find(entry->second->path);
+  if (path_it != opened_files_.end() &&
+      --path_it->second.descriptor_count == 0) {
+    block_cache_.InvalidateFile(path_it->second.file_ctrl->id);
+    opened_files_.erase(path_it);
+  }
   fmap_.erase(entry);
 
-  return true;
+  return synced;
 }
 
 // Note: questionable whether to allow setting the key only on newly opened
@@ -895,18 +1366,10 @@ int AeadHandler::SetMasterKey(int fd, const uint8_t *key_data,
     return -1;
   }
 
-  std::shared_ptr<FileControl> file_ctrl;
-  {
-    absl::MutexLock global_lock(&mu_);
-
-    auto entry = fmap_.find(fd);
-    if (entry == fmap_.end()) {
-      LOG(ERROR) << "Attempt made to set key on an unopened file, fd = " << fd;
-      errno = ENOENT;
-      return -1;
-    }
-
-    file_ctrl = entry->second;
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to set key on an unopened file, fd = " << fd;
+    return -1;
   }
 
   absl::MutexLock lock(&file_ctrl->mu);
@@ -933,20 +1396,104 @@ int AeadHandler::SetMasterKey(int fd, const uint8_t *key_data,
   return 0;
 }
 
-const OffsetTranslator &AeadHandler::GetOffsetTranslator() const {
-  return *offset_translator_;
+int AeadHandler::SetBlockLength(int fd, size_t block_length) {
+  if (!IsValidBlockLength(block_length)) {
+    LOG(ERROR) << "Attempt made to set an invalid block length, block_length = "
+               << block_length;
+    errno = EINVAL;
+    return -1;
+  }
+
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to set block length on an unopened file, fd = "
+               << fd;
+    return -1;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+
+  if (file_ctrl->block_length == block_length) {
+    return 0;
+  }
+
+  // The layout of a file is fixed once it has been written to disk.
+  if (!file_ctrl->is_new || file_ctrl->is_deserialized) {
+    LOG(ERROR) << "Attempt made to change block length of an existing file, fd="
+               << fd << ", block_length = " << file_ctrl->block_length;
+    errno = EINVAL;
+    return -1;
+  }
+
+  file_ctrl->SetLayout(kFileHeaderLength, block_length);
+  return 0;
+}
+
+ssize_t AeadHandler::GetBlockLength(int fd) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    return -1;
+  }
+
+  absl::ReaderMutexLock lock(&file_ctrl->mu);
+  return file_ctrl->block_length;
+}
+
+int AeadHandler::SetWriteBack(int fd, absl::Duration digest_interval) {
+  if (digest_interval < absl::ZeroDuration()) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to set write-back on an unopened file, fd = "
+               << fd;
+    return -1;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+  if (file_ctrl->write_back() && !SyncInternal(file_ctrl.get())) {
+    return -1;
+  }
+  file_ctrl->digest_interval = digest_interval;
+  file_ctrl->digest_time = absl::Now();
+  return 0;
+}
+
+int AeadHandler::Sync(int fd) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    LOG(ERROR) << "Attempt made to sync an unopened file, fd = " << fd;
+    return -1;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+  return SyncInternal(file_ctrl.get()) ? 0 : -1;
+}
+
+std::shared_ptr<const OffsetTranslator> AeadHandler::GetOffsetTranslator(
+    int fd) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
+    return nullptr;
+  }
+
+  absl::ReaderMutexLock lock(&file_ctrl->mu);
+  return file_ctrl->offset_translator;
 }
 
 off_t AeadHandler::GetLogicalFileSize(int fd) {
-  absl::MutexLock global_lock(&mu_);
-  auto entry = fmap_.find(fd);
-  if (entry == fmap_.end()) {
+  std::shared_ptr<FileControl> file_ctrl = GetFileControl(fd);
+  if (!file_ctrl) {
     LOG(ERROR)
         << "Attempt made to get logical file size on an unopened file, fd = "
         << fd;
     return -1;
   }
-  return entry->second->logical_size;
+
+  absl::ReaderMutexLock lock(&file_ctrl->mu);
+  return file_ctrl->logical_size;
 }
 
 }  // namespace storage
@@ -26,12 +26,17 @@
 #include <unordered_map>
 
 #include "absl/base/attributes.h"
+#include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "asylo/crypto/util/bytes.h"
 #include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
 #include "asylo/platform/storage/secure/authenticated_dictionary.h"
-#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/block_cache.h"
+#include "asylo/platform/storage/secure/compact_authenticated_dictionary.h"
 #include "asylo/platform/storage/utils/offset_translator.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/worker_pool.h"
 
 namespace asylo {
 namespace platform {
@@ -43,9 +48,25 @@ using crypto::gcmlib::kKeyLength;
 using crypto::gcmlib::kTagLength;
 using crypto::gcmlib::kTokenLength;
 
-// Length of file blocks to encrypt/decrypt.
-constexpr size_t kBlockLength = 128;
-using Block = UnsafeBytes<kBlockLength>;
+// Length of file blocks in the legacy secure file layout, which predates
+// per-file block lengths. Files in this layout are still read and updated in
+// place, but new files are always created in the versioned layout.
+constexpr size_t kLegacyBlockLength = 128;
+
+// Bounds on the length of file blocks. The length of a block must be a power of
+// two within these bounds.
+constexpr size_t kMinBlockLength = kLegacyBlockLength;
+constexpr size_t kMaxBlockLength = 64 * 1024;
+
+// Length of file blocks for newly created files, unless specified otherwise.
+constexpr size_t kDefaultBlockLength = 4096;
+
+// Length of plaintext a file in write-back buffers before writing it to the
+// host. Longer writes bypass the buffer.
+constexpr size_t kWriteBackBufferLength = 256 * 1024;
+
+// Default length of verified plaintext blocks cached across all files.
+constexpr size_t kDefaultBlockCacheCapacity = 1024 * 1024;
 
 // Length of the file digest (of the AD root).
 constexpr int64_t kRootHashLength = 32;
@@ -53,11 +74,19 @@ constexpr int64_t kRootHashLength = 32;
 // Length of the hash of the file digest (of the AD root).
 constexpr int64_t kFileHashLength = 16;
 
-// Constants for the secure block structure - the secure block consists of
-// the ciphertext of the same length as the original plaintext, followed by the
-// integrity tag, followed by the encryption token.
-constexpr size_t kCipherBlockLength = kBlockLength + kTagLength;
-constexpr size_t kSecureBlockLength = kCipherBlockLength + kTokenLength;
+// Length of the header of files in the legacy layout.
+constexpr size_t kLegacyFileHeaderLength = kFileHashLength + sizeof(size_t);
+
+// Length of the header of files in the versioned layout.
+constexpr size_t kFileHeaderLength = kLegacyFileHeaderLength + 16;
+
+// Returns the length of a secure block that carries |block_length| bytes of
+// file data. The secure block consists of the ciphertext of the same length as
+// the original plaintext, followed by the integrity tag, followed by the
+// encryption token.
+constexpr size_t SecureBlockLength(size_t block_length) {
+  return block_length + kTagLength + kTokenLength;
+}
 
 using FileHash = UnsafeBytes<kFileHashLength>;
 using FileDigest = UnsafeBytes<kRootHashLength>;
@@ -68,6 +97,22 @@ using FileDigest = UnsafeBytes<kRootHashLength>;
 // supplied file data. Uses enclave-to-host IO delegates to propagate IO calls
 // over the enclave boundary to access file storage outside the enclave.
 //
+// The handler-wide lock is taken exclusively only when files are opened and
+// closed. Operations on an opened file take the lock of that file - reads take
+// it shared and may proceed concurrently, while writes and changes to the file
+// state take it exclusively. Concurrent reads should be issued as positional
+// reads, or on distinct file descriptors, since each cursor-based read moves
+// the cursor of its descriptor.
+//
+// Verified plaintext of blocks read by short reads is kept in a cache shared by
+// all files, so that hot regions of files are neither read from the host nor
+// decrypted again. Writes invalidate the blocks they overwrite.
+//
+// By default every write persists the file digest before returning. A file
+// may instead be switched to write-back with SetWriteBack(), which buffers
+// small writes in the enclave and defers digest updates. See SetWriteBack()
+// for the semantics on a crash.
+//
 // Tracked feature work:
 //
 class AeadHandler {
@@ -89,11 +134,22 @@ class AeadHandler {
   ssize_t DecryptAndVerify(int fd, void *buf, size_t count)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Same as above, but reads at logical offset |offset| without using or
+  // moving the cursor associated with |fd|, as with pread(2). Positional reads
+  // of a file, through the same or different descriptors, run concurrently.
+  ssize_t DecryptAndVerify(int fd, void *buf, size_t count, off_t offset)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
   // Encrypts data and generates integrity metadata for it in memory, writes
   // encrypted data to disk, returns the size of data written, or -1 on failure.
   ssize_t EncryptAndPersist(int fd, const void *buf, size_t count)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Same as above, but writes at logical offset |offset| without using or
+  // moving the cursor associated with |fd|, as with pwrite(2).
+  ssize_t EncryptAndPersist(int fd, const void *buf, size_t count,
+                            off_t offset) ABSL_LOCKS_EXCLUDED(mu_);
+
   // Frees resources used to assure integrity of an opened file, persists
   // integrity metadata to a designated location on disk, returns false on
   // failure. Does not modify the state of the file descriptor.
@@ -106,10 +162,70 @@ class AeadHandler {
   // Returns the logical file size, or -1 on failure.
   off_t GetLogicalFileSize(int fd) ABSL_LOCKS_EXCLUDED(mu_);
 
-  const OffsetTranslator &GetOffsetTranslator() const;
+  // Sets the length of file blocks for a newly created file. The block length
+  // can only be changed before the master key is set on the file. For an
+  // existing file, succeeds only if |block_length| matches the length the file
+  // was created with. Returns 0 on success, or -1 on failure.
+  int SetBlockLength(int fd, size_t block_length) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the length of file blocks, or -1 on failure.
+  ssize_t GetBlockLength(int fd) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Switches an opened file to write-back, or back to write-through if
+  // |digest_interval| is zero. Applies to all descriptors of the file. Returns
+  // 0 on success, or -1 on failure.
+  //
+  // In write-back, contiguous writes shorter than kWriteBackBufferLength are
+  // buffered in the enclave, and are encrypted and written to the host in
+  // batches of full blocks. The digest in the file header is updated by Sync(),
+  // when a descriptor of the file is closed, and by the first write after
+  // |digest_interval| has passed since the last update. Reads of the file
+  // write out buffered data first, hence always observe preceding writes.
+  //
+  // On a crash, buffered writes are lost. Data written to the host since the
+  // last digest update does not match the digest, so the file fails integrity
+  // verification when it is opened again, as it would if the data had been
+  // tampered with. A crash after data was written to the host but before the
+  // next digest update therefore leaves the file unopenable - applications
+  // that need to survive crashes should call Sync() at their commit points, as
+  // with fsync(2).
+  int SetWriteBack(int fd, absl::Duration digest_interval)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes out data buffered for an opened file and updates its digest if it
+  // is out of date. Returns 0 on success, or -1 on failure.
+  int Sync(int fd) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Sets the length of verified plaintext cached across all files, evicting
+  // cached blocks as needed. A capacity of zero disables the cache.
+  void SetBlockCacheCapacity(size_t capacity) {
+    block_cache_.SetCapacity(capacity);
+  }
+
+  // Returns the counters of the block cache.
+  BlockCache::Stats GetBlockCacheStats() const {
+    return block_cache_.GetStats();
+  }
+
+  // Sets the number of enclave threads, in addition to the calling thread,
+  // that reads and writes of many blocks use to encrypt and decrypt blocks
+  // concurrently. Zero processes all blocks on the calling thread, so that
+  // file I/O never starts enclave threads.
+  void SetMaxWorkers(size_t max_workers) {
+    worker_pool_.SetMaxWorkers(max_workers);
+  }
+
+  // Returns the offset translator for the layout of an opened file, or nullptr
+  // if |fd| does not refer to an opened file.
+  std::shared_ptr<const OffsetTranslator> GetOffsetTranslator(int fd)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns true if |block_length| is a supported length of file blocks.
+  static bool IsValidBlockLength(size_t block_length);
 
  private:
-  // Structure represents the file header layout.
+  // Structure represents the file header layout. Files in the legacy layout
+  // have a header that consists of |file_hash| and |file_size| only.
   struct FileHeader {
     // Hash of the DataDigest.
     FileHash file_hash;
@@ -118,6 +234,16 @@ class AeadHandler {
     // FileHash.
     size_t file_size;
 
+    // Identifies the versioned layout - is not present in legacy files.
+    uint64_t magic;
+
+    // Length of file blocks - is incorporated into DataDigest and is protected
+    // by FileHash.
+    uint32_t block_length;
+
+    // Reserved, must be zero.
+    uint32_t reserved;
+
     // Returns the address of the FileHeader instance.
     uint8_t *data() { return file_hash.data(); }
   } ABSL_ATTRIBUTE_PACKED;
@@ -131,12 +257,18 @@ class AeadHandler {
     // Logical file size.
     size_t file_size;
 
+    // Length of file blocks - is not included in the digest of legacy files.
+    uint32_t block_length;
+
     // Returns the address of the DataDigest instance.
     uint8_t *data() { return file_digest.data(); }
   } ABSL_ATTRIBUTE_PACKED;
 
   // File (data set) control structure for an opened file.
   struct FileControl {
+    // Identity of the file in the block cache, distinct each time the file is
+    // opened.
+    const uint64_t id;
     const std::string path;
     size_t logical_size;
     bool is_new;
@@ -145,26 +277,73 @@ class AeadHandler {
     std::string zero_hash;
     std::unique_ptr<GcmCryptorKey> master_key;
 
-    // Mutex for protecting FileControl instance.
+    // Layout of the file - the length of the file header and of the plaintext
+    // of a single block, and the translator for the resulting layout.
+    size_t header_length;
+    size_t block_length;
+    std::shared_ptr<const OffsetTranslator> offset_translator;
+
+    // Write-back state - the interval between digest updates, or zero for
+    // write-through, plaintext of contiguous writes not yet written to the
+    // host, which starts at logical offset |pending_offset|, the descriptor
+    // the writes were made through, the logical size of the file without the
+    // buffered data, whether the digest in the file header is out of date,
+    // and the time of its last update.
+    absl::Duration digest_interval;
+    CleansingVector<uint8_t> pending;
+    off_t pending_offset;
+    int pending_fd;
+    size_t unbuffered_size;
+    bool digest_dirty;
+    absl::Time digest_time;
+
+    // Mutex for protecting FileControl instance. Held shared when reading file
+    // data, and exclusively when modifying the file or the members above.
     absl::Mutex mu;
 
-    FileControl(const char *path_name, bool is_new_file)
-        : path(path_name),
+    FileControl(uint64_t file_id, const char *path_name, bool is_new_file,
+                size_t header_len, size_t block_len)
+        : id(file_id),
+          path(path_name),
           logical_size(0),
           is_new(is_new_file),
           is_deserialized(false),
-          ad(absl::make_unique<CTMMTAuthenticatedDictionary>()) {
+          ad(absl::make_unique<CompactAuthenticatedDictionary>()),
+          digest_interval(absl::ZeroDuration()),
+          pending_offset(0),
+          pending_fd(-1),
+          unbuffered_size(0),
+          digest_dirty(false) {
       UnsafeBytes<kTagLength> tag;
       memset(tag.data(), 0, kTagLength);
       std::string tag_string(reinterpret_cast<char *>(tag.data()), kTagLength);
       zero_hash = ad->LeafHash(tag_string);
+      SetLayout(header_len, block_len);
+    }
+
+    void SetLayout(size_t header_len, size_t block_len) {
+      header_length = header_len;
+      block_length = block_len;
+      offset_translator = OffsetTranslator::Create(header_length, block_length,
+                                                   secure_block_length());
     }
 
+    bool is_legacy() const { return header_length == kLegacyFileHeaderLength; }
+
+    size_t cipher_block_length() const { return block_length + kTagLength; }
+
+    size_t secure_block_length() const {
+      return SecureBlockLength(block_length);
+    }
+
+    bool write_back() const { return digest_interval != absl::ZeroDuration(); }
+
     // NOTE: The physical_size is on block granularity because the block
     // metadata is placed after the block data, hence, only full blocks are
     // written - there are no partial blocks.
-    size_t physical_size() {
-      return sizeof(FileHeader) + ad->LeafCount() * kSecureBlockLength;
+
+    size_t physical_size() const {
+      return header_length + ad->LeafCount() * secure_block_length();
     }
   };
 
@@ -176,9 +355,27 @@ class AeadHandler {
   bool Deserialize(FileControl *file_ctrl)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
+  // Determines the layout of an existing file at |path_name| from its header.
+  // Returns false on failure.
+  static bool ReadLayout(const char *path_name, size_t *header_length,
+                         size_t *block_length);
+
   // Retrieves logical cursor offset associated with a file descriptor |fd|.
   // Returns false on failure.
-  bool RetrieveLogicalOffset(int fd, off_t *logical_offset) const;
+  bool RetrieveLogicalOffset(int fd, const FileControl &file_ctrl,
+                             off_t *logical_offset) const
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Computes the hash of the file data digest - the AD root |root|, the file
+  // size |file_size| and the file layout. Returns false on failure.
+  bool ComputeFileHash(const FileControl &file_ctrl, const GcmCryptor &cryptor,
+                       const std::string &root, size_t file_size,
+                       FileHash *file_hash) const
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Returns the control structure of an opened file, or nullptr with errno set
+  // if |fd| does not refer to an opened file.
+  std::shared_ptr<FileControl> GetFileControl(int fd) ABSL_LOCKS_EXCLUDED(mu_);
 
   // Updates digest of the file data in the secure file header.
   bool UpdateDigest(FileControl *file_ctrl, const GcmCryptor &cryptor) const
@@ -187,21 +384,62 @@ class AeadHandler {
   // Returns an instance of GcmCryptor associated with a file, or nullptr if was
   // not able to retrieve. The caller does not own the instance.
   GcmCryptor *GetGcmCryptor(const FileControl &file_ctrl) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
 
   // Similar to DecryptAndVerify, but is called by internal implementation, and
-  // as such does not take a file lock. The cursor associated with the file
-  // descriptor |fd| is expected to be at the position of |logical_offset|.
+  // as such does not take a file lock. Does not modify |file_ctrl|, hence may
+  // run concurrently with other reads of the file. Reads at |logical_offset|
+  // without using or moving the cursor associated with the file descriptor
+  // |fd|.
   ssize_t DecryptAndVerifyInternal(int fd, void *buf, size_t count,
                                    const FileControl &file_ctrl,
                                    off_t logical_offset) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Similar to EncryptAndPersist, but is called by internal implementation, and
+  // as such does not take a file lock. Writes at |logical_offset| without using
+  // or moving the cursor associated with the file descriptor |fd|. Does not
+  // update the digest of the file.
+  ssize_t EncryptAndPersistInternal(int fd, const void *buf, size_t count,
+                                    FileControl *file_ctrl,
+                                    off_t logical_offset)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Writes |count| bytes of |buf| at |logical_offset| through |fd|, either
+  // immediately, followed by a digest update, or through the write-back buffer.
+  // Returns the number of bytes written, or -1 on failure.
+  ssize_t Write(int fd, const void *buf, size_t count, FileControl *file_ctrl,
+                off_t logical_offset)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Writes buffered data of a write-back file to the host - only its full
+  // blocks if |full_blocks_only|, since a partial last block may still be
+  // extended by the next write. Returns false on failure.
+  bool FlushPendingWrites(FileControl *file_ctrl, bool full_blocks_only)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
-  // Reads a single full block of a file at a specified logical offset. Returns
+  // Writes out all buffered data, if any, so that it can be read back. Returns
   // false on failure.
+  bool FlushPendingWritesForRead(FileControl *file_ctrl)
+      ABSL_LOCKS_EXCLUDED(file_ctrl->mu);
+
+  // Writes out buffered data and updates the digest if it is out of date.
+  // Returns false on failure.
+  bool SyncInternal(FileControl *file_ctrl)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Moves the cursor associated with |fd| to logical offset |logical_offset|.
+  // Returns false on failure.
+  bool MoveCursor(int fd, const FileControl &file_ctrl,
+                  off_t logical_offset) const
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Reads a single full block of a file at a specified logical offset into
+  // |block|, which must have room for a full block of the file. Returns false
+  // on failure.
   bool ReadFullBlock(const FileControl &file_ctrl, off_t logical_offset,
-                     Block *block) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+                     uint8_t *block) const
+      ABSL_SHARED_LOCKS_REQUIRED(file_ctrl.mu);
 
   // Map of file (data set) controls for opened files keyed on int identity of
   // files. Avoid using absl based containers which may perform system calls, as
@@ -210,18 +448,37 @@ class AeadHandler {
   std::unordered_map<int, std::shared_ptr<FileControl>> fmap_
       ABSL_GUARDED_BY(mu_);
 
+  // File (data set) control of an opened file, shared by all descriptors of the
+  // file.
+  struct OpenedFile {
+    std::shared_ptr<FileControl> file_ctrl;
+
+    // Number of descriptors of the file in |fmap_|.
+    size_t descriptor_count;
+  };
+
   // Map of file (data set) controls for opened files keyed on string paths of
-  // files. Avoid using absl based containers which may perform system calls, as
-  // this class is expected to be used in trusted primitives layer where system
-  // calls might not be available.
-  std::unordered_map<std::string, std::shared_ptr<FileControl>> opened_files_
+  // files. An entry is removed only when the last descriptor of the file is
+  // closed. Avoid using absl based containers which may perform system calls,
+  // as this class is expected to be used in trusted primitives layer where
+  // system calls might not be available.
+  std::unordered_map<std::string, OpenedFile> opened_files_
       ABSL_GUARDED_BY(mu_);
 
-  // An instance that performs operations on untrusted file offset.
-  std::unique_ptr<OffsetTranslator> offset_translator_;
+  // Identity of the next file to be opened.
+  uint64_t next_file_id_ ABSL_GUARDED_BY(mu_);
 
-  // Mutex for protecting map members of the class.
+  // Mutex for protecting map members of the class. Held exclusively only when
+  // files are opened and closed, and shared when looking up opened files.
   absl::Mutex mu_;
+
+  // Verified plaintext of blocks of opened files. Updated by reads, hence
+  // mutable.
+  mutable BlockCache block_cache_;
+
+  // Workers that encrypt and decrypt the blocks of large reads and writes.
+  // Used by reads, hence mutable.
+  mutable WorkerPool worker_pool_;
 };
 
 }  // namespace storage
@@ -0,0 +1,114 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of the Authenticated Dictionary implementations, measuring the
+// cost of maintaining the root of files of 1 GiB across block lengths. Run with
+// --benchmarks=all.
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include "asylo/platform/storage/secure/compact_authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+// Size of the file whose blocks the dictionaries authenticate.
+constexpr int64_t kFileSize = int64_t{1} << 30;
+
+// Number of consecutive blocks modified by a multi-block write.
+constexpr size_t kRangeLength = 16;
+
+// Arguments are the number of leaves of a 1 GiB file with 4 KiB and 64 KiB
+// blocks.
+void LeafCountArguments(benchmark::internal::Benchmark *benchmark) {
+  benchmark->Arg(kFileSize / 4096)->Arg(kFileSize / 65536);
+}
+
+template <typename Dictionary>
+void Populate(size_t leaf_count, Dictionary *dictionary) {
+  const std::string hash = dictionary->LeafHash(std::string(16, '\0'));
+  for (size_t leaf = 0; leaf < leaf_count; leaf++) {
+    dictionary->AddLeafHash(hash);
+  }
+  dictionary->CurrentRoot();
+}
+
+// Updates a random leaf and recomputes the root, as a single block write.
+template <typename Dictionary>
+void BM_UpdateLeaf(benchmark::State &state) {
+  Dictionary dictionary;
+  Populate(state.range(0), &dictionary);
+  std::mt19937 random(0);
+  std::uniform_int_distribution<size_t> leaves(1, state.range(0));
+  std::string data(16, 'a');
+  for (auto _ : state) {
+    dictionary.UpdateLeaf(leaves(random), data);
+    benchmark::DoNotOptimize(dictionary.CurrentRoot());
+  }
+}
+BENCHMARK_TEMPLATE(BM_UpdateLeaf, CompactAuthenticatedDictionary)
+    ->Apply(LeafCountArguments);
+BENCHMARK_TEMPLATE(BM_UpdateLeaf, CTMMTAuthenticatedDictionary)
+    ->Apply(LeafCountArguments);
+
+// Updates a random range of consecutive leaves and recomputes the root, as a
+// multi-block write.
+template <typename Dictionary>
+void BM_UpdateRange(benchmark::State &state) {
+  Dictionary dictionary;
+  Populate(state.range(0), &dictionary);
+  std::mt19937 random(0);
+  std::uniform_int_distribution<size_t> leaves(
+      1, state.range(0) - kRangeLength + 1);
+  std::string data(16, 'a');
+  for (auto _ : state) {
+    size_t first = leaves(random);
+    for (size_t leaf = first; leaf < first + kRangeLength; leaf++) {
+      dictionary.UpdateLeaf(leaf, data);
+    }
+    benchmark::DoNotOptimize(dictionary.CurrentRoot());
+  }
+}
+BENCHMARK_TEMPLATE(BM_UpdateRange, CompactAuthenticatedDictionary)
+    ->Apply(LeafCountArguments);
+BENCHMARK_TEMPLATE(BM_UpdateRange, CTMMTAuthenticatedDictionary)
+    ->Apply(LeafCountArguments);
+
+// Builds the dictionary of an existing file, as on file open.
+template <typename Dictionary>
+void BM_Build(benchmark::State &state) {
+  for (auto _ : state) {
+    Dictionary dictionary;
+    Populate(state.range(0), &dictionary);
+  }
+}
+BENCHMARK_TEMPLATE(BM_Build, CompactAuthenticatedDictionary)
+    ->Apply(LeafCountArguments);
+BENCHMARK_TEMPLATE(BM_Build, CTMMTAuthenticatedDictionary)
+    ->Apply(LeafCountArguments);
+
+}  // namespace
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -0,0 +1,122 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/block_cache.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+BlockCache::BlockCache(size_t capacity) : capacity_(capacity), stats_{} {}
+
+bool BlockCache::Lookup(uint64_t file_id, uint64_t block_index, size_t offset,
+                        size_t length, uint8_t *out) {
+  absl::MutexLock lock(&mu_);
+  auto it = index_.find(Key{file_id, block_index});
+  if (it == index_.end() || offset + length > it->second->plaintext.size()) {
+    stats_.misses++;
+    return false;
+  }
+
+  stats_.hits++;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  std::copy_n(it->second->plaintext.begin() + offset, length, out);
+  return true;
+}
+
+void BlockCache::Insert(uint64_t file_id, uint64_t block_index,
+                        const uint8_t *block, size_t block_length) {
+  absl::MutexLock lock(&mu_);
+  if (block_length > capacity_) {
+    return;
+  }
+
+  const Key key{file_id, block_index};
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    Erase(it->second);
+  }
+  entries_.push_front(
+      Entry{key, CleansingVector<uint8_t>(block, block + block_length)});
+  index_[key] = entries_.begin();
+  stats_.size += block_length;
+  EvictToCapacity();
+}
+
+void BlockCache::Invalidate(uint64_t file_id, uint64_t begin_block,
+                            uint64_t end_block) {
+  absl::MutexLock lock(&mu_);
+  if (end_block <= begin_block) {
+    return;
+  }
+
+  // Scan whichever is shorter - the range, or the cached entries.
+  if (end_block - begin_block <= index_.size()) {
+    for (uint64_t block = begin_block; block < end_block; block++) {
+      auto it = index_.find(Key{file_id, block});
+      if (it != index_.end()) {
+        Erase(it->second);
+      }
+    }
+    return;
+  }
+
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    auto next = std::next(it);
+    if (it->key.file_id == file_id && it->key.block_index >= begin_block &&
+        it->key.block_index < end_block) {
+      Erase(it);
+    }
+    it = next;
+  }
+}
+
+void BlockCache::InvalidateFile(uint64_t file_id) {
+  Invalidate(file_id, 0, UINT64_MAX);
+}
+
+void BlockCache::SetCapacity(size_t capacity) {
+  absl::MutexLock lock(&mu_);
+  capacity_ = capacity;
+  EvictToCapacity();
+}
+
+BlockCache::Stats BlockCache::GetStats() const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+void BlockCache::Erase(EntryList::iterator it) {
+  stats_.size -= it->plaintext.size();
+  index_.erase(it->key);
+  entries_.erase(it);
+}
+
+void BlockCache::EvictToCapacity() {
+  while (stats_.size > capacity_) {
+    Erase(std::prev(entries_.end()));
+    stats_.evictions++;
+  }
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
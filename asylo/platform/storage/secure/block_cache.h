@@ -0,0 +1,130 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_BLOCK_CACHE_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_BLOCK_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/util/cleansing_types.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// A cache of verified plaintext blocks of secure files, keyed by file and
+// block index, bounded by the total length of the cached plaintext. The least
+// recently used blocks are evicted first. Cached plaintext is cleansed when it
+// is evicted or invalidated.
+//
+// Blocks are cached only after they have been verified against the integrity
+// metadata of the file, and the cache must be invalidated whenever blocks of a
+// file are written, so that it only ever holds data the enclave wrote. All
+// methods are thread-safe.
+class BlockCache {
+ public:
+  // Counters of the cache since its creation.
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+
+    // Length of the plaintext currently cached.
+    size_t size;
+  };
+
+  // Creates a cache of at most |capacity| bytes of plaintext. A cache of zero
+  // capacity caches nothing.
+  explicit BlockCache(size_t capacity);
+
+  // Copies |length| bytes at |offset| within block |block_index| of file
+  // |file_id| to |out|, and returns true, if the block is cached.
+  bool Lookup(uint64_t file_id, uint64_t block_index, size_t offset,
+              size_t length, uint8_t *out) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Caches |block_length| bytes of |block| as block |block_index| of file
+  // |file_id|, replacing the cached block if any.
+  void Insert(uint64_t file_id, uint64_t block_index, const uint8_t *block,
+              size_t block_length) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Drops blocks [|begin_block|, |end_block|) of file |file_id|.
+  void Invalidate(uint64_t file_id, uint64_t begin_block, uint64_t end_block)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Drops all blocks of file |file_id|.
+  void InvalidateFile(uint64_t file_id) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Changes the capacity of the cache, evicting blocks as needed.
+  void SetCapacity(size_t capacity) ABSL_LOCKS_EXCLUDED(mu_);
+
+  Stats GetStats() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  struct Key {
+    uint64_t file_id;
+    uint64_t block_index;
+
+    bool operator==(const Key &other) const {
+      return file_id == other.file_id && block_index == other.block_index;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return std::hash<uint64_t>()(key.file_id * 0x9e3779b97f4a7c15ULL ^
+                                   key.block_index);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    CleansingVector<uint8_t> plaintext;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  // Removes the entry at |it|.
+  void Erase(EntryList::iterator it) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Evicts the least recently used entries until the cache fits its capacity.
+  void EvictToCapacity() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  size_t capacity_ ABSL_GUARDED_BY(mu_);
+  Stats stats_ ABSL_GUARDED_BY(mu_);
+
+  // Entries ordered from the most to the least recently used, and their index.
+  // Avoid using absl based containers which may perform system calls, as this
+  // class is used in the trusted primitives layer.
+  EntryList entries_ ABSL_GUARDED_BY(mu_);
+  std::unordered_map<Key, EntryList::iterator, KeyHash> index_
+      ABSL_GUARDED_BY(mu_);
+
+  mutable absl::Mutex mu_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_BLOCK_CACHE_H_
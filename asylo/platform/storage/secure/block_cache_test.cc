@@ -0,0 +1,149 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/block_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr size_t kBlockLength = 4;
+
+std::vector<uint8_t> Block(uint8_t value) {
+  return std::vector<uint8_t>(kBlockLength, value);
+}
+
+void InsertBlock(BlockCache *cache, uint64_t file_id, uint64_t block_index,
+                 uint8_t value) {
+  std::vector<uint8_t> block = Block(value);
+  cache->Insert(file_id, block_index, block.data(), block.size());
+}
+
+bool IsCached(BlockCache *cache, uint64_t file_id, uint64_t block_index) {
+  std::vector<uint8_t> out(kBlockLength);
+  return cache->Lookup(file_id, block_index, 0, kBlockLength, out.data());
+}
+
+TEST(BlockCacheTest, LookupReturnsInsertedRange) {
+  BlockCache cache(4 * kBlockLength);
+  const std::vector<uint8_t> block = {1, 2, 3, 4};
+  cache.Insert(/*file_id=*/7, /*block_index=*/3, block.data(), block.size());
+
+  std::vector<uint8_t> out(2);
+  EXPECT_TRUE(cache.Lookup(7, 3, /*offset=*/1, /*length=*/2, out.data()));
+  EXPECT_THAT(out, ElementsAre(2, 3));
+
+  EXPECT_FALSE(cache.Lookup(7, 2, 0, 2, out.data()));
+  EXPECT_FALSE(cache.Lookup(8, 3, 0, 2, out.data()));
+  EXPECT_FALSE(cache.Lookup(7, 3, 3, 2, out.data()));
+
+  BlockCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 3);
+  EXPECT_EQ(stats.size, kBlockLength);
+}
+
+TEST(BlockCacheTest, InsertReplacesCachedBlock) {
+  BlockCache cache(4 * kBlockLength);
+  InsertBlock(&cache, 1, 0, 'a');
+  InsertBlock(&cache, 1, 0, 'b');
+
+  std::vector<uint8_t> out(kBlockLength);
+  EXPECT_TRUE(cache.Lookup(1, 0, 0, kBlockLength, out.data()));
+  EXPECT_EQ(out, Block('b'));
+  EXPECT_EQ(cache.GetStats().size, kBlockLength);
+}
+
+TEST(BlockCacheTest, EvictsLeastRecentlyUsed) {
+  BlockCache cache(2 * kBlockLength);
+  InsertBlock(&cache, 1, 0, 'a');
+  InsertBlock(&cache, 1, 1, 'b');
+
+  // Touch block 0, so that block 1 is evicted first.
+  EXPECT_TRUE(IsCached(&cache, 1, 0));
+  InsertBlock(&cache, 1, 2, 'c');
+
+  EXPECT_TRUE(IsCached(&cache, 1, 0));
+  EXPECT_FALSE(IsCached(&cache, 1, 1));
+  EXPECT_TRUE(IsCached(&cache, 1, 2));
+  EXPECT_EQ(cache.GetStats().evictions, 1);
+  EXPECT_EQ(cache.GetStats().size, 2 * kBlockLength);
+}
+
+TEST(BlockCacheTest, InvalidateDropsRange) {
+  BlockCache cache(16 * kBlockLength);
+  for (uint64_t block = 0; block < 8; block++) {
+    InsertBlock(&cache, 1, block, 'a');
+    InsertBlock(&cache, 2, block, 'b');
+  }
+
+  // A short range is looked up, a long one is scanned for.
+  cache.Invalidate(1, 2, 4);
+  cache.Invalidate(2, 5, 1000);
+
+  for (uint64_t block = 0; block < 8; block++) {
+    EXPECT_EQ(IsCached(&cache, 1, block), block < 2 || block >= 4) << block;
+    EXPECT_EQ(IsCached(&cache, 2, block), block < 5) << block;
+  }
+  EXPECT_EQ(cache.GetStats().size, 11 * kBlockLength);
+}
+
+TEST(BlockCacheTest, InvalidateFileDropsAllBlocksOfFile) {
+  BlockCache cache(16 * kBlockLength);
+  for (uint64_t block = 0; block < 4; block++) {
+    InsertBlock(&cache, 1, block, 'a');
+    InsertBlock(&cache, 2, block, 'b');
+  }
+
+  cache.InvalidateFile(1);
+
+  for (uint64_t block = 0; block < 4; block++) {
+    EXPECT_FALSE(IsCached(&cache, 1, block));
+    EXPECT_TRUE(IsCached(&cache, 2, block));
+  }
+}
+
+TEST(BlockCacheTest, SetCapacityEvicts) {
+  BlockCache cache(4 * kBlockLength);
+  for (uint64_t block = 0; block < 4; block++) {
+    InsertBlock(&cache, 1, block, 'a');
+  }
+
+  cache.SetCapacity(kBlockLength);
+  EXPECT_EQ(cache.GetStats().size, kBlockLength);
+  EXPECT_TRUE(IsCached(&cache, 1, 3));
+
+  cache.SetCapacity(0);
+  EXPECT_EQ(cache.GetStats().size, 0);
+  InsertBlock(&cache, 1, 0, 'a');
+  EXPECT_FALSE(IsCached(&cache, 1, 0));
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
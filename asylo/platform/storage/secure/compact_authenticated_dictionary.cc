@@ -0,0 +1,180 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/compact_authenticated_dictionary.h"
+
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+using Digest = CompactAuthenticatedDictionary::Digest;
+
+// Domain separation prefixes of RFC 6962.
+constexpr uint8_t kLeafHashPrefix = 0x00;
+constexpr uint8_t kNodeHashPrefix = 0x01;
+
+Digest HashLeaf(const std::string &data) {
+  Digest digest;
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, &kLeafHashPrefix, sizeof(kLeafHashPrefix));
+  SHA256_Update(&context, data.data(), data.size());
+  SHA256_Final(digest.data(), &context);
+  return digest;
+}
+
+void HashChildren(const Digest &left, const Digest &right, Digest *parent) {
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  SHA256_Update(&context, &kNodeHashPrefix, sizeof(kNodeHashPrefix));
+  SHA256_Update(&context, left.data(), left.size());
+  SHA256_Update(&context, right.data(), right.size());
+  SHA256_Final(parent->data(), &context);
+}
+
+std::string ToString(const Digest &digest) {
+  return std::string(reinterpret_cast<const char *>(digest.data()),
+                     digest.size());
+}
+
+}  // namespace
+
+CompactAuthenticatedDictionary::CompactAuthenticatedDictionary()
+    : levels_(1), dirty_begin_(0), dirty_end_(0) {}
+
+size_t CompactAuthenticatedDictionary::AddLeaf(const std::string &data) {
+  return AppendLeafHash(HashLeaf(data));
+}
+
+size_t CompactAuthenticatedDictionary::AddLeafHash(const std::string &hash) {
+  // It is the caller's responsibility to supply a valid hash - a hash of an
+  // unexpected length is not added.
+  if (hash.size() != kDigestLength) {
+    return 0;
+  }
+
+  Digest digest;
+  memcpy(digest.data(), hash.data(), kDigestLength);
+  return AppendLeafHash(digest);
+}
+
+size_t CompactAuthenticatedDictionary::AppendLeafHash(const Digest &digest) {
+  levels_[0].push_back(digest);
+  MarkDirty(levels_[0].size() - 1);
+  return levels_[0].size();
+}
+
+std::string CompactAuthenticatedDictionary::CurrentRoot() {
+  if (levels_[0].empty()) {
+    Digest digest;
+    SHA256(nullptr, 0, digest.data());
+    return ToString(digest);
+  }
+
+  Rehash();
+
+  size_t level = 0;
+  while (levels_[level].size() > 1) {
+    level++;
+  }
+  return ToString(levels_[level][0]);
+}
+
+std::string CompactAuthenticatedDictionary::LeafHash(size_t leaf) const {
+  if (leaf == 0 || leaf > levels_[0].size()) {
+    return std::string();
+  }
+  return ToString(levels_[0][leaf - 1]);
+}
+
+std::string CompactAuthenticatedDictionary::LeafHash(
+    const std::string &data) const {
+  return ToString(HashLeaf(data));
+}
+
+bool CompactAuthenticatedDictionary::UpdateLeaf(size_t leaf,
+                                                const std::string &data) {
+  if (leaf == 0 || leaf > levels_[0].size()) {
+    return false;
+  }
+
+  levels_[0][leaf - 1] = HashLeaf(data);
+  MarkDirty(leaf - 1);
+  return true;
+}
+
+void CompactAuthenticatedDictionary::MarkDirty(size_t index) {
+  if (dirty_begin_ == dirty_end_) {
+    dirty_begin_ = index;
+    dirty_end_ = index + 1;
+    return;
+  }
+
+  // Extend the dirty range only with adjacent leaves, otherwise settle the
+  // current range first.
+  if (index + 1 < dirty_begin_ || index > dirty_end_) {
+    Rehash();
+    dirty_begin_ = index;
+    dirty_end_ = index + 1;
+    return;
+  }
+
+  dirty_begin_ = std::min(dirty_begin_, index);
+  dirty_end_ = std::max(dirty_end_, index + 1);
+}
+
+void CompactAuthenticatedDictionary::Rehash() {
+  size_t begin = dirty_begin_;
+  size_t end = dirty_end_;
+  if (begin == end) {
+    return;
+  }
+
+  for (size_t level = 0; levels_[level].size() > 1; level++) {
+    if (levels_.size() == level + 1) {
+      levels_.emplace_back();
+    }
+    const std::vector<Digest> &children = levels_[level];
+    std::vector<Digest> &parents = levels_[level + 1];
+    parents.resize((children.size() + 1) / 2);
+
+    begin /= 2;
+    end = (end + 1) / 2;
+    for (size_t index = begin; index < end; index++) {
+      if (2 * index + 1 < children.size()) {
+        HashChildren(children[2 * index], children[2 * index + 1],
+                     &parents[index]);
+      } else {
+        parents[index] = children[2 * index];
+      }
+    }
+  }
+
+  dirty_begin_ = 0;
+  dirty_end_ = 0;
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
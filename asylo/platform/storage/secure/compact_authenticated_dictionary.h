@@ -0,0 +1,96 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_COMPACT_AUTHENTICATED_DICTIONARY_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_COMPACT_AUTHENTICATED_DICTIONARY_H_
+
+#include <openssl/sha.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "asylo/platform/storage/secure/authenticated_dictionary.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Authenticated Dictionary implementation backed by a Merkle tree that keeps
+// all interior hashes in memory. The tree is stored level by level, each level
+// as a contiguous array of fixed-length SHA-256 digests. The hashing scheme is
+// the one of RFC 6962, hence roots are identical to the ones computed by
+// CTMMTAuthenticatedDictionary.
+//
+// Modified leaves are tracked as a dirty range, and interior hashes above the
+// range are recomputed once, when the root is requested. Updating a single
+// leaf costs O(log n) hashes, and updating k consecutive leaves costs
+// O(k + log n) hashes. Updates to a leaf far from the dirty range first
+// recompute the hashes above the range, so that unrelated updates do not
+// coalesce into a range spanning the whole tree.
+//
+// Const methods do not modify the tree and may be called concurrently.
+class CompactAuthenticatedDictionary : public AuthenticatedDictionary {
+ public:
+  static constexpr size_t kDigestLength = SHA256_DIGEST_LENGTH;
+  using Digest = std::array<uint8_t, kDigestLength>;
+
+  CompactAuthenticatedDictionary();
+
+  size_t LeafCount() const final { return levels_[0].size(); }
+
+  size_t AddLeaf(const std::string &data) final;
+
+  size_t AddLeafHash(const std::string &hash) final;
+
+  std::string CurrentRoot() final;
+
+  std::string LeafHash(size_t leaf) const final;
+
+  std::string LeafHash(const std::string &data) const final;
+
+  bool UpdateLeaf(size_t leaf, const std::string &data) final;
+
+ private:
+  // Appends leaf hash |digest|, returns the number of leaves.
+  size_t AppendLeafHash(const Digest &digest);
+
+  // Records that leaf |index|, counted from 0, has been modified.
+  void MarkDirty(size_t index);
+
+  // Recomputes the interior hashes above the dirty range.
+  void Rehash();
+
+  // The levels of the tree - levels_[0] holds the leaf hashes, and
+  // levels_[i + 1] holds the parents of levels_[i]. The last node of a level
+  // with an odd number of nodes is promoted to the next level as is. Interior
+  // hashes above the dirty range are stale until Rehash() is called.
+  std::vector<std::vector<Digest>> levels_;
+
+  // The range [dirty_begin_, dirty_end_) of leaves modified since the interior
+  // hashes were last recomputed. Empty if dirty_begin_ == dirty_end_.
+  size_t dirty_begin_;
+  size_t dirty_end_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_COMPACT_AUTHENTICATED_DICTIONARY_H_
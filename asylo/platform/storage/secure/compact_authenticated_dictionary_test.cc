@@ -0,0 +1,138 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/compact_authenticated_dictionary.h"
+
+#include <random>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+std::string LeafData(size_t value) {
+  return std::string(16, static_cast<char>(value));
+}
+
+// Verifies that roots match the ones of the CT Merkle tree implementation for
+// trees of every size up to a bound, built leaf by leaf.
+TEST(CompactAuthenticatedDictionaryTest, RootMatchesWhileAppending) {
+  CompactAuthenticatedDictionary compact;
+  CTMMTAuthenticatedDictionary ctmmt;
+  EXPECT_EQ(compact.CurrentRoot(), ctmmt.CurrentRoot());
+
+  for (size_t leaf = 1; leaf <= 130; leaf++) {
+    EXPECT_EQ(compact.AddLeaf(LeafData(leaf)), leaf);
+    ctmmt.AddLeaf(LeafData(leaf));
+    EXPECT_EQ(compact.LeafCount(), leaf);
+    EXPECT_EQ(compact.LeafHash(leaf), ctmmt.LeafHash(leaf));
+    ASSERT_EQ(compact.CurrentRoot(), ctmmt.CurrentRoot()) << leaf;
+  }
+}
+
+// Verifies that leaves appended in bulk by hash produce the same root as
+// leaves appended one by one.
+TEST(CompactAuthenticatedDictionaryTest, AddLeafHash) {
+  CompactAuthenticatedDictionary bulk;
+  CTMMTAuthenticatedDictionary ctmmt;
+  for (size_t leaf = 1; leaf <= 1000; leaf++) {
+    ctmmt.AddLeaf(LeafData(leaf));
+    EXPECT_EQ(bulk.AddLeafHash(ctmmt.LeafHash(leaf)), leaf);
+  }
+  EXPECT_EQ(bulk.CurrentRoot(), ctmmt.CurrentRoot());
+
+  // Hashes of unexpected length are not added.
+  EXPECT_EQ(bulk.AddLeafHash("short"), 0);
+  EXPECT_EQ(bulk.LeafCount(), 1000);
+}
+
+// Verifies that roots match after random single leaf and range updates, with
+// and without intermediate root computations.
+TEST(CompactAuthenticatedDictionaryTest, RootMatchesAfterUpdates) {
+  std::mt19937 random(0);
+  for (size_t leaf_count : {1, 2, 3, 7, 64, 127, 513}) {
+    CompactAuthenticatedDictionary compact;
+    CTMMTAuthenticatedDictionary ctmmt;
+    for (size_t leaf = 1; leaf <= leaf_count; leaf++) {
+      compact.AddLeaf(LeafData(leaf));
+      ctmmt.AddLeaf(LeafData(leaf));
+    }
+
+    std::uniform_int_distribution<size_t> leaves(1, leaf_count);
+    for (int round = 0; round < 50; round++) {
+      // Scattered updates.
+      for (int update = 0; update < 3; update++) {
+        size_t leaf = leaves(random);
+        std::string data = LeafData(random());
+        ASSERT_TRUE(compact.UpdateLeaf(leaf, data));
+        ASSERT_TRUE(ctmmt.UpdateLeaf(leaf, data));
+      }
+
+      // A range of consecutive updates, in descending order on odd rounds.
+      size_t first = leaves(random);
+      size_t last = std::min(leaf_count, first + leaves(random) % 16);
+      for (size_t i = first; i <= last; i++) {
+        size_t leaf = round % 2 ? first + last - i : i;
+        std::string data = LeafData(random());
+        ASSERT_TRUE(compact.UpdateLeaf(leaf, data));
+        ASSERT_TRUE(ctmmt.UpdateLeaf(leaf, data));
+      }
+
+      if (round % 3 == 0) {
+        ASSERT_EQ(compact.CurrentRoot(), ctmmt.CurrentRoot())
+            << leaf_count << " " << round;
+      }
+    }
+    EXPECT_EQ(compact.CurrentRoot(), ctmmt.CurrentRoot()) << leaf_count;
+  }
+}
+
+// Verifies that updates interleaved with appends produce a matching root.
+TEST(CompactAuthenticatedDictionaryTest, UpdateThenAppend) {
+  CompactAuthenticatedDictionary compact;
+  CTMMTAuthenticatedDictionary ctmmt;
+  for (size_t leaf = 1; leaf <= 37; leaf++) {
+    compact.AddLeaf(LeafData(leaf));
+    ctmmt.AddLeaf(LeafData(leaf));
+    ASSERT_TRUE(compact.UpdateLeaf((leaf + 1) / 2, LeafData(leaf + 100)));
+    ASSERT_TRUE(ctmmt.UpdateLeaf((leaf + 1) / 2, LeafData(leaf + 100)));
+  }
+  EXPECT_EQ(compact.CurrentRoot(), ctmmt.CurrentRoot());
+}
+
+TEST(CompactAuthenticatedDictionaryTest, OutOfRangeLeaf) {
+  CompactAuthenticatedDictionary compact;
+  compact.AddLeaf(LeafData(1));
+  std::string root = compact.CurrentRoot();
+
+  EXPECT_FALSE(compact.UpdateLeaf(0, LeafData(2)));
+  EXPECT_FALSE(compact.UpdateLeaf(2, LeafData(2)));
+  EXPECT_EQ(compact.LeafHash(0), "");
+  EXPECT_EQ(compact.LeafHash(2), "");
+  EXPECT_EQ(compact.CurrentRoot(), root);
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -22,18 +22,64 @@
 #include <sys/types.h>
 
 // IO syscall interface constants.
+#include <errno.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <sys/mman.h>
 
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "absl/synchronization/mutex.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
 #include "asylo/platform/storage/secure/aead_handler.h"
+#include "asylo/platform/storage/secure/secure_mapping.h"
 #include "asylo/platform/storage/utils/fd_closer.h"
 #include "asylo/platform/storage/utils/offset_translator.h"
 
 namespace asylo {
 namespace platform {
 namespace storage {
+namespace {
+
+// A mapping created by secure_mmap().
+struct Mapping {
+  std::unique_ptr<SecureMapping> mapping;
+  bool writable;
+};
+
+// Mappings created by secure_mmap(), by address.
+struct Mappings {
+  absl::Mutex mu;
+  std::map<uintptr_t, Mapping> by_address ABSL_GUARDED_BY(mu);
+};
+
+// Writes back the pages of a mapping created by secure_mmap() that overlap
+// [|offset|, |offset| + |length|) of the mapping and changed since they were
+// loaded or last written back. Stores through the returned pointer cannot be
+// tracked, hence the pages of a writable mapping are compared with their
+// digests.
+int SyncMapping(const Mapping &mapping, size_t offset, size_t length) {
+  if (mapping.writable) {
+    mapping.mapping->MarkChangedPagesDirty(offset, length);
+  }
+  if (mapping.mapping->Sync(offset, length) != 0) {
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+Mappings &GetMappings() {
+  static Mappings *mappings = new Mappings;
+  return *mappings;
+}
+
+}  // namespace
 
 int secure_open(const char *pathname, int flags, ...) {
   if ((flags & O_APPEND) || (flags & O_TRUNC)) {
@@ -59,15 +105,18 @@ int secure_open(const char *pathname, int flags, ...) {
 
   FdCloser fd_closer(fd, &enc_untrusted_close);
 
+  // The file has to be initialized first, as the layout of the file determines
+  // the physical offset of the logical offset of 0.
+  if (!AeadHandler::GetInstance().InitializeFile(fd, pathname, is_new_file)) {
+    LOG(ERROR) << "Failed to initialize secure handling of file: " << pathname;
+    return -1;
+  }
+
   // Set cursor to the logical offset of 0.
   if (secure_lseek(fd, 0, SEEK_SET) == -1) {
     LOG(ERROR) << "Failed to initialize cursor to the logical offset of 0, fd="
                << fd;
-    return -1;
-  }
-
-  if (!AeadHandler::GetInstance().InitializeFile(fd, pathname, is_new_file)) {
-    LOG(ERROR) << "Failed to initialize secure handling of file: " << pathname;
+    AeadHandler::GetInstance().FinalizeFile(fd);
     return -1;
   }
 
@@ -83,18 +132,38 @@ ssize_t secure_write(int fd, const void *buf, size_t count) {
   return AeadHandler::GetInstance().EncryptAndPersist(fd, buf, count);
 }
 
+ssize_t secure_pread(int fd, void *buf, size_t count, off_t offset) {
+  return AeadHandler::GetInstance().DecryptAndVerify(fd, buf, count, offset);
+}
+
+ssize_t secure_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  return AeadHandler::GetInstance().EncryptAndPersist(fd, buf, count, offset);
+}
+
 int secure_close(int fd) {
   bool finalize_result = AeadHandler::GetInstance().FinalizeFile(fd);
   return (finalize_result && enc_untrusted_close(fd) == 0) ? 0 : -1;
 }
 
+int secure_fsync(int fd) {
+  if (AeadHandler::GetInstance().Sync(fd) != 0) {
+    return -1;
+  }
+  return enc_untrusted_fsync(fd);
+}
+
 off_t secure_lseek(int fd, off_t offset, int whence) {
   if (offset < 0) {
     return -1;
   }
 
-  const OffsetTranslator &offset_translator =
-      AeadHandler::GetInstance().GetOffsetTranslator();
+  std::shared_ptr<const OffsetTranslator> translator =
+      AeadHandler::GetInstance().GetOffsetTranslator(fd);
+  if (!translator) {
+    LOG(ERROR) << "Attempt made to lseek on an unopened file, fd = " << fd;
+    return -1;
+  }
+  const OffsetTranslator &offset_translator = *translator;
 
   // The net logical offset to which lseek has been requested.
   off_t logical_offset;
@@ -140,6 +209,76 @@ int secure_fstat(int fd, struct stat *st) {
   return ret;
 }
 
+void *secure_mmap(void *addr, size_t length, int prot, int flags, int fd,
+                  off_t offset) {
+  const int type = flags & (MAP_SHARED | MAP_PRIVATE);
+  if (addr || (type != MAP_SHARED && type != MAP_PRIVATE) || flags != type) {
+    LOG(ERROR) << "Unsupported mapping of a secure file, flags = " << flags;
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+
+  std::unique_ptr<SecureMapping> mapping =
+      SecureMapping::Create(fd, offset, length, type == MAP_SHARED);
+  if (!mapping) {
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+
+  if (!mapping->Pin(0, length, /*write=*/false)) {
+    errno = EIO;
+    return MAP_FAILED;
+  }
+
+  void *data = mapping->data();
+  Mappings &mappings = GetMappings();
+  absl::MutexLock lock(&mappings.mu);
+  mappings.by_address[reinterpret_cast<uintptr_t>(data)] =
+      Mapping{std::move(mapping), (prot & PROT_WRITE) != 0};
+  return data;
+}
+
+int secure_msync(void *addr, size_t length, int flags) {
+  // Changes are written back before returning, which satisfies MS_ASYNC as
+  // well. Other mappings of the file are not reloaded for MS_INVALIDATE.
+  if ((flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE)) != 0 ||
+      ((flags & MS_ASYNC) && (flags & MS_SYNC))) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  Mappings &mappings = GetMappings();
+  absl::MutexLock lock(&mappings.mu);
+  const uintptr_t address = reinterpret_cast<uintptr_t>(addr);
+  auto it = mappings.by_address.upper_bound(address);
+  if (it == mappings.by_address.begin() ||
+      address + length >
+          std::prev(it)->first + std::prev(it)->second.mapping->length()) {
+    errno = ENOMEM;
+    return -1;
+  }
+  return SyncMapping(std::prev(it)->second, address - std::prev(it)->first,
+                     length);
+}
+
+int secure_munmap(void *addr, size_t length) {
+  Mapping mapping;
+  {
+    Mappings &mappings = GetMappings();
+    absl::MutexLock lock(&mappings.mu);
+    auto it = mappings.by_address.find(reinterpret_cast<uintptr_t>(addr));
+    if (it == mappings.by_address.end() ||
+        it->second.mapping->length() != length) {
+      LOG(ERROR) << "Only whole mappings of secure files can be unmapped";
+      errno = EINVAL;
+      return -1;
+    }
+    mapping = std::move(it->second);
+    mappings.by_address.erase(it);
+  }
+  return SyncMapping(mapping, 0, length);
+}
+
 }  // namespace storage
 }  // namespace platform
 }  // namespace asylo
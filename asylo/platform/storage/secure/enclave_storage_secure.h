@@ -43,13 +43,47 @@ ssize_t secure_read(int fd, void *buf, size_t count);
 // responsibility to explicitly set file offset on error as the client desires.
 ssize_t secure_write(int fd, const void *buf, size_t count);
 
+// Reads at logical |offset| without using or moving the file offset of |fd|.
+// Positional reads of a file may be issued concurrently, including through a
+// single descriptor.
+ssize_t secure_pread(int fd, void *buf, size_t count, off_t offset);
+
+// Writes at logical |offset| without using or moving the file offset of |fd|.
+ssize_t secure_pwrite(int fd, const void *buf, size_t count, off_t offset);
+
 int secure_close(int fd);
 
+// Writes out data buffered by a file in write-back and updates its digest,
+// then flushes the file on the host.
+int secure_fsync(int fd);
+
 off_t secure_lseek(int fd, off_t offset, int whence);
 
 // |st->st_size| will be set to logical file size on success.
 int secure_fstat(int fd, struct stat* st);
 
+// Maps |length| bytes of a secure file from |offset| into enclave memory, with
+// the semantics of mmap() for MAP_SHARED and MAP_PRIVATE mappings. |addr| must
+// be null. The mapped range is decrypted and verified when it is mapped; use
+// SecureMapping directly to load pages on first use. |fd| must stay open until
+// the mapping is unmapped. Returns MAP_FAILED and sets errno on failure.
+//
+// The mapping does not observe writes made through |fd| after it was mapped.
+// Such writes survive msync() and munmap() unless the mapping changed the same
+// page, in which case the page of the mapping overwrites them. Files should
+// not be written through |fd| while they are mapped.
+void *secure_mmap(void *addr, size_t length, int prot, int flags, int fd,
+                  off_t offset);
+
+// Writes back the pages of a writable shared mapping that overlap [|addr|,
+// |addr| + |length|) and changed since they were mapped or last written back.
+// Changes are written back synchronously for both MS_SYNC and MS_ASYNC.
+int secure_msync(void *addr, size_t length, int flags);
+
+// Writes back the changed pages of a whole mapping created by secure_mmap(),
+// and unmaps it.
+int secure_munmap(void *addr, size_t length);
+
 }  // namespace storage
 }  // namespace platform
 }  // namespace asylo
@@ -0,0 +1,294 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of the Secure IO Library, comparing throughput of sequential and
+// random access across block lengths, of reads and writes of a whole file at
+// once, of small appends with and without write-back, and of concurrent reads
+// of a single file. Run with --benchmarks=all.
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
+#include "asylo/platform/storage/secure/aead_handler.h"
+#include "asylo/platform/storage/secure/enclave_storage_secure.h"
+#include "asylo/test/util/test_flags.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace {
+
+using platform::crypto::gcmlib::kKeyLength;
+using platform::storage::AeadHandler;
+using platform::storage::kDefaultBlockLength;
+using platform::storage::kLegacyBlockLength;
+using platform::storage::kMaxBlockLength;
+using platform::storage::secure_close;
+using platform::storage::secure_fsync;
+using platform::storage::secure_lseek;
+using platform::storage::secure_open;
+using platform::storage::secure_read;
+using platform::storage::secure_write;
+
+// Size of the file each benchmark operates on.
+constexpr size_t kFileSize = 1 << 20;
+
+// An open secure file of kFileSize bytes with a given block length.
+class BenchmarkFile {
+ public:
+  explicit BenchmarkFile(size_t block_length)
+      : path_(absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir),
+                           "/EnclaveStorageSecureBenchmark_", block_length)),
+        key_(kKeyLength) {
+    remove(path_.c_str());
+    CHECK_EQ(RAND_bytes(key_.data(), key_.size()), 1);
+
+    fd_ = secure_open(path_.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    CHECK_GE(fd_, 0);
+    CHECK_EQ(AeadHandler::GetInstance().SetBlockLength(fd_, block_length), 0);
+    CHECK_EQ(
+        AeadHandler::GetInstance().SetMasterKey(fd_, key_.data(), key_.size()),
+        0);
+
+    std::vector<uint8_t> data(kMaxBlockLength, 'a');
+    for (size_t offset = 0; offset < kFileSize; offset += data.size()) {
+      CHECK_EQ(secure_write(fd_, data.data(), data.size()), data.size());
+    }
+  }
+
+  ~BenchmarkFile() {
+    secure_close(fd_);
+    remove(path_.c_str());
+  }
+
+  int fd() const { return fd_; }
+
+  // Opens another descriptor of the file, with an independent cursor.
+  int OpenDescriptor() const {
+    int fd = secure_open(path_.c_str(), O_RDWR);
+    CHECK_GE(fd, 0);
+    CHECK_EQ(
+        AeadHandler::GetInstance().SetMasterKey(fd, key_.data(), key_.size()),
+        0);
+    return fd;
+  }
+
+ private:
+  const std::string path_;
+  std::vector<uint8_t> key_;
+  int fd_;
+};
+
+// Block lengths and sizes of a single read or write to benchmark.
+constexpr size_t kBlockLengths[] = {kLegacyBlockLength, 1024,
+                                    kDefaultBlockLength, kMaxBlockLength};
+constexpr size_t kIoSizes[] = {512, 4096, 65536};
+
+// Arguments are the block length and the size of a single read or write.
+void BlockLengthArguments(benchmark::internal::Benchmark *benchmark) {
+  for (int64_t block_length : kBlockLengths) {
+    for (int64_t io_size : kIoSizes) {
+      benchmark->Args({block_length, io_size});
+    }
+  }
+}
+
+void BM_SequentialWrite(benchmark::State &state) {
+  BenchmarkFile file(state.range(0));
+  std::vector<uint8_t> buffer(state.range(1), 'b');
+  off_t offset = 0;
+  for (auto _ : state) {
+    if (offset + buffer.size() > kFileSize) {
+      offset = 0;
+      secure_lseek(file.fd(), offset, SEEK_SET);
+    }
+    CHECK_EQ(secure_write(file.fd(), buffer.data(), buffer.size()),
+             buffer.size());
+    offset += buffer.size();
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_SequentialWrite)->Apply(BlockLengthArguments);
+
+void BM_SequentialRead(benchmark::State &state) {
+  BenchmarkFile file(state.range(0));
+  std::vector<uint8_t> buffer(state.range(1));
+  secure_lseek(file.fd(), 0, SEEK_SET);
+  off_t offset = 0;
+  for (auto _ : state) {
+    if (offset + buffer.size() > kFileSize) {
+      offset = 0;
+      secure_lseek(file.fd(), offset, SEEK_SET);
+    }
+    CHECK_EQ(secure_read(file.fd(), buffer.data(), buffer.size()),
+             buffer.size());
+    offset += buffer.size();
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_SequentialRead)->Apply(BlockLengthArguments);
+
+void BM_RandomWrite(benchmark::State &state) {
+  BenchmarkFile file(state.range(0));
+  std::vector<uint8_t> buffer(state.range(1), 'b');
+  std::mt19937 random(0);
+  std::uniform_int_distribution<off_t> offsets(0, kFileSize - buffer.size());
+  for (auto _ : state) {
+    secure_lseek(file.fd(), offsets(random), SEEK_SET);
+    CHECK_EQ(secure_write(file.fd(), buffer.data(), buffer.size()),
+             buffer.size());
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_RandomWrite)->Apply(BlockLengthArguments);
+
+void BM_RandomRead(benchmark::State &state) {
+  BenchmarkFile file(state.range(0));
+  std::vector<uint8_t> buffer(state.range(1));
+  std::mt19937 random(0);
+  std::uniform_int_distribution<off_t> offsets(0, kFileSize - buffer.size());
+  for (auto _ : state) {
+    secure_lseek(file.fd(), offsets(random), SEEK_SET);
+    CHECK_EQ(secure_read(file.fd(), buffer.data(), buffer.size()),
+             buffer.size());
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_RandomRead)->Apply(BlockLengthArguments);
+
+// Arguments are the block length - the whole file is read or written at once.
+void WholeFileArguments(benchmark::internal::Benchmark *benchmark) {
+  for (int64_t block_length : kBlockLengths) {
+    benchmark->Arg(block_length);
+  }
+}
+
+// Writes the whole file with a single call, whose blocks are encrypted by the
+// worker pool. Measured in real time, since workers do most of the work.
+void BM_WholeFileWrite(benchmark::State &state) {
+  BenchmarkFile file(state.range(0));
+  std::vector<uint8_t> buffer(kFileSize, 'b');
+  for (auto _ : state) {
+    secure_lseek(file.fd(), 0, SEEK_SET);
+    CHECK_EQ(secure_write(file.fd(), buffer.data(), buffer.size()),
+             buffer.size());
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_WholeFileWrite)->Apply(WholeFileArguments)->UseRealTime();
+
+// Reads the whole file with a single call, whose blocks are decrypted by the
+// worker pool.
+void BM_WholeFileRead(benchmark::State &state) {
+  BenchmarkFile file(state.range(0));
+  std::vector<uint8_t> buffer(kFileSize);
+  for (auto _ : state) {
+    secure_lseek(file.fd(), 0, SEEK_SET);
+    CHECK_EQ(secure_read(file.fd(), buffer.data(), buffer.size()),
+             buffer.size());
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_WholeFileRead)->Apply(WholeFileArguments)->UseRealTime();
+
+// Appends small records to a new file, with write-back disabled or enabled,
+// syncing the file every 64 appends as a database would commit transactions.
+// Arguments are whether write-back is enabled and the size of a single append.
+void BM_SmallAppend(benchmark::State &state) {
+  constexpr int kAppendsPerSync = 64;
+  const std::string path =
+      absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir),
+                   "/EnclaveStorageSecureBenchmark_append");
+  std::vector<uint8_t> key(kKeyLength);
+  CHECK_EQ(RAND_bytes(key.data(), key.size()), 1);
+  std::vector<uint8_t> record(state.range(1), 'c');
+
+  int fd = -1;
+  int appends = 0;
+  off_t offset = kFileSize;
+  for (auto _ : state) {
+    // Start over with a new file once the file is full.
+    if (offset + record.size() > kFileSize) {
+      state.PauseTiming();
+      if (fd != -1) {
+        CHECK_EQ(secure_close(fd), 0);
+      }
+      remove(path.c_str());
+      fd = secure_open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+      CHECK_GE(fd, 0);
+      CHECK_EQ(
+          AeadHandler::GetInstance().SetMasterKey(fd, key.data(), key.size()),
+          0);
+      if (state.range(0)) {
+        CHECK_EQ(AeadHandler::GetInstance().SetWriteBack(fd, absl::Seconds(1)),
+                 0);
+      }
+      offset = 0;
+      state.ResumeTiming();
+    }
+    CHECK_EQ(secure_write(fd, record.data(), record.size()), record.size());
+    offset += record.size();
+    if (++appends % kAppendsPerSync == 0) {
+      CHECK_EQ(secure_fsync(fd), 0);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * record.size());
+  secure_close(fd);
+  remove(path.c_str());
+}
+BENCHMARK(BM_SmallAppend)
+    ->Args({0, 64})
+    ->Args({0, 512})
+    ->Args({1, 64})
+    ->Args({1, 512});
+
+// Reads random ranges of a single file shared by all benchmark threads, each
+// thread through its own descriptor. The argument is the size of a single read.
+void BM_ConcurrentRandomRead(benchmark::State &state) {
+  // The file outlives the benchmark, so that threads do not race on creating
+  // and removing it.
+  static BenchmarkFile *file = new BenchmarkFile(kDefaultBlockLength);
+  int fd = file->OpenDescriptor();
+  std::vector<uint8_t> buffer(state.range(0));
+  std::mt19937 random(fd);
+  std::uniform_int_distribution<off_t> offsets(0, kFileSize - buffer.size());
+  for (auto _ : state) {
+    secure_lseek(fd, offsets(random), SEEK_SET);
+    CHECK_EQ(secure_read(fd, buffer.data(), buffer.size()), buffer.size());
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+  secure_close(fd);
+}
+BENCHMARK(BM_ConcurrentRandomRead)
+    ->Arg(4096)
+    ->Arg(65536)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace asylo
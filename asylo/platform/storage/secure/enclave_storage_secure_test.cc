@@ -23,33 +23,67 @@
 
 #include <fcntl.h>
 #include <openssl/rand.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/base/macros.h"
 #include "absl/flags/flag.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "asylo/util/logging.h"
+#include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
 #include "asylo/platform/storage/secure/aead_handler.h"
+#include "asylo/platform/storage/secure/block_cache.h"
+#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+#include "asylo/platform/storage/secure/secure_mapping.h"
 #include "asylo/platform/storage/utils/fd_closer.h"
 #include "asylo/test/util/status_matchers.h"
 #include "asylo/test/util/test_flags.h"
 #include "asylo/util/cleansing_types.h"
+#include "asylo/util/worker_pool.h"
 #include "asylo/util/status.h"
 
 namespace asylo {
 namespace {
 
+using platform::crypto::gcmlib::GcmCryptor;
+using platform::crypto::gcmlib::GcmCryptorKey;
 using platform::crypto::gcmlib::kKeyLength;
+using platform::crypto::gcmlib::kTagLength;
 using platform::storage::AeadHandler;
-using platform::storage::kBlockLength;
-using platform::storage::kCipherBlockLength;
+using platform::storage::BlockCache;
+using platform::storage::CTMMTAuthenticatedDictionary;
+using platform::storage::kDefaultBlockLength;
 using platform::storage::kFileHashLength;
+using platform::storage::kFileHeaderLength;
+using platform::storage::kLegacyBlockLength;
+using platform::storage::kLegacyFileHeaderLength;
+using platform::storage::kMaxBlockLength;
+using platform::storage::SecureBlockLength;
+using platform::storage::SecureMapping;
+using platform::storage::kWriteBackBufferLength;
 using platform::storage::secure_close;
 using platform::storage::secure_fstat;
+using platform::storage::secure_fsync;
 using platform::storage::secure_lseek;
+using platform::storage::secure_mmap;
+using platform::storage::secure_msync;
+using platform::storage::secure_munmap;
 using platform::storage::secure_open;
+using platform::storage::secure_pread;
+using platform::storage::secure_pwrite;
 using platform::storage::secure_read;
 using platform::storage::secure_write;
 using ::testing::Not;
@@ -57,15 +91,43 @@ using ::testing::Not;
 constexpr size_t kMaxTestBufLen = 1000;
 constexpr char kTamperData[] = "Exceedingly rare string";
 
-class EnclaveStorageSecureTest : public ::testing::Test,
-                                 public ::testing::WithParamInterface<size_t> {
+// Test parameters are the length of the test buffer and the length of file
+// blocks.
+class EnclaveStorageSecureTest
+    : public ::testing::Test,
+      public ::testing::WithParamInterface<std::tuple<size_t, size_t>> {
  protected:
   void SetUp() override { PrepareTest(); }
   void PrepareTest();
   Status OpenWriteClose(off_t offset);
   Status OpenReadVerifyClose(off_t offset, size_t bytes_expected);
+  Status WriteLegacyFile();
+
+  // Returns the size of the test file on disk.
+  off_t GetPhysicalFileSize() const {
+    struct stat file_stat;
+    if (stat(GetPath().c_str(), &file_stat) != 0) {
+      return -1;
+    }
+    return file_stat.st_size;
+  }
+
+  // Returns the file size recorded in the header of the test file on disk, or
+  // -1 on failure.
+  int64_t GetRecordedFileSize() const {
+    int fd = enc_untrusted_open(GetPath().c_str(), O_RDONLY);
+    if (fd == -1) {
+      return -1;
+    }
+    platform::storage::FdCloser fd_closer(fd, &enc_untrusted_close);
+    size_t file_size;
+    if (enc_untrusted_pread64(fd, &file_size, sizeof(file_size),
+                              kFileHashLength) != sizeof(file_size)) {
+      return -1;
+    }
+    return file_size;
+  }
 
-  const int64_t kFileHeaderLength = kFileHashLength + sizeof(size_t);
   const std::string &GetPath() const { return path_; }
   const void *GetWriteBuffer() const {
     return reinterpret_cast<const void *>(write_buffer_);
@@ -74,12 +136,17 @@ class EnclaveStorageSecureTest : public ::testing::Test,
   const void *GetZeroBuffer() const {
     return reinterpret_cast<const void *>(zero_buffer_);
   }
+  // Emulates the block length IOCTL followed by the set key IOCTL.
   int EmulateSetKeyIoctl(int fd) const {
+    if (AeadHandler::GetInstance().SetBlockLength(fd, block_length_) != 0) {
+      return -1;
+    }
     return AeadHandler::GetInstance().SetMasterKey(fd, key_.data(),
                                                    key_.size());
   }
 
   size_t test_buf_len_;
+  size_t block_length_;
   std::string path_;
   CleansingVector<uint8_t> key_;
   char write_buffer_[kMaxTestBufLen];
@@ -89,8 +156,11 @@ class EnclaveStorageSecureTest : public ::testing::Test,
 
 const size_t buffer_length_vals[] = {128, 160, 512, 544};
 
-INSTANTIATE_TEST_SUITE_P(Instance1, EnclaveStorageSecureTest,
-                         ::testing::ValuesIn(buffer_length_vals));
+INSTANTIATE_TEST_SUITE_P(
+    Instance1, EnclaveStorageSecureTest,
+    ::testing::Combine(::testing::ValuesIn(buffer_length_vals),
+                       ::testing::Values(kLegacyBlockLength,
+                                         kDefaultBlockLength)));
 
 void EnclaveStorageSecureTest::PrepareTest() {
   path_ = absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir),
@@ -106,7 +176,8 @@ void EnclaveStorageSecureTest::PrepareTest() {
   ASSERT_EQ(RAND_bytes(key_.data(), key_.size()), 1);
 
   // Prepare test buffer.
-  test_buf_len_ = GetParam();
+  test_buf_len_ = std::get<0>(GetParam());
+  block_length_ = std::get<1>(GetParam());
   constexpr size_t pattern_length = 16;
   ASSERT_LE(test_buf_len_, kMaxTestBufLen);
   ASSERT_EQ(test_buf_len_ % pattern_length, 0);
@@ -212,6 +283,62 @@ Status EnclaveStorageSecureTest::OpenReadVerifyClose(off_t offset,
   return Status::OkStatus();
 }
 
+// Writes the test buffer to the test file in the legacy layout, as it would
+// have been written before block lengths became configurable.
+Status EnclaveStorageSecureTest::WriteLegacyFile() {
+  std::unique_ptr<GcmCryptor> cryptor = GcmCryptor::Create(
+      kLegacyBlockLength, GcmCryptorKey(key_.data(), key_.size()));
+  if (!cryptor) {
+    return Status(error::GoogleError::INTERNAL, "GcmCryptor creation failed.");
+  }
+
+  CTMMTAuthenticatedDictionary ad;
+  const size_t blocks_count =
+      (test_buf_len_ + kLegacyBlockLength - 1) / kLegacyBlockLength;
+  const size_t secure_block_length = SecureBlockLength(kLegacyBlockLength);
+  std::vector<uint8_t> file(kLegacyFileHeaderLength +
+                            blocks_count * secure_block_length);
+  for (size_t block = 0; block < blocks_count; block++) {
+    std::vector<uint8_t> plaintext(kLegacyBlockLength, 0);
+    const size_t offset = block * kLegacyBlockLength;
+    memcpy(plaintext.data(), write_buffer_ + offset,
+           std::min(kLegacyBlockLength, test_buf_len_ - offset));
+
+    uint8_t *secure_block =
+        file.data() + kLegacyFileHeaderLength + block * secure_block_length;
+    uint8_t *tag = secure_block + kLegacyBlockLength;
+    if (!cryptor->EncryptBlock(plaintext.data(), tag + kTagLength,
+                               secure_block)) {
+      return Status(error::GoogleError::INTERNAL, "Encryption failed.");
+    }
+    ad.AddLeaf(std::string(reinterpret_cast<char *>(tag), kTagLength));
+  }
+
+  // The legacy header holds the CMAC of the AD root and the file size,
+  // followed by the file size.
+  const size_t file_size = test_buf_len_;
+  std::string digest = ad.CurrentRoot();
+  digest.append(reinterpret_cast<const char *>(&file_size), sizeof(file_size));
+  if (!cryptor->GetAuthTag(file.data(),
+                           reinterpret_cast<const uint8_t *>(digest.data()),
+                           digest.size())) {
+    return Status(error::GoogleError::INTERNAL, "CMAC generation failed.");
+  }
+  memcpy(file.data() + kFileHashLength, &file_size, sizeof(file_size));
+
+  int fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                              S_IRWXU | S_IRWXG | S_IRWXO);
+  if (fd < 0) {
+    return Status(error::GoogleError::INTERNAL, "Open failed.");
+  }
+  platform::storage::FdCloser fd_closer(fd, &enc_untrusted_close);
+  if (enc_untrusted_write(fd, file.data(), file.size()) != file.size()) {
+    return Status(error::GoogleError::INTERNAL, "Write failed.");
+  }
+
+  return Status::OkStatus();
+}
+
 //
 // Success cases.
 //
@@ -439,7 +566,7 @@ TEST_P(EnclaveStorageSecureTest, ModificationWriteSuccessTest) {
   EXPECT_THAT(OpenWriteClose(0), IsOk());
   EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
 
-  if (test_buf_len_ / kBlockLength != 1) {
+  if (test_buf_len_ / block_length_ != 1) {
     // Test mixed update-append write: lseek to the middle of written range -
     // the next write will include both updated and appended file data.
     off_t offset = test_buf_len_ / 2;
@@ -470,15 +597,15 @@ TEST_P(EnclaveStorageSecureTest, ModificationWriteSuccessTest) {
 
 TEST_P(EnclaveStorageSecureTest, SimpleMisalignedWriteSuccess) {
   EXPECT_THAT(OpenWriteClose(0), IsOk());
-  // Lseek to the middle of the last block.
-  off_t offset = test_buf_len_ - kBlockLength / 2;
+  // Lseek to a misaligned offset within the written range.
+  off_t offset = test_buf_len_ - kLegacyBlockLength / 2;
   EXPECT_THAT(OpenWriteClose(offset), IsOk());
 }
 
 TEST_P(EnclaveStorageSecureTest, SimpleMisalignedReadSuccess) {
   EXPECT_THAT(OpenWriteClose(0), IsOk());
-  // Lseek to the middle of the first block.
-  off_t offset = kBlockLength / 2;
+  // Lseek to a misaligned offset within the first block.
+  off_t offset = kLegacyBlockLength / 2;
   EXPECT_THAT(OpenReadVerifyClose(offset, test_buf_len_ - offset), IsOk());
 }
 
@@ -503,6 +630,622 @@ TEST_P(EnclaveStorageSecureTest, LseekEndSuccess) {
   EXPECT_EQ(secure_close(fd), 0);
 }
 
+TEST_P(EnclaveStorageSecureTest, BlockLengthDeterminesLayout) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+
+  // Data is stored in full blocks of the configured length.
+  const size_t blocks_count =
+      (test_buf_len_ + block_length_ - 1) / block_length_;
+  EXPECT_EQ(
+      GetPhysicalFileSize(),
+      kFileHeaderLength + blocks_count * SecureBlockLength(block_length_));
+
+  // The block length is recorded in the file.
+  int fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(AeadHandler::GetInstance().GetBlockLength(fd), block_length_);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+}
+
+TEST_P(EnclaveStorageSecureTest, ReopenLargeFileSuccess) {
+  // Large enough for integrity metadata to be collected in several reads.
+  constexpr size_t kLargeFileLength = 3 * 1024 * 1024;
+  std::vector<uint8_t> data(kLargeFileLength);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = i % 251;
+  }
+
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+  EXPECT_EQ(secure_close(fd), 0);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  std::vector<uint8_t> read_data(data.size());
+  EXPECT_EQ(secure_read(fd, read_data.data(), read_data.size()),
+            read_data.size());
+  EXPECT_EQ(read_data, data);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  // Modify the auth tag of the last block - form of tampering.
+  const off_t physical_size = GetPhysicalFileSize();
+  fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  const off_t last_tag_offset =
+      physical_size - SecureBlockLength(block_length_) + block_length_;
+  EXPECT_EQ(enc_untrusted_lseek(fd, last_tag_offset, SEEK_SET),
+            last_tag_offset);
+  EXPECT_EQ(enc_untrusted_write(fd, kTamperData, kTagLength), kTagLength);
+  ASSERT_EQ(enc_untrusted_close(fd), 0) << strerror(errno);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(EmulateSetKeyIoctl(fd), -1);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, ConcurrentReadWriteSuccess) {
+  constexpr size_t kFileLength = 256 * 1024;
+  constexpr int kReaders = 4;
+  constexpr int kReadsPerReader = 64;
+  std::vector<uint8_t> data(kFileLength);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = i % 251;
+  }
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  // Readers verify random ranges through their own descriptors, while the
+  // writer rewrites the file with the same contents.
+  std::vector<std::thread> threads;
+  for (int reader = 0; reader < kReaders; reader++) {
+    threads.emplace_back([this, reader, &data]() {
+      int reader_fd = secure_open(GetPath().c_str(), O_RDONLY);
+      ASSERT_GE(reader_fd, 0);
+      ASSERT_EQ(EmulateSetKeyIoctl(reader_fd), 0);
+      std::mt19937 random(reader);
+      std::uniform_int_distribution<size_t> offsets(0, data.size() - 1);
+      std::vector<uint8_t> buffer(test_buf_len_);
+      for (int i = 0; i < kReadsPerReader; i++) {
+        off_t offset = offsets(random);
+        size_t count = std::min(buffer.size(), data.size() - offset);
+        ASSERT_EQ(secure_lseek(reader_fd, offset, SEEK_SET), offset);
+        ASSERT_EQ(secure_read(reader_fd, buffer.data(), count), count);
+        EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + count,
+                               data.begin() + offset));
+      }
+      EXPECT_EQ(secure_close(reader_fd), 0);
+    });
+  }
+  for (size_t offset = 0; offset < data.size(); offset += block_length_) {
+    ASSERT_EQ(secure_lseek(fd, offset, SEEK_SET), offset);
+    ASSERT_EQ(secure_write(fd, data.data() + offset, block_length_),
+              block_length_);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+// Reads and writes ranges spanning several pipeline chunks, which start and
+// end within blocks, some of them in a sparse region.
+TEST_P(EnclaveStorageSecureTest, LargeMisalignedReadWriteSuccess) {
+  constexpr size_t kDataLength = 3 * 1024 * 1024 + 123;
+  const off_t data_offset = 5 * block_length_ + 77;
+  std::vector<uint8_t> expected(data_offset + kDataLength, 0);
+  for (size_t i = data_offset; i < expected.size(); i++) {
+    expected[i] = i % 251;
+  }
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_lseek(fd, data_offset, SEEK_SET), data_offset);
+  ASSERT_EQ(secure_write(fd, expected.data() + data_offset, kDataLength),
+            kDataLength);
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), expected.size());
+
+  for (off_t offset :
+       {off_t{0}, static_cast<off_t>(block_length_ + 5), data_offset}) {
+    std::vector<uint8_t> buffer(expected.size() - offset);
+    ASSERT_EQ(secure_lseek(fd, offset, SEEK_SET), offset);
+    ASSERT_EQ(secure_read(fd, buffer.data(), buffer.size()), buffer.size());
+    EXPECT_TRUE(std::equal(buffer.begin(), buffer.end(),
+                           expected.begin() + offset));
+    EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), expected.size());
+  }
+
+  // Reading beyond the end of the file returns the data up to the end.
+  std::vector<uint8_t> buffer(expected.size() + 3 * block_length_);
+  ASSERT_EQ(secure_lseek(fd, 0, SEEK_SET), 0);
+  ASSERT_EQ(secure_read(fd, buffer.data(), buffer.size()), expected.size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), buffer.begin()));
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+// Large reads and writes succeed with the block processing confined to the
+// calling thread.
+TEST_P(EnclaveStorageSecureTest, LargeReadWriteWithoutWorkersSuccess) {
+  constexpr size_t kDataLength = 2 * 1024 * 1024 + 45;
+  std::vector<uint8_t> expected(kDataLength);
+  for (size_t i = 0; i < expected.size(); i++) {
+    expected[i] = i % 253;
+  }
+
+  AeadHandler::GetInstance().SetMaxWorkers(0);
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_write(fd, expected.data(), expected.size()),
+            expected.size());
+  std::vector<uint8_t> buffer(expected.size());
+  EXPECT_EQ(secure_pread(fd, buffer.data(), buffer.size(), 0), buffer.size());
+  EXPECT_EQ(buffer, expected);
+  EXPECT_EQ(secure_close(fd), 0);
+  AeadHandler::GetInstance().SetMaxWorkers(WorkerPool::kDefaultMaxWorkers);
+}
+
+// Positional reads and writes access the requested offsets and leave the
+// cursor in place.
+TEST_P(EnclaveStorageSecureTest, PositionalReadWriteSuccess) {
+  constexpr size_t kFileLength = 64 * 1024;
+  std::vector<uint8_t> expected(kFileLength);
+  for (size_t i = 0; i < expected.size(); i++) {
+    expected[i] = i % 251;
+  }
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_pwrite(fd, expected.data(), expected.size(), 0),
+            expected.size());
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), 0);
+
+  const off_t cursor = 3 * block_length_ + 1;
+  ASSERT_EQ(secure_lseek(fd, cursor, SEEK_SET), cursor);
+  const off_t offset = 7 * block_length_ + 5;
+  const size_t count = 2 * block_length_ + 9;
+  std::fill_n(expected.begin() + offset, count, 'x');
+  ASSERT_EQ(secure_pwrite(fd, expected.data() + offset, count, offset), count);
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), cursor);
+
+  std::vector<uint8_t> buffer(count + block_length_);
+  for (off_t read_offset : {off_t{0}, offset - 1, cursor}) {
+    ASSERT_EQ(secure_pread(fd, buffer.data(), buffer.size(), read_offset),
+              buffer.size());
+    EXPECT_TRUE(std::equal(buffer.begin(), buffer.end(),
+                           expected.begin() + read_offset));
+    EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), cursor);
+  }
+
+  // Positional reads stop at the end of the file.
+  EXPECT_EQ(secure_pread(fd, buffer.data(), buffer.size(), kFileLength - 3), 3);
+  EXPECT_EQ(secure_pread(fd, buffer.data(), buffer.size(), kFileLength), 0);
+  EXPECT_EQ(secure_pread(fd, buffer.data(), buffer.size(), -1), -1);
+
+  // Cursor-based reads continue from the cursor.
+  ASSERT_EQ(secure_read(fd, buffer.data(), buffer.size()), buffer.size());
+  EXPECT_TRUE(
+      std::equal(buffer.begin(), buffer.end(), expected.begin() + cursor));
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_CUR), cursor + buffer.size());
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+// Several threads read random ranges through a single descriptor.
+TEST_P(EnclaveStorageSecureTest, ConcurrentPositionalReadSuccess) {
+  constexpr size_t kFileLength = 256 * 1024;
+  constexpr int kReaders = 4;
+  constexpr int kReadsPerReader = 64;
+  std::vector<uint8_t> data(kFileLength);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = i % 251;
+  }
+
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  std::vector<std::thread> threads;
+  for (int reader = 0; reader < kReaders; reader++) {
+    threads.emplace_back([this, fd, reader, &data]() {
+      std::mt19937 random(reader);
+      std::uniform_int_distribution<size_t> offsets(0, data.size() - 1);
+      std::vector<uint8_t> buffer(test_buf_len_);
+      for (int i = 0; i < kReadsPerReader; i++) {
+        off_t offset = offsets(random);
+        size_t count = std::min(buffer.size(), data.size() - offset);
+        ASSERT_EQ(secure_pread(fd, buffer.data(), count, offset), count);
+        EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + count,
+                               data.begin() + offset));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+// Small writes to a file in write-back are buffered and the digest is updated
+// only on sync, while reads observe the writes.
+TEST_P(EnclaveStorageSecureTest, WriteBackDefersDigestUntilSync) {
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(AeadHandler::GetInstance().SetWriteBack(fd, absl::Hours(1)), 0);
+  const off_t initial_physical_size = GetPhysicalFileSize();
+
+  constexpr int kWrites = 20;
+  for (int i = 0; i < kWrites; i++) {
+    ASSERT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_),
+              test_buf_len_);
+  }
+  EXPECT_EQ(GetPhysicalFileSize(), initial_physical_size);
+  EXPECT_EQ(GetRecordedFileSize(), 0);
+  EXPECT_EQ(AeadHandler::GetInstance().GetLogicalFileSize(fd),
+            kWrites * test_buf_len_);
+
+  // Reads write out buffered data, but do not update the digest.
+  ASSERT_EQ(secure_pread(fd, GetReadBuffer(), test_buf_len_, test_buf_len_),
+            test_buf_len_);
+  EXPECT_EQ(memcmp(GetReadBuffer(), GetWriteBuffer(), test_buf_len_), 0);
+  EXPECT_GT(GetPhysicalFileSize(), initial_physical_size);
+  EXPECT_EQ(GetRecordedFileSize(), 0);
+
+  ASSERT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  ASSERT_EQ(secure_fsync(fd), 0);
+  EXPECT_EQ(GetRecordedFileSize(), (kWrites + 1) * test_buf_len_);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  for (int i = 0; i <= kWrites; i++) {
+    ASSERT_THAT(OpenReadVerifyClose(i * test_buf_len_, test_buf_len_), IsOk());
+  }
+}
+
+// Closing a file in write-back writes out buffered data and the digest.
+TEST_P(EnclaveStorageSecureTest, WriteBackPersistsOnClose) {
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(AeadHandler::GetInstance().SetWriteBack(fd, absl::Hours(1)), 0);
+
+  // Writes a sparse region, and rewrites data within the buffered range.
+  const off_t offset = 3 * block_length_ + 7;
+  ASSERT_EQ(secure_lseek(fd, offset, SEEK_SET), offset);
+  ASSERT_EQ(secure_write(fd, GetZeroBuffer(), test_buf_len_), test_buf_len_);
+  ASSERT_EQ(secure_pwrite(fd, GetWriteBuffer(), test_buf_len_, offset),
+            test_buf_len_);
+  EXPECT_EQ(GetRecordedFileSize(), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  EXPECT_EQ(GetRecordedFileSize(), offset + test_buf_len_);
+  EXPECT_THAT(OpenReadVerifyClose(offset, test_buf_len_), IsOk());
+
+  std::vector<uint8_t> sparse(offset, 1);
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_read(fd, sparse.data(), sparse.size()), sparse.size());
+  EXPECT_EQ(std::count(sparse.begin(), sparse.end(), 0), sparse.size());
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+// The digest of a file in write-back is updated by writes once the interval
+// passes.
+TEST_P(EnclaveStorageSecureTest, WriteBackIntervalUpdatesDigest) {
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(
+      AeadHandler::GetInstance().SetWriteBack(fd, absl::Milliseconds(20)), 0);
+
+  ASSERT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(GetRecordedFileSize(), 0);
+  absl::SleepFor(absl::Milliseconds(40));
+  ASSERT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(GetRecordedFileSize(), 2 * test_buf_len_);
+
+  // Switching back to write-through updates the digest on every write.
+  ASSERT_EQ(
+      AeadHandler::GetInstance().SetWriteBack(fd, absl::ZeroDuration()), 0);
+  ASSERT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(GetRecordedFileSize(), 3 * test_buf_len_);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+// Mixed reads and writes of a file in write-back, including writes that do not
+// extend the buffered range and writes longer than the buffer, match a plain
+// copy of the data.
+TEST_P(EnclaveStorageSecureTest, WriteBackRandomAccessSuccess) {
+  constexpr size_t kFileLength = 3 * kWriteBackBufferLength;
+  std::vector<uint8_t> expected(kFileLength, 0);
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(AeadHandler::GetInstance().SetWriteBack(fd, absl::Hours(1)), 0);
+  ASSERT_EQ(secure_pwrite(fd, expected.data(), expected.size(), 0),
+            expected.size());
+
+  std::mt19937 random(block_length_ + test_buf_len_);
+  std::uniform_int_distribution<size_t> offsets(0, kFileLength - 1);
+  std::vector<uint8_t> buffer(kWriteBackBufferLength + block_length_);
+  for (int i = 0; i < 200; i++) {
+    size_t offset = offsets(random);
+    size_t count = i % 50 == 0 ? buffer.size() : test_buf_len_;
+    count = std::min(count, kFileLength - offset);
+    if (i % 3 == 2) {
+      ASSERT_EQ(secure_pread(fd, buffer.data(), count, offset), count);
+      ASSERT_TRUE(std::equal(buffer.begin(), buffer.begin() + count,
+                             expected.begin() + offset));
+      continue;
+    }
+
+    // Sequences of writes extend the previous write.
+    for (int j = 0; j < 4 && offset + count <= kFileLength; j++) {
+      std::fill_n(buffer.begin(), count, i + j);
+      std::copy_n(buffer.begin(), count, expected.begin() + offset);
+      ASSERT_EQ(secure_pwrite(fd, buffer.data(), count, offset), count);
+      offset += count;
+    }
+  }
+  EXPECT_EQ(secure_close(fd), 0);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  std::vector<uint8_t> actual(kFileLength);
+  ASSERT_EQ(secure_read(fd, actual.data(), actual.size()), actual.size());
+  EXPECT_TRUE(actual == expected);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, BlockCacheServesRepeatedReads) {
+  std::vector<uint8_t> data(4 * block_length_);
+  std::iota(data.begin(), data.end(), 0);
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  // A misaligned read across two blocks misses the cache once, then hits it.
+  const size_t offset = block_length_ / 2;
+  std::vector<uint8_t> buffer(block_length_);
+  AeadHandler &handler = AeadHandler::GetInstance();
+  ASSERT_EQ(secure_pread(fd, buffer.data(), buffer.size(), offset),
+            buffer.size());
+  BlockCache::Stats stats = handler.GetBlockCacheStats();
+  for (int i = 0; i < 3; i++) {
+    std::fill(buffer.begin(), buffer.end(), 0);
+    ASSERT_EQ(secure_pread(fd, buffer.data(), buffer.size(), offset),
+              buffer.size());
+    EXPECT_TRUE(std::equal(buffer.begin(), buffer.end(),
+                           data.begin() + offset));
+  }
+  EXPECT_EQ(handler.GetBlockCacheStats().hits, stats.hits + 6);
+  EXPECT_EQ(handler.GetBlockCacheStats().misses, stats.misses);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, BlockCacheInvalidatedByWrite) {
+  std::vector<uint8_t> data(4 * block_length_, 'a');
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  std::vector<uint8_t> buffer(data.size());
+  ASSERT_EQ(secure_pread(fd, buffer.data(), buffer.size(), 0), buffer.size());
+  EXPECT_TRUE(buffer == data);
+
+  // Overwrite part of the cached blocks, then read them all back.
+  std::fill_n(data.begin() + block_length_ + 1, block_length_, 'b');
+  ASSERT_EQ(secure_pwrite(fd, data.data() + block_length_ + 1, block_length_,
+                          block_length_ + 1),
+            block_length_);
+  ASSERT_EQ(secure_pread(fd, buffer.data(), buffer.size(), 0), buffer.size());
+  EXPECT_TRUE(buffer == data);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_read(fd, buffer.data(), buffer.size()), buffer.size());
+  EXPECT_TRUE(buffer == data);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, SecureMappingLoadsPinnedPages) {
+  constexpr size_t kPageSize = SecureMapping::kPageSize;
+  std::vector<uint8_t> data(3 * kPageSize + 100);
+  std::iota(data.begin(), data.end(), 1);
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  auto mapping = SecureMapping::Create(fd, kPageSize, 4 * kPageSize,
+                                       /*shared=*/false);
+  ASSERT_NE(mapping, nullptr);
+  const uint8_t *pinned = mapping->Pin(10, kPageSize, /*write=*/false);
+  ASSERT_EQ(pinned, mapping->data() + 10);
+  EXPECT_TRUE(std::equal(pinned, pinned + kPageSize,
+                         data.begin() + kPageSize + 10));
+
+  // Pages are loaded only once pinned, and read as zeros beyond the file.
+  EXPECT_EQ(mapping->data()[2 * kPageSize], 0);
+  pinned = mapping->Pin(2 * kPageSize, 2 * kPageSize, /*write=*/false);
+  ASSERT_NE(pinned, nullptr);
+  EXPECT_TRUE(std::equal(pinned, pinned + 100, data.begin() + 3 * kPageSize));
+  EXPECT_TRUE(std::all_of(pinned + 100, pinned + 2 * kPageSize,
+                          [](uint8_t byte) { return byte == 0; }));
+
+  EXPECT_EQ(mapping->Pin(4 * kPageSize, 1, /*write=*/false), nullptr);
+  mapping.reset();
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, SecureMappingWritesBackDirtyPages) {
+  constexpr size_t kPageSize = SecureMapping::kPageSize;
+  std::vector<uint8_t> data(2 * kPageSize + 100, 'a');
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  for (bool shared : {false, true}) {
+    auto mapping = SecureMapping::Create(fd, 0, 3 * kPageSize, shared);
+    ASSERT_NE(mapping, nullptr);
+    uint8_t *pinned = mapping->Pin(kPageSize - 1, 2 * kPageSize, true);
+    ASSERT_NE(pinned, nullptr);
+    std::fill_n(pinned, 2 * kPageSize, shared ? 'c' : 'b');
+    EXPECT_EQ(mapping->Sync(), 0);
+  }
+
+  // Only the shared mapping is written back, and only up to the end of file.
+  std::fill_n(data.begin() + kPageSize - 1, kPageSize + 101, 'c');
+  std::vector<uint8_t> actual(3 * kPageSize);
+  EXPECT_EQ(secure_pread(fd, actual.data(), actual.size(), 0), data.size());
+  actual.resize(data.size());
+  EXPECT_TRUE(actual == data);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, SecureMmapSuccess) {
+  std::vector<uint8_t> data(3 * test_buf_len_, 'a');
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  EXPECT_EQ(secure_mmap(nullptr, data.size(), PROT_READ, MAP_ANONYMOUS, fd, 0),
+            MAP_FAILED);
+  void *addr = secure_mmap(nullptr, data.size(), PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+  ASSERT_NE(addr, MAP_FAILED);
+  uint8_t *mapped = static_cast<uint8_t *>(addr);
+  EXPECT_TRUE(std::equal(data.begin(), data.end(), mapped));
+
+  std::fill_n(mapped + test_buf_len_, test_buf_len_, 'b');
+  std::fill_n(data.begin() + test_buf_len_, test_buf_len_, 'b');
+  EXPECT_EQ(secure_msync(mapped + test_buf_len_, test_buf_len_, MS_SYNC), 0);
+  std::vector<uint8_t> actual(data.size());
+  EXPECT_EQ(secure_pread(fd, actual.data(), actual.size(), 0), data.size());
+  EXPECT_TRUE(actual == data);
+
+  mapped[0] = 'c';
+  data[0] = 'c';
+  EXPECT_EQ(secure_munmap(addr, data.size() - 1), -1);
+  EXPECT_EQ(secure_munmap(addr, data.size()), 0);
+  EXPECT_EQ(secure_pread(fd, actual.data(), actual.size(), 0), data.size());
+  EXPECT_TRUE(actual == data);
+  EXPECT_EQ(secure_msync(addr, data.size(), MS_SYNC), -1);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+// Verifies that msync() writes back only the changed pages in its range, and
+// that neither msync() nor munmap() reverts writes made through the file
+// descriptor to pages the mapping did not change.
+TEST_P(EnclaveStorageSecureTest, SecureMsyncWritesBackChangedPagesInRange) {
+  constexpr size_t kPageSize = SecureMapping::kPageSize;
+  std::vector<uint8_t> data(3 * kPageSize, 'a');
+  int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  ASSERT_EQ(secure_write(fd, data.data(), data.size()), data.size());
+
+  void *addr = secure_mmap(nullptr, data.size(), PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+  ASSERT_NE(addr, MAP_FAILED);
+  uint8_t *mapped = static_cast<uint8_t *>(addr);
+  EXPECT_EQ(secure_msync(addr, data.size(), MS_SYNC | MS_ASYNC), -1);
+  EXPECT_EQ(errno, EINVAL);
+
+  // Write the last page through the descriptor and the first page through the
+  // mapping. Syncing the middle page writes back nothing.
+  const std::vector<uint8_t> written(kPageSize, 'w');
+  ASSERT_EQ(secure_pwrite(fd, written.data(), kPageSize, 2 * kPageSize),
+            kPageSize);
+  std::fill_n(data.begin() + 2 * kPageSize, kPageSize, 'w');
+  std::fill_n(mapped, kPageSize, 'm');
+  EXPECT_EQ(secure_msync(mapped + kPageSize, kPageSize, MS_SYNC), 0);
+  std::vector<uint8_t> actual(data.size());
+  EXPECT_EQ(secure_pread(fd, actual.data(), actual.size(), 0), data.size());
+  EXPECT_TRUE(actual == data);
+
+  // Syncing the whole mapping writes back only the first page.
+  std::fill_n(data.begin(), kPageSize, 'm');
+  EXPECT_EQ(secure_msync(addr, data.size(), MS_ASYNC), 0);
+  EXPECT_EQ(secure_pread(fd, actual.data(), actual.size(), 0), data.size());
+  EXPECT_TRUE(actual == data);
+
+  EXPECT_EQ(secure_munmap(addr, data.size()), 0);
+  EXPECT_EQ(secure_pread(fd, actual.data(), actual.size(), 0), data.size());
+  EXPECT_TRUE(actual == data);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, ReadWriteLegacyFileSuccess) {
+  ASSERT_THAT(WriteLegacyFile(), IsOk());
+  const off_t legacy_file_size = GetPhysicalFileSize();
+
+  // Legacy files are read in their own layout, regardless of the block length
+  // requested for new files.
+  int fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(AeadHandler::GetInstance().GetBlockLength(fd), kLegacyBlockLength);
+  EXPECT_EQ(AeadHandler::GetInstance().SetMasterKey(fd, key_.data(),
+                                                    key_.size()),
+            0);
+  EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(memcmp(GetWriteBuffer(), GetReadBuffer(), test_buf_len_), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  // Updates keep the legacy layout.
+  fd = secure_open(GetPath().c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(AeadHandler::GetInstance().SetMasterKey(fd, key_.data(),
+                                                    key_.size()),
+            0);
+  EXPECT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(secure_close(fd), 0);
+  EXPECT_EQ(GetPhysicalFileSize(), legacy_file_size);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(AeadHandler::GetInstance().SetMasterKey(fd, key_.data(),
+                                                    key_.size()),
+            0);
+  EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+  EXPECT_EQ(memcmp(GetWriteBuffer(), GetReadBuffer(), test_buf_len_), 0);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
 //
 // Failure cases.
 //
@@ -540,8 +1283,8 @@ TEST_P(EnclaveStorageSecureTest, ReadWriteAuthTagsModified) {
   // Modify an auth tag - form of tampering.
   int fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY);
   ASSERT_GE(fd, 0);
-  EXPECT_GT(enc_untrusted_lseek(fd, kFileHeaderLength + kBlockLength, SEEK_SET),
-            0);
+  EXPECT_GT(
+      enc_untrusted_lseek(fd, kFileHeaderLength + block_length_, SEEK_SET), 0);
   EXPECT_GT(enc_untrusted_write(fd, kTamperData, ABSL_ARRAYSIZE(kTamperData)),
             0);
   ASSERT_EQ(enc_untrusted_fsync(fd), 0) << strerror(errno);
@@ -556,9 +1299,9 @@ TEST_P(EnclaveStorageSecureTest, ReadWriteTokensModified) {
   // Modify a token - form of tampering.
   int fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY);
   ASSERT_GE(fd, 0);
-  EXPECT_GT(
-      enc_untrusted_lseek(fd, kFileHeaderLength + kCipherBlockLength, SEEK_SET),
-      0);
+  EXPECT_GT(enc_untrusted_lseek(
+                fd, kFileHeaderLength + block_length_ + kTagLength, SEEK_SET),
+            0);
   EXPECT_GT(enc_untrusted_write(fd, kTamperData, ABSL_ARRAYSIZE(kTamperData)),
             0);
   ASSERT_EQ(enc_untrusted_fsync(fd), 0) << strerror(errno);
@@ -631,5 +1374,56 @@ TEST_P(EnclaveStorageSecureTest, UnsupportedFileCreationFlagFailure) {
   EXPECT_EQ(fd, -1);
 }
 
+TEST_P(EnclaveStorageSecureTest, InvalidBlockLengthFailure) {
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+
+  EXPECT_EQ(AeadHandler::GetInstance().SetBlockLength(fd, 0), -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(AeadHandler::GetInstance().SetBlockLength(fd, 1000), -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(AeadHandler::GetInstance().SetBlockLength(fd, 2 * kMaxBlockLength),
+            -1);
+  EXPECT_EQ(errno, EINVAL);
+
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, ChangeBlockLengthOfExistingFileFailure) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+
+  int fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(AeadHandler::GetInstance().SetBlockLength(fd, block_length_), 0);
+  EXPECT_EQ(AeadHandler::GetInstance().SetBlockLength(fd, 2 * block_length_),
+            -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+}
+
+TEST_P(EnclaveStorageSecureTest, LegacyFileDigestModified) {
+  ASSERT_THAT(WriteLegacyFile(), IsOk());
+
+  // Modify the stored file size - form of tampering.
+  int fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(enc_untrusted_lseek(fd, kFileHashLength, SEEK_SET),
+            kFileHashLength);
+  const size_t file_size = test_buf_len_ + 1;
+  EXPECT_EQ(enc_untrusted_write(fd, &file_size, sizeof(file_size)),
+            sizeof(file_size));
+  ASSERT_EQ(enc_untrusted_close(fd), 0) << strerror(errno);
+
+  fd = secure_open(GetPath().c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(AeadHandler::GetInstance().SetMasterKey(fd, key_.data(),
+                                                    key_.size()),
+            -1);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -0,0 +1,236 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/secure_mapping.h"
+
+#include <openssl/mem.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "asylo/platform/storage/secure/aead_handler.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+constexpr size_t SecureMapping::kPageSize;
+
+std::unique_ptr<SecureMapping> SecureMapping::Create(int fd, off_t offset,
+                                                     size_t length,
+                                                     bool shared) {
+  if (offset < 0 || offset % kPageSize != 0 || length == 0) {
+    LOG(ERROR) << "Invalid range to map, offset = " << offset
+               << ", length = " << length;
+    return nullptr;
+  }
+  if (!AeadHandler::GetInstance().GetOffsetTranslator(fd)) {
+    LOG(ERROR) << "Attempt made to map an unopened file, fd = " << fd;
+    return nullptr;
+  }
+
+  const size_t pages = (length + kPageSize - 1) / kPageSize;
+  void *data = nullptr;
+  if (posix_memalign(&data, kPageSize, pages * kPageSize) != 0) {
+    LOG(ERROR) << "Failed to allocate a mapping of " << length << " bytes";
+    return nullptr;
+  }
+  memset(data, 0, pages * kPageSize);
+
+  return std::unique_ptr<SecureMapping>(new SecureMapping(
+      fd, offset, length, shared,
+      std::unique_ptr<uint8_t, Deleter>(static_cast<uint8_t *>(data),
+                                        Deleter{pages * kPageSize})));
+}
+
+SecureMapping::SecureMapping(int fd, off_t offset, size_t length, bool shared,
+                             std::unique_ptr<uint8_t, Deleter> data)
+    : fd_(fd),
+      offset_(offset),
+      length_(length),
+      shared_(shared),
+      data_(std::move(data)),
+      pages_(data_.get_deleter().length / kPageSize, PageState::kUnloaded),
+      digests_(pages_.size()) {}
+
+SecureMapping::~SecureMapping() {
+  if (Sync() != 0) {
+    LOG(ERROR) << "Failed to write back a mapping of fd = " << fd_;
+  }
+}
+
+void SecureMapping::Deleter::operator()(uint8_t *data) const {
+  OPENSSL_cleanse(data, length);
+  free(data);
+}
+
+bool SecureMapping::PageRange(size_t offset, size_t length, size_t *begin_page,
+                              size_t *end_page) const {
+  if (offset > length_ || length > length_ - offset) {
+    LOG(ERROR) << "Range exceeds the mapping, offset = " << offset
+               << ", length = " << length;
+    return false;
+  }
+  *begin_page = offset / kPageSize;
+  *end_page = (offset + length + kPageSize - 1) / kPageSize;
+  return true;
+}
+
+void SecureMapping::UpdateDigests(size_t begin_page, size_t end_page) {
+  for (size_t page = begin_page; page < end_page; page++) {
+    digests_[page] = Digest(page);
+  }
+}
+
+SecureMapping::PageDigest SecureMapping::Digest(size_t page) const {
+  PageDigest digest;
+  SHA256(data() + page * kPageSize, kPageSize, digest.data());
+  return digest;
+}
+
+template <typename Visitor>
+bool SecureMapping::ForEachRun(size_t begin_page, size_t end_page,
+                               PageState state, Visitor visit) {
+  size_t page = begin_page;
+  while (page < end_page) {
+    if (pages_[page] != state) {
+      page++;
+      continue;
+    }
+    size_t run_end = page + 1;
+    while (run_end < end_page && pages_[run_end] == state) {
+      run_end++;
+    }
+    if (!visit(page, run_end)) {
+      return false;
+    }
+    page = run_end;
+  }
+  return true;
+}
+
+uint8_t *SecureMapping::Pin(size_t offset, size_t length, bool write) {
+  size_t begin_page;
+  size_t end_page;
+  if (!PageRange(offset, length, &begin_page, &end_page)) {
+    return nullptr;
+  }
+  if (length == 0) {
+    return data() + offset;
+  }
+
+  absl::MutexLock lock(&mu_);
+
+  // Load runs of unloaded pages with a read each, so that larger runs are
+  // decrypted in parallel.
+  bool loaded = ForEachRun(
+      begin_page, end_page, PageState::kUnloaded,
+      [this](size_t first_page, size_t last_page) {
+        uint8_t *buf = data() + first_page * kPageSize;
+        size_t count = (last_page - first_page) * kPageSize;
+        off_t file_offset = offset_ + first_page * kPageSize;
+        while (count > 0) {
+          ssize_t bytes_read = AeadHandler::GetInstance().DecryptAndVerify(
+              fd_, buf, count, file_offset);
+          if (bytes_read < 0) {
+            return false;
+          }
+          if (bytes_read == 0) {
+            // The rest of the run is beyond the end of the file.
+            break;
+          }
+          buf += bytes_read;
+          count -= bytes_read;
+          file_offset += bytes_read;
+        }
+        std::fill(pages_.begin() + first_page, pages_.begin() + last_page,
+                  PageState::kClean);
+        UpdateDigests(first_page, last_page);
+        return true;
+      });
+  if (!loaded) {
+    LOG(ERROR) << "Failed to load pages of a mapping of fd = " << fd_;
+    return nullptr;
+  }
+
+  if (write) {
+    std::fill(pages_.begin() + begin_page, pages_.begin() + end_page,
+              PageState::kDirty);
+  }
+  return data() + offset;
+}
+
+void SecureMapping::MarkChangedPagesDirty(size_t offset, size_t length) {
+  size_t begin_page;
+  size_t end_page;
+  if (!PageRange(offset, length, &begin_page, &end_page)) {
+    return;
+  }
+
+  absl::MutexLock lock(&mu_);
+  for (size_t page = begin_page; page < end_page; page++) {
+    if (pages_[page] == PageState::kClean && Digest(page) != digests_[page]) {
+      pages_[page] = PageState::kDirty;
+    }
+  }
+}
+
+int SecureMapping::Sync(size_t offset, size_t length) {
+  if (!shared_) {
+    return 0;
+  }
+  size_t begin_page;
+  size_t end_page;
+  if (!PageRange(offset, length, &begin_page, &end_page)) {
+    return -1;
+  }
+
+  absl::MutexLock lock(&mu_);
+  const off_t file_size = AeadHandler::GetInstance().GetLogicalFileSize(fd_);
+  if (file_size < 0) {
+    return -1;
+  }
+
+  // Writing to a mapping does not extend the file, hence dirty pages are only
+  // written back up to the end of the file.
+  bool synced = ForEachRun(
+      begin_page, end_page, PageState::kDirty,
+      [this, file_size](size_t first_page, size_t last_page) {
+        off_t begin = offset_ + first_page * kPageSize;
+        off_t end = std::min<off_t>(
+            offset_ + std::min(last_page * kPageSize, length_), file_size);
+        if (end > begin &&
+            AeadHandler::GetInstance().EncryptAndPersist(
+                fd_, data() + first_page * kPageSize, end - begin, begin) !=
+                end - begin) {
+          return false;
+        }
+        std::fill(pages_.begin() + first_page, pages_.begin() + last_page,
+                  PageState::kClean);
+        UpdateDigests(first_page, last_page);
+        return true;
+      });
+  return synced ? 0 : -1;
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
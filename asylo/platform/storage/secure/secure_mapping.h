@@ -0,0 +1,150 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_SECURE_MAPPING_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_SECURE_MAPPING_H_
+
+#include <openssl/sha.h>
+#include <sys/types.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// A range of an opened secure file mapped into enclave memory, emulating
+// mmap() for secure files. Pages of the mapping are decrypted and verified the
+// first time they are pinned, and the pages pinned for writing are encrypted
+// and written back to the file by Sync(). Writes to private mappings are never
+// written back.
+//
+// Permissions of enclave pages cannot be changed from within the enclave, so
+// first access to a page cannot be trapped by a page fault. Accessing the
+// mapping through Pin() rather than data() is what makes loading and dirty
+// tracking lazy. Writes through data() are found by MarkChangedPagesDirty(),
+// which compares loaded pages with a digest taken when they were loaded.
+//
+// A mapping does not observe writes made to the file through its descriptor
+// after the pages were loaded, and writing back a page changed in the mapping
+// overwrites such writes to the same page.
+//
+// Memory of the mapping is cleansed when the mapping is destroyed. The file
+// descriptor of the mapping must stay open as long as the mapping exists.
+class SecureMapping {
+ public:
+  static constexpr size_t kPageSize = 4096;
+
+  // Maps |length| bytes of opened secure file |fd| from logical |offset|, which
+  // must be a multiple of kPageSize. Changes to a |shared| mapping are written
+  // back to the file. Returns nullptr on failure.
+  static std::unique_ptr<SecureMapping> Create(int fd, off_t offset,
+                                               size_t length, bool shared);
+
+  // Writes back the dirty pages of a shared mapping.
+  ~SecureMapping();
+
+  // Returns the page aligned memory of the mapping. Only pinned ranges of the
+  // mapping hold the contents of the file.
+  uint8_t *data() const { return data_.get(); }
+
+  size_t length() const { return length_; }
+
+  // Loads the pages of [|offset|, |offset| + |length|) of the mapping that are
+  // not loaded yet, and marks them dirty if |write| is true. Returns a pointer
+  // to |offset| within the mapping, or nullptr on failure. Pages beyond the end
+  // of the file read as zeros.
+  uint8_t *Pin(size_t offset, size_t length, bool write)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Marks the loaded pages of [|offset|, |offset| + |length|) of the mapping
+  // dirty whose contents differ from when they were loaded or last written
+  // back, so that writes made through data() are written back by Sync().
+  void MarkChangedPagesDirty(size_t offset, size_t length)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes the dirty pages of a shared mapping that overlap [|offset|,
+  // |offset| + |length|) back to the file, up to the end of the file. Returns 0
+  // on success, or -1 on failure.
+  int Sync(size_t offset, size_t length) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes all dirty pages of a shared mapping back to the file.
+  int Sync() { return Sync(0, length_); }
+
+ private:
+  enum class PageState : uint8_t { kUnloaded, kClean, kDirty };
+
+  using PageDigest = std::array<uint8_t, SHA256_DIGEST_LENGTH>;
+
+  // Frees the memory of the mapping after cleansing it.
+  struct Deleter {
+    size_t length;
+    void operator()(uint8_t *data) const;
+  };
+
+  SecureMapping(int fd, off_t offset, size_t length, bool shared,
+                std::unique_ptr<uint8_t, Deleter> data);
+
+  // Returns the range of pages overlapping [|offset|, |offset| + |length|) of
+  // the mapping in |begin_page| and |end_page|, or false if the range exceeds
+  // the mapping.
+  bool PageRange(size_t offset, size_t length, size_t *begin_page,
+                 size_t *end_page) const;
+
+  // Records the digests of the contents of [|begin_page|, |end_page|).
+  void UpdateDigests(size_t begin_page, size_t end_page)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the digest of the contents of |page|.
+  PageDigest Digest(size_t page) const;
+
+  // Calls |visit| with the first page and the end of every run of consecutive
+  // pages in [|begin_page|, |end_page|) that are in |state|, stopping at the
+  // first failure. Returns false if |visit| failed.
+  template <typename Visitor>
+  bool ForEachRun(size_t begin_page, size_t end_page, PageState state,
+                  Visitor visit) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int fd_;
+  const off_t offset_;
+  const size_t length_;
+  const bool shared_;
+  const std::unique_ptr<uint8_t, Deleter> data_;
+
+  std::vector<PageState> pages_ ABSL_GUARDED_BY(mu_);
+
+  // Digests of loaded pages as of when they were loaded or last written back.
+  std::vector<PageDigest> digests_ ABSL_GUARDED_BY(mu_);
+  absl::Mutex mu_;
+
+  SecureMapping(const SecureMapping &) = delete;
+  SecureMapping &operator=(const SecureMapping &) = delete;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_SECURE_MAPPING_H_
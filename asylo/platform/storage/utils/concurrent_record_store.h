@@ -0,0 +1,335 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_UTILS_CONCURRENT_RECORD_STORE_H_
+#define ASYLO_PLATFORM_STORAGE_UTILS_CONCURRENT_RECORD_STORE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/util/logging.h"
+#include "asylo/platform/storage/utils/random_access_storage.h"
+#include "asylo/util/asylo_macros.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+// A thread-safe variant of RecordStore. Records of type T are addressed by
+// their byte offset into a storage resource, as with RecordStore, and the
+// caller remains responsible for the layout of the records.
+//
+// The cache is split into shards by record index, each with its own lock and
+// least-recently-used eviction policy, so that accesses to different records
+// rarely contend. Accesses to the storage resource are serialized, as
+// RandomAccessStorage implementations are not required to be thread-safe.
+//
+// Flush() writes runs of adjacent dirty records with a single write each. Reads
+// that miss the cache while scanning records sequentially may prefetch the
+// records that follow with the same read.
+template <typename T>
+class ConcurrentRecordStore {
+ public:
+  using value_type = T;
+
+  // Check that reading an object of type T from storage makes sense.
+  static_assert(std::is_trivially_copy_assignable<T>::value,
+                "T must satisfy std::is_trivially_copy_assignable");
+
+  static constexpr size_t kDefaultShardCount = 8;
+
+  // Initializes a ConcurrentRecordStore backed by a storage resource |io|, with
+  // a cache of |capacity| elements of type T split into |shard_count| shards.
+  // If |prefetch_count| is non-zero, a read that misses the cache right after a
+  // read of the preceding record also reads up to |prefetch_count| records that
+  // follow it. The ConcurrentRecordStore does not take ownership of |io|, which
+  // must remain valid over its lifetime.
+  ConcurrentRecordStore(size_t capacity, RandomAccessStorage *io,
+                        size_t shard_count = kDefaultShardCount,
+                        size_t prefetch_count = 0)
+      : io_(io), prefetch_count_(prefetch_count), next_offset_(-1),
+        write_backs_(0) {
+    shard_count = std::max<size_t>(std::min(shard_count, capacity), 1);
+    for (size_t i = 0; i < shard_count; i++) {
+      // Spread the capacity evenly over the shards.
+      size_t shard_capacity = capacity * (i + 1) / shard_count -
+                              capacity * i / shard_count;
+      shards_.emplace_back(new Shard(std::max<size_t>(shard_capacity, 1)));
+    }
+  }
+
+  ConcurrentRecordStore(const ConcurrentRecordStore<T> &) = delete;
+
+  ConcurrentRecordStore &operator=(const ConcurrentRecordStore<T> &) = delete;
+
+  // Flushes the cache to disk and finalizes the ConcurrentRecordStore.
+  ~ConcurrentRecordStore() {
+    Status status = Flush();
+    LOG_IF(ERROR, !status.ok()) << "Could not flush cache: " << status;
+  }
+
+  // Writes the dirty records of the cache to storage and synchronizes the
+  // storage resource. All other operations are blocked while dirty records are
+  // written. Returns an error status on failure.
+  ASYLO_MUST_USE_RESULT Status Flush() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    // Lock all shards, in a fixed order, so that no record is modified while
+    // it is being written.
+    for (auto &shard : shards_) {
+      shard->mu.Lock();
+    }
+    Status status = FlushLocked();
+    for (auto &shard : shards_) {
+      shard->mu.Unlock();
+    }
+    ASYLO_RETURN_IF_ERROR(status);
+
+    absl::MutexLock lock(&io_mu_);
+    return io_->Sync();
+  }
+
+  // Reads a record from storage into |item|, returning an error status on
+  // failure. |offset| specifies a byte-offset into the underlying storage
+  // resource. As with RecordStore, the value may be read from the cache.
+  ASYLO_MUST_USE_RESULT Status Read(off_t offset, T *item) {
+    const bool sequential =
+        prefetch_count_ > 0 &&
+        next_offset_.exchange(offset + sizeof(T)) == offset;
+    Shard &shard = GetShard(offset);
+    {
+      absl::MutexLock lock(&shard.mu);
+      auto it = shard.index.find(offset);
+      if (it != shard.index.end()) {
+        MoveToFront(&shard, it->second);
+        *item = it->second->value;
+        return Status::OkStatus();
+      }
+    }
+
+    // Read the record without holding the lock of its shard, along with the
+    // records that follow it if the read continues a sequential scan.
+    size_t count = 1;
+    std::vector<T> records;
+    const uint64_t write_backs = write_backs_.load();
+    {
+      absl::MutexLock lock(&io_mu_);
+      if (sequential) {
+        size_t size;
+        ASYLO_ASSIGN_OR_RETURN(size, io_->Size());
+        if (size > offset) {
+          count = std::min((size - offset) / sizeof(T), prefetch_count_ + 1);
+          count = std::max<size_t>(count, 1);
+        }
+      }
+      records.resize(count);
+      ASYLO_RETURN_IF_ERROR(
+          io_->Read(records.data(), offset, count * sizeof(T)));
+    }
+
+    // A record written back while it was being read may be read stale, in
+    // which case none of the records read are cached.
+    const bool cacheable = write_backs_.load() == write_backs;
+    for (size_t i = count - 1; i > 0 && cacheable; i--) {
+      ASYLO_RETURN_IF_ERROR(
+          Fill(offset + i * sizeof(T), records[i], /*item=*/nullptr));
+    }
+    *item = records[0];
+    if (!cacheable) {
+      return Status::OkStatus();
+    }
+    return Fill(offset, records[0], item);
+  }
+
+  // Writes |item| to the record store, returning an error status on failure.
+  // |offset| specifies a byte-offset into the underlying storage resource.
+  // Writes are cached and may not be persisted to storage until Flush() is
+  // called or the ConcurrentRecordStore is destroyed.
+  ASYLO_MUST_USE_RESULT Status Write(off_t offset, const T &item) {
+    Shard &shard = GetShard(offset);
+    absl::MutexLock lock(&shard.mu);
+    NodeRef node;
+    auto it = shard.index.find(offset);
+    if (it != shard.index.end()) {
+      node = it->second;
+      MoveToFront(&shard, node);
+    } else {
+      ASYLO_ASSIGN_OR_RETURN(node, Insert(&shard, offset));
+    }
+    node->value = item;
+    node->dirty = true;
+    return Status::OkStatus();
+  }
+
+  // Returns true if a record specified by its byte-offset is present in the
+  // cache.
+  bool IsCached(off_t offset) const {
+    const Shard &shard = GetShard(offset);
+    absl::MutexLock lock(&shard.mu);
+    return shard.index.contains(offset);
+  }
+
+ private:
+  struct CacheEntry {
+    off_t offset;  // Byte offset of this record.
+    T value;       // Cached record value.
+    bool dirty;    // True if this entry has been modified.
+  };
+
+  using NodeRef = typename std::list<CacheEntry>::iterator;
+
+  // A part of the cache, maintained in LRU order.
+  struct Shard {
+    explicit Shard(size_t capacity) : capacity(capacity), count(0) {}
+
+    const size_t capacity;
+    size_t count ABSL_GUARDED_BY(mu);
+    std::list<CacheEntry> cache ABSL_GUARDED_BY(mu);
+    absl::flat_hash_map<off_t, NodeRef> index ABSL_GUARDED_BY(mu);
+    mutable absl::Mutex mu;
+  };
+
+  Shard &GetShard(off_t offset) const {
+    return *shards_[static_cast<uint64_t>(offset) / sizeof(T) %
+                    shards_.size()];
+  }
+
+  // Caches |value| read from storage as the record at |offset| unless the
+  // record is cached already, and copies the cached record to |item| if it is
+  // not null. Returns an error status on failure.
+  ASYLO_MUST_USE_RESULT Status Fill(off_t offset, const T &value, T *item) {
+    Shard &shard = GetShard(offset);
+    absl::MutexLock lock(&shard.mu);
+    auto it = shard.index.find(offset);
+    NodeRef node;
+    if (it != shard.index.end()) {
+      // The record was cached while it was being read, and may have been
+      // modified since.
+      node = it->second;
+      MoveToFront(&shard, node);
+    } else {
+      ASYLO_ASSIGN_OR_RETURN(node, Insert(&shard, offset));
+      node->value = value;
+      node->dirty = false;
+    }
+    if (item) {
+      *item = node->value;
+    }
+    return Status::OkStatus();
+  }
+
+  // Adds an entry for the record at |offset| to the front of |shard|, evicting
+  // the least recently used entry if the shard is full. Returns an error status
+  // if the evicted entry could not be written to storage.
+  StatusOr<NodeRef> Insert(Shard *shard, off_t offset)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    if (shard->count < shard->capacity) {
+      shard->cache.emplace_front();
+      shard->count++;
+    } else {
+      auto last = std::prev(shard->cache.end());
+      if (last->dirty) {
+        absl::MutexLock lock(&io_mu_);
+        ASYLO_RETURN_IF_ERROR(
+            io_->Write(&last->value, last->offset, sizeof(T)));
+        write_backs_++;
+      }
+      shard->index.erase(last->offset);
+      MoveToFront(shard, last);
+    }
+    NodeRef first = shard->cache.begin();
+    first->offset = offset;
+    first->dirty = false;
+    shard->index[offset] = first;
+    return first;
+  }
+
+  // Moves an LRU list node to the front of the list of |shard|.
+  void MoveToFront(Shard *shard, NodeRef node)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard->mu) {
+    if (node != shard->cache.begin()) {
+      shard->cache.splice(shard->cache.begin(), shard->cache, node);
+    }
+  }
+
+  // Writes the dirty records of all shards, which must be locked, coalescing
+  // runs of adjacent records into single writes.
+  ASYLO_MUST_USE_RESULT Status FlushLocked() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+    std::vector<NodeRef> dirty;
+    for (auto &shard : shards_) {
+      for (auto it = shard->cache.begin(); it != shard->cache.end(); it++) {
+        if (it->dirty) {
+          dirty.push_back(it);
+        }
+      }
+    }
+    std::sort(dirty.begin(), dirty.end(), [](NodeRef lhs, NodeRef rhs) {
+      return lhs->offset < rhs->offset;
+    });
+
+    std::vector<T> run;
+    absl::MutexLock lock(&io_mu_);
+    for (size_t begin = 0; begin < dirty.size();) {
+      size_t end = begin + 1;
+      while (end < dirty.size() &&
+             dirty[end]->offset == dirty[end - 1]->offset + sizeof(T)) {
+        end++;
+      }
+      run.clear();
+      for (size_t i = begin; i < end; i++) {
+        run.push_back(dirty[i]->value);
+      }
+      ASYLO_RETURN_IF_ERROR(io_->Write(run.data(), dirty[begin]->offset,
+                                       run.size() * sizeof(T)));
+      for (size_t i = begin; i < end; i++) {
+        dirty[i]->dirty = false;
+      }
+      begin = end;
+    }
+    return Status::OkStatus();
+  }
+
+  RandomAccessStorage *const io_;  // Record backing store.
+  absl::Mutex io_mu_;              // Serializes accesses to |io_|.
+
+  const size_t prefetch_count_;
+
+  // Offset of the record following the last one read, for detecting
+  // sequential scans.
+  std::atomic<off_t> next_offset_;
+
+  // Number of dirty records evicted and written to storage.
+  std::atomic<uint64_t> write_backs_;
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+template <typename T>
+constexpr size_t ConcurrentRecordStore<T>::kDefaultShardCount;
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_UTILS_CONCURRENT_RECORD_STORE_H_
@@ -0,0 +1,217 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/utils/concurrent_record_store.h"
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/platform/storage/utils/test_utils.h"
+#include "asylo/platform/storage/utils/untrusted_file.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+// An UntrustedFile that counts the reads and writes made to it.
+class CountingFile : public UntrustedFile {
+ public:
+  explicit CountingFile(int fd) : UntrustedFile(fd), reads(0), writes(0) {}
+
+  Status Read(void *buffer, off_t offset, size_t size) override {
+    reads++;
+    return UntrustedFile::Read(buffer, offset, size);
+  }
+
+  Status Write(const void *buffer, off_t offset, size_t size) override {
+    writes++;
+    return UntrustedFile::Write(buffer, offset, size);
+  }
+
+  std::atomic<int> reads;
+  std::atomic<int> writes;
+};
+
+// Ensure that reading and writing records returns the expected values, with
+// the cache both larger and smaller than the records.
+TEST(ConcurrentRecordStoreTest, WriteRead) {
+  int fd = CreateEmptyTempFileOrDie("concurrent_write_read.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+
+  constexpr size_t kRecordCount = 256;
+  for (size_t capacity : {16, 1024}) {
+    ConcurrentRecordStore<size_t> records(capacity, &file);
+    for (size_t i = 0; i < kRecordCount; i++) {
+      size_t record;
+      off_t offset = i * sizeof(size_t);
+      ASYLO_EXPECT_OK(records.Write(offset, i + capacity));
+      ASYLO_EXPECT_OK(records.Read(offset, &record));
+      EXPECT_EQ(record, i + capacity);
+    }
+
+    for (size_t i = 0; i < kRecordCount; i++) {
+      size_t record;
+      ASYLO_EXPECT_OK(records.Read(i * sizeof(size_t), &record));
+      EXPECT_EQ(record, i + capacity);
+    }
+  }
+}
+
+// Ensure that the cache holds at most its capacity.
+TEST(ConcurrentRecordStoreTest, Eviction) {
+  int fd = CreateEmptyTempFileOrDie("concurrent_eviction.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+
+  constexpr size_t kCapacity = 16;
+  constexpr size_t kRecordCount = 256;
+  ConcurrentRecordStore<size_t> records(kCapacity, &file, /*shard_count=*/4);
+  for (size_t i = 0; i < kRecordCount; i++) {
+    ASYLO_EXPECT_OK(records.Write(i * sizeof(size_t), i));
+  }
+
+  size_t cached = 0;
+  for (size_t i = 0; i < kRecordCount; i++) {
+    cached += records.IsCached(i * sizeof(size_t));
+  }
+  EXPECT_EQ(cached, kCapacity);
+
+  // The most recently written records of each shard are cached.
+  for (size_t i = kRecordCount - kCapacity; i < kRecordCount; i++) {
+    EXPECT_TRUE(records.IsCached(i * sizeof(size_t)));
+  }
+}
+
+// Ensure that Flush() persists dirty records with a write per run of adjacent
+// records.
+TEST(ConcurrentRecordStoreTest, FlushCoalescesAdjacentRecords) {
+  int fd = CreateEmptyTempFileOrDie("concurrent_flush.tmp");
+  platform::storage::FdCloser closer(fd);
+  CountingFile file(fd);
+
+  constexpr size_t kRecordCount = 256;
+  ConcurrentRecordStore<size_t> records(kRecordCount, &file);
+  for (size_t i = 0; i < kRecordCount; i++) {
+    // Leave a gap after the first half of the records.
+    if (i != kRecordCount / 2) {
+      ASYLO_EXPECT_OK(records.Write(i * sizeof(size_t), i));
+    }
+  }
+  ASYLO_ASSERT_OK(records.Flush());
+  EXPECT_EQ(file.writes, 2);
+
+  // Flushing clean records writes nothing.
+  ASYLO_ASSERT_OK(records.Flush());
+  EXPECT_EQ(file.writes, 2);
+
+  EXPECT_THAT(file.Size(), IsOkAndHolds(kRecordCount * sizeof(size_t)));
+  for (size_t i = 0; i < kRecordCount; i++) {
+    size_t record;
+    ASYLO_EXPECT_OK(file.Read(&record, i * sizeof(size_t), sizeof(size_t)));
+    EXPECT_EQ(record, i == kRecordCount / 2 ? 0 : i);
+  }
+}
+
+// Ensure that sequential scans prefetch records, and random reads do not.
+TEST(ConcurrentRecordStoreTest, SequentialPrefetch) {
+  int fd = CreateEmptyTempFileOrDie("concurrent_prefetch.tmp");
+  platform::storage::FdCloser closer(fd);
+  CountingFile file(fd);
+
+  constexpr size_t kRecordCount = 256;
+  constexpr size_t kPrefetchCount = 15;
+  std::vector<size_t> data(kRecordCount);
+  for (size_t i = 0; i < kRecordCount; i++) {
+    data[i] = i;
+  }
+  ASYLO_ASSERT_OK(file.Write(data.data(), 0, data.size() * sizeof(size_t)));
+
+  {
+    ConcurrentRecordStore<size_t> records(kRecordCount, &file,
+                                          /*shard_count=*/4, kPrefetchCount);
+    file.reads = 0;
+    for (size_t i = 0; i < kRecordCount; i++) {
+      size_t record;
+      ASYLO_EXPECT_OK(records.Read(i * sizeof(size_t), &record));
+      EXPECT_EQ(record, i);
+    }
+
+    // The first read does not continue a scan, and the second one starts
+    // prefetching.
+    EXPECT_EQ(file.reads, 1 + (kRecordCount - 1 + kPrefetchCount) /
+                                  (kPrefetchCount + 1));
+  }
+
+  ConcurrentRecordStore<size_t> records(kRecordCount, &file,
+                                        /*shard_count=*/4, kPrefetchCount);
+  file.reads = 0;
+  for (size_t i = 0; i < kRecordCount; i += 2) {
+    size_t record;
+    ASYLO_EXPECT_OK(records.Read(i * sizeof(size_t), &record));
+    EXPECT_EQ(record, i);
+  }
+  EXPECT_EQ(file.reads, kRecordCount / 2);
+}
+
+// Ensure that concurrent reads and writes of records return the expected
+// values and are persisted.
+TEST(ConcurrentRecordStoreTest, ConcurrentAccess) {
+  int fd = CreateEmptyTempFileOrDie("concurrent_access.tmp");
+  platform::storage::FdCloser closer(fd);
+  UntrustedFile file(fd);
+
+  constexpr size_t kThreadCount = 4;
+  constexpr size_t kRecordCount = 1024;
+  {
+    ConcurrentRecordStore<size_t> records(/*capacity=*/64, &file,
+                                          /*shard_count=*/4,
+                                          /*prefetch_count=*/7);
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < kThreadCount; thread++) {
+      threads.emplace_back([&records, thread] {
+        // Each thread owns the records whose index is congruent to its own.
+        for (int round = 0; round < 3; round++) {
+          for (size_t i = thread; i < kRecordCount; i += kThreadCount) {
+            size_t record;
+            ASYLO_EXPECT_OK(records.Write(i * sizeof(size_t), i + round));
+            ASYLO_EXPECT_OK(records.Read(i * sizeof(size_t), &record));
+            EXPECT_EQ(record, i + round);
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  for (size_t i = 0; i < kRecordCount; i++) {
+    size_t record;
+    ASYLO_EXPECT_OK(file.Read(&record, i * sizeof(size_t), sizeof(size_t)));
+    EXPECT_EQ(record, i + 2);
+  }
+}
+
+}  // namespace
+}  // namespace asylo
@@ -0,0 +1,134 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Benchmarks of RecordStore and ConcurrentRecordStore over an UntrustedFile,
+// for random and sequential access patterns. Run with --benchmarks=all.
+
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "asylo/platform/storage/utils/concurrent_record_store.h"
+#include "asylo/platform/storage/utils/record_store.h"
+#include "asylo/platform/storage/utils/test_utils.h"
+#include "asylo/platform/storage/utils/untrusted_file.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+namespace {
+
+constexpr size_t kRecordCount = 64 * 1024;
+constexpr size_t kCapacity = 4096;
+
+// Returns a file of kRecordCount records shared by all benchmarks.
+UntrustedFile *GetFile() {
+  static UntrustedFile *file = [] {
+    auto *file =
+        new UntrustedFile(CreateEmptyTempFileOrDie("record_store_bench.tmp"));
+    std::vector<uint64_t> records(kRecordCount);
+    for (size_t i = 0; i < kRecordCount; i++) {
+      records[i] = i;
+    }
+    CHECK(file->Write(records.data(), 0, records.size() * sizeof(uint64_t))
+              .ok());
+    return file;
+  }();
+  return file;
+}
+
+off_t RecordOffset(size_t index) { return index * sizeof(uint64_t); }
+
+void BM_RecordStoreRandomRead(benchmark::State &state) {
+  RecordStore<uint64_t> records(kCapacity, GetFile());
+  std::mt19937 random(0);
+  std::uniform_int_distribution<size_t> indices(0, kRecordCount - 1);
+  uint64_t record;
+  for (auto _ : state) {
+    CHECK(records.Read(RecordOffset(indices(random)), &record).ok());
+  }
+}
+BENCHMARK(BM_RecordStoreRandomRead);
+
+// Reads random records of a store shared by all benchmark threads.
+void BM_ConcurrentRecordStoreRandomRead(benchmark::State &state) {
+  static auto *records =
+      new ConcurrentRecordStore<uint64_t>(kCapacity, GetFile());
+  std::mt19937 random(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::uniform_int_distribution<size_t> indices(0, kRecordCount - 1);
+  uint64_t record;
+  for (auto _ : state) {
+    CHECK(records->Read(RecordOffset(indices(random)), &record).ok());
+  }
+}
+BENCHMARK(BM_ConcurrentRecordStoreRandomRead)->ThreadRange(1, 4)->UseRealTime();
+
+void BM_RecordStoreSequentialRead(benchmark::State &state) {
+  RecordStore<uint64_t> records(kCapacity, GetFile());
+  size_t index = 0;
+  uint64_t record;
+  for (auto _ : state) {
+    CHECK(records.Read(RecordOffset(index), &record).ok());
+    index = (index + 1) % kRecordCount;
+  }
+}
+BENCHMARK(BM_RecordStoreSequentialRead);
+
+// Scans the records with the prefetch count given by the argument.
+void BM_ConcurrentRecordStoreSequentialRead(benchmark::State &state) {
+  ConcurrentRecordStore<uint64_t> records(
+      kCapacity, GetFile(), ConcurrentRecordStore<uint64_t>::kDefaultShardCount,
+      state.range(0));
+  size_t index = 0;
+  uint64_t record;
+  for (auto _ : state) {
+    CHECK(records.Read(RecordOffset(index), &record).ok());
+    index = (index + 1) % kRecordCount;
+  }
+}
+BENCHMARK(BM_ConcurrentRecordStoreSequentialRead)->Arg(0)->Arg(64);
+
+// Writes and flushes runs of adjacent records.
+void BM_RecordStoreFlush(benchmark::State &state) {
+  RecordStore<uint64_t> records(kCapacity, GetFile());
+  for (auto _ : state) {
+    for (size_t i = 0; i < kCapacity; i++) {
+      CHECK(records.Write(RecordOffset(i), i).ok());
+    }
+    CHECK(records.Flush().ok());
+  }
+  state.SetItemsProcessed(state.iterations() * kCapacity);
+}
+BENCHMARK(BM_RecordStoreFlush);
+
+void BM_ConcurrentRecordStoreFlush(benchmark::State &state) {
+  ConcurrentRecordStore<uint64_t> records(kCapacity, GetFile());
+  for (auto _ : state) {
+    for (size_t i = 0; i < kCapacity; i++) {
+      CHECK(records.Write(RecordOffset(i), i).ok());
+    }
+    CHECK(records.Flush().ok());
+  }
+  state.SetItemsProcessed(state.iterations() * kCapacity);
+}
+BENCHMARK(BM_ConcurrentRecordStoreFlush);
+
+}  // namespace
+}  // namespace asylo
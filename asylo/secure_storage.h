@@ -40,4 +40,35 @@ struct key_info {
   uint8_t *data;
 } __attribute__((packed));
 
+// IOCTL to set the length of file blocks on a newly created secure file. Takes
+// a pointer to uint32_t holding the block length, which must be a power of two
+// between 128 bytes and 64 KiB. Must be issued before ENCLAVE_STORAGE_SET_KEY.
+// Existing files keep the block length they were created with.
+#ifndef ENCLAVE_STORAGE_SET_BLOCK_LENGTH
+#define ENCLAVE_STORAGE_SET_BLOCK_LENGTH \
+  (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000002)
+#endif
+
+// IOCTL to switch a secure file to write-back. Takes a pointer to uint32_t
+// holding the maximum interval, in milliseconds, between updates of the file
+// digest, or 0 to switch the file back to updating its digest on every write.
+// In write-back, small writes are buffered in the enclave, and the digest is
+// also updated on fsync() and close(). Data written since the last fsync() or
+// close() does not survive a crash - the file then fails integrity
+// verification when opened.
+#ifndef ENCLAVE_STORAGE_SET_WRITE_BACK
+#define ENCLAVE_STORAGE_SET_WRITE_BACK (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000003)
+#endif
+
+// IOCTL to set the number of enclave threads, in addition to the calling
+// thread, that reads and writes of many blocks of secure files use to encrypt
+// and decrypt blocks concurrently. Takes a pointer to uint32_t holding the
+// number of threads, or 0 to process all blocks on the calling thread so that
+// secure file I/O never starts enclave threads. Applies to all secure files,
+// and may be issued on any secure file descriptor.
+#ifndef ENCLAVE_STORAGE_SET_MAX_WORKERS
+#define ENCLAVE_STORAGE_SET_MAX_WORKERS \
+  (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000004)
+#endif
+
 #endif  // ASYLO_SECURE_STORAGE_H_
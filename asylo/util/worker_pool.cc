@@ -0,0 +1,266 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/util/worker_pool.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "asylo/util/logging.h"
+
+namespace asylo {
+
+constexpr size_t WorkerPool::kDefaultMaxWorkers;
+constexpr absl::Duration WorkerPool::kDefaultIdleTimeout;
+
+WorkerPool::WorkerPool(size_t max_workers, absl::Duration idle_timeout)
+    : max_workers_(max_workers),
+      idle_timeout_(idle_timeout),
+      workers_(0),
+      idle_workers_(0),
+      shutting_down_(false) {}
+
+WorkerPool::~WorkerPool() {
+  absl::MutexLock lock(&mu_);
+  shutting_down_ = true;
+  auto no_workers = [this]() { return workers_ == 0; };
+  mu_.Await(absl::Condition(&no_workers));
+}
+
+bool WorkerPool::Run(std::vector<Task> tasks) {
+  if (tasks.empty()) {
+    return true;
+  }
+  if (tasks.size() == 1) {
+    return tasks[0]();
+  }
+
+  auto batch = std::make_shared<Batch>();
+  batch->remaining = tasks.size();
+  batch->ok = true;
+
+  // The calling thread runs the last task itself, the rest are queued for the
+  // workers.
+  Task own_task = std::move(tasks.back());
+  tasks.pop_back();
+  size_t to_start = 0;
+  {
+    absl::MutexLock lock(&mu_);
+    for (Task &task : tasks) {
+      queue_.push_back(QueuedTask{std::move(task), batch});
+    }
+    to_start = ReserveWorkers();
+  }
+  StartWorkers(to_start);
+
+  Execute(QueuedTask{std::move(own_task), batch});
+
+  // Help with queued tasks until the batch completes.
+  while (true) {
+    QueuedTask queued_task;
+    {
+      absl::MutexLock lock(&mu_);
+      auto batch_done_or_queued = [this, &batch]() {
+        return batch->remaining == 0 || !queue_.empty();
+      };
+      mu_.Await(absl::Condition(&batch_done_or_queued));
+      if (batch->remaining == 0) {
+        return batch->ok;
+      }
+      queued_task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    Execute(std::move(queued_task));
+  }
+}
+
+void WorkerPool::SetMaxWorkers(size_t max_workers) {
+  absl::MutexLock lock(&mu_);
+  max_workers_ = max_workers;
+}
+
+bool WorkerPool::TrySchedule(std::function<void()> task) {
+  {
+    absl::MutexLock lock(&mu_);
+    if (workers_ > max_workers_) {
+      return false;
+    }
+    if (idle_workers_ > queue_.size() + scheduled_.size()) {
+      // More workers are idle than there are tasks to take, so one of them is
+      // free to take |task|.
+      scheduled_.push_back(std::move(task));
+      return true;
+    }
+    if (workers_ == max_workers_) {
+      return false;
+    }
+    workers_++;
+  }
+
+  // A worker started for |task| runs it first, so that it does not wait for
+  // queued tasks.
+  if (StartWorker(&task)) {
+    return true;
+  }
+  absl::MutexLock lock(&mu_);
+  workers_--;
+  return false;
+}
+
+bool WorkerPool::ParallelFor(
+    size_t count, size_t min_range_length,
+    const std::function<bool(size_t begin, size_t end)> &task) {
+  return Run(SplitRange(count, min_range_length, task));
+}
+
+std::vector<WorkerPool::Task> WorkerPool::SplitRange(
+    size_t count, size_t min_range_length,
+    const std::function<bool(size_t begin, size_t end)> &task) const {
+  std::vector<Task> tasks;
+  if (count == 0) {
+    return tasks;
+  }
+
+  size_t ranges = std::min(max_workers_ + 1,
+                           count / std::max<size_t>(min_range_length, 1));
+  ranges = std::max<size_t>(ranges, 1);
+  tasks.reserve(ranges);
+  for (size_t range = 0; range < ranges; range++) {
+    size_t begin = count * range / ranges;
+    size_t end = count * (range + 1) / ranges;
+    tasks.emplace_back([&task, begin, end] { return task(begin, end); });
+  }
+  return tasks;
+}
+
+size_t WorkerPool::ReserveWorkers() {
+  size_t to_start = 0;
+  size_t max_workers = max_workers_;
+  size_t queued = queue_.size() + scheduled_.size();
+  if (queued > idle_workers_) {
+    to_start = std::min(queued - idle_workers_,
+                        max_workers - std::min(workers_, max_workers));
+  }
+  workers_ += to_start;
+  return to_start;
+}
+
+void WorkerPool::StartWorkers(size_t count) {
+  // Starting a thread may exit the enclave, so do not hold |mu_| meanwhile.
+  size_t started = 0;
+  while (started < count) {
+    std::function<void()> no_first_task;
+    if (!StartWorker(&no_first_task)) {
+      break;
+    }
+    started++;
+  }
+  if (started < count) {
+    absl::MutexLock lock(&mu_);
+    workers_ -= count - started;
+  }
+}
+
+bool WorkerPool::StartWorker(std::function<void()> *first_task) {
+  // Threads are started with pthread_create() rather than asylo::Thread, since
+  // a failure to start a thread, such as when the enclave has no thread slot
+  // left, must not terminate the enclave.
+  auto start = absl::make_unique<WorkerStart>();
+  start->pool = this;
+  start->first_task = std::move(*first_task);
+
+  pthread_attr_t attr;
+  int result = pthread_attr_init(&attr);
+  if (result == 0) {
+    result = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    if (result == 0) {
+      result = pthread_create(&thread, &attr, &WorkerPool::WorkerMain,
+                              start.get());
+    }
+    pthread_attr_destroy(&attr);
+  }
+  if (result != 0) {
+    LOG(WARNING) << "Failed to start a worker thread: " << strerror(result);
+    *first_task = std::move(start->first_task);
+    return false;
+  }
+  start.release();
+  return true;
+}
+
+void *WorkerPool::WorkerMain(void *arg) {
+  std::unique_ptr<WorkerStart> start(static_cast<WorkerStart *>(arg));
+  if (start->first_task) {
+    start->first_task();
+  }
+  start->pool->WorkerLoop();
+  return nullptr;
+}
+
+void WorkerPool::Execute(QueuedTask queued_task) {
+  bool ok = queued_task.task();
+
+  absl::MutexLock lock(&mu_);
+  queued_task.batch->ok &= ok;
+  queued_task.batch->remaining--;
+}
+
+void WorkerPool::WorkerLoop() {
+  while (true) {
+    QueuedTask queued_task;
+    std::function<void()> scheduled_task;
+    {
+      absl::MutexLock lock(&mu_);
+      idle_workers_++;
+      auto queued_or_exiting = [this]() {
+        return !queue_.empty() || !scheduled_.empty() || shutting_down_ ||
+               workers_ > max_workers_;
+      };
+      mu_.AwaitWithTimeout(absl::Condition(&queued_or_exiting),
+                           idle_timeout_);
+      idle_workers_--;
+
+      // Workers beyond a lowered maximum leave batch tasks to the callers of
+      // Run(), but finish scheduled tasks, which no other thread would run.
+      bool surplus = workers_ > max_workers_;
+      if (scheduled_.empty() && (surplus || queue_.empty())) {
+        workers_--;
+        return;
+      }
+      if (!surplus && !queue_.empty()) {
+        queued_task = std::move(queue_.front());
+        queue_.pop_front();
+      } else {
+        scheduled_task = std::move(scheduled_.front());
+        scheduled_.pop_front();
+      }
+    }
+    if (scheduled_task) {
+      scheduled_task();
+    } else {
+      Execute(std::move(queued_task));
+    }
+  }
+}
+
+}  // namespace asylo
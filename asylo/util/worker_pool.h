@@ -0,0 +1,165 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_UTIL_WORKER_POOL_H_
+#define ASYLO_UTIL_WORKER_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace asylo {
+
+// A small pool of worker threads for running tasks off the calling thread.
+//
+// Run() runs a batch of independent tasks concurrently, such as the encryption
+// of disjoint block ranges of a file, and waits for them. The calling thread
+// runs tasks of the batch as well, hence the batch makes progress even if no
+// worker could be started. TrySchedule() hands a single task to a free worker,
+// such as a handshake step that should not block the caller, and declines it
+// if there is none.
+//
+// Workers are started on demand, up to the maximum size of the pool, and exit
+// after being idle for a while, so that an idle pool does not hold on to
+// enclave threads. Tasks that arrive while all workers are busy are queued and
+// run in order of arrival. A worker that cannot be started, such as when the
+// enclave has no thread slot left, is not retried for the task at hand; the
+// submitting thread runs the task instead.
+class WorkerPool {
+ public:
+  // A task returns false on failure.
+  using Task = std::function<bool()>;
+
+  // Default number of workers, in addition to the submitting thread.
+  static constexpr size_t kDefaultMaxWorkers = 3;
+
+  // Default time after which idle workers exit. It is long enough for workers
+  // to survive the gaps between the bursts of a busy caller.
+  static constexpr absl::Duration kDefaultIdleTimeout = absl::Seconds(30);
+
+  // Creates a pool of at most |max_workers| workers, which exit after being
+  // idle for |idle_timeout|. A pool of no workers runs tasks on the submitting
+  // thread only.
+  explicit WorkerPool(size_t max_workers = kDefaultMaxWorkers,
+                      absl::Duration idle_timeout = kDefaultIdleTimeout);
+
+  // Waits for all queued tasks to complete and for all workers to exit.
+  ~WorkerPool();
+
+  // Runs |tasks| concurrently on the workers and the calling thread, and
+  // returns once all of them have completed. Returns true if all tasks
+  // returned true. Tasks must not call Run().
+  bool Run(std::vector<Task> tasks) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Splits [0, |count|) into at most max_workers() + 1 ranges of at least
+  // |min_range_length| items, and runs |task| on each of them as with Run().
+  bool ParallelFor(size_t count, size_t min_range_length,
+                   const std::function<bool(size_t begin, size_t end)> &task);
+
+  // Returns the tasks ParallelFor() runs, for submitting them to Run() along
+  // with other tasks. |task| must outlive the returned tasks.
+  std::vector<Task> SplitRange(
+      size_t count, size_t min_range_length,
+      const std::function<bool(size_t begin, size_t end)> &task) const;
+
+  // Hands |task| to an idle worker, or to a newly started one, and returns true
+  // without waiting for it. Returns false without running |task| if all
+  // workers are busy and no more can be started, in which case the caller runs
+  // it. Tasks are never queued behind busy workers, so a task may block on
+  // other tasks submitted this way without exhausting the pool.
+  bool TrySchedule(std::function<void()> task) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Changes the maximum number of workers. Workers beyond a lowered maximum
+  // exit once they complete their current task.
+  void SetMaxWorkers(size_t max_workers) ABSL_LOCKS_EXCLUDED(mu_);
+
+  size_t max_workers() const { return max_workers_; }
+
+ private:
+  // Tasks submitted by a single call to Run().
+  struct Batch {
+    size_t remaining;
+    bool ok;
+  };
+
+  struct QueuedTask {
+    Task task;
+    std::shared_ptr<Batch> batch;
+  };
+
+  // Reserves workers for the queued tasks that idle workers cannot take, and
+  // returns the number of workers the caller must start after releasing |mu_|.
+  size_t ReserveWorkers() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Starts |count| workers reserved by ReserveWorkers(), and releases the
+  // reservations of those that could not be started.
+  void StartWorkers(size_t count) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Starts a worker thread that runs |*first_task|, if set, before taking
+  // queued tasks. Returns false and leaves |*first_task| in place if the
+  // thread could not be started. The caller must have counted the worker in
+  // |workers_|.
+  bool StartWorker(std::function<void()> *first_task);
+
+  // Arguments of WorkerMain().
+  struct WorkerStart {
+    WorkerPool *pool;
+    std::function<void()> first_task;
+  };
+
+  // Entry point of a worker thread, taking ownership of a WorkerStart.
+  static void *WorkerMain(void *arg);
+
+  // Runs |queued_task| and records its completion. Takes |mu_|.
+  void Execute(QueuedTask queued_task) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Body of a worker thread.
+  void WorkerLoop() ABSL_LOCKS_EXCLUDED(mu_);
+
+  std::atomic<size_t> max_workers_;
+  const absl::Duration idle_timeout_;
+
+  // Tasks of batches, which workers take first since callers of Run() wait
+  // for them.
+  std::deque<QueuedTask> queue_ ABSL_GUARDED_BY(mu_);
+
+  // Tasks accepted by TrySchedule(), each of which an idle worker is free to
+  // take. Only workers take them, so that a caller of Run() is not held up by
+  // an unrelated task.
+  std::deque<std::function<void()>> scheduled_ ABSL_GUARDED_BY(mu_);
+
+  // Number of workers, including those being started.
+  size_t workers_ ABSL_GUARDED_BY(mu_);
+  size_t idle_workers_ ABSL_GUARDED_BY(mu_);
+  bool shutting_down_ ABSL_GUARDED_BY(mu_);
+  absl::Mutex mu_;
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_UTIL_WORKER_POOL_H_
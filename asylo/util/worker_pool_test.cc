@@ -0,0 +1,288 @@
+/*
+ *
+ * Copyright 2020 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/util/worker_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace asylo {
+namespace {
+
+TEST(WorkerPoolTest, RunsAllTasks) {
+  WorkerPool pool;
+  std::vector<std::atomic<int>> runs(100);
+  std::vector<WorkerPool::Task> tasks;
+  for (auto &run : runs) {
+    tasks.emplace_back([&run] {
+      run++;
+      return true;
+    });
+  }
+
+  EXPECT_TRUE(pool.Run(std::move(tasks)));
+  for (const auto &run : runs) {
+    EXPECT_EQ(run, 1);
+  }
+}
+
+TEST(WorkerPoolTest, ReportsFailedTask) {
+  WorkerPool pool;
+  std::atomic<int> runs(0);
+  std::vector<WorkerPool::Task> tasks;
+  for (int i = 0; i < 10; i++) {
+    tasks.emplace_back([&runs, i] {
+      runs++;
+      return i != 5;
+    });
+  }
+
+  EXPECT_FALSE(pool.Run(std::move(tasks)));
+  EXPECT_EQ(runs, 10);
+}
+
+// Verifies that tasks run concurrently - each task waits for the others to
+// start.
+TEST(WorkerPoolTest, RunsTasksConcurrently) {
+  WorkerPool pool(/*max_workers=*/3);
+  std::atomic<int> started(0);
+  std::vector<WorkerPool::Task> tasks;
+  for (int i = 0; i < 4; i++) {
+    tasks.emplace_back([&started] {
+      started++;
+      while (started < 4) {
+        std::this_thread::yield();
+      }
+      return true;
+    });
+  }
+
+  EXPECT_TRUE(pool.Run(std::move(tasks)));
+}
+
+TEST(WorkerPoolTest, NoWorkersRunsOnCallingThread) {
+  WorkerPool pool(/*max_workers=*/0);
+  const std::thread::id caller = std::this_thread::get_id();
+  std::vector<WorkerPool::Task> tasks;
+  for (int i = 0; i < 4; i++) {
+    tasks.emplace_back(
+        [caller] { return std::this_thread::get_id() == caller; });
+  }
+
+  EXPECT_TRUE(pool.Run(std::move(tasks)));
+}
+
+TEST(WorkerPoolTest, ParallelForCoversRange) {
+  WorkerPool pool;
+  for (size_t count : {0, 1, 7, 100, 1001}) {
+    std::vector<std::atomic<int>> visits(count);
+    EXPECT_TRUE(pool.ParallelFor(count, /*min_range_length=*/3,
+                                 [&visits](size_t begin, size_t end) {
+                                   for (size_t i = begin; i < end; i++) {
+                                     visits[i]++;
+                                   }
+                                   return true;
+                                 }));
+    for (const auto &visit : visits) {
+      EXPECT_EQ(visit, 1);
+    }
+  }
+}
+
+TEST(WorkerPoolTest, ParallelForReportsFailure) {
+  WorkerPool pool;
+  EXPECT_FALSE(pool.ParallelFor(
+      100, /*min_range_length=*/1,
+      [](size_t begin, size_t end) { return !(begin <= 50 && 50 < end); }));
+}
+
+TEST(WorkerPoolTest, SplitRangeHonorsMinRangeLength) {
+  WorkerPool pool(/*max_workers=*/3);
+  std::function<bool(size_t, size_t)> task = [](size_t begin, size_t end) {
+    return true;
+  };
+  EXPECT_EQ(pool.SplitRange(0, 1, task).size(), 0);
+  EXPECT_EQ(pool.SplitRange(3, 10, task).size(), 1);
+  EXPECT_EQ(pool.SplitRange(10, 4, task).size(), 2);
+  EXPECT_EQ(pool.SplitRange(100, 1, task).size(), 4);
+}
+
+// Verifies that idle workers exit and new ones are started for later tasks.
+TEST(WorkerPoolTest, RestartsWorkersAfterIdleTimeout) {
+  WorkerPool pool(/*max_workers=*/2, absl::Milliseconds(10));
+  for (int round = 0; round < 3; round++) {
+    std::atomic<int> runs(0);
+    std::vector<WorkerPool::Task> tasks(8, [&runs] {
+      runs++;
+      return true;
+    });
+    EXPECT_TRUE(pool.Run(std::move(tasks)));
+    EXPECT_EQ(runs, 8);
+    absl::SleepFor(absl::Milliseconds(50));
+  }
+}
+
+TEST(WorkerPoolTest, RunsAllAcceptedTasks) {
+  std::atomic<int> runs(0);
+  int accepted = 0;
+  {
+    WorkerPool pool;
+    for (int i = 0; i < 100; i++) {
+      if (pool.TrySchedule([&runs] { runs++; })) {
+        accepted++;
+      }
+    }
+    EXPECT_GE(accepted, 1);
+  }
+  EXPECT_EQ(runs, accepted);
+}
+
+// Verifies that no more than the maximum number of workers run scheduled tasks
+// at once, and that tasks beyond them are declined rather than queued.
+TEST(WorkerPoolTest, DeclinesTasksWhenAllWorkersAreBusy) {
+  WorkerPool pool(/*max_workers=*/2);
+  absl::Notification release;
+  for (int i = 0; i < 2; i++) {
+    EXPECT_TRUE(
+        pool.TrySchedule([&release] { release.WaitForNotification(); }));
+  }
+
+  bool ran = false;
+  EXPECT_FALSE(pool.TrySchedule([&ran] { ran = true; }));
+  EXPECT_FALSE(ran);
+  release.Notify();
+}
+
+// Verifies that scheduled tasks do not run on the scheduling thread, so that a
+// blocked task does not block the scheduler.
+TEST(WorkerPoolTest, ScheduleDoesNotBlockScheduler) {
+  WorkerPool pool(/*max_workers=*/1);
+  absl::Notification release;
+  absl::Notification done;
+  const std::thread::id scheduler = std::this_thread::get_id();
+  std::atomic<bool> ran_on_scheduler(true);
+  ASSERT_TRUE(pool.TrySchedule([&] {
+    ran_on_scheduler = std::this_thread::get_id() == scheduler;
+    release.WaitForNotification();
+    done.Notify();
+  }));
+
+  // The scheduling thread is free while the task waits.
+  release.Notify();
+  done.WaitForNotification();
+  EXPECT_FALSE(ran_on_scheduler);
+}
+
+TEST(WorkerPoolTest, NoWorkersDeclinesScheduledTask) {
+  WorkerPool pool(/*max_workers=*/0);
+  bool ran = false;
+  EXPECT_FALSE(pool.TrySchedule([&ran] { ran = true; }));
+  EXPECT_FALSE(ran);
+}
+
+// Verifies that tasks which block on tasks they schedule complete when there
+// are more of them than workers, as with handshake steps that wait for a nested
+// handshake. Declined tasks run on the submitting thread.
+TEST(WorkerPoolTest, CompletesNestedTasksBeyondPoolSize) {
+  constexpr int kOuterTasks = 8;
+  WorkerPool pool(/*max_workers=*/2);
+  auto run_step = [&pool](std::function<void()> step) {
+    if (!pool.TrySchedule(step)) {
+      step();
+    }
+  };
+
+  std::vector<absl::Notification> done(kOuterTasks);
+  std::vector<std::thread> submitters;
+  for (int i = 0; i < kOuterTasks; i++) {
+    submitters.emplace_back([&, i] {
+      run_step([&, i] {
+        // Submit the nested task from another thread, as the I/O thread of a
+        // nested channel would, and block until it has run.
+        absl::Notification nested_done;
+        std::thread nested_submitter(
+            [&] { run_step([&nested_done] { nested_done.Notify(); }); });
+        nested_done.WaitForNotification();
+        nested_submitter.join();
+        done[i].Notify();
+      });
+    });
+  }
+
+  for (absl::Notification &notification : done) {
+    EXPECT_TRUE(notification.WaitForNotificationWithTimeout(absl::Seconds(10)));
+  }
+  for (std::thread &submitter : submitters) {
+    submitter.join();
+  }
+}
+
+// Verifies that lowering the maximum number of workers to zero confines tasks
+// to the submitting thread.
+TEST(WorkerPoolTest, SetMaxWorkersToZeroRunsOnCallingThread) {
+  WorkerPool pool;
+  EXPECT_TRUE(pool.ParallelFor(100, /*min_range_length=*/1,
+                               [](size_t begin, size_t end) { return true; }));
+
+  pool.SetMaxWorkers(0);
+  EXPECT_EQ(pool.SplitRange(100, 1, [](size_t, size_t) { return true; }).size(),
+            1);
+  const std::thread::id caller = std::this_thread::get_id();
+  std::vector<WorkerPool::Task> tasks;
+  for (int i = 0; i < 4; i++) {
+    tasks.emplace_back(
+        [caller] { return std::this_thread::get_id() == caller; });
+  }
+  EXPECT_TRUE(pool.Run(std::move(tasks)));
+
+  EXPECT_FALSE(pool.TrySchedule([] {}));
+}
+
+// Verifies that a batch completes while a scheduled task blocks the only
+// worker, and that the caller of Run() does not take the scheduled task.
+TEST(WorkerPoolTest, RunsBatchAlongsideScheduledTask) {
+  WorkerPool pool(/*max_workers=*/1);
+  absl::Notification release;
+  absl::Notification done;
+  ASSERT_TRUE(pool.TrySchedule([&] {
+    release.WaitForNotification();
+    done.Notify();
+  }));
+
+  std::atomic<int> runs(0);
+  std::vector<WorkerPool::Task> tasks(4, [&runs] {
+    runs++;
+    return true;
+  });
+  EXPECT_TRUE(pool.Run(std::move(tasks)));
+  EXPECT_EQ(runs, 4);
+
+  release.Notify();
+  done.WaitForNotification();
+}
+
+}  // namespace
+}  // namespace asylo